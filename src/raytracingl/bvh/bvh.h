@@ -0,0 +1,93 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include <glm/vec3.hpp>
+
+#include "raytracingl/ptr.h"
+
+// Shader storage binding points used by the acceleration structure.
+// Bindings 0 and 1 are the vertex and index buffers of the scene
+#define BVH_NODES_BINDING_POINT 2
+
+// Entries of the traversal stack of compute.glsl. Deeper trees need a variant compiled with
+// bvhStackSizeDefine(), see bvhStackSize()
+#define BVH_STACK_SIZE 64
+#define BVH_STACK_SIZE_DEFINE "BVH_STACK_SIZE"
+
+// Leaf nodes store the item index complemented in the left child. Items are the
+// triangles followed by the analytic primitives
+#define BVH_LEAF(item) (~(item))
+#define BVH_IS_LEAF(child) ((child) < 0)
+#define BVH_ITEM(child) (~(child))
+
+namespace rgl
+{
+
+struct alignas(16) BVHNode {
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, THERE WILL BE A MEMORY ALIGNMENT ISSUE
+    // AND IT WILL NOT MATCH THE BVHNode STRUCTURE OF THE COMPUTE SHADER
+    glm::vec3 aabbMin;
+    int left;   // child node index or BVH_LEAF(item) in leaves
+
+    glm::vec3 aabbMax;
+    int right;  // child node index, -1 in leaves
+
+    BVHNode(const glm::vec3& _aabbMin, const glm::vec3& _aabbMax, int _left, int _right)
+        : aabbMin(_aabbMin), left(_left), aabbMax(_aabbMax), right(_right) {
+    }
+
+    BVHNode() = default;
+    ~BVHNode() = default;
+
+    bool isLeaf() const { return BVH_IS_LEAF(left); }
+    int getItem() const { return BVH_ITEM(left); }
+
+    friend std::ostream& operator<<(std::ostream& os, const BVHNode& node) {
+        os << "BVHNode = [";
+        os << "(" << node.aabbMin.x << "," << node.aabbMin.y << "," << node.aabbMin.z << "),";
+        os << "(" << node.aabbMax.x << "," << node.aabbMax.y << "," << node.aabbMax.z << "),";
+        os << "(" << node.left << "," << node.right << ")]";
+        return os;
+    }
+};
+
+// Stack entries a depth first traversal needs: the width - 1 siblings of every node on the
+// path wait on the stack, depth is the number of levels below the root
+inline unsigned int bvhStackSize(unsigned int width, unsigned int depth) {
+    return (width - 1) * depth + 1;
+}
+
+// Define of the compute.glsl variant with a traversal stack of stackSize entries
+inline std::string bvhStackSizeDefine(unsigned int stackSize) {
+    return std::string(BVH_STACK_SIZE_DEFINE) + " " + std::to_string(stackSize);
+}
+
+// Levels below the root of the deepest leaf of a binary BVH
+inline unsigned int bvhDepth(const std::vector<BVHNode>& nodes) {
+
+    if(nodes.empty()) return 0;
+
+    unsigned int depth = 0;
+    std::vector<std::pair<int, unsigned int>> stack = { { 0, 0u } };
+    while(!stack.empty()) {
+
+        auto [node, level] = stack.back();
+        stack.pop_back();
+        depth = std::max(depth, level);
+
+        if(!nodes[node].isLeaf()) {
+            stack.push_back({ nodes[node].left, level + 1 });
+            stack.push_back({ nodes[node].right, level + 1 });
+        }
+    }
+
+    return depth;
+}
+
+}
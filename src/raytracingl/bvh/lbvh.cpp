@@ -0,0 +1,352 @@
+#include "lbvh.h"
+
+#include <algorithm>
+#include <utility>
+#include <limits>
+
+namespace rgl
+{
+
+LBVH::LBVH(const std::string& shadersPath) : numTriangles(0), numPrimitives(0), capacity(0), valid(false) {
+
+    valid = checkStorageBindings(LBVH_SCRATCH_BINDING_POINT + 4, "LBVH");
+    if(!valid) return;
+
+    sceneBoundsProgram = loadProgram(shadersPath + "lbvh_scene_bounds.glsl");
+    mortonProgram = loadProgram(shadersPath + "lbvh_morton.glsl");
+    histogramProgram = loadProgram(shadersPath + "lbvh_radix_histogram.glsl");
+    scanProgram = loadProgram(shadersPath + "lbvh_radix_scan.glsl");
+    scatterProgram = loadProgram(shadersPath + "lbvh_radix_scatter.glsl");
+    hierarchyProgram = loadProgram(shadersPath + "lbvh_hierarchy.glsl");
+    boundsProgram = loadProgram(shadersPath + "lbvh_bounds.glsl");
+
+    for(auto& timer : timers) timer = GPUTimer::New();
+
+    sceneBounds = ShaderStorageBuffer<unsigned int>::New(6, LBVH_SCRATCH_BINDING_POINT, MemoryCategory::Scratch);
+    depth = ShaderStorageBuffer<unsigned int>::New(1, LBVH_SCRATCH_BINDING_POINT + 4, MemoryCategory::Scratch);
+}
+
+ShaderProgram::Ptr LBVH::loadProgram(const std::string& filePath) {
+    Shader computeShader = Shader::fromFile(filePath, Shader::ShaderType::Compute);
+    return ShaderProgram::New(computeShader);
+}
+
+unsigned int LBVH::numGroups(unsigned int count) {
+    return (count + LBVH_WORKGROUP_SIZE - 1) / LBVH_WORKGROUP_SIZE;
+}
+
+void LBVH::allocate(unsigned int numItems) {
+
+    // Buffers are only reallocated when the scene grows
+    if(numItems <= capacity) return;
+    capacity = numItems;
+
+    const unsigned int scratch = LBVH_SCRATCH_BINDING_POINT;
+
+    nodes = ShaderStorageBuffer<BVHNode>::New(2 * capacity - 1, BVH_NODES_BINDING_POINT);
+    parents = ShaderStorageBuffer<int>::New(2 * capacity - 1, scratch, MemoryCategory::Scratch);
+    flags = ShaderStorageBuffer<unsigned int>::New(capacity, scratch + 3, MemoryCategory::Scratch);
+    histogram = ShaderStorageBuffer<unsigned int>::New(numGroups(capacity) * (1 << LBVH_RADIX_BITS), scratch, MemoryCategory::Scratch);
+
+    for(int i = 0; i < 2; i ++) {
+        keys[i] = ShaderStorageBuffer<unsigned int>::New(capacity, scratch + 1 + 2 * i, MemoryCategory::Scratch);
+        values[i] = ShaderStorageBuffer<unsigned int>::New(capacity, scratch + 2 + 2 * i, MemoryCategory::Scratch);
+    }
+}
+
+void LBVH::sort() {
+
+    const unsigned int scratch = LBVH_SCRATCH_BINDING_POINT;
+    unsigned int numItems = getNumItems();
+    unsigned int numBlocks = numGroups(numItems);
+
+    // LBVH_RADIX_PASSES is even, so the sorted keys end up in keys[0] and values[0]
+    for(int pass = 0; pass < LBVH_RADIX_PASSES; pass ++) {
+
+        int in = pass % 2, out = 1 - in;
+        int shift = pass * LBVH_RADIX_BITS;
+
+        histogram->bindBase(scratch);
+        keys[in]->bindBase(scratch + 1);
+        values[in]->bindBase(scratch + 2);
+        keys[out]->bindBase(scratch + 3);
+        values[out]->bindBase(scratch + 4);
+
+        histogramProgram->useProgram();
+        histogramProgram->uniformInt("numElements", numItems);
+        histogramProgram->uniformInt("numBlocks", numBlocks);
+        histogramProgram->uniformInt("shift", shift);
+        glDispatchCompute(numBlocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        scanProgram->useProgram();
+        scanProgram->uniformInt("numBlocks", numBlocks);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        scatterProgram->useProgram();
+        scatterProgram->uniformInt("numElements", numItems);
+        scatterProgram->uniformInt("numBlocks", numBlocks);
+        scatterProgram->uniformInt("shift", shift);
+        glDispatchCompute(numBlocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+}
+
+void LBVH::build(const ShaderStorageBuffer<Vertex>::Ptr& vertices, const ShaderStorageBuffer<unsigned int>::Ptr& indices,
+    const ShaderStorageBuffer<Primitive>::Ptr& primitives) {
+    vertices->bindBase(0);
+    indices->bindBase(1);
+    buildItems(VertexFormat::Full, VertexQuantization(), indices->getSize(), 0, 0, primitives);
+}
+
+void LBVH::build(const ShaderStorageBuffer<PackedVertex>::Ptr& vertices, const VertexQuantization& quantization,
+    const ShaderStorageBuffer<unsigned int>::Ptr& indices, const ShaderStorageBuffer<Primitive>::Ptr& primitives) {
+    vertices->bindBase(0);
+    indices->bindBase(1);
+    buildItems(VertexFormat::Packed, quantization, indices->getSize(), 0, 0, primitives);
+}
+
+void LBVH::build(const BufferArena<Vertex>::Allocation& vertices, const BufferArena<unsigned int>::Allocation& indices,
+    const ShaderStorageBuffer<Primitive>::Ptr& primitives) {
+    if(vertices.isValid()) vertices.getArena()->bindBase(0);
+    if(indices.isValid()) indices.getArena()->bindBase(1);
+    buildItems(VertexFormat::Full, VertexQuantization(), indices.getCount(), vertices.getOffset(), indices.getOffset(), primitives);
+}
+
+void LBVH::build(const BufferArena<PackedVertex>::Allocation& vertices, const VertexQuantization& quantization,
+    const BufferArena<unsigned int>::Allocation& indices, const ShaderStorageBuffer<Primitive>::Ptr& primitives) {
+    if(vertices.isValid()) vertices.getArena()->bindBase(0);
+    if(indices.isValid()) indices.getArena()->bindBase(1);
+    buildItems(VertexFormat::Packed, quantization, indices.getCount(), vertices.getOffset(), indices.getOffset(), primitives);
+}
+
+void LBVH::buildItems(VertexFormat format, const VertexQuantization& quantization, unsigned int numIndices,
+    unsigned int vertexOffset, unsigned int indexOffset, const ShaderStorageBuffer<Primitive>::Ptr& primitives) {
+
+    if(!valid) return;
+
+    const unsigned int scratch = LBVH_SCRATCH_BINDING_POINT;
+
+    numTriangles = numIndices / 3;
+    numPrimitives = primitives != nullptr ? primitives->getSize() : 0;
+
+    unsigned int numItems = getNumItems();
+    if(numItems == 0) return;
+
+    allocate(numItems);
+    unsigned int groups = numGroups(numItems);
+
+    auto vertexUniforms = [&](const ShaderProgram::Ptr& program) {
+        program->uniformInt("vertexFormat", (int)format);
+        program->uniformVec3("vertexOrigin", quantization.origin);
+        program->uniformVec3("vertexScale", quantization.scale);
+        program->uniformInt("vertexOffset", vertexOffset);
+        program->uniformInt("indexOffset", indexOffset);
+    };
+
+    nodes->bindBase(BVH_NODES_BINDING_POINT);
+    if(primitives != nullptr) primitives->bindBase(PRIMITIVES_BINDING_POINT);
+
+    // Centroid bounds
+    timers[SceneBoundsStage]->begin();
+    const std::vector<unsigned int> emptyBounds = { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0, 0, 0 };
+    sceneBounds->setData(emptyBounds);
+    sceneBounds->bindBase(scratch);
+    sceneBoundsProgram->useProgram();
+    sceneBoundsProgram->uniformInt("numTriangles", numTriangles);
+    sceneBoundsProgram->uniformInt("numPrimitives", numPrimitives);
+    vertexUniforms(sceneBoundsProgram);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    timers[SceneBoundsStage]->end();
+
+    // Morton codes
+    timers[MortonStage]->begin();
+    keys[0]->bindBase(scratch + 1);
+    values[0]->bindBase(scratch + 2);
+    mortonProgram->useProgram();
+    mortonProgram->uniformInt("numTriangles", numTriangles);
+    mortonProgram->uniformInt("numPrimitives", numPrimitives);
+    vertexUniforms(mortonProgram);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    timers[MortonStage]->end();
+
+    // Radix sort
+    timers[SortStage]->begin();
+    sort();
+    timers[SortStage]->end();
+
+    // Hierarchy
+    timers[HierarchyStage]->begin();
+    parents->bindBase(scratch);
+    keys[0]->bindBase(scratch + 1);
+    values[0]->bindBase(scratch + 2);
+    flags->bindBase(scratch + 3);
+    hierarchyProgram->useProgram();
+    hierarchyProgram->uniformInt("numItems", numItems);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    timers[HierarchyStage]->end();
+
+    // Bounds
+    timers[BoundsStage]->begin();
+    const std::vector<unsigned int> zeroDepth = { 0 };
+    depth->setData(zeroDepth);
+    depth->bindBase(scratch + 4);
+    boundsProgram->useProgram();
+    boundsProgram->uniformInt("numTriangles", numTriangles);
+    boundsProgram->uniformInt("numPrimitives", numPrimitives);
+    vertexUniforms(boundsProgram);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    timers[BoundsStage]->end();
+}
+
+LBVH::Timings LBVH::getTimings() {
+
+    Timings timings;
+    if(getNumItems() == 0) return timings;
+
+    timings.sceneBounds = timers[SceneBoundsStage]->getElapsedMilliseconds();
+    timings.mortonCodes = timers[MortonStage]->getElapsedMilliseconds();
+    timings.sort = timers[SortStage]->getElapsedMilliseconds();
+    timings.hierarchy = timers[HierarchyStage]->getElapsedMilliseconds();
+    timings.bounds = timers[BoundsStage]->getElapsedMilliseconds();
+    timings.total = timings.sceneBounds + timings.mortonCodes + timings.sort + timings.hierarchy + timings.bounds;
+
+    return timings;
+}
+
+unsigned int LBVH::getDepth() const {
+    if(getNumItems() == 0) return 0;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    return depth->download()[0];
+}
+
+std::vector<BVHNode> LBVH::downloadNodes() const {
+    if(getNumItems() == 0) return {};
+    std::vector<BVHNode> result = nodes->download();
+    result.resize(getNumNodes());
+    return result;
+}
+
+unsigned int LBVH::expandBits(unsigned int v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+std::vector<BVHNode> LBVH::buildCPU(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+    const std::vector<Primitive>& primitives) {
+
+    int numTriangles = indices.size() / 3;
+    int n = numTriangles + primitives.size();
+    if(n == 0) return {};
+
+    auto bounds = [&](int item, glm::vec3& aabbMin, glm::vec3& aabbMax) {
+        if(item < numTriangles) {
+            const glm::vec3& v1 = vertices[indices[3 * item]].pos;
+            const glm::vec3& v2 = vertices[indices[3 * item + 1]].pos;
+            const glm::vec3& v3 = vertices[indices[3 * item + 2]].pos;
+            aabbMin = glm::min(v1, glm::min(v2, v3));
+            aabbMax = glm::max(v1, glm::max(v2, v3));
+        }else
+            primitives[item - numTriangles].getBounds(aabbMin, aabbMax);
+    };
+
+    auto center = [&](int item) {
+        if(item < numTriangles) {
+            return (vertices[indices[3 * item]].pos + vertices[indices[3 * item + 1]].pos
+                + vertices[indices[3 * item + 2]].pos) / 3.f;
+        }
+        glm::vec3 aabbMin, aabbMax;
+        bounds(item, aabbMin, aabbMax);
+        return (aabbMin + aabbMax) * 0.5f;
+    };
+
+    // Centroid bounds
+    glm::vec3 sceneMin(std::numeric_limits<float>::max()), sceneMax(-std::numeric_limits<float>::max());
+    for(int i = 0; i < n; i ++) {
+        sceneMin = glm::min(sceneMin, center(i));
+        sceneMax = glm::max(sceneMax, center(i));
+    }
+    glm::vec3 extent = glm::max(sceneMax - sceneMin, glm::vec3(1e-20f));
+
+    // Morton codes sorted by code and triangle, as the stable radix sort of the GPU does
+    std::vector<std::pair<unsigned int, unsigned int>> codes(n);
+    for(int i = 0; i < n; i ++) {
+        glm::vec3 p = glm::clamp((center(i) - sceneMin) / extent * 1024.f, 0.f, 1023.f);
+        unsigned int code = (expandBits((unsigned int)p.x) << 2) | (expandBits((unsigned int)p.y) << 1) | expandBits((unsigned int)p.z);
+        codes[i] = { code, (unsigned int)i };
+    }
+    std::sort(codes.begin(), codes.end());
+
+    auto delta = [&](int i, int j) {
+        if(j < 0 || j >= n) return -1;
+        unsigned int x = codes[i].first ^ codes[j].first;
+        if(x == 0) return 32 + __builtin_clz((unsigned int)(i ^ j));
+        return __builtin_clz(x);
+    };
+
+    // Hierarchy
+    int numInternal = n - 1;
+    std::vector<BVHNode> nodes(2 * n - 1);
+
+    for(int i = 0; i < n; i ++) {
+        nodes[numInternal + i].left = BVH_LEAF((int)codes[i].second);
+        nodes[numInternal + i].right = -1;
+    }
+
+    for(int i = 0; i < numInternal; i ++) {
+
+        int d = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1;
+
+        int deltaMin = delta(i, i - d);
+        int lmax = 2;
+        while(delta(i, i + lmax * d) > deltaMin) lmax *= 2;
+
+        int l = 0;
+        for(int t = lmax / 2; t >= 1; t /= 2)
+            if(delta(i, i + (l + t) * d) > deltaMin) l += t;
+        int j = i + l * d;
+
+        int deltaNode = delta(i, j);
+        int s = 0, t = l;
+        do {
+            t = (t + 1) / 2;
+            if(delta(i, i + (s + t) * d) > deltaNode) s += t;
+        } while(t > 1);
+        int gamma = i + s * d + std::min(d, 0);
+
+        nodes[i].left = std::min(i, j) == gamma ? numInternal + gamma : gamma;
+        nodes[i].right = std::max(i, j) == gamma + 1 ? numInternal + gamma + 1 : gamma + 1;
+    }
+
+    // Bounds, children are visited before their parent
+    std::vector<std::pair<int, bool>> stack = { { 0, false } };
+    while(!stack.empty()) {
+
+        auto [node, childrenDone] = stack.back();
+        stack.pop_back();
+        BVHNode& bvhNode = nodes[node];
+
+        if(bvhNode.isLeaf())
+            bounds(bvhNode.getItem(), bvhNode.aabbMin, bvhNode.aabbMax);
+        else if(childrenDone) {
+            bvhNode.aabbMin = glm::min(nodes[bvhNode.left].aabbMin, nodes[bvhNode.right].aabbMin);
+            bvhNode.aabbMax = glm::max(nodes[bvhNode.left].aabbMax, nodes[bvhNode.right].aabbMax);
+        }else {
+            stack.push_back({ node, true });
+            stack.push_back({ bvhNode.left, false });
+            stack.push_back({ bvhNode.right, false });
+        }
+    }
+
+    return nodes;
+}
+
+}
\ No newline at end of file
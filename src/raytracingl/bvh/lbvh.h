@@ -0,0 +1,104 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <array>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/bvh/bvh.h"
+#include "raytracingl/geometry/vertex.h"
+#include "raytracingl/geometry/packedvertex.h"
+#include "raytracingl/geometry/primitive.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/opengl/buffer/bufferarena.h"
+#include "raytracingl/opengl/shader/shader.h"
+#include "raytracingl/opengl/timer/timer.h"
+
+#define LBVH_WORKGROUP_SIZE 256
+#define LBVH_RADIX_BITS 4
+#define LBVH_RADIX_PASSES 8
+
+// First of the 5 binding points used for scratch buffers during the build,
+// away from the ones of the scene so the trace kernel state is kept
+#define LBVH_SCRATCH_BINDING_POINT 16
+
+namespace rgl
+{
+
+// Linear BVH built entirely on the GPU from the vertex, index and primitive shader storage
+// buffers: Morton codes of the item centroids, radix sort, Karras hierarchy emission and
+// bottom-up bounds. Items are the triangles followed by the analytic primitives.
+// The nodes are bound to BVH_NODES_BINDING_POINT for the trace kernel.
+class LBVH {
+    GENERATE_SHARED_PTR(LBVH)
+public:
+    // GPU time of each build step in milliseconds
+    struct Timings {
+        double sceneBounds = 0.0;
+        double mortonCodes = 0.0;
+        double sort = 0.0;
+        double hierarchy = 0.0;
+        double bounds = 0.0;
+        double total = 0.0;
+    };
+private:
+    enum Stage { SceneBoundsStage, MortonStage, SortStage, HierarchyStage, BoundsStage, NumStages };
+
+    ShaderProgram::Ptr sceneBoundsProgram, mortonProgram;
+    ShaderProgram::Ptr histogramProgram, scanProgram, scatterProgram;
+    ShaderProgram::Ptr hierarchyProgram, boundsProgram;
+
+    ShaderStorageBuffer<BVHNode>::Ptr nodes;
+    ShaderStorageBuffer<unsigned int>::Ptr sceneBounds, histogram, flags, depth;
+    ShaderStorageBuffer<unsigned int>::Ptr keys[2], values[2];
+    ShaderStorageBuffer<int>::Ptr parents;
+
+    std::array<GPUTimer::Ptr, NumStages> timers;
+    unsigned int numTriangles, numPrimitives, capacity;
+    bool valid;
+private:
+    static ShaderProgram::Ptr loadProgram(const std::string& filePath);
+    static unsigned int numGroups(unsigned int count);
+    static unsigned int expandBits(unsigned int v);
+    void allocate(unsigned int numItems);
+    void sort();
+    // The vertices are already bound to binding 0 in the given format and the indices to
+    // binding 1. The triangles are numIndices indices from indexOffset
+    void buildItems(VertexFormat format, const VertexQuantization& quantization, unsigned int numIndices,
+        unsigned int vertexOffset, unsigned int indexOffset, const ShaderStorageBuffer<Primitive>::Ptr& primitives);
+public:
+    LBVH(const std::string& shadersPath = "glsl/");
+    ~LBVH() = default;
+    LBVH(const LBVH& lbvh) = delete;
+    LBVH& operator=(const LBVH& lbvh) = delete;
+public:
+    void build(const ShaderStorageBuffer<Vertex>::Ptr& vertices, const ShaderStorageBuffer<unsigned int>::Ptr& indices,
+        const ShaderStorageBuffer<Primitive>::Ptr& primitives = nullptr);
+    void build(const ShaderStorageBuffer<PackedVertex>::Ptr& vertices, const VertexQuantization& quantization,
+        const ShaderStorageBuffer<unsigned int>::Ptr& indices, const ShaderStorageBuffer<Primitive>::Ptr& primitives = nullptr);
+    // Mesh in shared buffers, the indices of the allocation are relative to the vertex allocation
+    void build(const BufferArena<Vertex>::Allocation& vertices, const BufferArena<unsigned int>::Allocation& indices,
+        const ShaderStorageBuffer<Primitive>::Ptr& primitives = nullptr);
+    void build(const BufferArena<PackedVertex>::Allocation& vertices, const VertexQuantization& quantization,
+        const BufferArena<unsigned int>::Allocation& indices, const ShaderStorageBuffer<Primitive>::Ptr& primitives = nullptr);
+    // Waits for the GPU timer queries of the last build
+    Timings getTimings();
+    // Levels below the root of the deepest leaf of the last build, it waits for the build.
+    // The trace kernel needs bvhStackSize(2, getDepth()) stack entries
+    unsigned int getDepth() const;
+    // Reads the nodes back, internal nodes first and then the leaves
+    std::vector<BVHNode> downloadNodes() const;
+    // Same algorithm and node layout on the host, it does not need a GL context
+    static std::vector<BVHNode> buildCPU(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+        const std::vector<Primitive>& primitives = {});
+public:
+    // False if the GPU lacks the scratch binding points, builds are empty then
+    bool isValid() const { return valid; }
+    ShaderStorageBuffer<BVHNode>::Ptr getNodes() const { return nodes; }
+    unsigned int getNumTriangles() const { return numTriangles; }
+    unsigned int getNumPrimitives() const { return numPrimitives; }
+    unsigned int getNumItems() const { return numTriangles + numPrimitives; }
+    unsigned int getNumNodes() const { return getNumItems() > 0 ? 2 * getNumItems() - 1 : 0; }
+};
+
+}
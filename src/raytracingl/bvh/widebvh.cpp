@@ -0,0 +1,202 @@
+#include "widebvh.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace rgl
+{
+
+static float surfaceArea(const BVHNode& node) {
+    glm::vec3 extent = node.aabbMax - node.aabbMin;
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+WideBVH::WideBVH(const std::vector<BVHNode>& binaryNodes, unsigned int _width, unsigned int _bits, unsigned int _maxLeafSize)
+    : width(_width), bits(_bits), maxLeafSize(_maxLeafSize), numNodes(0), depth(0),
+    memory(MemoryDomain::Host, MemoryCategory::AccelerationStructures) {
+
+    if(width != 4 && width != 8) width = 4;
+    if(bits != 8 && bits != 16) bits = 8;
+    maxLeafSize = std::max(1u, std::min((unsigned int)WIDE_BVH_MAX_LEAF_SIZE, maxLeafSize));
+
+    nodeStride = WIDE_BVH_HEADER_SIZE + width + 6 * width * bits / 32;
+
+    if(binaryNodes.empty()) return;
+
+    std::vector<unsigned int> counts(binaryNodes.size());
+    countItems(binaryNodes, counts, 0);
+
+    data.resize(nodeStride);
+    numNodes = 1;
+    collapse(binaryNodes, counts, 0, 0, 0);
+
+    // Leaf items after the nodes, references are made absolute
+    unsigned int offset = data.size();
+    for(unsigned int node = 0; node < numNodes; node ++) {
+        for(unsigned int i = 0; i < getNumChildren(node); i ++) {
+            unsigned int& reference = data[node * nodeStride + WIDE_BVH_HEADER_SIZE + i];
+            if(reference & WIDE_BVH_LEAF_BIT)
+                reference = WIDE_BVH_LEAF(WIDE_BVH_LEAF_FIRST(reference) + offset, WIDE_BVH_LEAF_COUNT(reference));
+        }
+    }
+
+    data.insert(data.end(), leafItems.begin(), leafItems.end());
+    leafItems.clear();
+    leafItems.shrink_to_fit();
+
+    memory.resize(getMemoryBytes());
+}
+
+unsigned int WideBVH::countItems(const std::vector<BVHNode>& binaryNodes, std::vector<unsigned int>& counts, int binaryNode) {
+    const BVHNode& node = binaryNodes[binaryNode];
+    counts[binaryNode] = node.isLeaf() ? 1
+        : countItems(binaryNodes, counts, node.left) + countItems(binaryNodes, counts, node.right);
+    return counts[binaryNode];
+}
+
+void WideBVH::collectItems(const std::vector<BVHNode>& binaryNodes, int binaryNode) {
+    const BVHNode& node = binaryNodes[binaryNode];
+    if(node.isLeaf()) leafItems.push_back(node.getItem());
+    else {
+        collectItems(binaryNodes, node.left);
+        collectItems(binaryNodes, node.right);
+    }
+}
+
+void WideBVH::collapse(const std::vector<BVHNode>& binaryNodes, const std::vector<unsigned int>& counts, int binaryNode, unsigned int node,
+    unsigned int level) {
+
+    depth = std::max(depth, level);
+
+    // Open the child with the largest surface area until the node is full,
+    // small subtrees are kept closed since they become leaves
+    std::vector<int> children;
+    if(counts[binaryNode] <= maxLeafSize) children.push_back(binaryNode);
+    else children = { binaryNodes[binaryNode].left, binaryNodes[binaryNode].right };
+
+    while(children.size() < width) {
+
+        int largest = -1;
+        float largestArea = -1.f;
+        for(int i = 0; i < (int)children.size(); i ++) {
+            const BVHNode& child = binaryNodes[children[i]];
+            if(counts[children[i]] > maxLeafSize && surfaceArea(child) > largestArea) {
+                largest = i;
+                largestArea = surfaceArea(child);
+            }
+        }
+
+        if(largest == -1) break;
+
+        const BVHNode& opened = binaryNodes[children[largest]];
+        children[largest] = opened.left;
+        children.push_back(opened.right);
+    }
+
+    std::vector<const BVHNode*> childNodes;
+    for(int child : children) childNodes.push_back(&binaryNodes[child]);
+    quantize(node, childNodes);
+
+    // Child references, internal children are appended and collapsed recursively
+    for(unsigned int i = 0; i < width; i ++) {
+
+        unsigned int reference = WIDE_BVH_EMPTY;
+
+        if(i < children.size()) {
+            if(counts[children[i]] <= maxLeafSize) {
+                reference = WIDE_BVH_LEAF((unsigned int)leafItems.size(), counts[children[i]]);
+                collectItems(binaryNodes, children[i]);
+            }else {
+                reference = numNodes ++;
+                data.resize(numNodes * nodeStride);
+            }
+        }
+
+        data[node * nodeStride + WIDE_BVH_HEADER_SIZE + i] = reference;
+    }
+
+    for(unsigned int i = 0; i < children.size(); i ++) {
+        unsigned int reference = getChild(node, i);
+        if((reference & WIDE_BVH_LEAF_BIT) == 0) collapse(binaryNodes, counts, children[i], reference, level + 1);
+    }
+}
+
+void WideBVH::quantize(unsigned int node, const std::vector<const BVHNode*>& children) {
+
+    const unsigned int maxValue = (1u << bits) - 1;
+    unsigned int* header = &data[node * nodeStride];
+
+    glm::vec3 aabbMin = children[0]->aabbMin, aabbMax = children[0]->aabbMax;
+    for(const BVHNode* child : children) {
+        aabbMin = glm::min(aabbMin, child->aabbMin);
+        aabbMax = glm::max(aabbMax, child->aabbMax);
+    }
+
+    // Smallest power of two scale per axis that covers the node with maxValue steps
+    int exponents[3];
+    glm::vec3 scale;
+    for(int axis = 0; axis < 3; axis ++) {
+        float extent = aabbMax[axis] - aabbMin[axis];
+        int exponent = extent > 0.f ? (int)std::ceil(std::log2(extent / maxValue)) : -126;
+        exponents[axis] = std::max(-126, std::min(127, exponent));
+        scale[axis] = std::ldexp(1.f, exponents[axis]);
+        std::memcpy(&header[axis], &aabbMin[axis], sizeof(float));
+    }
+
+    header[3] = (unsigned int)(exponents[0] + 128) | ((unsigned int)(exponents[1] + 128) << 8)
+        | ((unsigned int)(exponents[2] + 128) << 16) | ((unsigned int)children.size() << 24);
+
+    // Conservative rounding, the decoded box always contains the child
+    for(unsigned int i = 0; i < children.size(); i ++) {
+        for(int axis = 0; axis < 3; axis ++) {
+
+            float lo = std::floor((children[i]->aabbMin[axis] - aabbMin[axis]) / scale[axis]);
+            float hi = std::ceil((children[i]->aabbMax[axis] - aabbMin[axis]) / scale[axis]);
+
+            unsigned int qlo = (unsigned int)std::max(0.f, std::min((float)maxValue, lo));
+            unsigned int qhi = (unsigned int)std::max(0.f, std::min((float)maxValue, hi));
+
+            while(qlo > 0 && aabbMin[axis] + qlo * scale[axis] > children[i]->aabbMin[axis]) qlo --;
+            while(qhi < maxValue && aabbMin[axis] + qhi * scale[axis] < children[i]->aabbMax[axis]) qhi ++;
+
+            setQuantized(node, axis, i, qlo);
+            setQuantized(node, axis + 3, i, qhi);
+        }
+    }
+}
+
+unsigned int WideBVH::getQuantized(unsigned int node, unsigned int component, unsigned int child) const {
+    unsigned int index = component * width + child;
+    unsigned int valuesPerUint = 32 / bits;
+    unsigned int word = data[node * nodeStride + WIDE_BVH_HEADER_SIZE + width + index / valuesPerUint];
+    return (word >> ((index % valuesPerUint) * bits)) & ((1u << bits) - 1);
+}
+
+void WideBVH::setQuantized(unsigned int node, unsigned int component, unsigned int child, unsigned int value) {
+    unsigned int index = component * width + child;
+    unsigned int valuesPerUint = 32 / bits;
+    unsigned int shift = (index % valuesPerUint) * bits;
+    unsigned int& word = data[node * nodeStride + WIDE_BVH_HEADER_SIZE + width + index / valuesPerUint];
+    word = (word & ~(((1u << bits) - 1) << shift)) | (value << shift);
+}
+
+void WideBVH::getChildBounds(unsigned int node, unsigned int child, glm::vec3& aabbMin, glm::vec3& aabbMax) const {
+
+    const unsigned int* header = &data[node * nodeStride];
+
+    for(int axis = 0; axis < 3; axis ++) {
+        float origin;
+        std::memcpy(&origin, &header[axis], sizeof(float));
+        float scale = std::ldexp(1.f, (int)((header[3] >> (8 * axis)) & 0xFF) - 128);
+        aabbMin[axis] = origin + getQuantized(node, axis, child) * scale;
+        aabbMax[axis] = origin + getQuantized(node, axis + 3, child) * scale;
+    }
+}
+
+ShaderStorageBuffer<unsigned int>::Ptr WideBVH::upload() {
+    buffer = ShaderStorageBuffer<unsigned int>::New(data, WIDE_BVH_NODES_BINDING_POINT, false, MemoryCategory::AccelerationStructures);
+    return buffer;
+}
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/bvh/bvh.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+#define WIDE_BVH_NODES_BINDING_POINT 3
+#define WIDE_BVH_HEADER_SIZE 4
+#define WIDE_BVH_MAX_LEAF_SIZE 8
+
+// Child references. Leaves have the highest bit set, the position of their first
+// item index in the packed data shifted by 3 and the number of items - 1
+#define WIDE_BVH_EMPTY 0xFFFFFFFFu
+#define WIDE_BVH_LEAF_BIT 0x80000000u
+#define WIDE_BVH_LEAF(first, count) (WIDE_BVH_LEAF_BIT | ((first) << 3) | ((count) - 1))
+#define WIDE_BVH_LEAF_FIRST(reference) (((reference) & ~WIDE_BVH_LEAF_BIT) >> 3)
+#define WIDE_BVH_LEAF_COUNT(reference) (((reference) & 7u) + 1)
+
+namespace rgl
+{
+
+// BVH with 4 or 8 children per node collapsed from the binary BVH. Child bounds are
+// quantized to 8 or 16 bits relative to the node bounds using a power of two scale per
+// axis, and subtrees of up to maxLeafSize items (triangles or primitives) become a single leaf.
+//
+// Every node is packed into getNodeStride() uints:
+//   [0, 3)           node origin (float bits)
+//   [3]              scale exponents, one biased byte per axis and the child count in the highest byte
+//   [4, 4 + W)       child references
+//   [4 + W, stride)  quantized child bounds: min xyz and max xyz, W values per component
+// The item indices of the leaves follow the last node.
+class WideBVH {
+    GENERATE_SHARED_PTR(WideBVH)
+private:
+    std::vector<unsigned int> data;
+    std::vector<unsigned int> leafItems;
+    unsigned int width, bits, maxLeafSize, nodeStride, numNodes;
+    unsigned int depth;     // levels of internal nodes below the root
+    ShaderStorageBuffer<unsigned int>::Ptr buffer;
+    MemoryRecord memory;
+private:
+    unsigned int countItems(const std::vector<BVHNode>& binaryNodes, std::vector<unsigned int>& counts, int binaryNode);
+    void collectItems(const std::vector<BVHNode>& binaryNodes, int binaryNode);
+    void collapse(const std::vector<BVHNode>& binaryNodes, const std::vector<unsigned int>& counts, int binaryNode, unsigned int node,
+        unsigned int level);
+    void quantize(unsigned int node, const std::vector<const BVHNode*>& children);
+    unsigned int getQuantized(unsigned int node, unsigned int component, unsigned int child) const;
+    void setQuantized(unsigned int node, unsigned int component, unsigned int child, unsigned int value);
+public:
+    WideBVH(const std::vector<BVHNode>& binaryNodes, unsigned int _width = 4, unsigned int _bits = 8, unsigned int _maxLeafSize = 3);
+    WideBVH() = default;
+    ~WideBVH() = default;
+public:
+    // Uploads the packed nodes to WIDE_BVH_NODES_BINDING_POINT
+    ShaderStorageBuffer<unsigned int>::Ptr upload();
+
+    unsigned int getChild(unsigned int node, unsigned int child) const {
+        return data[node * nodeStride + WIDE_BVH_HEADER_SIZE + child];
+    }
+
+    unsigned int getNumChildren(unsigned int node) const {
+        return data[node * nodeStride + 3] >> 24;
+    }
+
+    // Item of a leaf, index < WIDE_BVH_LEAF_COUNT(reference)
+    unsigned int getLeafItem(unsigned int reference, unsigned int index) const {
+        return data[WIDE_BVH_LEAF_FIRST(reference) + index];
+    }
+
+    void getChildBounds(unsigned int node, unsigned int child, glm::vec3& aabbMin, glm::vec3& aabbMax) const;
+public:
+    const std::vector<unsigned int>& getData() const { return data; }
+    ShaderStorageBuffer<unsigned int>::Ptr getBuffer() const { return buffer; }
+    unsigned int getWidth() const { return width; }
+    unsigned int getBits() const { return bits; }
+    unsigned int getMaxLeafSize() const { return maxLeafSize; }
+    unsigned int getNodeStride() const { return nodeStride; }
+    unsigned int getNumNodes() const { return numNodes; }
+    unsigned int getDepth() const { return depth; }
+    // Traversal stack entries this tree needs, see bvhStackSize()
+    unsigned int getStackSize() const { return bvhStackSize(width, depth); }
+    size_t getMemoryBytes() const { return data.size() * sizeof(unsigned int); }
+};
+
+}
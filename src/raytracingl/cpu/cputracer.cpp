@@ -0,0 +1,335 @@
+#include "cputracer.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "raytracingl/bvh/lbvh.h"
+
+namespace rgl
+{
+
+// Traversal stack of size entries, on the heap when CPU_BVH_STACK_SIZE is too small
+template <typename T>
+struct TraversalStack {
+
+    T local[CPU_BVH_STACK_SIZE];
+    std::vector<T> heap;
+    T* entries;
+    int capacity;
+
+    TraversalStack(unsigned int size) : entries(local), capacity(CPU_BVH_STACK_SIZE) {
+        if(size > CPU_BVH_STACK_SIZE) {
+            heap.resize(size);
+            entries = heap.data();
+            capacity = size;
+        }
+    }
+};
+
+CPUTracer::CPUTracer(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices,
+    const std::vector<Primitive>& _primitives)
+    : vertices(_vertices), indices(_indices), primitives(_primitives),
+    nodes(LBVH::buildCPU(_vertices, _indices, _primitives)) {
+    binaryStackSize = bvhStackSize(2, bvhDepth(nodes));
+    recordMemory();
+}
+
+CPUTracer::CPUTracer(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices,
+    const std::vector<Primitive>& _primitives, const std::vector<BVHNode>& _nodes)
+    : vertices(_vertices), indices(_indices), primitives(_primitives), nodes(_nodes) {
+    binaryStackSize = bvhStackSize(2, bvhDepth(nodes));
+    recordMemory();
+}
+
+void CPUTracer::recordMemory() {
+    vertexMemory = MemoryRecord(MemoryDomain::Host, MemoryCategory::Vertices,
+        vertices.size() * sizeof(Vertex) + primitives.size() * sizeof(Primitive));
+    indexMemory = MemoryRecord(MemoryDomain::Host, MemoryCategory::Indices, indices.size() * sizeof(unsigned int));
+    nodesMemory = MemoryRecord(MemoryDomain::Host, MemoryCategory::AccelerationStructures, nodes.size() * sizeof(BVHNode));
+}
+
+HitInfo CPUTracer::intersectionItem(const Ray& ray, int item) const {
+
+    int numTriangles = getNumTriangles();
+
+    if(item < numTriangles) {
+        HitInfo hitInfo = intersectionTriangle(ray, getTriangle(item));
+        hitInfo.triangle = item;
+        return hitInfo;
+    }
+
+    HitInfo hitInfo = intersectionPrimitive(ray, primitives[item - numTriangles]);
+    hitInfo.primitive = item - numTriangles;
+    return hitInfo;
+}
+
+float CPUTracer::distanceItem(const Ray& ray, int item) const {
+    int numTriangles = getNumTriangles();
+    return item < numTriangles ? distanceTriangle(ray, getTriangle(item))
+        : distancePrimitive(ray, primitives[item - numTriangles]);
+}
+
+void CPUTracer::useWideBVH(unsigned int width, unsigned int bits) {
+    wideBVH = WideBVH::New(nodes, width, bits);
+}
+
+HitInfo CPUTracer::closestHit(const Ray& ray, float maxDist, TraversalStats* stats) const {
+    if(stats != nullptr) stats->rays ++;
+    if(nodes.empty()) return HitInfo();
+    return wideBVH != nullptr ? closestHitWide(ray, maxDist, stats) : closestHitBinary(ray, maxDist, stats);
+}
+
+bool CPUTracer::occluded(const Ray& ray, float maxDist, TraversalStats* stats) const {
+    if(stats != nullptr) stats->rays ++;
+    if(nodes.empty()) return false;
+    return wideBVH != nullptr ? occludedWide(ray, maxDist, stats) : occludedBinary(ray, maxDist, stats);
+}
+
+void CPUTracer::visibility(const std::vector<Ray>& rays, const std::vector<float>& maxDists,
+    std::vector<unsigned char>& visible, TraversalStats* stats) const {
+
+    visible.resize(rays.size());
+    for(size_t i = 0; i < rays.size(); i ++)
+        visible[i] = occluded(rays[i], maxDists[i], stats) ? 0 : 1;
+}
+
+glm::vec3 CPUTracer::directLighting(const LightBVH& lightBVH, const glm::vec3& position, const glm::vec3& normal,
+    const glm::vec3& albedo, const glm::vec3& u, TraversalStats* stats) const {
+
+    float pmf;
+    int light = lightBVH.sample(position, normal, u.x, pmf);
+    if(light < 0) return glm::vec3(0.f);
+
+    const EmissiveTriangle& emissive = lightBVH.getLights()[light];
+    Triangle triangle = getTriangle(emissive.triangle);
+
+    // Uniform point in the triangle
+    float su = std::sqrt(u.y);
+    glm::vec3 point = (1.f - su) * triangle.v1 + su * (1.f - u.z) * triangle.v2 + su * u.z * triangle.v3;
+
+    glm::vec3 lightNormal = glm::cross(triangle.v2 - triangle.v1, triangle.v3 - triangle.v1);
+    float area = 0.5f * glm::length(lightNormal);
+    lightNormal = glm::normalize(lightNormal);
+
+    glm::vec3 toLight = point - position;
+    float dist2 = glm::dot(toLight, toLight);
+    float dist = std::sqrt(dist2);
+    glm::vec3 direction = toLight / dist;
+
+    // Lights emit on one side only
+    float cosTheta = glm::dot(normal, direction);
+    float cosLight = -glm::dot(lightNormal, direction);
+    if(cosTheta <= 0.f || cosLight <= 0.f) return glm::vec3(0.f);
+
+    if(occluded(Ray(position + normal * 1e-4f, direction), dist * (1.f - 1e-3f), stats)) return glm::vec3(0.f);
+
+    // pdf in area measure is pmf / area
+    return albedo / glm::pi<float>() * emissive.emission * cosTheta * cosLight * area / (dist2 * pmf);
+}
+
+HitInfo CPUTracer::closestHitBinary(const Ray& ray, float maxDist, TraversalStats* stats) const {
+
+    HitInfo hitInfo;
+    hitInfo.dist = maxDist;
+    glm::vec3 invDirection = 1.f / ray.direction;
+    TraversalStats counters;
+
+    TraversalStack<int> traversal(binaryStackSize);
+    int* stack = traversal.entries;
+    int stackSize = 0;
+    stack[stackSize ++] = 0;
+
+    while(stackSize > 0) {
+
+        const BVHNode& node = nodes[stack[-- stackSize]];
+        counters.nodes ++;
+        counters.boxTests ++;
+        if(intersectionAABB(ray.origin, invDirection, node.aabbMin, node.aabbMax, hitInfo.dist) < 0.f)
+            continue;
+
+        if(node.isLeaf()) {
+            counters.triangleTests ++;
+            HitInfo currentHitInfo = intersectionItem(ray, node.getItem());
+            if(currentHitInfo.hit && currentHitInfo.dist < hitInfo.dist) hitInfo = currentHitInfo;
+            continue;
+        }
+
+        // Visit the nearest child first
+        counters.boxTests += 2;
+        float distLeft = intersectionAABB(ray.origin, invDirection, nodes[node.left].aabbMin, nodes[node.left].aabbMax, hitInfo.dist);
+        float distRight = intersectionAABB(ray.origin, invDirection, nodes[node.right].aabbMin, nodes[node.right].aabbMax, hitInfo.dist);
+
+        bool leftFirst = distLeft >= 0.f && (distRight < 0.f || distLeft <= distRight);
+        int near = leftFirst ? node.left : node.right;
+        int far = leftFirst ? node.right : node.left;
+        float distNear = leftFirst ? distLeft : distRight;
+        float distFar = leftFirst ? distRight : distLeft;
+
+        // A full stack drops the far child, the near one always fits in the entry just popped
+        if(distFar >= 0.f) {
+            if(stackSize + 2 <= traversal.capacity) stack[stackSize ++] = far;
+            else counters.stackOverflows ++;
+        }
+        if(distNear >= 0.f) stack[stackSize ++] = near;
+    }
+
+    if(stats != nullptr) *stats += counters;
+    return hitInfo;
+}
+
+HitInfo CPUTracer::closestHitWide(const Ray& ray, float maxDist, TraversalStats* stats) const {
+
+    HitInfo hitInfo;
+    hitInfo.dist = maxDist;
+    glm::vec3 invDirection = 1.f / ray.direction;
+    TraversalStats counters;
+
+    TraversalStack<unsigned int> traversal(wideBVH->getStackSize());
+    unsigned int* stack = traversal.entries;
+    int stackSize = 0;
+    stack[stackSize ++] = 0;
+
+    while(stackSize > 0) {
+
+        unsigned int node = stack[-- stackSize];
+        unsigned int numChildren = wideBVH->getNumChildren(node);
+        counters.nodes ++;
+
+        // Children hit by the ray sorted by entry distance
+        unsigned int hitChildren[8];
+        float hitDistances[8];
+        unsigned int numHits = 0;
+
+        for(unsigned int i = 0; i < numChildren; i ++) {
+
+            glm::vec3 aabbMin, aabbMax;
+            wideBVH->getChildBounds(node, i, aabbMin, aabbMax);
+            counters.boxTests ++;
+
+            float dist = intersectionAABB(ray.origin, invDirection, aabbMin, aabbMax, hitInfo.dist);
+            if(dist < 0.f) continue;
+
+            unsigned int reference = wideBVH->getChild(node, i);
+            if(reference & WIDE_BVH_LEAF_BIT) {
+                for(unsigned int k = 0; k < WIDE_BVH_LEAF_COUNT(reference); k ++) {
+                    counters.triangleTests ++;
+                    HitInfo currentHitInfo = intersectionItem(ray, wideBVH->getLeafItem(reference, k));
+                    if(currentHitInfo.hit && currentHitInfo.dist < hitInfo.dist) hitInfo = currentHitInfo;
+                }
+                continue;
+            }
+
+            unsigned int j = numHits ++;
+            while(j > 0 && hitDistances[j - 1] < dist) {
+                hitChildren[j] = hitChildren[j - 1];
+                hitDistances[j] = hitDistances[j - 1];
+                j --;
+            }
+            hitChildren[j] = reference;
+            hitDistances[j] = dist;
+        }
+
+        // Farthest first so the nearest child is popped next. A full stack drops the farthest ones
+        int numRemaining = (int)std::count_if(hitDistances, hitDistances + numHits, [&](float dist) { return dist < hitInfo.dist; });
+        for(unsigned int i = 0; i < numHits; i ++) {
+            if(hitDistances[i] >= hitInfo.dist) continue;
+            if(stackSize + numRemaining <= traversal.capacity) stack[stackSize ++] = hitChildren[i];
+            else counters.stackOverflows ++;
+            numRemaining --;
+        }
+    }
+
+    if(stats != nullptr) *stats += counters;
+    return hitInfo;
+}
+
+bool CPUTracer::occludedBinary(const Ray& ray, float maxDist, TraversalStats* stats) const {
+
+    glm::vec3 invDirection = 1.f / ray.direction;
+    TraversalStats counters;
+    bool occluded = false;
+
+    TraversalStack<int> traversal(binaryStackSize);
+    int* stack = traversal.entries;
+    int stackSize = 0;
+    stack[stackSize ++] = 0;
+
+    counters.boxTests ++;
+    if(intersectionAABB(ray.origin, invDirection, nodes[0].aabbMin, nodes[0].aabbMax, maxDist) < 0.f)
+        stackSize = 0;
+
+    // Children are not ordered, any hit ends the traversal
+    while(stackSize > 0 && !occluded) {
+
+        const BVHNode& node = nodes[stack[-- stackSize]];
+        counters.nodes ++;
+
+        if(node.isLeaf()) {
+            counters.triangleTests ++;
+            float dist = distanceItem(ray, node.getItem());
+            occluded = dist > 0.f && dist < maxDist;
+            continue;
+        }
+
+        // A full stack drops the right child, the left one always fits in the entry just popped
+        counters.boxTests += 2;
+        if(intersectionAABB(ray.origin, invDirection, nodes[node.right].aabbMin, nodes[node.right].aabbMax, maxDist) >= 0.f) {
+            if(stackSize + 2 <= traversal.capacity) stack[stackSize ++] = node.right;
+            else counters.stackOverflows ++;
+        }
+        if(intersectionAABB(ray.origin, invDirection, nodes[node.left].aabbMin, nodes[node.left].aabbMax, maxDist) >= 0.f)
+            stack[stackSize ++] = node.left;
+    }
+
+    if(stats != nullptr) *stats += counters;
+    return occluded;
+}
+
+bool CPUTracer::occludedWide(const Ray& ray, float maxDist, TraversalStats* stats) const {
+
+    glm::vec3 invDirection = 1.f / ray.direction;
+    TraversalStats counters;
+    bool occluded = false;
+
+    TraversalStack<unsigned int> traversal(wideBVH->getStackSize());
+    unsigned int* stack = traversal.entries;
+    int stackSize = 0;
+    stack[stackSize ++] = 0;
+
+    while(stackSize > 0 && !occluded) {
+
+        unsigned int node = stack[-- stackSize];
+        unsigned int numChildren = wideBVH->getNumChildren(node);
+        counters.nodes ++;
+
+        for(unsigned int i = 0; i < numChildren && !occluded; i ++) {
+
+            glm::vec3 aabbMin, aabbMax;
+            wideBVH->getChildBounds(node, i, aabbMin, aabbMax);
+            counters.boxTests ++;
+
+            if(intersectionAABB(ray.origin, invDirection, aabbMin, aabbMax, maxDist) < 0.f) continue;
+
+            unsigned int reference = wideBVH->getChild(node, i);
+            if(reference & WIDE_BVH_LEAF_BIT) {
+                for(unsigned int k = 0; k < WIDE_BVH_LEAF_COUNT(reference) && !occluded; k ++) {
+                    counters.triangleTests ++;
+                    float dist = distanceItem(ray, wideBVH->getLeafItem(reference, k));
+                    occluded = dist > 0.f && dist < maxDist;
+                }
+                continue;
+            }
+
+            if(stackSize < traversal.capacity) stack[stackSize ++] = reference;
+            else counters.stackOverflows ++;
+        }
+    }
+
+    if(stats != nullptr) *stats += counters;
+    return occluded;
+}
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/geometry/vertex.h"
+#include "raytracingl/geometry/ray.h"
+#include "raytracingl/geometry/primitive.h"
+#include "raytracingl/bvh/bvh.h"
+#include "raytracingl/bvh/widebvh.h"
+#include "raytracingl/light/lightbvh.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+// Traversal stack on the call stack, deeper trees get one on the heap
+#define CPU_BVH_STACK_SIZE 64
+
+namespace rgl
+{
+
+// Host backend: traverses the same binary or wide BVH that compute.glsl uses.
+// Rays are given in the object space of the mesh.
+class CPUTracer {
+    GENERATE_SHARED_PTR(CPUTracer)
+public:
+    struct TraversalStats {
+        unsigned long long rays = 0;
+        unsigned long long nodes = 0;
+        unsigned long long boxTests = 0;
+        unsigned long long triangleTests = 0;   // triangles and analytic primitives
+        unsigned long long stackOverflows = 0;  // nodes dropped by a full stack, never with the sizes of the builders
+
+        TraversalStats& operator+=(const TraversalStats& stats) {
+            rays += stats.rays;
+            nodes += stats.nodes;
+            boxTests += stats.boxTests;
+            triangleTests += stats.triangleTests;
+            stackOverflows += stats.stackOverflows;
+            return *this;
+        }
+    };
+private:
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Primitive> primitives;
+    std::vector<BVHNode> nodes;
+    WideBVH::Ptr wideBVH;
+    unsigned int binaryStackSize = 0;   // see bvhStackSize()
+
+    MemoryRecord vertexMemory, indexMemory, nodesMemory;
+private:
+    void recordMemory();
+private:
+    // Intersection with a triangle or an analytic primitive, fills the hit indices
+    HitInfo intersectionItem(const Ray& ray, int item) const;
+    float distanceItem(const Ray& ray, int item) const;
+    HitInfo closestHitBinary(const Ray& ray, float maxDist, TraversalStats* stats) const;
+    HitInfo closestHitWide(const Ray& ray, float maxDist, TraversalStats* stats) const;
+    bool occludedBinary(const Ray& ray, float maxDist, TraversalStats* stats) const;
+    bool occludedWide(const Ray& ray, float maxDist, TraversalStats* stats) const;
+public:
+    // Builds the binary BVH on the host
+    CPUTracer(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices,
+        const std::vector<Primitive>& _primitives = {});
+    // Reuses a binary BVH, e.g. the one built by LBVH::build and read back with LBVH::downloadNodes
+    CPUTracer(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices,
+        const std::vector<Primitive>& _primitives, const std::vector<BVHNode>& _nodes);
+    CPUTracer() = default;
+    ~CPUTracer() = default;
+public:
+    // Collapses the binary BVH, later queries traverse the wide one
+    void useWideBVH(unsigned int width, unsigned int bits);
+    void useBinaryBVH() { wideBVH = nullptr; }
+
+    HitInfo closestHit(const Ray& ray, TraversalStats* stats = nullptr) const { return closestHit(ray, 999999.f, stats); }
+
+    // Closest hit nearer than maxDist, the traversal prunes the boxes beyond it
+    HitInfo closestHit(const Ray& ray, float maxDist, TraversalStats* stats = nullptr) const;
+
+    // Any hit closer than maxDist. Stops at the first one and skips the shading data
+    bool occluded(const Ray& ray, float maxDist, TraversalStats* stats = nullptr) const;
+
+    // Batch of occlusion queries for shadow rays, visible[i] = 1 when rays[i] reaches maxDists[i].
+    // visible is resized to the number of rays
+    void visibility(const std::vector<Ray>& rays, const std::vector<float>& maxDists,
+        std::vector<unsigned char>& visible, TraversalStats* stats = nullptr) const;
+
+    // One light sample of the direct lighting of a lambertian point from the emissive triangles:
+    // u.x picks the light in the light BVH and u.y, u.z the point on it
+    glm::vec3 directLighting(const LightBVH& lightBVH, const glm::vec3& position, const glm::vec3& normal,
+        const glm::vec3& albedo, const glm::vec3& u, TraversalStats* stats = nullptr) const;
+
+    Triangle getTriangle(int triangle) const {
+        return { vertices[indices[3 * triangle]].pos, vertices[indices[3 * triangle + 1]].pos,
+            vertices[indices[3 * triangle + 2]].pos };
+    }
+public:
+    const std::vector<Vertex>& getVertices() const { return vertices; }
+    const std::vector<unsigned int>& getIndices() const { return indices; }
+    const std::vector<Primitive>& getPrimitives() const { return primitives; }
+    const std::vector<BVHNode>& getNodes() const { return nodes; }
+    WideBVH::Ptr getWideBVH() const { return wideBVH; }
+    unsigned int getNumTriangles() const { return indices.size() / 3; }
+    unsigned int getNumItems() const { return getNumTriangles() + primitives.size(); }
+};
+
+}
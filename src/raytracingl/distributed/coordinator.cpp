@@ -0,0 +1,200 @@
+#include "coordinator.h"
+
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace rgl
+{
+
+TileCoordinator::TileCoordinator(const std::string& _socketPath)
+    : socketPath(_socketPath), listenFD(listenLocal(_socketPath)), width(0), height(0) {
+}
+
+TileCoordinator::~TileCoordinator() {
+    if(listenFD >= 0) {
+        close(listenFD);
+        unlink(socketPath.c_str());
+    }
+}
+
+void TileCoordinator::createTasks(const Settings& settings) {
+
+    tasks.clear();
+    unsigned int tileSize = std::max(settings.tileSize, 1u);
+    unsigned int samplesPerTask = std::max(settings.samplesPerTask, 1u);
+    uint64_t id = 0;
+
+    // Sample ranges outermost, so a preview of the whole frame is complete early
+    for(unsigned int first = 0; first < settings.samples; first += samplesPerTask)
+        for(int y = 0; y < height; y += tileSize)
+            for(int x = 0; x < width; x += tileSize) {
+                TileTask task;
+                task.x = x;
+                task.y = y;
+                task.width = std::min<int>(tileSize, width - x);
+                task.height = std::min<int>(tileSize, height - y);
+                task.firstSample = first;
+                task.numSamples = std::min(samplesPerTask, settings.samples - first);
+                task.imageWidth = width;
+                task.imageHeight = height;
+                task.id = id ++;
+                tasks.push_back(task);
+            }
+}
+
+bool TileCoordinator::assign(int fd) {
+
+    if(tasks.empty()) {
+        idle.push_back(fd);
+        return true;
+    }
+
+    TileTask task = tasks.front();
+    if(!sendMessage(fd, MessageType::Task, &task, sizeof(task))) return false;
+
+    tasks.pop_front();
+    assigned[fd] = task;
+    return true;
+}
+
+void TileCoordinator::merge(const TileTask& task, const float* pixels) {
+
+    float weight = static_cast<float>(task.numSamples);
+
+    for(unsigned int j = 0; j < task.height; j ++)
+        for(unsigned int i = 0; i < task.width; i ++) {
+            size_t pixel = (size_t)(task.y + j) * width + task.x + i;
+            const float* value = &pixels[4 * (j * task.width + i)];
+            for(int c = 0; c < 4; c ++) accumulation[4 * pixel + c] += value[c] * weight;
+            weights[pixel] += weight;
+        }
+}
+
+bool TileCoordinator::render(const Settings& settings) {
+
+    if(listenFD < 0) return false;
+
+    auto start = std::chrono::steady_clock::now();
+
+    width = settings.width;
+    height = settings.height;
+    accumulation.assign((size_t)width * height * 4, 0.f);
+    weights.assign((size_t)width * height, 0.f);
+    assigned.clear();
+    idle.clear();
+    stats = Stats();
+
+    createTasks(settings);
+    size_t remaining = tasks.size();
+
+    std::vector<int> workers;
+    unsigned int connected = 0;
+    std::vector<char> payload;
+
+    // A result of the largest tile
+    unsigned int tileSize = std::max(settings.tileSize, 1u);
+    size_t maxPayload = sizeof(TileTask) + (size_t)std::min<int>(tileSize, width) * std::min<int>(tileSize, height) * 4 * sizeof(float);
+
+    while(remaining > 0) {
+
+        // Nobody left to do the work
+        if(connected >= settings.numWorkers && workers.empty()) break;
+
+        std::vector<pollfd> fds;
+        if(connected < settings.numWorkers) fds.push_back({ listenFD, POLLIN, 0 });
+        for(int fd : workers) fds.push_back({ fd, POLLIN, 0 });
+
+        if(poll(fds.data(), fds.size(), -1) < 0) continue;
+
+        for(const pollfd& entry : fds) {
+
+            if(entry.revents == 0) continue;
+
+            if(entry.fd == listenFD) {
+                int fd = accept(listenFD, nullptr, nullptr);
+                if(fd >= 0) {
+                    workers.push_back(fd);
+                    connected ++;
+                }
+                continue;
+            }
+
+            MessageType type;
+            bool alive = receiveMessage(entry.fd, type, payload, maxPayload);
+
+            if(alive && type == MessageType::Result && payload.size() >= sizeof(TileTask)) {
+                TileTask task = *reinterpret_cast<const TileTask*>(payload.data());
+                auto it = assigned.find(entry.fd);
+                if(it != assigned.end() && it->second.id == task.id
+                    && payload.size() == sizeof(TileTask) + (size_t)task.width * task.height * 4 * sizeof(float)) {
+                    merge(task, reinterpret_cast<const float*>(payload.data() + sizeof(TileTask)));
+                    assigned.erase(it);
+                    stats.tasks ++;
+                    remaining --;
+                }
+            }
+
+            // Workers only send a message once they are done with their task. One still holding
+            // it sent a result that doesn't match the task or a second Hello, and is dropped
+            if(alive && type != MessageType::Hello && type != MessageType::Result) alive = false;
+            if(alive && assigned.find(entry.fd) != assigned.end()) alive = false;
+
+            if(alive) {
+                idle.erase(std::remove(idle.begin(), idle.end(), entry.fd), idle.end());
+                alive = assign(entry.fd);
+            }
+
+            // The task of a lost worker goes back to the queue
+            if(!alive) {
+                auto it = assigned.find(entry.fd);
+                if(it != assigned.end()) {
+                    tasks.push_front(it->second);
+                    assigned.erase(it);
+                    stats.requeued ++;
+                }
+                close(entry.fd);
+                workers.erase(std::find(workers.begin(), workers.end(), entry.fd));
+                idle.erase(std::remove(idle.begin(), idle.end(), entry.fd), idle.end());
+            }
+        }
+
+        // Requeued tasks go to the parked workers. One that can't be reached is dropped from
+        // the idle list, poll reports it as lost
+        while(!tasks.empty() && !idle.empty()) {
+            int fd = idle.back();
+            idle.pop_back();
+            assign(fd);
+        }
+    }
+
+    for(int fd : workers) {
+        sendMessage(fd, MessageType::Done, nullptr, 0);
+        close(fd);
+    }
+
+    stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if(remaining > 0) {
+        std::cout << "Tile coordinator: " << remaining << " tasks left without workers" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<float> TileCoordinator::getImage() const {
+
+    std::vector<float> image(accumulation.size(), 0.f);
+
+    for(size_t pixel = 0; pixel < weights.size(); pixel ++)
+        if(weights[pixel] > 0.f)
+            for(int c = 0; c < 4; c ++) image[4 * pixel + c] = accumulation[4 * pixel + c] / weights[pixel];
+
+    return image;
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/distributed/protocol.h"
+
+namespace rgl
+{
+
+// Spreads one frame across worker processes. The image is split into tiles and the samples
+// of each tile into ranges, and the tasks are handed out to the workers as they ask for work,
+// so faster workers take more of them. Results are accumulated weighted by their number of
+// samples, so the merged image is the mean over all the samples whatever the split. Tasks of
+// a worker that disconnects or sends a malformed message go back to the queue.
+class TileCoordinator {
+    GENERATE_SHARED_PTR(TileCoordinator)
+public:
+    struct Settings {
+        int width = 500, height = 500;
+        unsigned int samples = 1;           // per pixel
+        unsigned int tileSize = 64;
+        unsigned int samplesPerTask = 1;
+        unsigned int numWorkers = 1;        // connections to wait for
+    };
+
+    struct Stats {
+        unsigned long long tasks = 0;
+        unsigned long long requeued = 0;
+        double milliseconds = 0.0;
+    };
+private:
+    std::string socketPath;
+    int listenFD;
+
+    std::vector<float> accumulation;    // RGBA weighted by samples
+    std::vector<float> weights;         // samples per pixel
+    int width, height;
+
+    std::deque<TileTask> tasks;
+    std::map<int, TileTask> assigned;   // socket -> task in progress
+    std::vector<int> idle;              // sockets waiting for a requeued task
+    Stats stats;
+private:
+    void createTasks(const Settings& settings);
+    // Parks the worker if the queue is empty, Done is only sent once every task is merged
+    bool assign(int fd);
+    void merge(const TileTask& task, const float* pixels);
+public:
+    TileCoordinator(const std::string& _socketPath);
+    ~TileCoordinator();
+    TileCoordinator(const TileCoordinator& tileCoordinator) = delete;
+    TileCoordinator& operator=(const TileCoordinator& tileCoordinator) = delete;
+public:
+    // Serves the frame until every task has a result. False if the workers were lost before
+    bool render(const Settings& settings);
+
+    // Mean RGBA of each pixel, bottom row first
+    std::vector<float> getImage() const;
+public:
+    bool isListening() const { return listenFD >= 0; }
+    const std::string& getSocketPath() const { return socketPath; }
+    const std::vector<float>& getWeights() const { return weights; }
+    const Stats& getStats() const { return stats; }
+};
+
+}
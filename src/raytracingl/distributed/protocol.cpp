@@ -0,0 +1,117 @@
+#include "protocol.h"
+
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace rgl
+{
+
+bool sendAll(int fd, const void* data, size_t size) {
+
+    const char* bytes = static_cast<const char*>(data);
+
+    while(size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR) continue;
+        if(sent <= 0) return false;
+        bytes += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+static bool receiveAll(int fd, void* data, size_t size) {
+
+    char* bytes = static_cast<char*>(data);
+
+    while(size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if(received < 0 && errno == EINTR) continue;
+        if(received <= 0) return false;
+        bytes += received;
+        size -= received;
+    }
+
+    return true;
+}
+
+bool sendMessage(int fd, MessageType type, const void* data, size_t size) {
+    return sendMessage(fd, type, data, size, nullptr, 0);
+}
+
+bool sendMessage(int fd, MessageType type, const void* header, size_t headerSize, const void* data, size_t size) {
+    MessageHeader messageHeader = { static_cast<uint32_t>(type), static_cast<uint32_t>(headerSize + size) };
+    return sendAll(fd, &messageHeader, sizeof(messageHeader))
+        && (headerSize == 0 || sendAll(fd, header, headerSize))
+        && (size == 0 || sendAll(fd, data, size));
+}
+
+bool receiveMessage(int fd, MessageType& type, std::vector<char>& payload, size_t maxSize) {
+
+    MessageHeader header;
+    if(!receiveAll(fd, &header, sizeof(header))) return false;
+
+    if(header.size > maxSize) {
+        std::cout << "Message of " << header.size << " bytes, at most " << maxSize << " expected" << std::endl;
+        return false;
+    }
+
+    type = static_cast<MessageType>(header.type);
+    payload.resize(header.size);
+
+    return header.size == 0 || receiveAll(fd, payload.data(), header.size);
+}
+
+static bool localAddress(const std::string& path, sockaddr_un& address) {
+
+    if(path.size() >= sizeof(address.sun_path)) {
+        std::cout << "Socket path too long: " << path << std::endl;
+        return false;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+int listenLocal(const std::string& path) {
+
+    sockaddr_un address;
+    if(!localAddress(path, address)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+
+    unlink(path.c_str());
+    if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        std::cout << "Couldn't listen on " << path << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int connectLocal(const std::string& path) {
+
+    sockaddr_un address;
+    if(!localAddress(path, address)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+
+    if(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace rgl
+{
+
+// Messages between a TileCoordinator and its TileWorkers. Each one is a MessageHeader
+// followed by size bytes of payload. Everything is sent as it is laid out in memory, so
+// machines talking to each other must share the endianness. Only the connection setup
+// depends on the kind of stream socket, local Unix sockets for now.
+enum class MessageType : uint32_t {
+    Hello = 1,      // worker -> coordinator, ready for work
+    Task = 2,       // coordinator -> worker, a TileTask
+    Result = 3,     // worker -> coordinator, the TileTask and its RGBA pixels
+    Done = 4        // coordinator -> worker, no more work
+};
+
+struct MessageHeader {
+    uint32_t type;
+    uint32_t size;
+};
+
+// Samples [firstSample, firstSample + numSamples) of a tile. The result of a task is the
+// mean of those samples for each pixel of the tile, rows from y upwards
+struct TileTask {
+    uint32_t x, y, width, height;
+    uint32_t firstSample, numSamples;
+    uint32_t imageWidth, imageHeight;
+    uint64_t id;
+};
+
+// Blocking, they return false when the connection is lost. receiveMessage also fails on
+// payloads larger than maxSize without reading them, the connection has to be closed then
+bool sendMessage(int fd, MessageType type, const void* data, size_t size);
+bool sendMessage(int fd, MessageType type, const void* header, size_t headerSize, const void* data, size_t size);
+bool receiveMessage(int fd, MessageType& type, std::vector<char>& payload, size_t maxSize);
+// Raw bytes, retried on interrupts and short writes
+bool sendAll(int fd, const void* data, size_t size);
+
+// Unix socket at path, -1 on error. listenLocal replaces an existing socket file
+int listenLocal(const std::string& path);
+int connectLocal(const std::string& path);
+
+}
@@ -0,0 +1,54 @@
+#include "worker.h"
+
+#include <chrono>
+#include <thread>
+
+#include <unistd.h>
+
+namespace rgl
+{
+
+long long TileWorker::run(const std::string& socketPath, const RenderFunction& render, int connectAttempts) {
+
+    // The coordinator may not be listening yet
+    int fd = connectLocal(socketPath);
+    for(int attempt = 1; fd < 0 && attempt < connectAttempts; attempt ++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        fd = connectLocal(socketPath);
+    }
+
+    if(fd < 0) {
+        std::cout << "Tile worker: couldn't connect to " << socketPath << std::endl;
+        return -1;
+    }
+
+    long long rendered = 0;
+    std::vector<char> payload;
+    std::vector<float> pixels;
+
+    bool alive = sendMessage(fd, MessageType::Hello, nullptr, 0);
+
+    while(alive) {
+
+        MessageType type;
+        if(!receiveMessage(fd, type, payload, sizeof(TileTask))) {
+            alive = false;
+            break;
+        }
+
+        if(type == MessageType::Done) break;
+        if(type != MessageType::Task || payload.size() != sizeof(TileTask)) continue;
+
+        TileTask task = *reinterpret_cast<const TileTask*>(payload.data());
+        pixels.assign((size_t)task.width * task.height * 4, 0.f);
+        render(task, pixels);
+
+        alive = sendMessage(fd, MessageType::Result, &task, sizeof(task), pixels.data(), pixels.size() * sizeof(float));
+        rendered ++;
+    }
+
+    close(fd);
+    return alive ? rendered : -1;
+}
+
+}
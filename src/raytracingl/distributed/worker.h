@@ -0,0 +1,25 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "raytracingl/distributed/protocol.h"
+
+namespace rgl
+{
+
+// Worker side of a TileCoordinator. The render function fills the mean RGBA of the samples
+// of the task for each pixel of the tile, width * height * 4 floats, rows from task.y upwards.
+// The backend is up to the caller: a GL context of its own, or a CPUTracer.
+class TileWorker {
+public:
+    using RenderFunction = std::function<void(const TileTask& task, std::vector<float>& pixels)>;
+public:
+    // Connects to the coordinator and renders tasks until it is done. Returns the number of
+    // tasks rendered, -1 if the coordinator couldn't be reached or was lost
+    static long long run(const std::string& socketPath, const RenderFunction& render, int connectAttempts = 50);
+};
+
+}
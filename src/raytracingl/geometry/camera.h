@@ -0,0 +1,34 @@
+#pragma once
+
+#include <iostream>
+
+#include <glm/vec3.hpp>
+
+#include "raytracingl/ptr.h"
+
+#define VIEW_CAMERAS_BINDING_POINT 12
+
+namespace rgl
+{
+
+// Camera of one view of the MULTI_VIEW variant of compute.glsl, the same parameters as its
+// cameraPosition, cameraTarget and cameraFov uniforms
+struct alignas(16) ViewCamera {
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, THERE WILL BE A MEMORY ALIGNMENT ISSUE
+    // AND IT WILL NOT MATCH THE VIEW CAMERA STRUCTURE OF THE COMPUTE SHADER
+    glm::vec3 position;
+    float fov;          // vertical, in degrees
+
+    glm::vec3 target;
+    float padding;
+
+    ViewCamera(const glm::vec3& _position, const glm::vec3& _target, float _fov = 45.f)
+        : position(_position), fov(_fov), target(_target), padding(0.f) {
+    }
+
+    ViewCamera() : position(0.f, 0.f, 2.f), fov(45.f), target(0.f), padding(0.f) {}
+    ~ViewCamera() = default;
+};
+
+}
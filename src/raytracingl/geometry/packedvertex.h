@@ -0,0 +1,156 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/span.h"
+#include "raytracingl/geometry/vertex.h"
+
+namespace rgl
+{
+
+// Layout of the vertex buffer at binding 0, chosen per scene when it is uploaded and given
+// to the shaders through the vertexFormat uniform
+enum class VertexFormat {
+    Full = 0,       // Vertex, 96 bytes
+    Packed = 1      // PackedVertex, 16 bytes
+};
+
+// Maps the 16 bit positions of a packed mesh to object space: origin + q * scale
+struct VertexQuantization {
+
+    glm::vec3 origin = glm::vec3(0.f);
+    glm::vec3 scale = glm::vec3(1.f);
+
+    // Bounds of the positions split in 65535 steps per axis
+    static VertexQuantization fromVertices(Span<const Vertex> vertices) {
+
+        VertexQuantization quantization;
+        if(vertices.empty()) return quantization;
+
+        glm::vec3 aabbMin(vertices[0].pos), aabbMax(vertices[0].pos);
+        for(const Vertex& vertex : vertices) {
+            aabbMin = glm::min(aabbMin, vertex.pos);
+            aabbMax = glm::max(aabbMax, vertex.pos);
+        }
+
+        quantization.origin = aabbMin;
+        quantization.scale = (aabbMax - aabbMin) / 65535.f;
+        return quantization;
+    }
+};
+
+// Vertex in 16 bytes: position quantized to 16 bits per axis in the bounds of the mesh,
+// RGB565 color, octahedral normal in two 16 bit snorms and half float UVs. Tangents are not
+// stored, triangleTangents() rebuilds them from the positions and UVs. The decode functions
+// match the ones of the compute shaders bit for bit.
+struct alignas(16) PackedVertex {
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, THERE WILL BE A MEMORY ALIGNMENT ISSUE
+    // AND IT WILL NOT MATCH THE PACKED VERTEX DECODING OF THE COMPUTE SHADER
+    uint32_t positionXY;        // x | y << 16
+    uint32_t positionZColor;    // z | RGB565 << 16
+    uint32_t normal;            // packSnorm2x16 of the octahedral coordinates
+    uint32_t uv;                // packHalf2x16
+
+    PackedVertex(const Vertex& vertex, const VertexQuantization& quantization) {
+
+        glm::vec3 q = (vertex.pos - quantization.origin) / glm::max(quantization.scale, glm::vec3(1e-30f));
+        uint32_t x = quantize(q.x, 65535.f), y = quantize(q.y, 65535.f), z = quantize(q.z, 65535.f);
+
+        uint32_t r = quantize(vertex.color.r * 31.f, 31.f);
+        uint32_t g = quantize(vertex.color.g * 63.f, 63.f);
+        uint32_t b = quantize(vertex.color.b * 31.f, 31.f);
+
+        positionXY = x | (y << 16);
+        positionZColor = z | (((r << 11) | (g << 5) | b) << 16);
+        normal = encodeOctahedral(vertex.normal);
+        uv = glm::packHalf2x16(vertex.uv);
+    }
+
+    PackedVertex() = default;
+    ~PackedVertex() = default;
+
+    glm::vec3 getPosition(const VertexQuantization& quantization) const {
+        glm::vec3 q(float(positionXY & 0xFFFFu), float(positionXY >> 16), float(positionZColor & 0xFFFFu));
+        return quantization.origin + q * quantization.scale;
+    }
+
+    glm::vec3 getColor() const {
+        uint32_t color = positionZColor >> 16;
+        return glm::vec3(float(color >> 11) / 31.f, float((color >> 5) & 63u) / 63.f, float(color & 31u) / 31.f);
+    }
+
+    glm::vec3 getNormal() const { return decodeOctahedral(normal); }
+    glm::vec2 getUV() const { return glm::unpackHalf2x16(uv); }
+
+    Vertex unpack(const VertexQuantization& quantization) const {
+        return Vertex(getPosition(quantization), getColor(), getNormal(), getUV());
+    }
+
+    static uint32_t quantize(float value, float maximum) {
+        return (uint32_t)std::clamp(std::round(value), 0.f, maximum);
+    }
+
+    // Unit vector folded onto the octahedron and unfolded into [-1, 1]^2. A zero normal
+    // decodes to +z
+    static uint32_t encodeOctahedral(const glm::vec3& n) {
+
+        float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if(l1 <= 0.f) return 0u;
+
+        glm::vec2 p(n.x / l1, n.y / l1);
+        if(n.z < 0.f) {
+            glm::vec2 folded((1.f - std::abs(p.y)) * (p.x >= 0.f ? 1.f : -1.f),
+                (1.f - std::abs(p.x)) * (p.y >= 0.f ? 1.f : -1.f));
+            p = folded;
+        }
+
+        return glm::packSnorm2x16(p);
+    }
+
+    static glm::vec3 decodeOctahedral(uint32_t encoded) {
+        glm::vec2 f = glm::unpackSnorm2x16(encoded);
+        glm::vec3 n(f.x, f.y, 1.f - std::abs(f.x) - std::abs(f.y));
+        float t = std::max(-n.z, 0.f);
+        n.x += n.x >= 0.f ? -t : t;
+        n.y += n.y >= 0.f ? -t : t;
+        return glm::normalize(n);
+    }
+};
+
+inline std::vector<PackedVertex> packVertices(Span<const Vertex> vertices, const VertexQuantization& quantization) {
+    std::vector<PackedVertex> packed;
+    packed.reserve(vertices.size());
+    for(const Vertex& vertex : vertices) packed.push_back(PackedVertex(vertex, quantization));
+    return packed;
+}
+
+// Tangent frame of a triangle from its positions and UVs, the same for its three vertices
+inline void triangleTangents(const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& v3,
+    const glm::vec2& uv1, const glm::vec2& uv2, const glm::vec2& uv3, glm::vec3& tangent, glm::vec3& bitangent) {
+
+    glm::vec3 e1 = v2 - v1, e2 = v3 - v1;
+    glm::vec2 d1 = uv2 - uv1, d2 = uv3 - uv1;
+
+    float determinant = d1.x * d2.y - d2.x * d1.y;
+    if(std::abs(determinant) < 1e-12f) {
+        tangent = bitangent = glm::vec3(0.f);
+        return;
+    }
+
+    float invDeterminant = 1.f / determinant;
+    tangent = (e1 * d2.y - e2 * d1.y) * invDeterminant;
+    bitangent = (e2 * d1.x - e1 * d2.x) * invDeterminant;
+}
+
+}
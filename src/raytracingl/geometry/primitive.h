@@ -0,0 +1,206 @@
+#pragma once
+
+#include <iostream>
+#include <cmath>
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/geometry/ray.h"
+
+#define PRIMITIVES_BINDING_POINT 4
+
+namespace rgl
+{
+
+// Analytic primitive traced without tessellation. BVH leaves reference primitives
+// after the triangles: item = number of triangles + primitive index.
+struct alignas(16) Primitive {
+
+    enum Type {
+        Sphere = 0,     // position = center, parameters.x = radius
+        Box = 1,        // position = min corner, parameters = max corner
+        Disc = 2        // position = center, parameters = normal * radius
+    };
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, THERE WILL BE A MEMORY ALIGNMENT ISSUE
+    // AND IT WILL NOT MATCH THE PRIMITIVE STRUCTURE OF THE COMPUTE SHADER
+    glm::vec3 position;
+    int type;
+
+    glm::vec3 parameters;
+    int material;
+
+    Primitive(const glm::vec3& _position, int _type, const glm::vec3& _parameters, int _material)
+        : position(_position), type(_type), parameters(_parameters), material(_material) {
+    }
+
+    Primitive() = default;
+    ~Primitive() = default;
+
+    static Primitive sphere(const glm::vec3& center, float radius, int material = 0) {
+        return Primitive(center, Sphere, glm::vec3(radius, 0.f, 0.f), material);
+    }
+
+    static Primitive box(const glm::vec3& aabbMin, const glm::vec3& aabbMax, int material = 0) {
+        return Primitive(aabbMin, Box, aabbMax, material);
+    }
+
+    static Primitive disc(const glm::vec3& center, const glm::vec3& normal, float radius, int material = 0) {
+        return Primitive(center, Disc, glm::normalize(normal) * radius, material);
+    }
+
+    void getBounds(glm::vec3& aabbMin, glm::vec3& aabbMax) const {
+        switch(type) {
+        case Sphere:
+            aabbMin = position - glm::vec3(parameters.x);
+            aabbMax = position + glm::vec3(parameters.x);
+            break;
+        case Box:
+            aabbMin = position;
+            aabbMax = parameters;
+            break;
+        default: {
+            // Disc extent along each axis is radius * sqrt(1 - normal_axis^2)
+            float radius = glm::length(parameters);
+            glm::vec3 normal = parameters / radius;
+            glm::vec3 extent = radius * glm::sqrt(glm::max(glm::vec3(1.f) - normal * normal, glm::vec3(0.f)));
+            aabbMin = position - extent;
+            aabbMax = position + extent;
+            break;
+        }
+        }
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const Primitive& primitive) {
+        os << "Primitive = [" << primitive.type << ",";
+        os << "(" << primitive.position.x << "," << primitive.position.y << "," << primitive.position.z << "),";
+        os << "(" << primitive.parameters.x << "," << primitive.parameters.y << "," << primitive.parameters.z << "),";
+        os << primitive.material << "]";
+        return os;
+    }
+};
+
+// Only the distance, -1 if there is no hit. Same hits as intersectionPrimitive
+inline float distancePrimitive(const Ray& ray, const Primitive& primitive) {
+
+    const float epsilon = 0.0000001f;
+
+    switch(primitive.type) {
+    case Primitive::Sphere: {
+
+        glm::vec3 oc = ray.origin - primitive.position;
+        float a = glm::dot(ray.direction, ray.direction);
+        float b = 2.f * glm::dot(oc, ray.direction);
+        float c = glm::dot(oc, oc) - primitive.parameters.x * primitive.parameters.x;
+
+        float nabla = b * b - 4.f * a * c;
+        if(nabla <= 0.f) return -1.f;
+
+        float lambda = (-b - std::sqrt(nabla)) / (2.f * a);
+        return lambda > 0.f ? lambda : -1.f;
+    }
+    case Primitive::Box: {
+
+        glm::vec3 invDirection = 1.f / ray.direction;
+        glm::vec3 t1 = (primitive.position - ray.origin) * invDirection;
+        glm::vec3 t2 = (primitive.parameters - ray.origin) * invDirection;
+        glm::vec3 tmin = glm::min(t1, t2), tmax = glm::max(t1, t2);
+
+        float tnear = std::max(std::max(tmin.x, tmin.y), tmin.z);
+        float tfar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+        if(tfar < tnear || tfar <= epsilon) return -1.f;
+
+        return tnear > epsilon ? tnear : tfar;
+    }
+    default: {
+
+        float radius2 = glm::dot(primitive.parameters, primitive.parameters);
+        glm::vec3 normal = primitive.parameters / std::sqrt(radius2);
+
+        float denom = glm::dot(ray.direction, normal);
+        if(denom > -epsilon && denom < epsilon) return -1.f;
+
+        float lambda = glm::dot(primitive.position - ray.origin, normal) / denom;
+        if(lambda <= epsilon) return -1.f;
+
+        glm::vec3 offset = ray.origin + lambda * ray.direction - primitive.position;
+        return glm::dot(offset, offset) <= radius2 ? lambda : -1.f;
+    }
+    }
+}
+
+// The normals follow the convention of the triangles in compute.glsl
+inline HitInfo intersectionPrimitive(const Ray& ray, const Primitive& primitive) {
+
+    const float epsilon = 0.0000001f;
+    HitInfo hitInfo;
+
+    switch(primitive.type) {
+    case Primitive::Sphere: {
+
+        glm::vec3 oc = ray.origin - primitive.position;
+        float a = glm::dot(ray.direction, ray.direction);
+        float b = 2.f * glm::dot(oc, ray.direction);
+        float c = glm::dot(oc, oc) - primitive.parameters.x * primitive.parameters.x;
+
+        float nabla = b * b - 4.f * a * c;
+        if(nabla <= 0.f) return hitInfo;
+
+        float lambda = (-b - std::sqrt(nabla)) / (2.f * a);
+        if(lambda <= 0.f) return hitInfo;
+
+        hitInfo.intersection = ray.origin + lambda * ray.direction;
+        hitInfo.normal = glm::normalize(primitive.position - hitInfo.intersection);
+        hitInfo.dist = lambda;
+        break;
+    }
+    case Primitive::Box: {
+
+        glm::vec3 invDirection = 1.f / ray.direction;
+        glm::vec3 t1 = (primitive.position - ray.origin) * invDirection;
+        glm::vec3 t2 = (primitive.parameters - ray.origin) * invDirection;
+        glm::vec3 tmin = glm::min(t1, t2), tmax = glm::max(t1, t2);
+
+        float tnear = std::max(std::max(tmin.x, tmin.y), tmin.z);
+        float tfar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+        if(tfar < tnear || tfar <= epsilon) return hitInfo;
+
+        float lambda = tnear > epsilon ? tnear : tfar;
+        int axis = lambda == tmin.x || lambda == tmax.x ? 0 : (lambda == tmin.y || lambda == tmax.y ? 1 : 2);
+
+        hitInfo.intersection = ray.origin + lambda * ray.direction;
+        hitInfo.normal = glm::vec3(0.f);
+        hitInfo.normal[axis] = ray.direction[axis] > 0.f ? 1.f : -1.f;
+        hitInfo.dist = lambda;
+        break;
+    }
+    default: {
+
+        float radius2 = glm::dot(primitive.parameters, primitive.parameters);
+        glm::vec3 normal = primitive.parameters / std::sqrt(radius2);
+
+        float denom = glm::dot(ray.direction, normal);
+        if(denom > -epsilon && denom < epsilon) return hitInfo;
+
+        float lambda = glm::dot(primitive.position - ray.origin, normal) / denom;
+        if(lambda <= epsilon) return hitInfo;
+
+        glm::vec3 intersection = ray.origin + lambda * ray.direction;
+        glm::vec3 offset = intersection - primitive.position;
+        if(glm::dot(offset, offset) > radius2) return hitInfo;
+
+        hitInfo.intersection = intersection;
+        hitInfo.normal = denom > 0.f ? normal : -normal;
+        hitInfo.dist = lambda;
+        break;
+    }
+    }
+
+    hitInfo.hit = true;
+    hitInfo.material = primitive.material;
+    return hitInfo;
+}
+
+}
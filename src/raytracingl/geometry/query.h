@@ -0,0 +1,54 @@
+#pragma once
+
+#include <iostream>
+
+#include <glm/vec3.hpp>
+
+#include "raytracingl/ptr.h"
+
+#define RAY_QUERY_RAYS_BINDING_POINT 13
+#define RAY_QUERY_HITS_BINDING_POINT 14
+#define RAY_QUERY_OCCLUSION_BINDING_POINT 15
+
+namespace rgl
+{
+
+// Ray of a RayQuery, in the object space of the mesh. Hits are searched in (tmin, tmax), the
+// distances are along the direction, which doesn't need to be normalized
+struct alignas(16) QueryRay {
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, THERE WILL BE A MEMORY ALIGNMENT ISSUE
+    // AND IT WILL NOT MATCH THE QUERY RAY STRUCTURE OF THE COMPUTE SHADER
+    glm::vec3 origin;
+    float tmin;
+
+    glm::vec3 direction;
+    float tmax;
+
+    QueryRay(const glm::vec3& _origin, const glm::vec3& _direction, float _tmin = 0.f, float _tmax = 999999.f)
+        : origin(_origin), tmin(_tmin), direction(_direction), tmax(_tmax) {
+    }
+
+    QueryRay() : origin(0.f), tmin(0.f), direction(0.f, 0.f, 1.f), tmax(999999.f) {}
+    ~QueryRay() = default;
+};
+
+// Closest hit of a QueryRay, triangle and primitive are -1 if there is none
+struct alignas(16) QueryHit {
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, THERE WILL BE A MEMORY ALIGNMENT ISSUE
+    // AND IT WILL NOT MATCH THE QUERY HIT STRUCTURE OF THE COMPUTE SHADER
+    glm::vec3 normal;   // geometric, object space
+    float dist;         // from the origin, not from tmin
+
+    int triangle;
+    int primitive;
+    int padding[2];
+
+    QueryHit() : normal(0.f), dist(999999.f), triangle(-1), primitive(-1), padding{0, 0} {}
+    ~QueryHit() = default;
+
+    bool hit() const { return triangle >= 0 || primitive >= 0; }
+};
+
+}
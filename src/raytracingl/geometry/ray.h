@@ -0,0 +1,100 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include "raytracingl/ptr.h"
+
+namespace rgl
+{
+
+// Host side counterparts of the structures and intersection routines of compute.glsl
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+
+    Ray(const glm::vec3& _origin, const glm::vec3& _direction)
+        : origin(_origin), direction(_direction) {
+    }
+
+    Ray() = default;
+    ~Ray() = default;
+};
+
+struct Triangle {
+    glm::vec3 v1;
+    glm::vec3 v2;
+    glm::vec3 v3;
+};
+
+struct HitInfo {
+    glm::vec3 intersection = glm::vec3(0.f);
+    glm::vec3 normal = glm::vec3(0.f);
+    float dist = 999999.f;
+    bool hit = false;
+    int triangle = -1;
+    int primitive = -1;
+    int material = -1;
+};
+
+// Möller–Trumbore ray-triangle intersection algorithm. Only the distance, -1 if there is no hit
+inline float distanceTriangle(const Ray& ray, const Triangle& triangle) {
+
+    const float epsilon = 0.0000001f;
+
+    glm::vec3 edge1 = triangle.v2 - triangle.v1;
+    glm::vec3 edge2 = triangle.v3 - triangle.v1;
+    glm::vec3 ray_cross_e2 = glm::cross(ray.direction, edge2);
+
+    float det = glm::dot(edge1, ray_cross_e2);
+    if (det > -epsilon && det < epsilon) return -1.f;
+
+    float inv_det = 1.f / det;
+    glm::vec3 s = ray.origin - triangle.v1;
+
+    float u = inv_det * glm::dot(s, ray_cross_e2);
+    if (u < 0 || u > 1) return -1.f;
+
+    glm::vec3 s_cross_e1 = glm::cross(s, edge1);
+    float v = inv_det * glm::dot(ray.direction, s_cross_e1);
+    if (v < 0 || u + v > 1) return -1.f;
+
+    float t = inv_det * glm::dot(edge2, s_cross_e1);
+    return t > epsilon ? t : -1.f;
+}
+
+inline HitInfo intersectionTriangle(const Ray& ray, const Triangle& triangle) {
+
+    HitInfo hitInfo;
+
+    float t = distanceTriangle(ray, triangle);
+    if (t > 0.f) {
+        hitInfo.intersection = ray.origin + ray.direction * t;
+        hitInfo.dist = t;
+        hitInfo.normal = glm::normalize(glm::cross(triangle.v3 - triangle.v1, triangle.v2 - triangle.v1));
+        hitInfo.hit = true;
+    }
+
+    return hitInfo;
+}
+
+// Slab test, returns the entry distance or -1 if the box is missed or farther than maxDist
+inline float intersectionAABB(const glm::vec3& origin, const glm::vec3& invDirection,
+    const glm::vec3& aabbMin, const glm::vec3& aabbMax, float maxDist) {
+
+    glm::vec3 t1 = (aabbMin - origin) * invDirection;
+    glm::vec3 t2 = (aabbMax - origin) * invDirection;
+    glm::vec3 tmin = glm::min(t1, t2);
+    glm::vec3 tmax = glm::max(t1, t2);
+
+    float tnear = std::max(std::max(tmin.x, tmin.y), tmin.z);
+    float tfar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+
+    return (tfar >= std::max(tnear, 0.f) && tnear < maxDist) ? std::max(tnear, 0.f) : -1.f;
+}
+
+}
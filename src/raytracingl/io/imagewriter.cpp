@@ -0,0 +1,144 @@
+#include "imagewriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include "raytracingl/vendor/stb_image_write.h"
+
+namespace rgl
+{
+
+ImageSequenceWriter::ImageSequenceWriter(const std::string& _pathPrefix, Format _format, unsigned int numThreads, size_t _capacity)
+    : pathPrefix(_pathPrefix), format(_format), capacity(std::max<size_t>(_capacity, 1)),
+    active(0), stopping(false), written(0), failed(0) {
+
+    for(unsigned int i = 0; i < std::max(numThreads, 1u); i ++)
+        workers.emplace_back(&ImageSequenceWriter::work, this);
+}
+
+ImageSequenceWriter::~ImageSequenceWriter() {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    notEmpty.notify_all();
+
+    // Workers drain the queue before leaving
+    for(std::thread& worker : workers) worker.join();
+}
+
+void ImageSequenceWriter::push(FrameImage&& image) {
+
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return queue.size() < capacity; });
+
+    queue.push_back(std::move(image));
+    lock.unlock();
+    notEmpty.notify_one();
+}
+
+void ImageSequenceWriter::finish() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return queue.empty() && active == 0; });
+}
+
+void ImageSequenceWriter::work() {
+
+    while(true) {
+
+        FrameImage image;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this] { return !queue.empty() || stopping; });
+            if(queue.empty()) return;
+
+            image = std::move(queue.front());
+            queue.pop_front();
+            active ++;
+        }
+        notFull.notify_one();
+
+        bool success = writeImage(getPath(image.index), format, image);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active --;
+            if(success) written ++;
+            else failed ++;
+        }
+        idle.notify_all();
+    }
+}
+
+bool ImageSequenceWriter::writeImage(const std::string& path, Format format, FrameImage& image) {
+
+    int width = image.width, height = image.height;
+
+    // Top row first for the file formats
+    for(int y = 0; y < height / 2; y ++)
+        std::swap_ranges(image.pixels.begin() + 4 * y * width, image.pixels.begin() + 4 * (y + 1) * width,
+            image.pixels.begin() + 4 * (height - 1 - y) * width);
+
+    bool success = false;
+
+    if(format == Format::PNG) {
+        std::vector<unsigned char> bytes(image.pixels.size());
+        for(size_t i = 0; i < bytes.size(); i ++) {
+            float value = std::clamp(image.pixels[i], 0.f, 1.f);
+            if(i % 4 != 3) value = std::pow(value, 1.f / 2.2f);
+            bytes[i] = (unsigned char)(value * 255.f + 0.5f);
+        }
+        success = stbi_write_png(path.c_str(), width, height, 4, bytes.data(), 4 * width) != 0;
+    }
+    else if(format == Format::HDR) {
+        success = stbi_write_hdr(path.c_str(), width, height, 4, image.pixels.data()) != 0;
+    }
+    else {
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if(file != nullptr) {
+            success = std::fwrite(image.pixels.data(), sizeof(float), image.pixels.size(), file) == image.pixels.size();
+            success = std::fclose(file) == 0 && success;
+        }
+    }
+
+    if(!success) std::cout << "Couldn't write the frame " << path << std::endl;
+    return success;
+}
+
+std::string ImageSequenceWriter::getPath(unsigned long long index) const {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%05llu", index);
+    return pathPrefix + number + "." + getExtension(format);
+}
+
+const char* ImageSequenceWriter::getExtension(Format format) {
+    switch(format) {
+        case Format::PNG: return "png";
+        case Format::HDR: return "hdr";
+        default: return "raw";
+    }
+}
+
+ImageSequenceWriter::Format ImageSequenceWriter::formatFromPath(const std::string& path) {
+
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if(extension == "png") return Format::PNG;
+    if(extension == "hdr") return Format::HDR;
+    return Format::Raw;
+}
+
+unsigned long long ImageSequenceWriter::getWritten() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return written;
+}
+
+unsigned long long ImageSequenceWriter::getFailed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "raytracingl/ptr.h"
+
+namespace rgl
+{
+
+// RGBA float pixels as read from an output image, bottom row first like OpenGL
+struct FrameImage {
+    std::vector<float> pixels;
+    int width = 0, height = 0;
+    unsigned long long index = 0;
+};
+
+// Writes an image sequence from a pool of encoder threads. push() only copies the frame into
+// a bounded queue, so the render thread only waits when the encoders fall behind by more
+// than the queue capacity. Frames are written as <prefix><index padded to 5 digits>.<ext>:
+// PNG (clamped and gamma corrected), HDR (Radiance RGBE) or raw (width * height RGBA floats,
+// top row first).
+class ImageSequenceWriter {
+    GENERATE_SHARED_PTR(ImageSequenceWriter)
+public:
+    enum class Format { PNG, HDR, Raw };
+private:
+    std::string pathPrefix;
+    Format format;
+    size_t capacity;
+
+    std::deque<FrameImage> queue;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable notEmpty, notFull, idle;
+    unsigned int active;        // frames being encoded
+    bool stopping;
+
+    unsigned long long written, failed;
+private:
+    void work();
+public:
+    ImageSequenceWriter(const std::string& _pathPrefix, Format _format, unsigned int numThreads = 2, size_t _capacity = 8);
+    ~ImageSequenceWriter();
+    ImageSequenceWriter(const ImageSequenceWriter& imageSequenceWriter) = delete;
+    ImageSequenceWriter& operator=(const ImageSequenceWriter& imageSequenceWriter) = delete;
+public:
+    // Blocks while the queue is full
+    void push(FrameImage&& image);
+    // Waits until every pushed frame is on disk
+    void finish();
+
+    std::string getPath(unsigned long long index) const;
+    static const char* getExtension(Format format);
+    // Format of a path from its extension, raw if it is neither .png nor .hdr
+    static Format formatFromPath(const std::string& path);
+
+    // Synchronous write of one frame, flips it in place to top row first
+    static bool writeImage(const std::string& path, Format format, FrameImage& image);
+public:
+    Format getFormat() const { return format; }
+    unsigned long long getWritten();
+    unsigned long long getFailed();
+};
+
+}
@@ -0,0 +1,245 @@
+#include "meshloader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include "raytracingl/vendor/tiny_gltf.h"
+
+namespace rgl
+{
+
+////////////////////
+//  GeometryHash  //
+////////////////////
+
+void GeometryHash::add(uint64_t& value, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for(size_t i = 0; i < size; i ++) {
+        value ^= bytes[i];
+        value *= 1099511628211ull;
+    }
+}
+
+void GeometryHash::add(const Vertex& vertex) {
+    add(vertices, &vertex.pos, sizeof(glm::vec3));
+    add(vertices, &vertex.color, sizeof(glm::vec3));
+    add(vertices, &vertex.normal, sizeof(glm::vec3));
+    add(vertices, &vertex.uv, sizeof(glm::vec2));
+}
+
+std::string GeometryHash::toString() const {
+
+    uint64_t value = vertices;
+    add(value, &indices, sizeof(uint64_t));
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)value);
+    return hex;
+}
+
+////////////////
+//  GLTFMesh  //
+////////////////
+
+// Component c of an accessor element as a float
+static float component(const unsigned char* data, int componentType, bool normalized, int c) {
+
+    switch(componentType) {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+        float value;
+        std::memcpy(&value, data + c * sizeof(float), sizeof(float));
+        return value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+        float value = data[c];
+        return normalized ? value / 255.f : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_BYTE: {
+        float value = static_cast<int8_t>(data[c]);
+        return normalized ? std::max(value / 127.f, -1.f) : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        uint16_t value;
+        std::memcpy(&value, data + c * sizeof(uint16_t), sizeof(uint16_t));
+        return normalized ? value / 65535.f : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_SHORT: {
+        int16_t value;
+        std::memcpy(&value, data + c * sizeof(int16_t), sizeof(int16_t));
+        return normalized ? std::max(value / 32767.f, -1.f) : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+        uint32_t value;
+        std::memcpy(&value, data + c * sizeof(uint32_t), sizeof(uint32_t));
+        return static_cast<float>(value);
+    }
+    }
+
+    return 0.f;
+}
+
+// The accessor has at least minComponents per element and all its elements lie within its buffer
+// view and buffer. An attribute without a buffer view reads as missing
+static bool validAccessor(const tinygltf::Model& model, int index, int minComponents, bool attribute) {
+
+    if(index < 0 || index >= (int)model.accessors.size()) return false;
+    const tinygltf::Accessor& accessor = model.accessors[index];
+    if(accessor.bufferView < 0) return attribute;
+    if(accessor.bufferView >= (int)model.bufferViews.size()) return false;
+
+    const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+    if(view.buffer < 0 || view.buffer >= (int)model.buffers.size()) return false;
+    size_t bufferSize = model.buffers[view.buffer].data.size();
+    if(view.byteOffset > bufferSize || view.byteLength > bufferSize - view.byteOffset) return false;
+
+    int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    int components = tinygltf::GetNumComponentsInType(accessor.type);
+    int stride = accessor.ByteStride(view);
+    if(componentSize <= 0 || components < minComponents || stride <= 0) return false;
+    if(accessor.count == 0) return true;
+
+    // byteOffset + (count - 1) * stride + elementSize <= byteLength, without overflowing
+    size_t elementSize = (size_t)componentSize * components;
+    if(accessor.byteOffset > view.byteLength || elementSize > view.byteLength - accessor.byteOffset) return false;
+    return accessor.count - 1 <= (view.byteLength - accessor.byteOffset - elementSize) / stride;
+}
+
+static bool validPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive) {
+
+    // Strips, fans, lines and points would be misread as triangle lists
+    if(primitive.mode != TINYGLTF_MODE_TRIANGLES && primitive.mode != -1) return false;
+
+    const int minComponents[] = { 3, 3, 3, 2 };
+    const char* names[] = { "POSITION", "NORMAL", "COLOR_0", "TEXCOORD_0" };
+    for(int i = 0; i < 4; i ++) {
+        auto it = primitive.attributes.find(names[i]);
+        if(it != primitive.attributes.end() && !validAccessor(model, it->second, minComponents[i], true)) return false;
+    }
+
+    if(!validAccessor(model, primitive.indices, 1, false)) return false;
+    const tinygltf::Accessor& indices = model.accessors[primitive.indices];
+    return indices.type == TINYGLTF_TYPE_SCALAR && indices.count % 3 == 0
+        && (indices.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE || indices.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT
+        || indices.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT);
+}
+
+GLTFMesh::GLTFMesh(std::unique_ptr<tinygltf::Model> _model)
+    : model(std::move(_model)), numVertices(0), numIndices(0) {
+
+    for(const tinygltf::Mesh& mesh : model->meshes) {
+        for(const tinygltf::Primitive& primitive : mesh.primitives) {
+            auto position = primitive.attributes.find("POSITION");
+            if(position == primitive.attributes.end() || primitive.indices < 0) continue;
+            // Out of range accessors are rejected by read
+            if(position->second < 0 || position->second >= (int)model->accessors.size() || primitive.indices >= (int)model->accessors.size()) continue;
+            numVertices += model->accessors[position->second].count;
+            numIndices += model->accessors[primitive.indices].count;
+        }
+    }
+}
+
+GLTFMesh::~GLTFMesh() = default;
+
+GLTFMesh::Ptr GLTFMesh::fromFile(const std::string& path) {
+
+    std::unique_ptr<tinygltf::Model> model = std::make_unique<tinygltf::Model>();
+    tinygltf::TinyGLTF loader;
+    std::string error, warning;
+
+    bool binary = path.size() > 4 && path.compare(path.size() - 4, 4, ".glb") == 0;
+    bool loaded = binary ? loader.LoadBinaryFromFile(model.get(), &error, &warning, path)
+        : loader.LoadASCIIFromFile(model.get(), &error, &warning, path);
+
+    if(!loaded) {
+        std::cout << "Couldn't load " << path << ": " << error << std::endl;
+        return nullptr;
+    }
+
+    return GLTFMesh::New(std::move(model));
+}
+
+bool GLTFMesh::read(Vertex* vertices, unsigned int* indices, GeometryHash* hash) const {
+
+    // Element of an accessor, fallback if the attribute is missing. Normalized integer
+    // components (TEXCOORD_0 and COLOR_0 may use them) are mapped to [0, 1] or [-1, 1]
+    auto attribute = [this](const tinygltf::Primitive& primitive, const char* name, size_t element, int components,
+        const glm::vec3& fallback) {
+
+        auto it = primitive.attributes.find(name);
+        if(it == primitive.attributes.end()) return fallback;
+
+        const tinygltf::Accessor& accessor = model->accessors[it->second];
+        if(accessor.bufferView < 0 || element >= accessor.count) return fallback;
+
+        const tinygltf::BufferView& view = model->bufferViews[accessor.bufferView];
+        int stride = accessor.ByteStride(view);
+        const unsigned char* data = &model->buffers[view.buffer].data[view.byteOffset + accessor.byteOffset + element * stride];
+
+        glm::vec3 value(0.f);
+        for(int c = 0; c < components; c ++) value[c] = component(data, accessor.componentType, accessor.normalized, c);
+        return value;
+    };
+
+    // Everything is checked before anything is written, the file may come from a client
+    for(const tinygltf::Mesh& mesh : model->meshes) {
+        for(const tinygltf::Primitive& primitive : mesh.primitives) {
+            auto position = primitive.attributes.find("POSITION");
+            if(position == primitive.attributes.end() || primitive.indices < 0) continue;
+            if(!validPrimitive(*model, primitive)) return false;
+        }
+    }
+
+    size_t vertex = 0, index = 0;
+    for(const tinygltf::Mesh& mesh : model->meshes) {
+        for(const tinygltf::Primitive& primitive : mesh.primitives) {
+
+            auto position = primitive.attributes.find("POSITION");
+            if(position == primitive.attributes.end() || primitive.indices < 0) continue;
+
+            size_t base = vertex, count = model->accessors[position->second].count;
+
+            for(size_t v = 0; v < count; v ++, vertex ++) {
+                glm::vec3 uv = attribute(primitive, "TEXCOORD_0", v, 2, glm::vec3(0.f));
+                Vertex value(attribute(primitive, "POSITION", v, 3, glm::vec3(0.f)), attribute(primitive, "COLOR_0", v, 3, glm::vec3(1.f)),
+                    attribute(primitive, "NORMAL", v, 3, glm::vec3(0.f)), glm::vec2(uv.x, uv.y));
+                if(hash != nullptr) hash->add(value);
+                if(vertices != nullptr) vertices[vertex] = value;
+            }
+
+            const tinygltf::Accessor& accessor = model->accessors[primitive.indices];
+            const tinygltf::BufferView& view = model->bufferViews[accessor.bufferView];
+            const unsigned char* data = &model->buffers[view.buffer].data[view.byteOffset + accessor.byteOffset];
+            int stride = accessor.ByteStride(view);
+
+            for(size_t i = 0; i < accessor.count; i ++, index ++) {
+                const unsigned char* element = data + i * stride;
+                unsigned int value = 0;
+                if(accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) value = *element;
+                else if(accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) value = *reinterpret_cast<const uint16_t*>(element);
+                else value = *reinterpret_cast<const uint32_t*>(element);
+
+                if(value >= count) return false;
+                value += base;
+                if(hash != nullptr) hash->add(value);
+                if(indices != nullptr) indices[index] = value;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool GLTFMesh::read(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) const {
+    size_t firstVertex = vertices.size(), firstIndex = indices.size();
+    vertices.resize(firstVertex + numVertices);
+    indices.resize(firstIndex + numIndices);
+    if(!read(vertices.data() + firstVertex, indices.data() + firstIndex)) return false;
+
+    // Indices continue after the vertices already in the vector
+    for(size_t i = firstIndex; i < indices.size(); i ++) indices[i] += firstVertex;
+    return true;
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/span.h"
+#include "raytracingl/geometry/vertex.h"
+
+namespace tinygltf
+{
+class Model;
+}
+
+namespace rgl
+{
+
+// FNV-1a over the attributes and indices of a mesh. The padding of Vertex is left out and
+// vertices and indices are hashed apart, so the same geometry gives the same hash whatever
+// order they are fed in
+struct GeometryHash {
+
+    uint64_t vertices = 14695981039346656037ull;
+    uint64_t indices = 14695981039346656037ull;
+
+    static void add(uint64_t& value, const void* data, size_t size);
+    void add(const Vertex& vertex);
+    void add(unsigned int index) { add(indices, &index, sizeof(unsigned int)); }
+
+    // 16 hexadecimal digits
+    std::string toString() const;
+};
+
+// Parsed glTF file whose triangles are written straight into caller memory. The counts are
+// known before anything is decoded, so the destination can be a mapped GPU buffer and no
+// intermediate vertex array is ever built. Every mesh and primitive is merged with their
+// indices offset. Positions, normals, UVs and vertex colors (white without COLOR_0) are read.
+class GLTFMesh {
+    GENERATE_SHARED_PTR(GLTFMesh)
+private:
+    std::unique_ptr<tinygltf::Model> model;
+    size_t numVertices, numIndices;
+public:
+    GLTFMesh(std::unique_ptr<tinygltf::Model> _model);
+    ~GLTFMesh();
+    GLTFMesh(const GLTFMesh& mesh) = delete;
+    GLTFMesh& operator=(const GLTFMesh& mesh) = delete;
+public:
+    // .gltf or .glb, nullptr if it can't be loaded
+    static Ptr fromFile(const std::string& path);
+
+    // Writes getNumVertices() vertices and getNumIndices() indices, either may be nullptr to
+    // skip them and hash may be nullptr. false if an accessor lies outside its buffer, a
+    // primitive isn't a triangle list (both before anything is written) or an index is out of range
+    bool read(Vertex* vertices, unsigned int* indices, GeometryHash* hash = nullptr) const;
+    bool read(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) const;
+public:
+    size_t getNumVertices() const { return numVertices; }
+    size_t getNumIndices() const { return numIndices; }
+};
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+namespace rgl
+{
+
+// Entry of a Walker/Vose alias table. An index i drawn uniformly is kept when the
+// fractional part of the draw is below probability, otherwise alias is taken.
+// pdf is the normalized weight of the entry, so lookups do not need the table sum.
+struct alignas(16) AliasEntry {
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, THERE WILL BE A MEMORY ALIGNMENT ISSUE
+    // AND IT WILL NOT MATCH THE ALIAS ENTRY STRUCTURE OF THE COMPUTE SHADER
+    float probability;
+    int alias;
+    float pdf;
+    float padding;
+
+    friend std::ostream& operator<<(std::ostream& os, const AliasEntry& entry) {
+        os << "AliasEntry = [" << entry.probability << "," << entry.alias << "," << entry.pdf << "]";
+        return os;
+    }
+};
+
+// O(n) construction from non-negative weights. All zero weights give a uniform table
+inline std::vector<AliasEntry> buildAliasTable(const std::vector<float>& weights) {
+
+    size_t n = weights.size();
+    std::vector<AliasEntry> table(n);
+    if(n == 0) return table;
+
+    double sum = 0.0;
+    for(float weight : weights) sum += weight;
+
+    std::vector<double> scaled(n);
+    std::vector<unsigned int> small, large;
+
+    for(size_t i = 0; i < n; i ++) {
+        table[i].pdf = sum > 0.0 ? (float)(weights[i] / sum) : 1.f / n;
+        table[i].alias = (int)i;
+        table[i].padding = 0.f;
+        scaled[i] = sum > 0.0 ? weights[i] * n / sum : 1.0;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while(!small.empty() && !large.empty()) {
+
+        unsigned int s = small.back(), l = large.back();
+        small.pop_back();
+
+        table[s].probability = (float)scaled[s];
+        table[s].alias = l;
+
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+        if(scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // Leftovers are 1 up to rounding
+    for(unsigned int i : large) table[i].probability = 1.f;
+    for(unsigned int i : small) table[i].probability = 1.f;
+
+    return table;
+}
+
+}
@@ -0,0 +1,150 @@
+#include "environment.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "raytracingl/vendor/stb_image.h"
+
+namespace rgl
+{
+
+Environment::Environment(const std::vector<float>& _pixels, int _width, int _height)
+    : pixels(_pixels), width(_width), height(_height), textureID(0),
+    textureMemory(MemoryDomain::GPU, MemoryCategory::Textures),
+    pixelsMemory(MemoryDomain::Host, MemoryCategory::Textures, pixels.size() * sizeof(float)),
+    tableMemory(MemoryDomain::Host, MemoryCategory::Lights) {
+
+    // Texel weights, sin(theta) accounts for the area of the rows in the sphere
+    std::vector<float> weights(width * height);
+
+    for(int y = 0; y < height; y ++) {
+        float sinTheta = std::sin(glm::pi<float>() * (y + 0.5f) / height);
+        for(int x = 0; x < width; x ++) {
+            const float* rgb = &pixels[3 * (y * width + x)];
+            float luminance = 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+            weights[y * width + x] = std::max(luminance, 0.f) * sinTheta;
+        }
+    }
+
+    table = buildAliasTable(weights);
+    tableMemory.resize(table.size() * sizeof(AliasEntry));
+}
+
+Environment::Environment() : width(0), height(0), textureID(0) {
+}
+
+Environment::~Environment() {
+    if(textureID != 0) glDeleteTextures(1, &textureID);
+}
+
+Environment::Ptr Environment::fromFile(const std::string& filePath) {
+
+    // The flip is global state of stb_image without a getter, it is put back to its default
+    // (off) for the other loaders. LDR images are converted by hand so the gamma of
+    // stbi_loadf isn't touched either
+    stbi_set_flip_vertically_on_load(true);
+
+    int width, height, channels;
+    std::vector<float> pixels;
+
+    if(stbi_is_hdr(filePath.c_str())) {
+        float* image = stbi_loadf(filePath.c_str(), &width, &height, &channels, STBI_rgb);
+        if(image != nullptr) {
+            pixels.assign(image, image + 3 * width * height);
+            stbi_image_free(image);
+        }
+    }
+    else {
+        unsigned char* image = stbi_load(filePath.c_str(), &width, &height, &channels, STBI_rgb);
+        if(image != nullptr) {
+            pixels.resize(3 * width * height);
+            for(size_t i = 0; i < pixels.size(); i ++) pixels[i] = image[i] / 255.f;
+            stbi_image_free(image);
+        }
+    }
+
+    stbi_set_flip_vertically_on_load(false);
+
+    if(pixels.empty()) {
+        std::cout << "Couldn't load the environment map " << filePath << std::endl;
+        return nullptr;
+    }
+
+    return Environment::New(pixels, width, height);
+}
+
+glm::vec2 Environment::directionToUV(const glm::vec3& direction) {
+    glm::vec3 d = glm::normalize(direction);
+    float u = std::atan2(d.z, d.x) / (2.f * glm::pi<float>());
+    float v = 1.f - std::acos(std::clamp(d.y, -1.f, 1.f)) / glm::pi<float>();
+    return glm::vec2(u < 0.f ? u + 1.f : u, v);
+}
+
+glm::vec3 Environment::uvToDirection(const glm::vec2& uv) {
+    float phi = 2.f * glm::pi<float>() * uv.x;
+    float theta = glm::pi<float>() * (1.f - uv.y);
+    return glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+}
+
+void Environment::upload() {
+
+    if(textureID == 0) glGenTextures(1, &textureID);
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, pixels.data());
+    textureMemory.resize(pixels.size() * sizeof(float));
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    ssboTable = ShaderStorageBuffer<AliasEntry>::New(table, ENVIRONMENT_BINDING_POINT);
+}
+
+void Environment::bind(unsigned int slot) const {
+    glActiveTexture(GL_TEXTURE0 + slot);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    if(ssboTable != nullptr) ssboTable->bindBase();
+}
+
+glm::vec3 Environment::sample(const glm::vec3& u, float& pdf) const {
+
+    int count = width * height;
+    float scaled = u.x * count;
+    int index = std::min((int)scaled, count - 1);
+    if(scaled - index >= table[index].probability) index = table[index].alias;
+
+    glm::vec2 uv((index % width + u.y) / width, (index / width + u.z) / height);
+    glm::vec3 direction = uvToDirection(uv);
+
+    float sinTheta = std::sin(glm::pi<float>() * (1.f - uv.y));
+    pdf = sinTheta > 0.f ? table[index].pdf * count / (2.f * glm::pi<float>() * glm::pi<float>() * sinTheta) : 0.f;
+
+    return direction;
+}
+
+float Environment::pdf(const glm::vec3& direction) const {
+
+    glm::vec2 uv = directionToUV(direction);
+    int x = std::min((int)(uv.x * width), width - 1);
+    int y = std::min((int)(uv.y * height), height - 1);
+
+    float sinTheta = std::sin(glm::pi<float>() * (1.f - uv.y));
+    return sinTheta > 0.f ? table[y * width + x].pdf * width * height / (2.f * glm::pi<float>() * glm::pi<float>() * sinTheta) : 0.f;
+}
+
+glm::vec3 Environment::radiance(const glm::vec3& direction) const {
+
+    glm::vec2 uv = directionToUV(direction);
+    int x = std::min((int)(uv.x * width), width - 1);
+    int y = std::min((int)(uv.y * height), height - 1);
+
+    const float* rgb = &pixels[3 * (y * width + x)];
+    return glm::vec3(rgb[0], rgb[1], rgb[2]);
+}
+
+}
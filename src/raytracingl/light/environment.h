@@ -0,0 +1,67 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <GL/glew.h>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/light/aliastable.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+#define ENVIRONMENT_BINDING_POINT 5
+
+namespace rgl
+{
+
+// Equirectangular environment map with an alias table over its texels for importance
+// sampling. Texel weights are the luminance times sin(theta), so directions are drawn
+// proportionally to the radiance they carry. Rows go from the bottom (v = 0, -y) to the
+// top (v = 1, +y) as in the sky texture of compute.glsl, u = atan(z, x) / 2pi.
+class Environment {
+    GENERATE_SHARED_PTR(Environment)
+private:
+    std::vector<float> pixels;  // RGB
+    std::vector<AliasEntry> table;
+    int width, height;
+
+    unsigned int textureID;
+    ShaderStorageBuffer<AliasEntry>::Ptr ssboTable;
+
+    MemoryRecord textureMemory, pixelsMemory, tableMemory;
+public:
+    Environment(const std::vector<float>& _pixels, int _width, int _height);
+    Environment();
+    ~Environment();
+    Environment(const Environment& environment) = delete;
+    Environment& operator=(const Environment& environment) = delete;
+public:
+    // HDR (.hdr) or LDR images, LDR values are kept as they are stored
+    static Environment::Ptr fromFile(const std::string& filePath);
+
+    static glm::vec2 directionToUV(const glm::vec3& direction);
+    static glm::vec3 uvToDirection(const glm::vec2& uv);
+
+    // Creates the RGB32F texture and the alias table SSBO at ENVIRONMENT_BINDING_POINT
+    void upload();
+    void bind(unsigned int slot) const;
+
+    // Direction drawn from three uniform numbers, pdf in solid angle
+    glm::vec3 sample(const glm::vec3& u, float& pdf) const;
+    float pdf(const glm::vec3& direction) const;
+    // Nearest texel, the same one the pdf is taken from
+    glm::vec3 radiance(const glm::vec3& direction) const;
+public:
+    const std::vector<float>& getPixels() const { return pixels; }
+    const std::vector<AliasEntry>& getTable() const { return table; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    unsigned int getTextureID() const { return textureID; }
+};
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <iostream>
+
+#include <glm/vec3.hpp>
+
+#include "raytracingl/ptr.h"
+
+#define LIGHT_BVH_NODES_BINDING_POINT 6
+#define LIGHTS_BINDING_POINT 7
+#define TRIANGLE_LIGHTS_BINDING_POINT 8
+
+namespace rgl
+{
+
+// Emissive triangle, emitting on the side of normalize(cross(v2 - v1, v3 - v1))
+struct alignas(16) EmissiveTriangle {
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, THERE WILL BE A MEMORY ALIGNMENT ISSUE
+    // AND IT WILL NOT MATCH THE EMISSIVE TRIANGLE STRUCTURE OF THE COMPUTE SHADER
+    glm::vec3 emission;
+    int triangle;
+
+    unsigned int trail;     // bit d is set when the path from the root goes right at depth d
+    unsigned int depth;
+    float padding[2];
+};
+
+// Node of the light BVH. Besides the bounds, it keeps the total power of the lights below
+// and a cone bounding their normals (axis, thetaO) and emission angle (thetaE)
+struct alignas(16) LightBVHNode {
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, THERE WILL BE A MEMORY ALIGNMENT ISSUE
+    // AND IT WILL NOT MATCH THE LIGHT BVH NODE STRUCTURE OF THE COMPUTE SHADER
+    glm::vec3 aabbMin;
+    float power;
+
+    glm::vec3 aabbMax;
+    int left;       // child node or ~light in leaves
+
+    glm::vec3 axis;
+    float thetaO;
+
+    float thetaE;
+    int right;
+    float padding[2];
+
+    bool isLeaf() const { return left < 0; }
+    int getLight() const { return ~left; }
+};
+
+}
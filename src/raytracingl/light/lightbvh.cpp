@@ -0,0 +1,249 @@
+#include "lightbvh.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+
+namespace rgl
+{
+
+LightBVH::LightBVH(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+    const std::vector<glm::vec3>& emission) : memory(MemoryDomain::Host, MemoryCategory::Lights) {
+
+    unsigned int numTriangles = indices.size() / 3;
+    triangleLights.assign(numTriangles, -1);
+
+    // One leaf per emissive triangle: a cone of zero aperture around its normal that emits
+    // over the hemisphere
+    std::vector<LightBVHNode> leaves;
+    std::vector<glm::vec3> centers;
+
+    for(unsigned int i = 0; i < numTriangles && i < emission.size(); i ++) {
+
+        float luminance = 0.2126f * emission[i].x + 0.7152f * emission[i].y + 0.0722f * emission[i].z;
+        if(luminance <= 0.f) continue;
+
+        const glm::vec3& v1 = vertices[indices[3 * i]].pos;
+        const glm::vec3& v2 = vertices[indices[3 * i + 1]].pos;
+        const glm::vec3& v3 = vertices[indices[3 * i + 2]].pos;
+
+        glm::vec3 normal = glm::cross(v2 - v1, v3 - v1);
+        float area = 0.5f * glm::length(normal);
+        if(area <= 0.f) continue;
+
+        EmissiveTriangle light = {};
+        light.emission = emission[i];
+        light.triangle = i;
+
+        LightBVHNode leaf = {};
+        leaf.aabbMin = glm::min(v1, glm::min(v2, v3));
+        leaf.aabbMax = glm::max(v1, glm::max(v2, v3));
+        leaf.power = luminance * area * glm::pi<float>();
+        leaf.left = ~(int)lights.size();
+        leaf.right = -1;
+        leaf.axis = normal / (2.f * area);
+        leaf.thetaO = 0.f;
+        leaf.thetaE = glm::pi<float>() / 2.f;
+
+        triangleLights[i] = lights.size();
+        lights.push_back(light);
+        leaves.push_back(leaf);
+        centers.push_back((v1 + v2 + v3) / 3.f);
+    }
+
+    if(!lights.empty()) {
+
+        std::vector<unsigned int> order(lights.size());
+        for(unsigned int i = 0; i < order.size(); i ++) order[i] = i;
+
+        nodes.reserve(2 * lights.size() - 1);
+        build(order, 0, lights.size(), centers, leaves, 0, 0);
+    }
+
+    memory.resize(nodes.size() * sizeof(LightBVHNode) + lights.size() * sizeof(EmissiveTriangle) + triangleLights.size() * sizeof(int));
+}
+
+int LightBVH::build(std::vector<unsigned int>& order, unsigned int begin, unsigned int end,
+    const std::vector<glm::vec3>& centers, const std::vector<LightBVHNode>& leaves, unsigned int trail, unsigned int depth) {
+
+    int index = nodes.size();
+
+    if(end - begin == 1) {
+        nodes.push_back(leaves[order[begin]]);
+        lights[order[begin]].trail = trail;
+        lights[order[begin]].depth = depth;
+        return index;
+    }
+
+    nodes.push_back(LightBVHNode());
+
+    // Median split along the largest extent of the centers. The tree stays balanced so the
+    // 32 bits of the trails are always enough
+    glm::vec3 centerMin(centers[order[begin]]), centerMax(centers[order[begin]]);
+    for(unsigned int i = begin; i < end; i ++) {
+        centerMin = glm::min(centerMin, centers[order[i]]);
+        centerMax = glm::max(centerMax, centers[order[i]]);
+    }
+
+    glm::vec3 extent = centerMax - centerMin;
+    int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+
+    unsigned int middle = (begin + end) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+        [&](unsigned int a, unsigned int b) { return centers[a][axis] < centers[b][axis]; });
+
+    int left = build(order, begin, middle, centers, leaves, trail, depth + 1);
+    int right = build(order, middle, end, centers, leaves, trail | (1u << depth), depth + 1);
+
+    LightBVHNode node = {};
+    node.aabbMin = glm::min(nodes[left].aabbMin, nodes[right].aabbMin);
+    node.aabbMax = glm::max(nodes[left].aabbMax, nodes[right].aabbMax);
+    node.power = nodes[left].power + nodes[right].power;
+    node.left = left;
+    node.right = right;
+    mergeCones(nodes[left], nodes[right], node);
+
+    nodes[index] = node;
+    return index;
+}
+
+void LightBVH::mergeCones(const LightBVHNode& a, const LightBVHNode& b, LightBVHNode& result) {
+
+    const float pi = glm::pi<float>();
+
+    // a is the widest cone
+    if(b.thetaO > a.thetaO) {
+        mergeCones(b, a, result);
+        return;
+    }
+
+    float thetaD = std::acos(std::clamp(glm::dot(a.axis, b.axis), -1.f, 1.f));
+    result.thetaE = std::max(a.thetaE, b.thetaE);
+
+    if(std::min(thetaD + b.thetaO, pi) <= a.thetaO) {
+        result.axis = a.axis;
+        result.thetaO = a.thetaO;
+        return;
+    }
+
+    float thetaO = (a.thetaO + thetaD + b.thetaO) / 2.f;
+    if(thetaO >= pi) {
+        result.axis = a.axis;
+        result.thetaO = pi;
+        return;
+    }
+
+    // Rotate the axis of a towards b by thetaO - a.thetaO
+    glm::vec3 ortho = b.axis - a.axis * glm::dot(a.axis, b.axis);
+    if(glm::dot(ortho, ortho) < 1e-12f)
+        ortho = glm::cross(a.axis, std::abs(a.axis.x) > 0.5f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f));
+
+    float thetaR = thetaO - a.thetaO;
+    result.axis = glm::normalize(std::cos(thetaR) * a.axis + std::sin(thetaR) * glm::normalize(ortho));
+    result.thetaO = thetaO;
+}
+
+float LightBVH::importance(const LightBVHNode& node, const glm::vec3& position, const glm::vec3& normal) {
+
+    const float pi = glm::pi<float>();
+
+    glm::vec3 center = (node.aabbMin + node.aabbMax) * 0.5f;
+    float radius = glm::length(node.aabbMax - node.aabbMin) * 0.5f;
+
+    glm::vec3 toCenter = center - position;
+    float dist2 = glm::dot(toCenter, toCenter);
+    float dist = std::sqrt(dist2);
+    glm::vec3 direction = dist > 0.f ? toCenter / dist : glm::vec3(0.f, 0.f, 1.f);
+
+    // Angle subtended by the bounding sphere, everything if the point is inside
+    float thetaU = dist > radius ? std::asin(radius / dist) : pi;
+
+    // Emitter side: angle between the cone and the direction to the point
+    float theta = std::acos(std::clamp(glm::dot(node.axis, -direction), -1.f, 1.f));
+    float thetaP = std::max(theta - node.thetaO - thetaU, 0.f);
+    if(thetaP >= node.thetaE) return 0.f;
+
+    // Receiver side, only the upper hemisphere of the normal can be lit
+    float cosThetaI = 1.f;
+    if(glm::dot(normal, normal) > 0.f) {
+        float thetaI = std::acos(std::clamp(glm::dot(normal, direction), -1.f, 1.f));
+        float thetaIP = std::max(thetaI - thetaU, 0.f);
+        if(thetaIP >= pi / 2.f) return 0.f;
+        cosThetaI = std::cos(thetaIP);
+    }
+
+    return node.power * std::cos(thetaP) * cosThetaI / std::max(dist2, radius * radius);
+}
+
+int LightBVH::sample(const glm::vec3& position, const glm::vec3& normal, float u, float& pmf) const {
+
+    pmf = 0.f;
+    if(nodes.empty()) return -1;
+
+    float probability = 1.f;
+    int index = 0;
+
+    while(!nodes[index].isLeaf()) {
+
+        const LightBVHNode& node = nodes[index];
+        float importanceLeft = importance(nodes[node.left], position, normal);
+        float importanceRight = importance(nodes[node.right], position, normal);
+        if(importanceLeft + importanceRight <= 0.f) return -1;
+
+        // u is rescaled to [0, 1) for the next level
+        float probabilityLeft = importanceLeft / (importanceLeft + importanceRight);
+        if(u < probabilityLeft) {
+            u = std::min(u / probabilityLeft, 0.99999994f);
+            probability *= probabilityLeft;
+            index = node.left;
+        }
+        else {
+            u = std::min((u - probabilityLeft) / (1.f - probabilityLeft), 0.99999994f);
+            probability *= 1.f - probabilityLeft;
+            index = node.right;
+        }
+    }
+
+    pmf = probability;
+    return nodes[index].getLight();
+}
+
+float LightBVH::pmf(const glm::vec3& position, const glm::vec3& normal, int light) const {
+
+    if(light < 0 || light >= (int)lights.size()) return 0.f;
+
+    float probability = 1.f;
+    int index = 0;
+
+    for(unsigned int depth = 0; !nodes[index].isLeaf(); depth ++) {
+
+        const LightBVHNode& node = nodes[index];
+        float importanceLeft = importance(nodes[node.left], position, normal);
+        float importanceRight = importance(nodes[node.right], position, normal);
+        if(importanceLeft + importanceRight <= 0.f) return 0.f;
+
+        bool right = (lights[light].trail >> depth) & 1u;
+        probability *= (right ? importanceRight : importanceLeft) / (importanceLeft + importanceRight);
+        index = right ? node.right : node.left;
+    }
+
+    return probability;
+}
+
+void LightBVH::upload() {
+    if(lights.empty()) return;
+    ssboNodes = ShaderStorageBuffer<LightBVHNode>::New(nodes, LIGHT_BVH_NODES_BINDING_POINT);
+    ssboLights = ShaderStorageBuffer<EmissiveTriangle>::New(lights, LIGHTS_BINDING_POINT);
+    ssboTriangleLights = ShaderStorageBuffer<int>::New(triangleLights, TRIANGLE_LIGHTS_BINDING_POINT, false, MemoryCategory::Lights);
+}
+
+void LightBVH::bind() const {
+    if(ssboNodes == nullptr) return;
+    ssboNodes->bindBase();
+    ssboLights->bindBase();
+    ssboTriangleLights->bindBase();
+}
+
+}
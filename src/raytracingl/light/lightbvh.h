@@ -0,0 +1,62 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/geometry/vertex.h"
+#include "raytracingl/light/light.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+namespace rgl
+{
+
+// Light BVH over the emissive triangles of a mesh for many-light sampling, see "Importance
+// Sampling of Many Lights with Adaptive Tree Splitting" (Conty and Kulla). A light is chosen
+// by descending the tree, each child with a probability proportional to an estimate of its
+// contribution to the shading point. Everything is in the object space of the mesh.
+class LightBVH {
+    GENERATE_SHARED_PTR(LightBVH)
+private:
+    std::vector<LightBVHNode> nodes;
+    std::vector<EmissiveTriangle> lights;
+    std::vector<int> triangleLights;    // light of each triangle or -1
+
+    ShaderStorageBuffer<LightBVHNode>::Ptr ssboNodes;
+    ShaderStorageBuffer<EmissiveTriangle>::Ptr ssboLights;
+    ShaderStorageBuffer<int>::Ptr ssboTriangleLights;
+
+    MemoryRecord memory;
+private:
+    int build(std::vector<unsigned int>& order, unsigned int begin, unsigned int end,
+        const std::vector<glm::vec3>& centers, const std::vector<LightBVHNode>& leaves, unsigned int trail, unsigned int depth);
+    static void mergeCones(const LightBVHNode& a, const LightBVHNode& b, LightBVHNode& result);
+public:
+    // emission holds the radiance of each triangle, the black ones are not lights
+    LightBVH(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+        const std::vector<glm::vec3>& emission);
+    LightBVH() = default;
+    ~LightBVH() = default;
+public:
+    // Estimated contribution of the lights below a node, normal may be zero
+    static float importance(const LightBVHNode& node, const glm::vec3& position, const glm::vec3& normal);
+
+    // Light drawn with u in [0, 1) and its probability, -1 if no light can contribute
+    int sample(const glm::vec3& position, const glm::vec3& normal, float u, float& pmf) const;
+    // Probability of sample() returning the light
+    float pmf(const glm::vec3& position, const glm::vec3& normal, int light) const;
+
+    // SSBOs at LIGHT_BVH_NODES_BINDING_POINT, LIGHTS_BINDING_POINT and TRIANGLE_LIGHTS_BINDING_POINT
+    void upload();
+    void bind() const;
+public:
+    const std::vector<LightBVHNode>& getNodes() const { return nodes; }
+    const std::vector<EmissiveTriangle>& getLights() const { return lights; }
+    const std::vector<int>& getTriangleLights() const { return triangleLights; }
+    unsigned int getNumLights() const { return lights.size(); }
+};
+
+}
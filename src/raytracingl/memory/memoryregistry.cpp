@@ -0,0 +1,199 @@
+#include "memoryregistry.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+namespace rgl
+{
+
+//////////////////////
+//  MemoryRegistry  //
+//////////////////////
+
+MemoryRegistry& MemoryRegistry::get() {
+    static MemoryRegistry registry;
+    return registry;
+}
+
+void MemoryRegistry::allocate(MemoryDomain domain, MemoryCategory category, size_t bytes, bool newResource) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Usage& usage = usages[(size_t)domain][(size_t)category];
+    Usage& total = totals[(size_t)domain];
+
+    usage.current += bytes;
+    usage.peak = std::max(usage.peak, usage.current);
+    total.current += bytes;
+    total.peak = std::max(total.peak, total.current);
+
+    if(newResource) {
+        usage.resources ++;
+        total.resources ++;
+    }
+}
+
+void MemoryRegistry::release(MemoryDomain domain, MemoryCategory category, size_t bytes, bool lastResource) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Usage& usage = usages[(size_t)domain][(size_t)category];
+    Usage& total = totals[(size_t)domain];
+
+    usage.current -= std::min(bytes, usage.current);
+    total.current -= std::min(bytes, total.current);
+
+    if(lastResource) {
+        if(usage.resources > 0) usage.resources --;
+        if(total.resources > 0) total.resources --;
+    }
+}
+
+MemoryRegistry::Usage MemoryRegistry::getUsage(MemoryDomain domain, MemoryCategory category) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usages[(size_t)domain][(size_t)category];
+}
+
+MemoryRegistry::Usage MemoryRegistry::getTotal(MemoryDomain domain) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals[(size_t)domain];
+}
+
+void MemoryRegistry::resetPeaks() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for(size_t d = 0; d < NUM_DOMAINS; d ++) {
+        for(Usage& usage : usages[d]) usage.peak = usage.current;
+        totals[d].peak = totals[d].current;
+    }
+}
+
+std::string MemoryRegistry::toJSON() const {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto usageJSON = [](std::ostringstream& os, const Usage& usage) {
+        os << "\"current\": " << usage.current << ", \"peak\": " << usage.peak << ", \"resources\": " << usage.resources;
+    };
+
+    std::ostringstream os;
+    os << "{";
+
+    for(size_t d = 0; d < NUM_DOMAINS; d ++) {
+
+        os << (d > 0 ? ", " : "") << "\"" << getName((MemoryDomain)d) << "\": {";
+        usageJSON(os, totals[d]);
+        os << ", \"categories\": {";
+
+        for(size_t c = 0; c < NUM_CATEGORIES; c ++) {
+            os << (c > 0 ? ", " : "") << "\"" << getName((MemoryCategory)c) << "\": {";
+            usageJSON(os, usages[d][c]);
+            os << "}";
+        }
+
+        os << "}}";
+    }
+
+    os << "}";
+    return os.str();
+}
+
+void MemoryRegistry::print(std::ostream& os) const {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto megabytes = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(2);
+
+    for(size_t d = 0; d < NUM_DOMAINS; d ++) {
+
+        os << "  " << std::left << std::setw(24) << getName((MemoryDomain)d) << std::right
+           << std::setw(10) << megabytes(totals[d].current) << " MB current, "
+           << std::setw(10) << megabytes(totals[d].peak) << " MB peak" << std::endl;
+
+        for(size_t c = 0; c < NUM_CATEGORIES; c ++) {
+            const Usage& usage = usages[d][c];
+            if(usage.peak == 0) continue;
+            os << "    " << std::left << std::setw(22) << getName((MemoryCategory)c) << std::right
+               << std::setw(10) << megabytes(usage.current) << " MB current, "
+               << std::setw(10) << megabytes(usage.peak) << " MB peak, "
+               << usage.resources << " resources" << std::endl;
+        }
+    }
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+const char* MemoryRegistry::getName(MemoryCategory category) {
+    switch(category) {
+        case MemoryCategory::Vertices: return "vertices";
+        case MemoryCategory::Indices: return "indices";
+        case MemoryCategory::Textures: return "textures";
+        case MemoryCategory::AccelerationStructures: return "accelerationStructures";
+        case MemoryCategory::Lights: return "lights";
+        case MemoryCategory::OutputImages: return "outputImages";
+        case MemoryCategory::Readback: return "readback";
+        case MemoryCategory::Scratch: return "scratch";
+        default: return "other";
+    }
+}
+
+const char* MemoryRegistry::getName(MemoryDomain domain) {
+    return domain == MemoryDomain::GPU ? "gpu" : "host";
+}
+
+////////////////////
+//  MemoryRecord  //
+////////////////////
+
+MemoryRecord::MemoryRecord(MemoryDomain _domain, MemoryCategory _category, size_t _bytes)
+    : domain(_domain), category(_category), bytes(0) {
+    resize(_bytes);
+}
+
+MemoryRecord::MemoryRecord()
+    : domain(MemoryDomain::GPU), category(MemoryCategory::Other), bytes(0) {
+}
+
+MemoryRecord::~MemoryRecord() {
+    reset();
+}
+
+MemoryRecord::MemoryRecord(MemoryRecord&& memoryRecord) noexcept
+    : domain(memoryRecord.domain), category(memoryRecord.category), bytes(memoryRecord.bytes) {
+    memoryRecord.bytes = 0;
+}
+
+MemoryRecord& MemoryRecord::operator=(MemoryRecord&& memoryRecord) noexcept {
+    if(this == &memoryRecord) return *this;
+    reset();
+    domain = memoryRecord.domain;
+    category = memoryRecord.category;
+    bytes = memoryRecord.bytes;
+    memoryRecord.bytes = 0;
+    return *this;
+}
+
+void MemoryRecord::resize(size_t _bytes) {
+
+    MemoryRegistry& registry = MemoryRegistry::get();
+
+    if(bytes == 0 && _bytes > 0) registry.allocate(domain, category, _bytes);
+    else if(bytes > 0 && _bytes == 0) registry.release(domain, category, bytes);
+    else if(_bytes > bytes) registry.allocate(domain, category, _bytes - bytes, false);
+    else if(_bytes < bytes) registry.release(domain, category, bytes - _bytes, false);
+
+    bytes = _bytes;
+}
+
+void MemoryRecord::reset() {
+    resize(0);
+}
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <mutex>
+#include <cstddef>
+
+#include "raytracingl/ptr.h"
+
+namespace rgl
+{
+
+enum class MemoryCategory {
+    Vertices = 0,
+    Indices,
+    Textures,
+    AccelerationStructures,
+    Lights,
+    OutputImages,
+    Readback,
+    Scratch,
+    Other,
+    Count
+};
+
+enum class MemoryDomain {
+    GPU = 0,
+    Host,
+    Count
+};
+
+// Bytes held by the resources of the renderer, per domain and category. The buffers,
+// textures and the large host copies register themselves through a MemoryRecord, so the
+// totals can be queried at any time and dumped by the benchmarks. Thread safe.
+class MemoryRegistry {
+public:
+    struct Usage {
+        size_t current = 0;
+        size_t peak = 0;
+        size_t resources = 0;   // records holding memory
+    };
+private:
+    static constexpr size_t NUM_DOMAINS = (size_t)MemoryDomain::Count;
+    static constexpr size_t NUM_CATEGORIES = (size_t)MemoryCategory::Count;
+
+    mutable std::mutex mutex;
+    Usage usages[NUM_DOMAINS][NUM_CATEGORIES];
+    Usage totals[NUM_DOMAINS];
+private:
+    MemoryRegistry() = default;
+public:
+    MemoryRegistry(const MemoryRegistry& memoryRegistry) = delete;
+    MemoryRegistry& operator=(const MemoryRegistry& memoryRegistry) = delete;
+
+    static MemoryRegistry& get();
+public:
+    void allocate(MemoryDomain domain, MemoryCategory category, size_t bytes, bool newResource = true);
+    void release(MemoryDomain domain, MemoryCategory category, size_t bytes, bool lastResource = true);
+
+    Usage getUsage(MemoryDomain domain, MemoryCategory category) const;
+    Usage getTotal(MemoryDomain domain) const;
+
+    // Peaks restart from the current usage, e.g. between benchmark scenes
+    void resetPeaks();
+
+    // {"gpu": {"current": ..., "peak": ..., "categories": {"vertices": {...}, ...}}, "host": ...}
+    std::string toJSON() const;
+    // Table of the categories in use
+    void print(std::ostream& os = std::cout) const;
+public:
+    static const char* getName(MemoryCategory category);
+    static const char* getName(MemoryDomain domain);
+};
+
+
+// Bytes of one resource in the registry, released when the record is destroyed. Owned by
+// the resource, so it can only be moved
+class MemoryRecord {
+private:
+    MemoryDomain domain;
+    MemoryCategory category;
+    size_t bytes;
+public:
+    MemoryRecord(MemoryDomain _domain, MemoryCategory _category, size_t _bytes = 0);
+    MemoryRecord();
+    ~MemoryRecord();
+    MemoryRecord(const MemoryRecord& memoryRecord) = delete;
+    MemoryRecord(MemoryRecord&& memoryRecord) noexcept;
+    MemoryRecord& operator=(const MemoryRecord& memoryRecord) = delete;
+    MemoryRecord& operator=(MemoryRecord&& memoryRecord) noexcept;
+public:
+    // The resource was reallocated with a new size. Records without bytes don't count as resources
+    void resize(size_t _bytes);
+    void reset();
+public:
+    MemoryDomain getDomain() const { return domain; }
+    MemoryCategory getCategory() const { return category; }
+    size_t getBytes() const { return bytes; }
+};
+
+}
@@ -1,5 +1,21 @@
 #include "buffer.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include <glm/vec4.hpp>
+
+// Element types of the explicit instantiations at the end
+#include "raytracingl/geometry/packedvertex.h"
+#include "raytracingl/geometry/primitive.h"
+#include "raytracingl/geometry/camera.h"
+#include "raytracingl/geometry/query.h"
+#include "raytracingl/bvh/bvh.h"
+#include "raytracingl/light/aliastable.h"
+#include "raytracingl/light/light.h"
+
 namespace rgl
 {
 
@@ -7,9 +23,14 @@ namespace rgl
 //  IndexBuffer  //
 ///////////////////
 
-IndexBuffer::IndexBuffer(const std::vector<unsigned int>& _indices)
-    : Buffer(), indices(_indices) {
-    initBuffer();
+IndexBuffer::IndexBuffer(Span<const unsigned int> _indices, bool shadow)
+    : Buffer(MemoryCategory::Indices), size(_indices.size()) {
+    if(shadow) indices.assign(_indices.begin(), _indices.end());
+    hostMemory.resize(indices.size() * sizeof(unsigned int));
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.bytes(), _indices.data(), GL_STATIC_DRAW);
+    gpuMemory.resize(_indices.bytes());
 }
 
 IndexBuffer::~IndexBuffer() {
@@ -17,32 +38,29 @@ IndexBuffer::~IndexBuffer() {
     glDeleteBuffers(1, &id);
 }
 
-IndexBuffer::IndexBuffer(const IndexBuffer& indexBuffer) 
-    : indices(indexBuffer.indices) {
-    id = indexBuffer.id;
-}
-
 IndexBuffer::IndexBuffer(IndexBuffer&& indexBuffer) noexcept
-    : indices(std::move(indexBuffer.indices)) {
-    id = indexBuffer.id;
-}
-
-IndexBuffer& IndexBuffer::operator=(const IndexBuffer& indexBuffer) {
-    id = indexBuffer.id;
-    indices = indexBuffer.indices;
-    return *this;
+    : indices(std::move(indexBuffer.indices)), size(indexBuffer.size) {
+    id = std::exchange(indexBuffer.id, 0);
+    gpuMemory = std::move(indexBuffer.gpuMemory);
+    hostMemory = std::move(indexBuffer.hostMemory);
 }
 
 IndexBuffer& IndexBuffer::operator=(IndexBuffer&& indexBuffer) noexcept {
-    id = indexBuffer.id;
+    if(this == &indexBuffer) return *this;
+    if(id != 0) glDeleteBuffers(1, &id);
+    id = std::exchange(indexBuffer.id, 0);
     indices = std::move(indexBuffer.indices);
+    size = indexBuffer.size;
+    gpuMemory = std::move(indexBuffer.gpuMemory);
+    hostMemory = std::move(indexBuffer.hostMemory);
     return *this;
 }
 
 void IndexBuffer::initBuffer() {
     glGenBuffers(1, &id);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size * sizeof(unsigned int), indices.empty() ? nullptr : indices.data(), GL_STATIC_DRAW);
+    gpuMemory.resize(size * sizeof(unsigned int));
 }
 
 void IndexBuffer::bind() {
@@ -57,15 +75,19 @@ void IndexBuffer::unbind() {
 //  VertexBuffer  //
 ////////////////////
 
-VertexBuffer::VertexBuffer(const std::vector<Vertex>& _vertices)
-    : Buffer(), vertices(_vertices) {
-    initBuffer();
+VertexBuffer::VertexBuffer(Span<const Vertex> _vertices, bool shadow)
+    : Buffer(MemoryCategory::Vertices), size(_vertices.size()) {
+    if(shadow) vertices.assign(_vertices.begin(), _vertices.end());
+    hostMemory.resize(vertices.size() * sizeof(Vertex));
+    upload(_vertices.data());
 }
 
-VertexBuffer::VertexBuffer(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& indices)
-    : Buffer(), vertices(_vertices) {
-    initBuffer();
-    indexBuffer = IndexBuffer::New(indices);
+VertexBuffer::VertexBuffer(Span<const Vertex> _vertices, Span<const unsigned int> indices, bool shadow)
+    : Buffer(MemoryCategory::Vertices), size(_vertices.size()) {
+    if(shadow) vertices.assign(_vertices.begin(), _vertices.end());
+    hostMemory.resize(vertices.size() * sizeof(Vertex));
+    upload(_vertices.data());
+    indexBuffer = IndexBuffer::New(indices, shadow);
 }
 
 VertexBuffer::~VertexBuffer() {
@@ -73,87 +95,66 @@ VertexBuffer::~VertexBuffer() {
     glDeleteBuffers(1, &id);
 }
 
-VertexBuffer::VertexBuffer(const VertexBuffer& vertexBuffer)
-    : vertices(vertexBuffer.vertices), indexBuffer(vertexBuffer.indexBuffer) {
-    id = vertexBuffer.id;
-}
-
 VertexBuffer::VertexBuffer(VertexBuffer&& vertexBuffer) noexcept 
-    : vertices(std::move(vertexBuffer.vertices)), indexBuffer(vertexBuffer.indexBuffer) {
-    id = vertexBuffer.id;
-}
-
-VertexBuffer& VertexBuffer::operator=(const VertexBuffer& vertexBuffer) {
-    id = vertexBuffer.id;
-    vertices = vertexBuffer.vertices;
-    indexBuffer = vertexBuffer.indexBuffer;
-    return *this;
+    : vertices(std::move(vertexBuffer.vertices)), size(vertexBuffer.size), indexBuffer(std::move(vertexBuffer.indexBuffer)) {
+    id = std::exchange(vertexBuffer.id, 0);
+    gpuMemory = std::move(vertexBuffer.gpuMemory);
+    hostMemory = std::move(vertexBuffer.hostMemory);
 }
 
 VertexBuffer& VertexBuffer::operator=(VertexBuffer&& vertexBuffer) noexcept {
-    id = vertexBuffer.id;
+    if(this == &vertexBuffer) return *this;
+    if(id != 0) glDeleteBuffers(1, &id);
+    id = std::exchange(vertexBuffer.id, 0);
     vertices = std::move(vertexBuffer.vertices);
-    indexBuffer = vertexBuffer.indexBuffer;
+    size = vertexBuffer.size;
+    indexBuffer = std::move(vertexBuffer.indexBuffer);
+    gpuMemory = std::move(vertexBuffer.gpuMemory);
+    hostMemory = std::move(vertexBuffer.hostMemory);
     return *this;
 }
 
 void VertexBuffer::vertexAttributes() {
+    // The attributes are read in place from the padded Vertex structure
     // position attribute
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, MAX_VERTEX_ATTRIBUTES * sizeof(float), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
 
     // color attribute
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, MAX_VERTEX_ATTRIBUTES * sizeof(float), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
 
     // normal attribute
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, MAX_VERTEX_ATTRIBUTES * sizeof(float), (void*)(6 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
 
     // texture coordinates attribute
     glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, MAX_VERTEX_ATTRIBUTES * sizeof(float), (void*)(9 * sizeof(float)));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
 
     // tangent attribute
     glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, MAX_VERTEX_ATTRIBUTES * sizeof(float), (void*)(11 * sizeof(float)));
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tan));
     
     // bitangent attribute
     glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, MAX_VERTEX_ATTRIBUTES * sizeof(float), (void*)(14 * sizeof(float)));
-}
-
-float* VertexBuffer::parseVertices() {
-
-    unsigned int index = 0;
-    float* glVertices = new float[vertices.size() * MAX_VERTEX_ATTRIBUTES];
-
-    for(auto& vertex : vertices) {
-        glVertices[index] = vertex.pos.x;        glVertices[index + 1] = vertex.pos.y;    glVertices[index + 2] = vertex.pos.z;
-        glVertices[index + 3] = vertex.color.r;  glVertices[index + 4] = vertex.color.g;  glVertices[index + 5] = vertex.color.b;
-        glVertices[index + 6] = vertex.normal.x; glVertices[index + 7] = vertex.normal.y; glVertices[index + 8] = vertex.normal.z;
-        glVertices[index + 9] = vertex.uv.x;     glVertices[index + 10] = vertex.uv.y;  
-        glVertices[index + 11] = vertex.tan.x;   glVertices[index + 12] = vertex.tan.y;   glVertices[index + 13] = vertex.tan.z;
-        glVertices[index + 14] = vertex.bitan.x; glVertices[index + 15] = vertex.bitan.y; glVertices[index + 16] = vertex.bitan.z;
-        index += MAX_VERTEX_ATTRIBUTES;
-    }
-
-    return glVertices;
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, bitan));
 }
 
-void VertexBuffer::initBuffer() {
-
-    float* glVertices = parseVertices();
+void VertexBuffer::upload(const Vertex* source) {
 
     glGenBuffers(1, &id);
     glBindBuffer(GL_ARRAY_BUFFER, id);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float) * MAX_VERTEX_ATTRIBUTES, glVertices, GL_STATIC_DRAW);
-
-    delete[] glVertices;
+    glBufferData(GL_ARRAY_BUFFER, size * sizeof(Vertex), source, GL_STATIC_DRAW);
+    gpuMemory.resize(size * sizeof(Vertex));
 
     vertexAttributes();
 }
 
+void VertexBuffer::initBuffer() {
+    upload(vertices.empty() ? nullptr : vertices.data());
+}
+
 void VertexBuffer::bind() {
     glBindBuffer(GL_ARRAY_BUFFER, id);
 }
@@ -175,21 +176,14 @@ VertexArray::~VertexArray() {
     glDeleteVertexArrays(1, &id);
 }
 
-VertexArray::VertexArray(const VertexArray& vertexArray) {
-    id = vertexArray.id;
-}
-
 VertexArray::VertexArray(VertexArray&& vertexArray) noexcept {
-    id = vertexArray.id;
-}
-
-VertexArray& VertexArray::operator=(const VertexArray& vertexArray) {
-    id = vertexArray.id;
-    return *this;
+    id = std::exchange(vertexArray.id, 0);
 }
 
 VertexArray& VertexArray::operator=(VertexArray&& vertexArray) noexcept {
-    id = vertexArray.id;
+    if(this == &vertexArray) return *this;
+    if(id != 0) glDeleteVertexArrays(1, &id);
+    id = std::exchange(vertexArray.id, 0);
     return *this;
 }
 
@@ -210,52 +204,89 @@ void VertexArray::unbind() {
 //  ShaderStorageBuffer  //
 //////////////////////////
 
+bool checkStorageBindings(unsigned int highestBindingPoint, const char* user) {
+
+    GLint maxBindings = 0;
+    glGetIntegerv(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, &maxBindings);
+    if(highestBindingPoint < (unsigned int)maxBindings) return true;
+
+    std::cout << user << " needs shader storage binding point " << highestBindingPoint << ", the GPU has "
+        << maxBindings << " (GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS)" << std::endl;
+    return false;
+}
+
 template <typename T>
-ShaderStorageBuffer<T>::ShaderStorageBuffer(const std::vector<T>& _data, unsigned int _bindingPoint) 
-    : data(_data), bindingPoint(_bindingPoint) {
-    initBuffer();
+ShaderStorageBuffer<T>::ShaderStorageBuffer(Span<const T> _data, unsigned int _bindingPoint, bool shadow, MemoryCategory category)
+    : Buffer(category), size(_data.size()), bindingPoint(_bindingPoint) {
+    if(shadow) data.assign(_data.begin(), _data.end());
+    hostMemory.resize(data.size() * sizeof(T));
+    upload(_data.data());
 }
 
 template <typename T>
-ShaderStorageBuffer<T>::~ShaderStorageBuffer() {
-    glDeleteBuffers(1, &id);
+ShaderStorageBuffer<T>::ShaderStorageBuffer(std::vector<T>&& _data, unsigned int _bindingPoint, bool shadow, MemoryCategory category)
+    : Buffer(category), size(_data.size()), bindingPoint(_bindingPoint) {
+    upload(_data.data());
+    if(shadow) data = std::move(_data);
+    else std::vector<T>().swap(_data);
+    hostMemory.resize(data.size() * sizeof(T));
 }
 
 template <typename T>
-ShaderStorageBuffer<T>::ShaderStorageBuffer(const ShaderStorageBuffer<T>& shaderStorageBuffer) 
-    : data(shaderStorageBuffer.data), bindingPoint(shaderStorageBuffer.bindingPoint) {
-    id = shaderStorageBuffer.id;
+ShaderStorageBuffer<T>::ShaderStorageBuffer(size_t _size, unsigned int _bindingPoint, MemoryCategory category)
+    : Buffer(category), size(_size), bindingPoint(_bindingPoint) {
+    upload(nullptr);
 }
 
 template <typename T>
-ShaderStorageBuffer<T>::ShaderStorageBuffer(ShaderStorageBuffer<T>&& shaderStorageBuffer) noexcept 
-    : data(std::move(shaderStorageBuffer.data)), bindingPoint(shaderStorageBuffer.bindingPoint) {
-    id = shaderStorageBuffer.id;
+ShaderStorageBuffer<T>::~ShaderStorageBuffer() {
+    glDeleteBuffers(1, &id);
 }
 
 template <typename T>
-ShaderStorageBuffer<T>& ShaderStorageBuffer<T>::operator=(const ShaderStorageBuffer<T>& shaderStorageBuffer) {
-    id = shaderStorageBuffer.id;
-    data = shaderStorageBuffer.data;
-    bindingPoint = shaderStorageBuffer.bindingPoint;
-    return *this;
+ShaderStorageBuffer<T>::ShaderStorageBuffer(ShaderStorageBuffer<T>&& shaderStorageBuffer) noexcept
+    : data(std::move(shaderStorageBuffer.data)), size(shaderStorageBuffer.size), bindingPoint(shaderStorageBuffer.bindingPoint) {
+    id = std::exchange(shaderStorageBuffer.id, 0);
+    gpuMemory = std::move(shaderStorageBuffer.gpuMemory);
+    hostMemory = std::move(shaderStorageBuffer.hostMemory);
 }
 
 template <typename T>
 ShaderStorageBuffer<T>& ShaderStorageBuffer<T>::operator=(ShaderStorageBuffer<T>&& shaderStorageBuffer) noexcept {
-    id = shaderStorageBuffer.id;
+    if(this == &shaderStorageBuffer) return *this;
+    if(id != 0) glDeleteBuffers(1, &id);
+    id = std::exchange(shaderStorageBuffer.id, 0);
     data = std::move(shaderStorageBuffer.data);
+    size = shaderStorageBuffer.size;
     bindingPoint = shaderStorageBuffer.bindingPoint;
+    gpuMemory = std::move(shaderStorageBuffer.gpuMemory);
+    hostMemory = std::move(shaderStorageBuffer.hostMemory);
     return *this;
 }
 
 template <typename T>
-void ShaderStorageBuffer<T>::initBuffer() {
+void ShaderStorageBuffer<T>::upload(const T* source) {
     glGenBuffers(1, &id);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(T), data.data(), GL_STATIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size * sizeof(T), source, source == nullptr ? GL_DYNAMIC_COPY : GL_STATIC_DRAW);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bindingPoint, id);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    gpuMemory.resize(size * sizeof(T));
+}
+
+template <typename T>
+MemoryCategory ShaderStorageBuffer<T>::defaultCategory() {
+    if constexpr(std::is_same_v<T, Vertex> || std::is_same_v<T, PackedVertex>) return MemoryCategory::Vertices;
+    else if constexpr(std::is_same_v<T, unsigned int>) return MemoryCategory::Indices;
+    else if constexpr(std::is_same_v<T, BVHNode>) return MemoryCategory::AccelerationStructures;
+    else if constexpr(std::is_same_v<T, AliasEntry> || std::is_same_v<T, LightBVHNode> || std::is_same_v<T, EmissiveTriangle>)
+        return MemoryCategory::Lights;
+    else return MemoryCategory::Other;
+}
+
+template <typename T>
+void ShaderStorageBuffer<T>::initBuffer() {
+    upload(data.empty() ? nullptr : data.data());
 }
 
 template <typename T>
@@ -268,7 +299,73 @@ void ShaderStorageBuffer<T>::unbind() {
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
+template <typename T>
+void ShaderStorageBuffer<T>::bindBase() {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bindingPoint, id);
+}
+
+template <typename T>
+void ShaderStorageBuffer<T>::bindBase(unsigned int _bindingPoint) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, _bindingPoint, id);
+}
+
+template <typename T>
+void ShaderStorageBuffer<T>::setData(Span<const T> _data, size_t offset) {
+    if(offset >= size) return;
+    size_t count = std::min(_data.size(), size - offset);
+    if(!data.empty()) std::copy(_data.begin(), _data.begin() + count, data.begin() + offset);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset * sizeof(T), count * sizeof(T), _data.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+template <typename T>
+std::vector<T> ShaderStorageBuffer<T>::download() const {
+    std::vector<T> result(size);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size * sizeof(T), result.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return result;
+}
+
+template <typename T>
+void ShaderStorageBuffer<T>::download(Span<T> destination, size_t offset) const {
+    if(offset >= size) return;
+    size_t count = std::min(destination.size(), size - offset);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, offset * sizeof(T), count * sizeof(T), destination.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+template <typename T>
+T* ShaderStorageBuffer<T>::map(size_t offset, size_t count) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
+    void* pointer = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, offset * sizeof(T), count * sizeof(T),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return static_cast<T*>(pointer);
+}
+
+template <typename T>
+bool ShaderStorageBuffer<T>::unmap() {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
+    bool valid = glUnmapBuffer(GL_SHADER_STORAGE_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return valid;
+}
+
 template class ShaderStorageBuffer<Vertex>;
+template class ShaderStorageBuffer<PackedVertex>;
 template class ShaderStorageBuffer<unsigned int>;
+template class ShaderStorageBuffer<int>;
+template class ShaderStorageBuffer<BVHNode>;
+template class ShaderStorageBuffer<Primitive>;
+template class ShaderStorageBuffer<AliasEntry>;
+template class ShaderStorageBuffer<LightBVHNode>;
+template class ShaderStorageBuffer<EmissiveTriangle>;
+template class ShaderStorageBuffer<glm::vec4>;
+template class ShaderStorageBuffer<ViewCamera>;
+template class ShaderStorageBuffer<QueryRay>;
+template class ShaderStorageBuffer<QueryHit>;
 
 }
\ No newline at end of file
@@ -6,9 +6,9 @@
 #include <GL/glew.h>
 
 #include "raytracingl/ptr.h"
+#include "raytracingl/span.h"
 #include "raytracingl/geometry/vertex.h"
-
-#define MAX_VERTEX_ATTRIBUTES 17
+#include "raytracingl/memory/memoryregistry.h"
 
 namespace rgl
 {
@@ -17,36 +17,47 @@ class Buffer {
     GENERATE_SHARED_PTR(Buffer)
 protected:
     unsigned int id;
+    MemoryRecord gpuMemory;     // storage
+    MemoryRecord hostMemory;    // shadow copy
     virtual void initBuffer() = 0;
 public:
-    Buffer() : id(0) {}
+    Buffer(MemoryCategory category = MemoryCategory::Other)
+        : id(0), gpuMemory(MemoryDomain::GPU, category), hostMemory(MemoryDomain::Host, category) {}
     virtual ~Buffer() = default;
 public:
     virtual void bind() = 0;
     virtual void unbind() = 0;
 public:
     unsigned int getID() const { return id; }
+    MemoryCategory getMemoryCategory() const { return gpuMemory.getCategory(); }
+    size_t getGPUBytes() const { return gpuMemory.getBytes(); }
+    size_t getHostBytes() const { return hostMemory.getBytes(); }
 };
 
 
+// The buffers upload straight from the caller's memory, a CPU copy is only kept when shadow
+// is set (getIndices(), getVertices() and getData() are empty otherwise). They own their GL
+// object, so they can be moved but not copied
 class IndexBuffer : public Buffer {
     GENERATE_SHARED_PTR(IndexBuffer)
 private:
     std::vector<unsigned int> indices;
+    size_t size;
 public:
-    IndexBuffer(const std::vector<unsigned int>& _indices);
-    IndexBuffer() = default;
+    IndexBuffer(Span<const unsigned int> _indices, bool shadow = false);
+    IndexBuffer() : Buffer(MemoryCategory::Indices), size(0) {}
     ~IndexBuffer();
-    IndexBuffer(const IndexBuffer& indexBuffer);
+    IndexBuffer(const IndexBuffer& indexBuffer) = delete;
     IndexBuffer(IndexBuffer&& indexBuffer) noexcept;
-    IndexBuffer& operator=(const IndexBuffer& indexBuffer);
+    IndexBuffer& operator=(const IndexBuffer& indexBuffer) = delete;
     IndexBuffer& operator=(IndexBuffer&& indexBuffer) noexcept;
 public:
     void initBuffer() override;
     void bind() override;
     void unbind() override;
 public:
-    std::vector<unsigned int> getIndices() const { return indices; }
+    Span<const unsigned int> getIndices() const { return indices; }
+    size_t getSize() const { return size; }
 };
 
 
@@ -54,25 +65,27 @@ class VertexBuffer : public Buffer {
     GENERATE_SHARED_PTR(VertexBuffer)
 private:
     std::vector<Vertex> vertices;
+    size_t size;
     IndexBuffer::Ptr indexBuffer;
 public:
-    VertexBuffer(const std::vector<Vertex>& _vertices);
-    VertexBuffer(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& indices);
-    VertexBuffer() = default;
+    VertexBuffer(Span<const Vertex> _vertices, bool shadow = false);
+    VertexBuffer(Span<const Vertex> _vertices, Span<const unsigned int> indices, bool shadow = false);
+    VertexBuffer() : Buffer(MemoryCategory::Vertices), size(0) {}
     ~VertexBuffer();
-    VertexBuffer(const VertexBuffer& vertexBuffer);
+    VertexBuffer(const VertexBuffer& vertexBuffer) = delete;
     VertexBuffer(VertexBuffer&& vertexBuffer) noexcept;
-    VertexBuffer& operator=(const VertexBuffer& vertexBuffer);
+    VertexBuffer& operator=(const VertexBuffer& vertexBuffer) = delete;
     VertexBuffer& operator=(VertexBuffer&& vertexBuffer) noexcept;
 private:
     void vertexAttributes();
-    float* parseVertices();
+    void upload(const Vertex* source);
 public:
     void initBuffer() override;
     void bind() override;
     void unbind() override;
 public:
-    std::vector<Vertex> getVertices() const { return vertices; }
+    Span<const Vertex> getVertices() const { return vertices; }
+    size_t getSize() const { return size; }
     IndexBuffer::Ptr getIndexBuffer() const { return indexBuffer; }
 };
 
@@ -82,9 +95,9 @@ class VertexArray : public Buffer {
 public:
     VertexArray();
     ~VertexArray();
-    VertexArray(const VertexArray& vertexArray);
+    VertexArray(const VertexArray& vertexArray) = delete;
     VertexArray(VertexArray&& vertexArray) noexcept;
-    VertexArray& operator=(const VertexArray& vertexArray);
+    VertexArray& operator=(const VertexArray& vertexArray) = delete;
     VertexArray& operator=(VertexArray&& vertexArray) noexcept;
 public:
     void initBuffer() override;
@@ -92,27 +105,58 @@ public:
     void unbind() override;
 };
 
+// OpenGL 4.3 only guarantees 8 shader storage binding points. False, printing an error that
+// names the user, if binding points up to highestBindingPoint aren't available
+bool checkStorageBindings(unsigned int highestBindingPoint, const char* user);
 
 template <typename T>
 class ShaderStorageBuffer : public Buffer {
     GENERATE_SHARED_PTR(ShaderStorageBuffer<T>)
 private:
     std::vector<T> data;
+    size_t size;
     unsigned int bindingPoint;
+private:
+    void upload(const T* source);
 public:
-    ShaderStorageBuffer(const std::vector<T>& _data, unsigned int _bindingPoint);
-    ShaderStorageBuffer() = default;
+    // MemoryRegistry category of the buffers that don't give one: vertices, indices, BVH
+    // nodes and lights are recognized by T
+    static MemoryCategory defaultCategory();
+
+    ShaderStorageBuffer(Span<const T> _data, unsigned int _bindingPoint, bool shadow = false,
+        MemoryCategory category = defaultCategory());
+    // Takes the vector as the shadow copy if one is wanted, releases it otherwise
+    ShaderStorageBuffer(std::vector<T>&& _data, unsigned int _bindingPoint, bool shadow = false,
+        MemoryCategory category = defaultCategory());
+    // GPU-only storage of _size elements, its contents are written by compute shaders
+    ShaderStorageBuffer(size_t _size, unsigned int _bindingPoint, MemoryCategory category = defaultCategory());
+    ShaderStorageBuffer() : Buffer(defaultCategory()), size(0), bindingPoint(0) {}
     ~ShaderStorageBuffer();
-    ShaderStorageBuffer(const ShaderStorageBuffer& shaderStorageBuffer);
+    ShaderStorageBuffer(const ShaderStorageBuffer& shaderStorageBuffer) = delete;
     ShaderStorageBuffer(ShaderStorageBuffer&& shaderStorageBuffer) noexcept;
-    ShaderStorageBuffer& operator=(const ShaderStorageBuffer& shaderStorageBuffer);
+    ShaderStorageBuffer& operator=(const ShaderStorageBuffer& shaderStorageBuffer) = delete;
     ShaderStorageBuffer& operator=(ShaderStorageBuffer&& shaderStorageBuffer) noexcept;
 public:
     void initBuffer() override;
     void bind() override;
     void unbind() override;
+    void bindBase();
+    void bindBase(unsigned int _bindingPoint);
+    // Writes the elements from offset
+    void setData(Span<const T> _data, size_t offset = 0);
+    std::vector<T> download() const;
+    // Reads destination.size() elements from offset into the caller's memory
+    void download(Span<T> destination, size_t offset = 0) const;
+
+    // Write-only view of count elements from offset in GPU memory, so loaders can fill the
+    // buffer without an intermediate copy. Valid until unmap(), which returns false if the
+    // contents were lost and have to be written again
+    T* map(size_t offset, size_t count);
+    T* map() { return map(0, size); }
+    bool unmap();
 public:
-    std::vector<T> getData() const { return data; }
+    Span<const T> getData() const { return data; }
+    size_t getSize() const { return size; }
     unsigned int getBindingPoint() const { return bindingPoint; }
 };
 
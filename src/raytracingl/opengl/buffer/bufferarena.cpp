@@ -0,0 +1,209 @@
+#include "bufferarena.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "raytracingl/geometry/packedvertex.h"
+
+namespace rgl
+{
+
+//////////////////////
+//  RangeAllocator  //
+//////////////////////
+
+RangeAllocator::RangeAllocator(size_t _capacity) : capacity(0), used(0) {
+    grow(_capacity);
+}
+
+void RangeAllocator::insertFree(size_t offset, size_t count) {
+
+    auto next = freeByOffset.lower_bound(offset);
+
+    if(next != freeByOffset.end() && offset + count == next->first) {
+        count += next->second;
+        next = eraseFree(next);
+    }
+
+    if(next != freeByOffset.begin()) {
+        auto previous = std::prev(next);
+        if(previous->first + previous->second == offset) {
+            offset = previous->first;
+            count += previous->second;
+            eraseFree(previous);
+        }
+    }
+
+    freeByOffset.emplace(offset, count);
+    freeBySize.emplace(count, offset);
+}
+
+std::map<size_t, size_t>::iterator RangeAllocator::eraseFree(std::map<size_t, size_t>::iterator range) {
+
+    auto [first, last] = freeBySize.equal_range(range->second);
+    for(auto it = first; it != last; it ++) {
+        if(it->second == range->first) {
+            freeBySize.erase(it);
+            break;
+        }
+    }
+
+    return freeByOffset.erase(range);
+}
+
+bool RangeAllocator::allocate(size_t count, size_t& offset) {
+
+    auto best = freeBySize.lower_bound(count);
+    if(count == 0 || best == freeBySize.end()) return false;
+
+    offset = best->second;
+    size_t rangeCount = best->first;
+    eraseFree(freeByOffset.find(offset));
+
+    // The rest can't have a free neighbour
+    if(rangeCount > count) {
+        freeByOffset.emplace(offset + count, rangeCount - count);
+        freeBySize.emplace(rangeCount - count, offset + count);
+    }
+
+    used += count;
+    return true;
+}
+
+void RangeAllocator::free(size_t offset, size_t count) {
+    if(count == 0) return;
+    used -= std::min(count, used);
+    insertFree(offset, count);
+}
+
+void RangeAllocator::grow(size_t _capacity) {
+    if(_capacity <= capacity) return;
+    insertFree(capacity, _capacity - capacity);
+    capacity = _capacity;
+}
+
+///////////////////
+//  BufferArena  //
+///////////////////
+
+template <typename T>
+BufferArena<T>::Allocation::Allocation(std::shared_ptr<BufferArena<T>> _arena, size_t _offset, size_t _count)
+    : arena(std::move(_arena)), offset(_offset), count(_count) {
+}
+
+template <typename T>
+BufferArena<T>::Allocation::Allocation() : offset(0), count(0) {
+}
+
+template <typename T>
+BufferArena<T>::Allocation::~Allocation() {
+    release();
+}
+
+template <typename T>
+BufferArena<T>::Allocation::Allocation(Allocation&& allocation) noexcept
+    : arena(std::move(allocation.arena)), offset(allocation.offset), count(allocation.count) {
+    allocation.offset = allocation.count = 0;
+}
+
+template <typename T>
+typename BufferArena<T>::Allocation& BufferArena<T>::Allocation::operator=(Allocation&& allocation) noexcept {
+    if(this == &allocation) return *this;
+    release();
+    arena = std::move(allocation.arena);
+    offset = std::exchange(allocation.offset, 0);
+    count = std::exchange(allocation.count, 0);
+    return *this;
+}
+
+template <typename T>
+void BufferArena<T>::Allocation::release() {
+    if(arena != nullptr) arena->free(offset, count);
+    arena = nullptr;
+    offset = count = 0;
+}
+
+template <typename T>
+void BufferArena<T>::Allocation::setData(Span<const T> data, size_t first) {
+    if(arena == nullptr || first >= count) return;
+    arena->buffer->setData(data.subspan(0, std::min(data.size(), count - first)), offset + first);
+}
+
+template <typename T>
+T* BufferArena<T>::Allocation::map() {
+    return arena != nullptr ? arena->buffer->map(offset, count) : nullptr;
+}
+
+template <typename T>
+bool BufferArena<T>::Allocation::unmap() {
+    return arena != nullptr && arena->buffer->unmap();
+}
+
+template <typename T>
+BufferArena<T>::BufferArena(size_t capacity, unsigned int _bindingPoint, MemoryCategory _category)
+    : allocator(capacity), bindingPoint(_bindingPoint), category(_category), numAllocations(0) {
+    buffer = ShaderStorageBuffer<T>::New(capacity, bindingPoint, category);
+}
+
+template <typename T>
+void BufferArena<T>::grow(size_t count) {
+
+    size_t oldCapacity = allocator.getCapacity();
+    size_t newCapacity = std::max(2 * oldCapacity, oldCapacity + count);
+
+    typename ShaderStorageBuffer<T>::Ptr newBuffer = ShaderStorageBuffer<T>::New(newCapacity, bindingPoint, category);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer->getID());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer->getID());
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity * sizeof(T));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    buffer = newBuffer;
+    allocator.grow(newCapacity);
+}
+
+template <typename T>
+void BufferArena<T>::free(size_t offset, size_t count) {
+    allocator.free(offset, count);
+    if(numAllocations > 0) numAllocations --;
+}
+
+template <typename T>
+typename BufferArena<T>::Allocation BufferArena<T>::allocate(size_t count) {
+
+    if(count == 0) return Allocation();
+
+    size_t offset;
+    if(!allocator.allocate(count, offset)) {
+        grow(count);
+        allocator.allocate(count, offset);
+    }
+
+    numAllocations ++;
+    return Allocation(this->shared_from_this(), offset, count);
+}
+
+template <typename T>
+typename BufferArena<T>::Allocation BufferArena<T>::allocate(Span<const T> data) {
+    Allocation allocation = allocate(data.size());
+    allocation.setData(data);
+    return allocation;
+}
+
+template <typename T>
+void BufferArena<T>::bindBase() {
+    buffer->bindBase(bindingPoint);
+}
+
+template <typename T>
+void BufferArena<T>::bindBase(unsigned int _bindingPoint) {
+    buffer->bindBase(_bindingPoint);
+}
+
+template class BufferArena<Vertex>;
+template class BufferArena<PackedVertex>;
+template class BufferArena<unsigned int>;
+
+}
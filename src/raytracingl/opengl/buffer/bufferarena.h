@@ -0,0 +1,110 @@
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <memory>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/span.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+
+namespace rgl
+{
+
+// Offset allocator over [0, capacity) in elements. The free ranges are indexed by offset, to
+// merge the neighbours of a freed range, and by size for the best fit
+class RangeAllocator {
+private:
+    std::map<size_t, size_t> freeByOffset;      // offset -> count
+    std::multimap<size_t, size_t> freeBySize;   // count -> offset
+    size_t capacity, used;
+private:
+    void insertFree(size_t offset, size_t count);
+    std::map<size_t, size_t>::iterator eraseFree(std::map<size_t, size_t>::iterator range);
+public:
+    RangeAllocator(size_t _capacity = 0);
+    ~RangeAllocator() = default;
+public:
+    // Smallest free range that fits, false if there is none
+    bool allocate(size_t count, size_t& offset);
+    void free(size_t offset, size_t count);
+    // Appends [capacity, _capacity) to the free ranges
+    void grow(size_t _capacity);
+public:
+    size_t getCapacity() const { return capacity; }
+    size_t getUsed() const { return used; }
+    size_t getLargestFree() const { return freeBySize.empty() ? 0 : freeBySize.rbegin()->first; }
+    size_t getNumFreeRanges() const { return freeByOffset.size(); }
+};
+
+
+// Many small buffers in one shader storage buffer, e.g. the vertices or the indices of every
+// mesh of a scene, so they are a single GL object bound once. Kernels index the shared buffer
+// with the offset of the allocation. The arena must be created with New, its allocations keep
+// it alive and give their range back when destroyed.
+template <typename T>
+class BufferArena : public std::enable_shared_from_this<BufferArena<T>> {
+    GENERATE_SHARED_PTR(BufferArena<T>)
+public:
+    // Move-only handle of a range of the arena
+    class Allocation {
+        friend class BufferArena<T>;
+    private:
+        std::shared_ptr<BufferArena<T>> arena;
+        size_t offset, count;
+    private:
+        Allocation(std::shared_ptr<BufferArena<T>> _arena, size_t _offset, size_t _count);
+    public:
+        Allocation();
+        ~Allocation();
+        Allocation(const Allocation& allocation) = delete;
+        Allocation(Allocation&& allocation) noexcept;
+        Allocation& operator=(const Allocation& allocation) = delete;
+        Allocation& operator=(Allocation&& allocation) noexcept;
+    public:
+        // Gives the range back to the arena, the handle is empty afterwards
+        void release();
+
+        // Writes the elements from first, relative to the allocation
+        void setData(Span<const T> data, size_t first = 0);
+        // Write-only view of the range, see ShaderStorageBuffer::map()
+        T* map();
+        bool unmap();
+    public:
+        bool isValid() const { return arena != nullptr; }
+        size_t getOffset() const { return offset; }
+        size_t getCount() const { return count; }
+        BufferArena<T>* getArena() const { return arena.get(); }
+    };
+private:
+    typename ShaderStorageBuffer<T>::Ptr buffer;
+    RangeAllocator allocator;
+    unsigned int bindingPoint;
+    MemoryCategory category;
+    size_t numAllocations;
+private:
+    // Reallocates the buffer with room for count more elements. Contents and offsets are kept
+    void grow(size_t count);
+    void free(size_t offset, size_t count);
+public:
+    BufferArena(size_t capacity, unsigned int _bindingPoint, MemoryCategory _category = ShaderStorageBuffer<T>::defaultCategory());
+    ~BufferArena() = default;
+    BufferArena(const BufferArena& bufferArena) = delete;
+    BufferArena& operator=(const BufferArena& bufferArena) = delete;
+public:
+    // The buffer grows when no free range fits, its ID changes then and it has to be bound
+    // again. Empty allocations are not valid
+    Allocation allocate(size_t count);
+    Allocation allocate(Span<const T> data);
+
+    void bindBase();
+    void bindBase(unsigned int _bindingPoint);
+public:
+    typename ShaderStorageBuffer<T>::Ptr getBuffer() const { return buffer; }
+    unsigned int getBindingPoint() const { return bindingPoint; }
+    size_t getCapacity() const { return allocator.getCapacity(); }
+    size_t getUsed() const { return allocator.getUsed(); }
+    size_t getNumAllocations() const { return numAllocations; }
+};
+
+}
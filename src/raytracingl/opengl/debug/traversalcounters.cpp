@@ -0,0 +1,141 @@
+#include "traversalcounters.h"
+
+#include <algorithm>
+
+// Layout of the counters buffer, the totals are 64 bits split in two words
+#define COUNTER_WORDS 11
+#define COUNTER_MAX_NODES 8
+#define COUNTER_MAX_ITEMS 9
+#define COUNTER_STACK_OVERFLOWS 10
+
+namespace rgl
+{
+
+TraversalCounters::TraversalCounters(int _width, int _height)
+    : width(_width), height(_height), textureID(0), memory(MemoryDomain::GPU, MemoryCategory::Other) {
+
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    // Integer textures can't be filtered
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, nullptr);
+    memory.resize((size_t)width * height * 4 * sizeof(uint32_t));
+
+    ssboCounters = ShaderStorageBuffer<unsigned int>::New(std::vector<unsigned int>(COUNTER_WORDS, 0u),
+        TRAVERSAL_COUNTERS_BINDING_POINT, false, MemoryCategory::Other);
+}
+
+TraversalCounters::~TraversalCounters() {
+    if(textureID != 0) glDeleteTextures(1, &textureID);
+}
+
+void TraversalCounters::reset() {
+    std::vector<unsigned int> zeros(COUNTER_WORDS, 0u);
+    ssboCounters->setData(zeros);
+}
+
+void TraversalCounters::bind() const {
+    glBindImageTexture(TRAVERSAL_STATS_IMAGE_UNIT, textureID, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32UI);
+    ssboCounters->bindBase();
+}
+
+TraversalCounters::Totals TraversalCounters::readTotals() const {
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    std::vector<unsigned int> counters = ssboCounters->download();
+
+    auto total = [&](unsigned int counter) {
+        return (uint64_t)counters[2 * counter] | ((uint64_t)counters[2 * counter + 1] << 32);
+    };
+
+    Totals totals;
+    totals.nodes = total(0);
+    totals.items = total(1);
+    totals.rays = total(2);
+    totals.pixels = total(3);
+    totals.maxNodes = counters[COUNTER_MAX_NODES];
+    totals.maxItems = counters[COUNTER_MAX_ITEMS];
+    totals.stackOverflows = counters[COUNTER_STACK_OVERFLOWS];
+    return totals;
+}
+
+std::vector<uint32_t> TraversalCounters::download() const {
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    std::vector<uint32_t> pixels((size_t)width * height * 4);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, pixels.data());
+    return pixels;
+}
+
+TraversalCounters::Summary TraversalCounters::summarize() const {
+
+    Summary summary;
+    summary.totals = readTotals();
+
+    std::vector<uint32_t> pixels = download();
+    size_t numPixels = (size_t)width * height;
+    if(numPixels == 0) return summary;
+
+    std::vector<uint32_t> nodes(numPixels), items(numPixels);
+    uint64_t sumNodes = 0, sumItems = 0, sumRays = 0;
+
+    for(size_t i = 0; i < numPixels; i ++) {
+
+        nodes[i] = pixels[4 * i];
+        items[i] = pixels[4 * i + 1];
+        sumNodes += nodes[i];
+        sumItems += items[i];
+        sumRays += pixels[4 * i + 2];
+
+        uint32_t depth = pixels[4 * i + 3];
+        if(depth >= summary.depthHistogram.size()) summary.depthHistogram.resize(depth + 1, 0);
+        summary.depthHistogram[depth] ++;
+    }
+
+    summary.meanNodes = (double)sumNodes / numPixels;
+    summary.meanItems = (double)sumItems / numPixels;
+    summary.meanRays = (double)sumRays / numPixels;
+
+    auto percentile = [&](std::vector<uint32_t>& values, double p) {
+        size_t k = std::min((size_t)(p * numPixels), numPixels - 1);
+        std::nth_element(values.begin(), values.begin() + k, values.end());
+        return values[k];
+    };
+
+    summary.p50Nodes = percentile(nodes, 0.5);
+    summary.p95Nodes = percentile(nodes, 0.95);
+    summary.p99Nodes = percentile(nodes, 0.99);
+    summary.p50Items = percentile(items, 0.5);
+    summary.p95Items = percentile(items, 0.95);
+    summary.p99Items = percentile(items, 0.99);
+
+    return summary;
+}
+
+void TraversalCounters::print(const Summary& summary, std::ostream& stream) {
+
+    const Totals& totals = summary.totals;
+    double rays = totals.rays > 0 ? (double)totals.rays : 1.0;
+
+    stream << "Traversal: " << totals.rays << " rays, " << (double)totals.nodes / rays << " nodes/ray, "
+        << (double)totals.items / rays << " items/ray" << std::endl;
+    stream << "  nodes/pixel mean " << summary.meanNodes << " p50 " << summary.p50Nodes << " p95 " << summary.p95Nodes
+        << " p99 " << summary.p99Nodes << " max " << totals.maxNodes << std::endl;
+    stream << "  items/pixel mean " << summary.meanItems << " p50 " << summary.p50Items << " p95 " << summary.p95Items
+        << " p99 " << summary.p99Items << " max " << totals.maxItems << std::endl;
+    stream << "  rays/pixel " << summary.meanRays << ", depth";
+    for(size_t depth = 0; depth < summary.depthHistogram.size(); depth ++)
+        stream << " " << depth << ": " << summary.depthHistogram[depth];
+    stream << std::endl;
+    if(totals.stackOverflows > 0)
+        stream << "  " << totals.stackOverflows << " nodes dropped by full traversal stacks, BVH_STACK_SIZE is too small" << std::endl;
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+#define TRAVERSAL_STATS_DEFINE "TRAVERSAL_STATS"
+#define TRAVERSAL_STATS_IMAGE_UNIT 1
+#define TRAVERSAL_COUNTERS_BINDING_POINT 11
+
+namespace rgl
+{
+
+// Counters of the debug variant of compute.glsl and fragment.glsl, compiled with
+// TRAVERSAL_STATS_DEFINE. Each pixel stores the BVH nodes visited, the triangles and primitives
+// tested, the rays traced and the depth of its path in an RGBA32UI image, which the present pass
+// shows as a heatmap. The totals of the frame are added with atomics.
+class TraversalCounters {
+    GENERATE_SHARED_PTR(TraversalCounters)
+public:
+    enum class Channel {
+        Image = 0, Nodes = 1, Items = 2, Rays = 3, Depth = 4      // heatmap uniform of fragment.glsl
+    };
+
+    struct Totals {
+        uint64_t nodes = 0, items = 0, rays = 0, pixels = 0;
+        uint32_t maxNodes = 0, maxItems = 0;            // of a pixel
+        uint32_t stackOverflows = 0;                    // nodes dropped by a full traversal stack
+    };
+
+    // Distribution over the pixels of the image
+    struct Summary {
+        Totals totals;
+        double meanNodes = 0.0, meanItems = 0.0, meanRays = 0.0;
+        uint32_t p50Nodes = 0, p95Nodes = 0, p99Nodes = 0;
+        uint32_t p50Items = 0, p95Items = 0, p99Items = 0;
+        std::vector<uint64_t> depthHistogram;           // pixels per path depth, 0 misses
+    };
+private:
+    int width, height;
+    unsigned int textureID;
+    ShaderStorageBuffer<unsigned int>::Ptr ssboCounters;
+    MemoryRecord memory;
+public:
+    TraversalCounters(int _width, int _height);
+    ~TraversalCounters();
+    TraversalCounters(const TraversalCounters& traversalCounters) = delete;
+    TraversalCounters& operator=(const TraversalCounters& traversalCounters) = delete;
+public:
+    // Zeroes the totals, once per frame before the dispatch
+    void reset();
+    // Image at TRAVERSAL_STATS_IMAGE_UNIT and totals at TRAVERSAL_COUNTERS_BINDING_POINT
+    void bind() const;
+
+    // They wait for the dispatch, debug only
+    Totals readTotals() const;
+    std::vector<uint32_t> download() const;
+    Summary summarize() const;
+
+    static void print(const Summary& summary, std::ostream& stream = std::cout);
+public:
+    unsigned int getTextureID() const { return textureID; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+};
+
+}
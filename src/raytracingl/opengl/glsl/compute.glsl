@@ -6,7 +6,12 @@
 //
 // ----------------------------------------------------------------------------
 
+// The RAY_QUERY variant traces the rays of RayQuery, one per invocation
+#ifdef RAY_QUERY
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+#else
 layout (local_size_x = 10, local_size_y = 10, local_size_z = 1) in;
+#endif
 
 // ----------------------------------------------------------------------------
 //
@@ -14,7 +19,33 @@ layout (local_size_x = 10, local_size_y = 10, local_size_z = 1) in;
 //
 // ----------------------------------------------------------------------------
 
+// The MULTI_VIEW variant traces one view per Z work group into the layers of an array, with
+// the cameras of ViewBatch
+#ifdef MULTI_VIEW
+layout(binding = 0, rgba32f) uniform image2DArray imgOutput;
+# define OUTPUT_COORD(pixel) ivec3(pixel, gl_GlobalInvocationID.z)
+#else
 layout(binding = 0, rgba32f) uniform image2D imgOutput;
+# define OUTPUT_COORD(pixel) (pixel)
+#endif
+
+// Debug variant, see TraversalCounters. Nodes visited, items tested, rays traced and depth of
+// the path of each pixel, and their totals
+#ifdef TRAVERSAL_STATS
+layout(binding = 1, rgba32ui) uniform uimage2D imgTraversalStats;
+
+layout(std430, binding = 11) buffer TraversalCounterBuffer {
+    uint traversalCounters[];   // 64 bit nodes, items, rays and pixels, max nodes and items, stack overflows
+};
+#endif
+
+// Rasterized primary hits, see VisibilityBuffer. Read when primaryVisibility is set
+layout(binding = 2, rgba32ui) readonly uniform uimage2D imgVisibility;
+
+// Surface of each pixel for TemporalReprojection, written when temporalReprojection is set:
+// motion to the previous frame in pixels, half float distances to the current and to the
+// previous camera (-1 for the sky) and octahedral normal in object space
+layout(binding = 3, rgba32ui) writeonly uniform uimage2D imgSurface;
 
 // ----------------------------------------------------------------------------
 //
@@ -39,11 +70,175 @@ layout(std430, binding = 1) buffer IndexBuffer {
     uint indices[];
 };
 
-layout (location = 0) uniform float t;
+// The same buffer when the scene was uploaded as PackedVertex, see geometry/packedvertex.h
+layout(std430, binding = 0) buffer PackedVertexBuffer {
+    uvec4 packedVertices[];
+};
+
+struct BVHNode {
+    vec3 aabbMin;
+    int left;   // child node or ~item in leaves
+    vec3 aabbMax;
+    int right;
+};
+
+layout(std430, binding = 2) buffer BVH {
+    BVHNode nodes[];
+};
+
+// Packed wide BVH nodes followed by the leaf items, see bvh/widebvh.h
+layout(std430, binding = 3) buffer WideBVH {
+    uint wideNodes[];
+};
+
+// Analytic primitives, see geometry/primitive.h
+struct Primitive {
+    vec3 position;
+    int type;       // 0 sphere, 1 box, 2 disc
+    vec3 parameters;
+    int material;
+};
+
+layout(std430, binding = 4) buffer PrimitiveBuffer {
+    Primitive primitives[];
+};
+
+// Alias table over the texels of the sky, see light/environment.h
+struct AliasEntry {
+    float probability;
+    int alias;
+    float pdf;
+    float padding;
+};
+
+layout(std430, binding = 5) buffer EnvironmentBuffer {
+    AliasEntry environmentTable[];
+};
+
+// Light BVH over the emissive triangles, see light/light.h
+struct LightBVHNode {
+    vec3 aabbMin;
+    float power;
+    vec3 aabbMax;
+    int left;       // child node or ~light in leaves
+    vec3 axis;
+    float thetaO;
+    float thetaE;
+    int right;
+    vec2 padding;
+};
+
+struct EmissiveTriangle {
+    vec3 emission;
+    int triangle;
+    uint trail;     // bit d is set when the path from the root goes right at depth d
+    uint depth;
+    vec2 padding;
+};
+
+layout(std430, binding = 6) buffer LightBVHBuffer {
+    LightBVHNode lightNodes[];
+};
+
+layout(std430, binding = 7) buffer LightBuffer {
+    EmissiveTriangle lights[];
+};
+
+layout(std430, binding = 8) buffer TriangleLightBuffer {
+    int triangleLights[];   // light of each triangle or -1
+};
+
+// Sobol direction numbers and blue noise ranks, see sampler/sampler.h
+layout(std430, binding = 9) buffer SobolBuffer {
+    uint sobolDirections[];     // 32 per dimension
+};
+
+layout(std430, binding = 10) buffer BlueNoiseBuffer {
+    uint blueNoise[];
+};
+
 layout (location = 1) uniform int numVertices;
 layout (location = 2) uniform int numIndices;
 
+uniform int numPrimitives;  // BVH items after the triangles
+
+uniform int vertexFormat;   // 0 Vertex, 1 PackedVertex
+uniform vec3 vertexOrigin;  // packed positions are vertexOrigin + 16 bit coordinates * vertexScale
+uniform vec3 vertexScale;
+uniform int vertexOffset;   // first vertex and index of the mesh when the buffers are shared
+uniform int indexOffset;    // by several meshes, see BufferArena
+
+uniform int bvhWidth;    // 0 traverses the binary BVH, 4 or 8 the wide one
+uniform int bvhBits;     // 8 or 16 bits per quantized bound
+
+uniform int environmentWidth;   // Size of the alias table, 0 if there is none
+uniform int environmentHeight;
+uniform int environmentSamples; // Light and BSDF samples per pixel, 0 keeps the unlit shading
+uniform int frame;              // Sample index of the pixels
+uniform int samplerType;        // 0 random, 1 Sobol, 2 blue noise Sobol, see SamplerType
+uniform int numLights;          // Emissive triangles in the light BVH, 0 if there are none
+uniform int accumulatedFrames;  // Frames averaged in the output so far, 0 overwrites it
+uniform int primaryVisibility;  // 1 takes the primary hits from imgVisibility instead of tracing them
+uniform int temporalReprojection;   // 1 writes imgSurface
+
+uniform vec3 cameraPosition = vec3(0.0, 0.0, 2.0);
+uniform vec3 cameraTarget = vec3(0.0);
+uniform float cameraFov = 45.0;    // Vertical, in degrees
+
+#ifdef MULTI_VIEW
+struct ViewCamera {
+    vec3 position;
+    float fov;
+    vec3 target;
+    float padding;
+};
+
+layout(std430, binding = 12) buffer ViewCameraBuffer {
+    ViewCamera viewCameras[];
+};
+#endif
+
+#ifdef RAY_QUERY
+struct QueryRay {
+    vec3 origin;
+    float tmin;
+    vec3 direction;
+    float tmax;
+};
+
+struct QueryHit {
+    vec3 normal;
+    float dist;
+    int triangle;
+    int primitive;
+    int padding0;
+    int padding1;
+};
+
+layout(std430, binding = 13) readonly buffer QueryRayBuffer {
+    QueryRay queryRays[];
+};
+
+layout(std430, binding = 14) writeonly buffer QueryHitBuffer {
+    QueryHit queryHits[];
+};
+
+layout(std430, binding = 15) writeonly buffer QueryOcclusionBuffer {
+    uint queryOccluded[];   // 1 if there is a hit in (tmin, tmax)
+};
+
+uniform int numQueryRays;
+uniform int queryOffset;        // first ray of the dispatch
+uniform int queryOcclusion;     // 1 writes queryOccluded instead of queryHits
+#endif
+
 uniform mat4 modelMatrix;
+
+// Transforms of the previous frame, for the motion vectors
+uniform mat4 previousModelMatrix;
+uniform vec3 previousCameraPosition;
+uniform vec3 previousCameraTarget;
+uniform float previousCameraFov;
 uniform sampler2D albedo;
 uniform sampler2D sky;
 
@@ -54,6 +249,87 @@ uniform sampler2D sky;
 // ----------------------------------------------------------------------------
 
 # define PI 3.14159265358979323846 
+#ifndef BVH_STACK_SIZE
+# define BVH_STACK_SIZE 64
+#endif
+# define WIDE_BVH_HEADER_SIZE 4u
+# define WIDE_BVH_LEAF_BIT 0x80000000u
+# define SOBOL_DIMENSIONS 32u
+# define BLUE_NOISE_SIZE 64u
+# define SAMPLER_SKY_DIMENSION 0u
+# define SAMPLER_LIGHT_DIMENSION 3u
+# define SAMPLER_BSDF_DIMENSION 6u
+# define SAMPLER_LIGHT_DIMENSIONS 8u
+
+#ifdef TRAVERSAL_STATS
+uint statsNodes = 0u, statsItems = 0u, statsRays = 0u, statsDepth = 0u, statsOverflows = 0u;
+# define COUNT_NODE statsNodes ++
+# define COUNT_ITEM statsItems ++
+# define COUNT_RAY statsRays ++
+# define COUNT_DEPTH(depth) statsDepth = max(statsDepth, depth)
+# define COUNT_OVERFLOW statsOverflows ++
+
+// The low word carries into the high one
+void addTraversalCounter(uint counter, uint value) {
+    uint previous = atomicAdd(traversalCounters[2u * counter], value);
+    if(previous + value < previous) atomicAdd(traversalCounters[2u * counter + 1u], 1u);
+}
+#else
+# define COUNT_NODE
+# define COUNT_ITEM
+# define COUNT_RAY
+# define COUNT_DEPTH(depth)
+# define COUNT_OVERFLOW
+#endif
+
+// Vertex attributes in either format, the packed decoding matches PackedVertex
+uint vertexIndex(uint index) {
+    return uint(vertexOffset) + indices[uint(indexOffset) + index];
+}
+
+vec3 vertexPosition(uint index) {
+    if(vertexFormat == 0) return vertices[index].pos;
+    uvec2 data = packedVertices[index].xy;
+    return vertexOrigin + vec3(data.x & 0xFFFFu, data.x >> 16, data.y & 0xFFFFu) * vertexScale;
+}
+
+vec3 vertexColor(uint index) {
+    if(vertexFormat == 0) return vertices[index].color;
+    uint color = packedVertices[index].y >> 16;
+    return vec3(float(color >> 11) / 31.0, float((color >> 5) & 63u) / 63.0, float(color & 31u) / 31.0);
+}
+
+vec3 vertexNormal(uint index) {
+    if(vertexFormat == 0) return vertices[index].normal;
+    vec2 f = unpackSnorm2x16(packedVertices[index].z);
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+vec2 vertexUV(uint index) {
+    if(vertexFormat == 0) return vertices[index].uv;
+    return unpackHalf2x16(packedVertices[index].w);
+}
+
+// Tangent frame of a triangle from its positions and UVs, for the packed vertices that don't store it
+void triangleTangents(vec3 v1, vec3 v2, vec3 v3, vec2 uv1, vec2 uv2, vec2 uv3, out vec3 tangent, out vec3 bitangent) {
+
+    vec3 e1 = v2 - v1, e2 = v3 - v1;
+    vec2 d1 = uv2 - uv1, d2 = uv3 - uv1;
+
+    float determinant = d1.x * d2.y - d2.x * d1.y;
+    if(abs(determinant) < 1e-12) {
+        tangent = bitangent = vec3(0.0);
+        return;
+    }
+
+    float invDeterminant = 1.0 / determinant;
+    tangent = (e1 * d2.y - e2 * d1.y) * invDeterminant;
+    bitangent = (e2 * d1.x - e1 * d2.x) * invDeterminant;
+}
 
 struct Ray {
     vec3 origin;
@@ -66,11 +342,6 @@ struct Triangle {
     vec3 v3;
 };
 
-struct Sphere {
-    vec3 origin;
-    float radius;
-};
-
 struct HitInfo {
     vec3 intersection;
     vec3 normal;
@@ -78,73 +349,814 @@ struct HitInfo {
     bool hit;
 };
 
-// Möller–Trumbore ray-triangle intersection algorithm
-HitInfo intersectionTriangle(Ray ray, Triangle triangle) {
+// Möller–Trumbore ray-triangle intersection algorithm. Only the distance, -1 if there is no hit
+float distanceTriangle(Ray ray, Triangle triangle) {
 
     const float epsilon = 0.0000001;
 
-    HitInfo hitInfo;
-    hitInfo.intersection = vec3(0.0);
-    hitInfo.hit = false;
-
     vec3 edge1 = triangle.v2 - triangle.v1;
     vec3 edge2 = triangle.v3 - triangle.v1;
     vec3 ray_cross_e2 = cross(ray.direction, edge2);
 
     float det = dot(edge1, ray_cross_e2);
-    if (det > -epsilon && det < epsilon) return hitInfo;
+    if (det > -epsilon && det < epsilon) return -1.0;
 
     float inv_det = 1.0 / det;
     vec3 s = ray.origin - triangle.v1;
 
     float u = inv_det * dot(s, ray_cross_e2);
-    if (u < 0 || u > 1) return hitInfo;
+    if (u < 0 || u > 1) return -1.0;
 
     vec3 s_cross_e1 = cross(s, edge1);
     float v = inv_det * dot(ray.direction, s_cross_e1);
-    if (v < 0 || u + v > 1) return hitInfo;
+    if (v < 0 || u + v > 1) return -1.0;
 
     float t = inv_det * dot(edge2, s_cross_e1);
-    if (t > epsilon) {
+    return t > epsilon ? t : -1.0;
+}
+
+HitInfo intersectionTriangle(Ray ray, Triangle triangle) {
+
+    HitInfo hitInfo;
+    hitInfo.intersection = vec3(0.0);
+    hitInfo.hit = false;
+
+    float t = distanceTriangle(ray, triangle);
+    if (t > 0.0) {
         hitInfo.intersection = vec3(ray.origin + ray.direction * t);
         hitInfo.dist = t;
-        hitInfo.normal = normalize(cross(edge2, edge1));
+        hitInfo.normal = normalize(cross(triangle.v3 - triangle.v1, triangle.v2 - triangle.v1));
         hitInfo.hit = true;
     }
 
     return hitInfo;
 }
 
-HitInfo intersectionSphere(Ray ray, Sphere sphere) {
-    
+// Only the distance, -1 if there is no hit. Same hits as intersectionPrimitive
+float distancePrimitive(Ray ray, Primitive primitive) {
+
+    const float epsilon = 0.0000001;
+
+    if(primitive.type == 0) {
+
+        vec3 oc = ray.origin - primitive.position;
+        float a = dot(ray.direction, ray.direction);
+        float b = 2.0 * dot(oc, ray.direction);
+        float c = dot(oc, oc) - primitive.parameters.x * primitive.parameters.x;
+
+        float nabla = b * b - 4.0 * a * c;
+        if(nabla <= 0.0) return -1.0;
+
+        float lambda = (-b - sqrt(nabla)) / (2.0 * a);
+        return lambda > 0.0 ? lambda : -1.0;
+    }
+
+    if(primitive.type == 1) {
+
+        vec3 t1 = (primitive.position - ray.origin) / ray.direction;
+        vec3 t2 = (primitive.parameters - ray.origin) / ray.direction;
+        vec3 tmin = min(t1, t2);
+        vec3 tmax = max(t1, t2);
+
+        float tnear = max(max(tmin.x, tmin.y), tmin.z);
+        float tfar = min(min(tmax.x, tmax.y), tmax.z);
+        if(tfar < tnear || tfar <= epsilon) return -1.0;
+
+        return tnear > epsilon ? tnear : tfar;
+    }
+
+    float radius2 = dot(primitive.parameters, primitive.parameters);
+    vec3 normal = primitive.parameters / sqrt(radius2);
+
+    float denom = dot(ray.direction, normal);
+    if(denom > -epsilon && denom < epsilon) return -1.0;
+
+    float lambda = dot(primitive.position - ray.origin, normal) / denom;
+    if(lambda <= epsilon) return -1.0;
+
+    vec3 offset = ray.origin + lambda * ray.direction - primitive.position;
+    return dot(offset, offset) <= radius2 ? lambda : -1.0;
+}
+
+// Sphere, box or disc. The normals follow the convention of the triangles
+HitInfo intersectionPrimitive(Ray ray, Primitive primitive) {
+
+    const float epsilon = 0.0000001;
+
     HitInfo hitInfo;
-    
-    vec3 oc = ray.origin - sphere.origin;
-    float a = dot(ray.direction, ray.direction);
-    float b = 2.0 * dot(oc, ray.direction);
-    float c = dot(oc, oc) - (sphere.radius * sphere.radius);
-    
-    float nabla = b * b - 4.0 * a * c;
-    
-    if (nabla > 0.0) {
-        
-        float lambda1 = (-b - sqrt(nabla)) / (2.0 * a);
-        float lambda2 = (-b + sqrt(nabla)) / (2.0 * a);
-        float lambda = min(lambda1, lambda2);
-        
-        if (lambda > 0.0) {
-            hitInfo.intersection = ray.origin + lambda * ray.direction;
-            hitInfo.normal = normalize(sphere.origin - hitInfo.intersection);
-            hitInfo.dist = lambda;
-            hitInfo.hit = true;
-            return hitInfo;
+    hitInfo.intersection = vec3(0.0);
+    hitInfo.hit = false;
+
+    float lambda;
+
+    if(primitive.type == 0) {
+
+        vec3 oc = ray.origin - primitive.position;
+        float a = dot(ray.direction, ray.direction);
+        float b = 2.0 * dot(oc, ray.direction);
+        float c = dot(oc, oc) - primitive.parameters.x * primitive.parameters.x;
+
+        float nabla = b * b - 4.0 * a * c;
+        if(nabla <= 0.0) return hitInfo;
+
+        lambda = (-b - sqrt(nabla)) / (2.0 * a);
+        if(lambda <= 0.0) return hitInfo;
+
+        hitInfo.intersection = ray.origin + lambda * ray.direction;
+        hitInfo.normal = normalize(primitive.position - hitInfo.intersection);
+    }
+    else if(primitive.type == 1) {
+
+        vec3 t1 = (primitive.position - ray.origin) / ray.direction;
+        vec3 t2 = (primitive.parameters - ray.origin) / ray.direction;
+        vec3 tmin = min(t1, t2);
+        vec3 tmax = max(t1, t2);
+
+        float tnear = max(max(tmin.x, tmin.y), tmin.z);
+        float tfar = min(min(tmax.x, tmax.y), tmax.z);
+        if(tfar < tnear || tfar <= epsilon) return hitInfo;
+
+        lambda = tnear > epsilon ? tnear : tfar;
+        int axis = lambda == tmin.x || lambda == tmax.x ? 0 : (lambda == tmin.y || lambda == tmax.y ? 1 : 2);
+
+        hitInfo.intersection = ray.origin + lambda * ray.direction;
+        hitInfo.normal = vec3(0.0);
+        hitInfo.normal[axis] = ray.direction[axis] > 0.0 ? 1.0 : -1.0;
+    }
+    else {
+
+        float radius2 = dot(primitive.parameters, primitive.parameters);
+        vec3 normal = primitive.parameters / sqrt(radius2);
+
+        float denom = dot(ray.direction, normal);
+        if(denom > -epsilon && denom < epsilon) return hitInfo;
+
+        lambda = dot(primitive.position - ray.origin, normal) / denom;
+        if(lambda <= epsilon) return hitInfo;
+
+        vec3 offset = ray.origin + lambda * ray.direction - primitive.position;
+        if(dot(offset, offset) > radius2) return hitInfo;
+
+        hitInfo.intersection = ray.origin + lambda * ray.direction;
+        hitInfo.normal = denom > 0.0 ? normal : -normal;
+    }
+
+    hitInfo.dist = lambda;
+    hitInfo.hit = true;
+    return hitInfo;
+}
+
+// Slab test, returns the entry distance or -1 if the box is missed or farther than maxDist
+float intersectionAABB(vec3 origin, vec3 invDirection, vec3 aabbMin, vec3 aabbMax, float maxDist) {
+
+    vec3 t1 = (aabbMin - origin) * invDirection;
+    vec3 t2 = (aabbMax - origin) * invDirection;
+    vec3 tmin = min(t1, t2);
+    vec3 tmax = max(t1, t2);
+
+    float tnear = max(max(tmin.x, tmin.y), tmin.z);
+    float tfar = min(min(tmax.x, tmax.y), tmax.z);
+
+    return (tfar >= max(tnear, 0.0) && tnear < maxDist) ? max(tnear, 0.0) : -1.0;
+}
+
+Triangle getTriangle(int index) {
+    Triangle triangle;
+    triangle.v1 = vertexPosition(vertexIndex(3 * index));
+    triangle.v2 = vertexPosition(vertexIndex(3 * index + 1));
+    triangle.v3 = vertexPosition(vertexIndex(3 * index + 2));
+    return triangle;
+}
+
+// BVH items are the triangles followed by the primitives
+HitInfo intersectionItem(Ray ray, int item) {
+    COUNT_ITEM;
+    return item < numIndices / 3 ? intersectionTriangle(ray, getTriangle(item))
+        : intersectionPrimitive(ray, primitives[item - numIndices / 3]);
+}
+
+float distanceItem(Ray ray, int item) {
+    COUNT_ITEM;
+    return item < numIndices / 3 ? distanceTriangle(ray, getTriangle(item))
+        : distancePrimitive(ray, primitives[item - numIndices / 3]);
+}
+
+// Closest hit traversal of the BVH nearer than maxDist. The ray is in object space, the
+// direction is not normalized so the distances match the world space ones
+HitInfo traverseBVH(Ray ray, float maxDist, out int hitItem) {
+
+    HitInfo hitInfo;
+    hitInfo.dist = maxDist;
+    hitInfo.hit = false;
+    hitItem = -1;
+
+    vec3 invDirection = 1.0 / ray.direction;
+    COUNT_RAY;
+
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize ++] = 0;
+
+    while(stackSize > 0) {
+
+        BVHNode node = nodes[stack[-- stackSize]];
+        COUNT_NODE;
+        if(intersectionAABB(ray.origin, invDirection, node.aabbMin, node.aabbMax, hitInfo.dist) < 0.0)
+            continue;
+
+        if(node.left < 0) {
+            HitInfo currentHitInfo = intersectionItem(ray, ~node.left);
+            if(currentHitInfo.hit && currentHitInfo.dist < hitInfo.dist) {
+                hitInfo = currentHitInfo;
+                hitItem = ~node.left;
+            }
+            continue;
+        }
+
+        // Visit the nearest child first
+        float distLeft = intersectionAABB(ray.origin, invDirection, nodes[node.left].aabbMin, nodes[node.left].aabbMax, hitInfo.dist);
+        float distRight = intersectionAABB(ray.origin, invDirection, nodes[node.right].aabbMin, nodes[node.right].aabbMax, hitInfo.dist);
+
+        int near = distLeft <= distRight ? node.left : node.right;
+        int far = distLeft <= distRight ? node.right : node.left;
+        float distNear = min(distLeft, distRight);
+        float distFar = max(distLeft, distRight);
+
+        if(distNear < 0.0) {
+            near = far;
+            distNear = distFar;
+            distFar = -1.0;
         }
+
+        // A full stack drops the far child, the near one always fits in the entry just popped
+        if(distFar >= 0.0) {
+            if(stackSize + 2 <= BVH_STACK_SIZE) stack[stackSize ++] = far;
+            else COUNT_OVERFLOW;
+        }
+        if(distNear >= 0.0) stack[stackSize ++] = near;
     }
-    
+
+    return hitInfo;
+}
+
+// Primary hit from the visibility buffer. The ray is intersected again with the triangle of
+// the texel so the distance is the traced one, the barycentrics are only used when the ray
+// grazes the edge and misses it. The analytic primitives aren't rasterized, they are few and
+// tested one by one
+HitInfo visibilityHit(ivec2 pixelCoord, Ray ray, out int hitItem) {
+
+    HitInfo hitInfo;
+    hitInfo.dist = 999999;
+    hitInfo.hit = false;
+    hitItem = -1;
+
+    uvec4 visibility = imageLoad(imgVisibility, pixelCoord);
+    if(visibility.x > 0u && int(visibility.x) <= numIndices / 3) {
+
+        hitItem = int(visibility.x - 1u);
+        Triangle triangle = getTriangle(hitItem);
+        COUNT_ITEM;
+
+        float dist = distanceTriangle(ray, triangle);
+        if(dist <= 0.0) {
+            vec2 b = unpackUnorm2x16(visibility.z);
+            vec3 position = (1.0 - b.x - b.y) * triangle.v1 + b.x * triangle.v2 + b.y * triangle.v3;
+            dist = dot(position - ray.origin, ray.direction) / dot(ray.direction, ray.direction);
+        }
+
+        hitInfo.dist = dist;
+        hitInfo.hit = true;
+    }
+
+    for(int i = 0; i < numPrimitives; i ++) {
+        HitInfo primitiveHitInfo = intersectionItem(ray, numIndices / 3 + i);
+        if(primitiveHitInfo.hit && primitiveHitInfo.dist < hitInfo.dist) {
+            hitInfo = primitiveHitInfo;
+            hitItem = numIndices / 3 + i;
+        }
+    }
+
+    return hitInfo;
+}
+
+uint wideQuantized(uint base, uint component, uint child) {
+    uint index = component * uint(bvhWidth) + child;
+    uint valuesPerUint = 32u / uint(bvhBits);
+    uint word = wideNodes[base + WIDE_BVH_HEADER_SIZE + uint(bvhWidth) + index / valuesPerUint];
+    return bitfieldExtract(word, int((index % valuesPerUint) * uint(bvhBits)), bvhBits);
+}
+
+// Closest hit traversal of the wide BVH, children are decoded from the quantized bounds
+HitInfo traverseWideBVH(Ray ray, float maxDist, out int hitItem) {
+
+    HitInfo hitInfo;
+    hitInfo.dist = maxDist;
     hitInfo.hit = false;
+    hitItem = -1;
+
+    vec3 invDirection = 1.0 / ray.direction;
+    COUNT_RAY;
+    uint stride = WIDE_BVH_HEADER_SIZE + uint(bvhWidth) + 6u * uint(bvhWidth * bvhBits) / 32u;
+
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize ++] = 0u;
+
+    while(stackSize > 0) {
+
+        uint base = stack[-- stackSize] * stride;
+        COUNT_NODE;
+
+        vec3 origin = uintBitsToFloat(uvec3(wideNodes[base], wideNodes[base + 1u], wideNodes[base + 2u]));
+        uint header = wideNodes[base + 3u];
+        vec3 scale = exp2(vec3(ivec3(header & 0xFFu, (header >> 8) & 0xFFu, (header >> 16) & 0xFFu) - 128));
+        uint numChildren = header >> 24;
+
+        // Internal children hit by the ray, sorted by entry distance
+        uint hitChildren[8];
+        float hitDistances[8];
+        int numHits = 0;
+
+        for(uint i = 0u; i < numChildren; i ++) {
+
+            vec3 qmin = vec3(wideQuantized(base, 0u, i), wideQuantized(base, 1u, i), wideQuantized(base, 2u, i));
+            vec3 qmax = vec3(wideQuantized(base, 3u, i), wideQuantized(base, 4u, i), wideQuantized(base, 5u, i));
+
+            float dist = intersectionAABB(ray.origin, invDirection, origin + qmin * scale, origin + qmax * scale, hitInfo.dist);
+            if(dist < 0.0) continue;
+
+            uint reference = wideNodes[base + WIDE_BVH_HEADER_SIZE + i];
+            if((reference & WIDE_BVH_LEAF_BIT) != 0u) {
+                uint first = (reference & ~WIDE_BVH_LEAF_BIT) >> 3;
+                uint count = (reference & 7u) + 1u;
+                for(uint k = 0u; k < count; k ++) {
+                    int item = int(wideNodes[first + k]);
+                    HitInfo currentHitInfo = intersectionItem(ray, item);
+                    if(currentHitInfo.hit && currentHitInfo.dist < hitInfo.dist) {
+                        hitInfo = currentHitInfo;
+                        hitItem = item;
+                    }
+                }
+                continue;
+            }
+
+            int j = numHits ++;
+            while(j > 0 && hitDistances[j - 1] < dist) {
+                hitChildren[j] = hitChildren[j - 1];
+                hitDistances[j] = hitDistances[j - 1];
+                j --;
+            }
+            hitChildren[j] = reference;
+            hitDistances[j] = dist;
+        }
+
+        // Farthest first so the nearest child is popped next. A full stack drops the farthest ones
+        int numRemaining = 0;
+        for(int i = 0; i < numHits; i ++)
+            if(hitDistances[i] < hitInfo.dist) numRemaining ++;
+        for(int i = 0; i < numHits; i ++) {
+            if(hitDistances[i] >= hitInfo.dist) continue;
+            if(stackSize + numRemaining <= BVH_STACK_SIZE) stack[stackSize ++] = hitChildren[i];
+            else COUNT_OVERFLOW;
+            numRemaining --;
+        }
+    }
+
     return hitInfo;
 }
 
+// Any hit traversal for shadow and occlusion rays, stops at the first hit closer than maxDist
+bool occludedBVH(Ray ray, float maxDist) {
+
+    vec3 invDirection = 1.0 / ray.direction;
+    COUNT_RAY;
+
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    if(intersectionAABB(ray.origin, invDirection, nodes[0].aabbMin, nodes[0].aabbMax, maxDist) >= 0.0)
+        stack[stackSize ++] = 0;
+
+    // Children are not ordered, any hit ends the traversal
+    while(stackSize > 0) {
+
+        BVHNode node = nodes[stack[-- stackSize]];
+        COUNT_NODE;
+
+        if(node.left < 0) {
+            float dist = distanceItem(ray, ~node.left);
+            if(dist > 0.0 && dist < maxDist) return true;
+            continue;
+        }
+
+        float distLeft = intersectionAABB(ray.origin, invDirection, nodes[node.left].aabbMin, nodes[node.left].aabbMax, maxDist);
+        float distRight = intersectionAABB(ray.origin, invDirection, nodes[node.right].aabbMin, nodes[node.right].aabbMax, maxDist);
+
+        // A full stack drops the right child, the left one always fits in the entry just popped
+        if(distRight >= 0.0) {
+            if(stackSize + 2 <= BVH_STACK_SIZE) stack[stackSize ++] = node.right;
+            else COUNT_OVERFLOW;
+        }
+        if(distLeft >= 0.0) stack[stackSize ++] = node.left;
+    }
+
+    return false;
+}
+
+bool occludedWideBVH(Ray ray, float maxDist) {
+
+    vec3 invDirection = 1.0 / ray.direction;
+    COUNT_RAY;
+    uint stride = WIDE_BVH_HEADER_SIZE + uint(bvhWidth) + 6u * uint(bvhWidth * bvhBits) / 32u;
+
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize ++] = 0u;
+
+    while(stackSize > 0) {
+
+        uint base = stack[-- stackSize] * stride;
+        COUNT_NODE;
+
+        vec3 origin = uintBitsToFloat(uvec3(wideNodes[base], wideNodes[base + 1u], wideNodes[base + 2u]));
+        uint header = wideNodes[base + 3u];
+        vec3 scale = exp2(vec3(ivec3(header & 0xFFu, (header >> 8) & 0xFFu, (header >> 16) & 0xFFu) - 128));
+        uint numChildren = header >> 24;
+
+        for(uint i = 0u; i < numChildren; i ++) {
+
+            vec3 qmin = vec3(wideQuantized(base, 0u, i), wideQuantized(base, 1u, i), wideQuantized(base, 2u, i));
+            vec3 qmax = vec3(wideQuantized(base, 3u, i), wideQuantized(base, 4u, i), wideQuantized(base, 5u, i));
+
+            if(intersectionAABB(ray.origin, invDirection, origin + qmin * scale, origin + qmax * scale, maxDist) < 0.0)
+                continue;
+
+            uint reference = wideNodes[base + WIDE_BVH_HEADER_SIZE + i];
+            if((reference & WIDE_BVH_LEAF_BIT) != 0u) {
+                uint first = (reference & ~WIDE_BVH_LEAF_BIT) >> 3;
+                uint count = (reference & 7u) + 1u;
+                for(uint k = 0u; k < count; k ++) {
+                    float dist = distanceItem(ray, int(wideNodes[first + k]));
+                    if(dist > 0.0 && dist < maxDist) return true;
+                }
+                continue;
+            }
+
+            if(stackSize < BVH_STACK_SIZE) stack[stackSize ++] = reference;
+            else COUNT_OVERFLOW;
+        }
+    }
+
+    return false;
+}
+
+// Visibility between the ray origin and the point at maxDist. The ray is in object space
+bool occluded(Ray ray, float maxDist) {
+    if(numIndices <= 0 && numPrimitives <= 0) return false;
+    return bvhWidth > 0 ? occludedWideBVH(ray, maxDist) : occludedBVH(ray, maxDist);
+}
+
+// PCG hash, see "Hash Functions for GPU Rendering" (Jarzynski and Olano)
+uint pcg(uint v) {
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Sample stream of a pixel, the same bits as Sampler::sampleBits
+struct PixelSampler {
+    uint x;
+    uint y;
+    uint index;
+};
+
+uint hashCombine(uint seed, uint v) {
+    return seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+uint sobol(uint index, uint dimension) {
+    uint x = 0u;
+    for(uint bit = 0u; index != 0u; index >>= 1, bit ++)
+        if((index & 1u) != 0u) x ^= sobolDirections[dimension * 32u + bit];
+    return x;
+}
+
+uint nestedUniformScramble(uint x, uint seed) {
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+uint sampleBits(PixelSampler pixelSampler, uint dimension) {
+
+    if(samplerType == 0)
+        return pcg(hashCombine(pcg(pixelSampler.x + pcg(pixelSampler.y + pcg(pixelSampler.index))), dimension));
+
+    uint seed = samplerType == 2 ? 0u : pcg(pixelSampler.x + pcg(pixelSampler.y));
+
+    uint shuffled = nestedUniformScramble(pixelSampler.index, hashCombine(seed, pcg(dimension / SOBOL_DIMENSIONS)));
+    uint value = sobol(shuffled, dimension % SOBOL_DIMENSIONS);
+    value = nestedUniformScramble(value, hashCombine(seed, dimension));
+
+    if(samplerType == 2) {
+        uint offset = pcg(dimension);
+        uint bx = (pixelSampler.x + offset) % BLUE_NOISE_SIZE, by = (pixelSampler.y + (offset >> 16)) % BLUE_NOISE_SIZE;
+        value += blueNoise[by * BLUE_NOISE_SIZE + bx] << 20;
+    }
+
+    return value;
+}
+
+// Uniform number in [0, 1)
+float sampleDimension(PixelSampler pixelSampler, uint dimension) {
+    return float(sampleBits(pixelSampler, dimension) >> 8) / 16777216.0;
+}
+
+// First dimension of a direct lighting iteration, see Sampler::lightDimension
+uint lightDimension(uint bounce, uint iteration) {
+    return (bounce * uint(environmentSamples) + iteration) * SAMPLER_LIGHT_DIMENSIONS;
+}
+
+// Equirectangular mapping of the sky, u = atan(z, x) / 2pi and v = 1 at +y
+vec2 directionToUV(vec3 direction) {
+    vec3 d = normalize(direction);
+    float u = atan(d.z, d.x) / (2.0 * PI);
+    return vec2(u < 0.0 ? u + 1.0 : u, 1.0 - acos(clamp(d.y, -1.0, 1.0)) / PI);
+}
+
+vec3 uvToDirection(vec2 uv) {
+    float phi = 2.0 * PI * uv.x;
+    float theta = PI * (1.0 - uv.y);
+    return vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+}
+
+vec3 environmentRadiance(vec3 direction) {
+    return texture(sky, directionToUV(direction)).rgb;
+}
+
+// Solid angle pdf of sampleEnvironment
+float environmentPdf(vec3 direction) {
+
+    if(environmentWidth == 0) return 0.0;
+
+    vec2 uv = directionToUV(direction);
+    int x = min(int(uv.x * environmentWidth), environmentWidth - 1);
+    int y = min(int(uv.y * environmentHeight), environmentHeight - 1);
+
+    float sinTheta = sin(PI * (1.0 - uv.y));
+    return sinTheta > 0.0 ? environmentTable[y * environmentWidth + x].pdf * float(environmentWidth * environmentHeight) / (2.0 * PI * PI * sinTheta) : 0.0;
+}
+
+// Texel drawn from the alias table, then a uniform point inside it
+vec3 sampleEnvironment(vec3 u, out float pdf) {
+
+    int count = environmentWidth * environmentHeight;
+    float scaled = u.x * float(count);
+    int index = min(int(scaled), count - 1);
+    if(scaled - float(index) >= environmentTable[index].probability) index = environmentTable[index].alias;
+
+    vec2 uv = (vec2(index % environmentWidth, index / environmentWidth) + u.yz) / vec2(environmentWidth, environmentHeight);
+
+    float sinTheta = sin(PI * (1.0 - uv.y));
+    pdf = sinTheta > 0.0 ? environmentTable[index].pdf * float(count) / (2.0 * PI * PI * sinTheta) : 0.0;
+
+    return uvToDirection(uv);
+}
+
+// Cosine weighted direction around the normal, pdf = cos / PI
+vec3 sampleCosine(vec3 normal, vec2 u) {
+
+    vec3 tangent = normalize(cross(abs(normal.x) > 0.5 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), normal));
+    vec3 bitangent = cross(normal, tangent);
+
+    float radius = sqrt(u.x);
+    float phi = 2.0 * PI * u.y;
+    return normalize(radius * cos(phi) * tangent + radius * sin(phi) * bitangent + sqrt(max(1.0 - u.x, 0.0)) * normal);
+}
+
+float powerHeuristic(float pdf, float otherPdf) {
+    return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+}
+
+// Estimated contribution of the lights below a node, mirrors LightBVH::importance
+float lightImportance(LightBVHNode node, vec3 position, vec3 normal) {
+
+    vec3 center = (node.aabbMin + node.aabbMax) * 0.5;
+    float radius = length(node.aabbMax - node.aabbMin) * 0.5;
+
+    vec3 toCenter = center - position;
+    float dist2 = dot(toCenter, toCenter);
+    float dist = sqrt(dist2);
+    vec3 direction = dist > 0.0 ? toCenter / dist : vec3(0.0, 0.0, 1.0);
+
+    float thetaU = dist > radius ? asin(radius / dist) : PI;
+
+    float theta = acos(clamp(dot(node.axis, -direction), -1.0, 1.0));
+    float thetaP = max(theta - node.thetaO - thetaU, 0.0);
+    if(thetaP >= node.thetaE) return 0.0;
+
+    float cosThetaI = 1.0;
+    if(dot(normal, normal) > 0.0) {
+        float thetaIP = max(acos(clamp(dot(normal, direction), -1.0, 1.0)) - thetaU, 0.0);
+        if(thetaIP >= PI / 2.0) return 0.0;
+        cosThetaI = cos(thetaIP);
+    }
+
+    return node.power * cos(thetaP) * cosThetaI / max(dist2, radius * radius);
+}
+
+// Light drawn by descending the light BVH, -1 if none can contribute. Object space
+int sampleLight(vec3 position, vec3 normal, float u, out float pmf) {
+
+    pmf = 0.0;
+    float probability = 1.0;
+    int index = 0;
+
+    while(lightNodes[index].left >= 0) {
+
+        LightBVHNode node = lightNodes[index];
+        float importanceLeft = lightImportance(lightNodes[node.left], position, normal);
+        float importanceRight = lightImportance(lightNodes[node.right], position, normal);
+        if(importanceLeft + importanceRight <= 0.0) return -1;
+
+        float probabilityLeft = importanceLeft / (importanceLeft + importanceRight);
+        if(u < probabilityLeft) {
+            u = min(u / probabilityLeft, 0.99999994);
+            probability *= probabilityLeft;
+            index = node.left;
+        }
+        else {
+            u = min((u - probabilityLeft) / (1.0 - probabilityLeft), 0.99999994);
+            probability *= 1.0 - probabilityLeft;
+            index = node.right;
+        }
+    }
+
+    pmf = probability;
+    return ~lightNodes[index].left;
+}
+
+// Probability of sampleLight returning the light, follows its trail from the root
+float lightPmf(vec3 position, vec3 normal, int light) {
+
+    float probability = 1.0;
+    int index = 0;
+
+    for(uint depth = 0u; lightNodes[index].left >= 0; depth ++) {
+
+        LightBVHNode node = lightNodes[index];
+        float importanceLeft = lightImportance(lightNodes[node.left], position, normal);
+        float importanceRight = lightImportance(lightNodes[node.right], position, normal);
+        if(importanceLeft + importanceRight <= 0.0) return 0.0;
+
+        bool right = ((lights[light].trail >> depth) & 1u) != 0u;
+        probability *= (right ? importanceRight : importanceLeft) / (importanceLeft + importanceRight);
+        index = right ? node.right : node.left;
+    }
+
+    return probability;
+}
+
+Triangle worldTriangle(int triangle) {
+    Triangle result;
+    result.v1 = (modelMatrix * vec4(vertexPosition(vertexIndex(3 * triangle)), 1.0)).xyz;
+    result.v2 = (modelMatrix * vec4(vertexPosition(vertexIndex(3 * triangle + 1)), 1.0)).xyz;
+    result.v3 = (modelMatrix * vec4(vertexPosition(vertexIndex(3 * triangle + 2)), 1.0)).xyz;
+    return result;
+}
+
+// Solid angle pdf of reaching a point of an emissive triangle from the light BVH,
+// 0 when the point is behind it
+float emissivePdf(Triangle triangle, vec3 direction, float dist, float pmf) {
+    vec3 lightNormal = cross(triangle.v2 - triangle.v1, triangle.v3 - triangle.v1);
+    float area = 0.5 * length(lightNormal);
+    float cosLight = -dot(normalize(lightNormal), direction);
+    return cosLight > 0.0 ? pmf * dist * dist / (cosLight * area) : 0.0;
+}
+
+// Direct lighting on a diffuse surface from the sky and the emissive triangles. Each iteration
+// takes a sample of the alias table, one of the light BVH and one of the BSDF, combined with
+// multiple importance sampling. The position and the normal are in world space, the normal
+// faces the viewer
+vec3 directLighting(vec3 position, vec3 normal, vec3 albedo, mat4 invModelMatrix, PixelSampler pixelSampler) {
+
+    vec3 radiance = vec3(0.0);
+    COUNT_DEPTH(2u);
+
+    Ray shadowRay;
+    shadowRay.origin = (invModelMatrix * vec4(position + normal * 0.0001, 1.0)).xyz;
+
+    // The light BVH is in object space
+    vec3 objectPosition = (invModelMatrix * vec4(position, 1.0)).xyz;
+    vec3 objectNormal = normalize(transpose(mat3(modelMatrix)) * normal);
+
+    for(int i = 0; i < environmentSamples; i ++) {
+
+        uint dimension = lightDimension(0u, uint(i));
+
+        // Light sample
+        if(environmentWidth > 0) {
+
+            float lightPdf;
+            vec3 direction = sampleEnvironment(vec3(sampleDimension(pixelSampler, dimension + SAMPLER_SKY_DIMENSION),
+                sampleDimension(pixelSampler, dimension + SAMPLER_SKY_DIMENSION + 1u), sampleDimension(pixelSampler, dimension + SAMPLER_SKY_DIMENSION + 2u)), lightPdf);
+            float cosTheta = dot(direction, normal);
+
+            shadowRay.direction = mat3(invModelMatrix) * direction;
+            if(lightPdf > 0.0 && cosTheta > 0.0 && !occluded(shadowRay, 999999.0)) {
+                float weight = powerHeuristic(lightPdf, cosTheta / PI);
+                radiance += environmentRadiance(direction) * (albedo / PI) * cosTheta / lightPdf * weight;
+            }
+        }
+
+        // Emissive triangle sample, a uniform point in the triangle
+        if(numLights > 0) {
+
+            float pmf;
+            int light = sampleLight(objectPosition, objectNormal, sampleDimension(pixelSampler, dimension + SAMPLER_LIGHT_DIMENSION), pmf);
+            vec2 u = vec2(sampleDimension(pixelSampler, dimension + SAMPLER_LIGHT_DIMENSION + 1u),
+                sampleDimension(pixelSampler, dimension + SAMPLER_LIGHT_DIMENSION + 2u));
+
+            if(light >= 0) {
+
+                Triangle triangle = worldTriangle(lights[light].triangle);
+                float su = sqrt(u.x);
+                vec3 point = (1.0 - su) * triangle.v1 + su * (1.0 - u.y) * triangle.v2 + su * u.y * triangle.v3;
+
+                vec3 toLight = point - position;
+                float dist = length(toLight);
+                vec3 direction = toLight / dist;
+                float cosTheta = dot(direction, normal);
+                float lightPdf = emissivePdf(triangle, direction, dist, pmf);
+
+                shadowRay.direction = mat3(invModelMatrix) * direction;
+                if(lightPdf > 0.0 && cosTheta > 0.0 && !occluded(shadowRay, dist * (1.0 - 1e-3))) {
+                    float weight = powerHeuristic(lightPdf, cosTheta / PI);
+                    radiance += lights[light].emission * (albedo / PI) * cosTheta / lightPdf * weight;
+                }
+            }
+        }
+
+        // BSDF sample, the cosine and the pdf cancel out
+        vec3 direction = sampleCosine(normal, vec2(sampleDimension(pixelSampler, dimension + SAMPLER_BSDF_DIMENSION),
+            sampleDimension(pixelSampler, dimension + SAMPLER_BSDF_DIMENSION + 1u)));
+        float cosTheta = dot(direction, normal);
+        if(cosTheta <= 0.0) continue;
+
+        shadowRay.direction = mat3(invModelMatrix) * direction;
+
+        // Without emissive triangles only the visibility of the sky matters
+        if(numLights == 0) {
+            if(!occluded(shadowRay, 999999.0)) {
+                float weight = powerHeuristic(cosTheta / PI, environmentPdf(direction));
+                radiance += environmentRadiance(direction) * albedo * weight;
+            }
+            continue;
+        }
+
+        int item;
+        HitInfo hitInfo = bvhWidth > 0 ? traverseWideBVH(shadowRay, 999999.0, item) : traverseBVH(shadowRay, 999999.0, item);
+
+        if(!hitInfo.hit) {
+            float weight = powerHeuristic(cosTheta / PI, environmentPdf(direction));
+            radiance += environmentRadiance(direction) * albedo * weight;
+        }
+        else if(item < numIndices / 3 && triangleLights[item] >= 0) {
+            int light = triangleLights[item];
+            float lightPdf = emissivePdf(worldTriangle(item), direction, hitInfo.dist, lightPmf(objectPosition, objectNormal, light));
+            if(lightPdf > 0.0)
+                radiance += lights[light].emission * albedo * powerHeuristic(cosTheta / PI, lightPdf);
+        }
+    }
+
+    return radiance / float(environmentSamples);
+}
+
+// Pixel whose primary ray goes through position, the inverse of the camera of main()
+vec2 cameraPixel(vec3 position, vec3 origin, vec3 target, float fov, vec2 resolution) {
+
+    vec3 forward = normalize(target - origin);
+    vec3 right = normalize(cross(forward, vec3(0.0, 1.0, 0.0)));
+    vec3 up = cross(right, forward);
+
+    vec3 view = position - origin;
+    float depth = dot(view, forward);
+    if(depth <= 0.0) return vec2(-1.0e6);
+
+    float tanHalfFov = tan(radians(fov) / 2.0);
+    vec2 ndc = vec2(dot(view, right) / (tanHalfFov * resolution.x / resolution.y), dot(view, up) / tanHalfFov) / depth;
+    return (ndc + 1.0) * 0.5 * resolution;
+}
+
+uint encodeOctahedral(vec3 n) {
+    vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    if(n.z < 0.0) p = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+    return packSnorm2x16(p);
+}
+
 vec3 barycentric(vec3 p, Triangle triangle) {
 
     float denom = (triangle.v2.y - triangle.v3.y) * (triangle.v1.x - triangle.v3.x) + (triangle.v3.x - triangle.v2.x) * (triangle.v1.y - triangle.v3.y);
@@ -159,28 +1171,73 @@ vec3 barycentric(vec3 p, Triangle triangle) {
     return vec3(alpha, beta, gamma);
 }
 
+#ifdef RAY_QUERY
+// Closest hit or occlusion of a query ray in object space. The origin is moved to tmin, so
+// the traversal is the one of the renderer with maxDist = tmax - tmin
+void main() {
+
+    int index = queryOffset + int(gl_GlobalInvocationID.x);
+    if(index >= numQueryRays) return;
+
+    QueryRay queryRay = queryRays[index];
+    float maxDist = queryRay.tmax - queryRay.tmin;
+
+    Ray ray;
+    ray.origin = queryRay.origin + queryRay.direction * queryRay.tmin;
+    ray.direction = queryRay.direction;
+
+    if(queryOcclusion != 0) {
+        queryOccluded[index] = maxDist > 0.0 && occluded(ray, maxDist) ? 1u : 0u;
+        return;
+    }
+
+    QueryHit queryHit = QueryHit(vec3(0.0), 999999.0, -1, -1, 0, 0);
+    if(maxDist > 0.0 && (numIndices > 0 || numPrimitives > 0)) {
+
+        int item;
+        HitInfo hitInfo = bvhWidth > 0 ? traverseWideBVH(ray, maxDist, item) : traverseBVH(ray, maxDist, item);
+
+        if(hitInfo.hit) {
+            queryHit.normal = hitInfo.normal;
+            queryHit.dist = hitInfo.dist + queryRay.tmin;
+            queryHit.triangle = item < numIndices / 3 ? item : -1;
+            queryHit.primitive = item < numIndices / 3 ? -1 : item - numIndices / 3;
+        }
+    }
+
+    queryHits[index] = queryHit;
+}
+#else
 void main() {
 
     // Definición de la cámara
-    vec3 cameraPos = vec3(0.0, 0.0, 2.0); // Posición de la cámara
-    vec3 cameraTarget = vec3(0.0, 0.0, 0.0); // Punto donde la cámara está mirando
+#ifdef MULTI_VIEW
+    ViewCamera viewCamera = viewCameras[gl_GlobalInvocationID.z];
+    vec3 cameraPos = viewCamera.position;
+    vec3 cameraLookAt = viewCamera.target;
+    float cameraFieldOfView = viewCamera.fov;
+#else
+    vec3 cameraPos = cameraPosition; // Posición de la cámara
+    vec3 cameraLookAt = cameraTarget;
+    float cameraFieldOfView = cameraFov;
+#endif
     vec3 cameraUp = vec3(0.0, 1.0, 0.0); // Vector hacia arriba
 
     // Calcular los vectores de la cámara
-    vec3 forward = normalize(cameraTarget - cameraPos);
+    vec3 forward = normalize(cameraLookAt - cameraPos);
     vec3 right = normalize(cross(forward, cameraUp));
     vec3 up = cross(right, forward);
 
-    vec2 imageSize = vec2(500, 500);
+    vec2 resolution = vec2(imageSize(imgOutput).xy);
     ivec2 pixelCoord = ivec2(gl_GlobalInvocationID.xy);
-    vec2 xy = 2.0 * pixelCoord / imageSize - 1.0;
+    if(any(greaterThanEqual(pixelCoord, imageSize(imgOutput).xy))) return;
 
     // Convertir las coordenadas del píxel a coordenadas normalizadas (-1 a 1)
-    vec2 ndc = (vec2(pixelCoord) / imageSize) * 2.0 - 1.0;
+    vec2 ndc = (vec2(pixelCoord) / resolution) * 2.0 - 1.0;
 
     // Campo de visión (FOV) y aspecto ratio
-    float fov = radians(45.0); // Campo de visión en radianes
-    float aspectRatio = imageSize.x / imageSize.y;
+    float fov = radians(cameraFieldOfView); // Campo de visión en radianes
+    float aspectRatio = resolution.x / resolution.y;
 
     // Coordenadas en el plano de la imagen
     float imagePlaneX = ndc.x * aspectRatio * tan(fov / 2.0);
@@ -197,86 +1254,135 @@ void main() {
     bool intersects = false;
 
     // Check intersection with mesh
-    for(int i = 0; i < numIndices; i += 3) {
+    mat4 invModelMatrix = inverse(modelMatrix);
+
+    Ray objectRay;
+    objectRay.origin = (invModelMatrix * vec4(ray.origin, 1.0)).xyz;
+    objectRay.direction = mat3(invModelMatrix) * ray.direction;
+
+    int item = -1;
+    if(primaryVisibility != 0) {
+        hitInfo = visibilityHit(pixelCoord, objectRay, item);
+        intersects = hitInfo.hit;
+    }
+    else if(numIndices > 0 || numPrimitives > 0) {
+        hitInfo = bvhWidth > 0 ? traverseWideBVH(objectRay, 999999.0, item) : traverseBVH(objectRay, 999999.0, item);
+        intersects = hitInfo.hit;
+    }
+
+    PixelSampler pixelSampler = PixelSampler(uint(pixelCoord.x), uint(pixelCoord.y), uint(frame));
+    vec3 surfaceNormal = vec3(0.0, 0.0, 1.0);   // world space, not flipped towards the camera
+
+    // Analytic primitive
+    if(intersects && item >= numIndices / 3) {
+        vec3 normal = normalize(transpose(mat3(invModelMatrix)) * hitInfo.normal);
+        surfaceNormal = -normal;
+        if(environmentSamples > 0)
+            color = directLighting(ray.origin + ray.direction * hitInfo.dist, -normal, vec3(1.0), invModelMatrix, pixelSampler);
+        else
+            color = vec3(1.0) * dot(ray.direction, normal);
+    }
+
+    // Triangle
+    else if(intersects) {
+
+        int i = 3 * item;
 
         Triangle triangle;
-        triangle.v1 = (modelMatrix * vec4(vertices[indices[i]].pos, 1.0)).xyz;
-        triangle.v2 = (modelMatrix * vec4(vertices[indices[i + 1]].pos, 1.0)).xyz;
-        triangle.v3 = (modelMatrix * vec4(vertices[indices[i + 2]].pos, 1.0)).xyz;
-
-        HitInfo currentHitInfo = intersectionTriangle(ray, triangle);
-
-        if(currentHitInfo.hit && currentHitInfo.dist < hitInfo.dist) {
-
-            intersects = true;
-            vec3 barycentricCoords = barycentric(currentHitInfo.intersection, triangle);
-
-            // Color interpolation -> same with textures
-            vec3 c1 = vertices[indices[i]].color;
-            vec3 c2 = vertices[indices[i + 1]].color;
-            vec3 c3 = vertices[indices[i + 2]].color;
-            vec3 colorInterpolation = barycentricCoords.x * c1 + barycentricCoords.y * c2 + barycentricCoords.z * c3;
-
-            // Normal interpolation
-            vec3 normal1 = vertices[indices[i]].normal;
-            vec3 normal2 = vertices[indices[i + 1]].normal;
-            vec3 normal3 = vertices[indices[i + 2]].normal;
-            vec3 normalInterpolation = normalize(barycentricCoords.x * normal1 + barycentricCoords.y * normal2 + barycentricCoords.z * normal3);
-
-            // UVs interpolation
-            vec2 uv1 = vertices[indices[i]].uv;
-            vec2 uv2 = vertices[indices[i + 1]].uv;
-            vec2 uv3 = vertices[indices[i + 2]].uv;
-            vec2 uvInterpolation = barycentricCoords.x * uv1 + barycentricCoords.y * uv2 + barycentricCoords.z * uv3;
-
-            // Tan interpolation
-            vec3 tan1 = vertices[indices[i]].tan;
-            vec3 tan2 = vertices[indices[i + 1]].tan;
-            vec3 tan3 = vertices[indices[i + 2]].tan;
-            vec3 tanInterpolation = barycentricCoords.x * tan1 + barycentricCoords.y * tan2 + barycentricCoords.z * tan3;
-
-            // Bitan interpolation
-            vec3 bitan1 = vertices[indices[i]].bitan;
-            vec3 bitan2 = vertices[indices[i + 1]].bitan;
-            vec3 bitan3 = vertices[indices[i + 2]].bitan;
-            vec3 bitanInterpolation = barycentricCoords.x * bitan1 + barycentricCoords.y * bitan2 + barycentricCoords.z * bitan3;
-
-            // Update hitInfo
-            //currentHitInfo.normal = normalInterpolation; // If the vertices have normals
-            hitInfo = currentHitInfo;
-
-            // Update color
-            //color = colorInterpolation * dot(hitInfo.normal, ray.direction);
-            color = colorInterpolation * texture(albedo, uvInterpolation).rgb * dot(hitInfo.normal, ray.direction);
+        triangle.v1 = (modelMatrix * vec4(vertexPosition(vertexIndex(i)), 1.0)).xyz;
+        triangle.v2 = (modelMatrix * vec4(vertexPosition(vertexIndex(i + 1)), 1.0)).xyz;
+        triangle.v3 = (modelMatrix * vec4(vertexPosition(vertexIndex(i + 2)), 1.0)).xyz;
+
+        hitInfo.intersection = ray.origin + ray.direction * hitInfo.dist;
+        hitInfo.normal = normalize(cross(triangle.v3 - triangle.v1, triangle.v2 - triangle.v1));
+        surfaceNormal = hitInfo.normal;
+        vec3 barycentricCoords = barycentric(hitInfo.intersection, triangle);
+
+        // Color interpolation -> same with textures
+        vec3 c1 = vertexColor(vertexIndex(i));
+        vec3 c2 = vertexColor(vertexIndex(i + 1));
+        vec3 c3 = vertexColor(vertexIndex(i + 2));
+        vec3 colorInterpolation = barycentricCoords.x * c1 + barycentricCoords.y * c2 + barycentricCoords.z * c3;
+
+        // Normal interpolation
+        vec3 normal1 = vertexNormal(vertexIndex(i));
+        vec3 normal2 = vertexNormal(vertexIndex(i + 1));
+        vec3 normal3 = vertexNormal(vertexIndex(i + 2));
+        vec3 normalInterpolation = normalize(barycentricCoords.x * normal1 + barycentricCoords.y * normal2 + barycentricCoords.z * normal3);
+
+        // UVs interpolation
+        vec2 uv1 = vertexUV(vertexIndex(i));
+        vec2 uv2 = vertexUV(vertexIndex(i + 1));
+        vec2 uv3 = vertexUV(vertexIndex(i + 2));
+        vec2 uvInterpolation = barycentricCoords.x * uv1 + barycentricCoords.y * uv2 + barycentricCoords.z * uv3;
+
+        // Tangent frame, interpolated or rebuilt from the triangle
+        vec3 tanInterpolation, bitanInterpolation;
+        if(vertexFormat == 0) {
+            vec3 tan1 = vertices[vertexIndex(i)].tan;
+            vec3 tan2 = vertices[vertexIndex(i + 1)].tan;
+            vec3 tan3 = vertices[vertexIndex(i + 2)].tan;
+            tanInterpolation = barycentricCoords.x * tan1 + barycentricCoords.y * tan2 + barycentricCoords.z * tan3;
+
+            vec3 bitan1 = vertices[vertexIndex(i)].bitan;
+            vec3 bitan2 = vertices[vertexIndex(i + 1)].bitan;
+            vec3 bitan3 = vertices[vertexIndex(i + 2)].bitan;
+            bitanInterpolation = barycentricCoords.x * bitan1 + barycentricCoords.y * bitan2 + barycentricCoords.z * bitan3;
         }
-    }
+        else triangleTangents(vertexPosition(vertexIndex(i)), vertexPosition(vertexIndex(i + 1)), vertexPosition(vertexIndex(i + 2)),
+            uv1, uv2, uv3, tanInterpolation, bitanInterpolation);
 
-    // Sky
-    if(!intersects) {
+        // Update hitInfo
+        //hitInfo.normal = normalInterpolation; // If the vertices have normals
 
-        // Normalizar la dirección del rayo (asegurándote de que es un vector unitario)
-        vec3 rayDirection = normalize(ray.direction);
+        // Update color
+        //color = colorInterpolation * dot(hitInfo.normal, ray.direction);
+        vec3 albedoColor = colorInterpolation * texture(albedo, uvInterpolation).rgb;
+        vec3 facingNormal = dot(hitInfo.normal, ray.direction) > 0.0 ? -hitInfo.normal : hitInfo.normal;
+        if(environmentSamples > 0)
+            color = directLighting(hitInfo.intersection, facingNormal, albedoColor, invModelMatrix, pixelSampler);
+        else
+            color = albedoColor * dot(hitInfo.normal, ray.direction);
 
-        // Calcular las coordenadas esféricas de la dirección del rayo
-        float theta = acos(rayDirection.y);                 // Ángulo polar (elevación)
-        float phi = 2 * atan(rayDirection.z, rayDirection.x); // Ángulo azimutal
+        // Emitters are seen from the side of cross(v2 - v1, v3 - v1)
+        if(numLights > 0 && triangleLights[item] >= 0 && dot(hitInfo.normal, ray.direction) > 0.0)
+            color += lights[triangleLights[item]].emission;
+    }
 
-        // Convertir los ángulos a coordenadas UV (en el rango [0, 1])
-        float u = phi / (2 * PI);
-        float v = 1.0 - (theta / PI);
+    // Sky
+    if(!intersects) color = environmentRadiance(ray.direction);
 
-        // Obtener el color de la skybox desde la imagen 360 en (pixel_x, pixel_y)
-        color = texture(sky, vec2(u, v)).rgb;
+    // Where the surface was in the previous frame: the hit in object space through the previous
+    // model matrix, or the direction of the sky, seen from the previous camera. Its distance to
+    // that camera is what the previous frame stored as its own distance if it saw the same
+    // surface, and the object space normal doesn't change with the model matrix
+    if(temporalReprojection != 0) {
+        vec3 previousPosition = intersects
+            ? (previousModelMatrix * vec4(objectRay.origin + objectRay.direction * hitInfo.dist, 1.0)).xyz
+            : previousCameraPosition + ray.direction;
+        vec2 motion = cameraPixel(previousPosition, previousCameraPosition, previousCameraTarget, previousCameraFov, resolution) - vec2(pixelCoord);
+        vec2 depths = intersects ? min(vec2(hitInfo.dist, distance(previousCameraPosition, previousPosition)), vec2(65504.0)) : vec2(-1.0);
+        vec3 objectNormal = normalize(transpose(mat3(modelMatrix)) * surfaceNormal);
+        imageStore(imgSurface, pixelCoord, uvec4(floatBitsToUint(motion.x), floatBitsToUint(motion.y), packHalf2x16(depths),
+            encodeOctahedral(objectNormal)));
     }
 
-    // Check intersection with sphere
-    Sphere sphere;
-    sphere.origin = vec3(0.0, sin(t) / 2.0, -2.0);
-    sphere.radius = 0.25;
+#ifdef TRAVERSAL_STATS
+    if(intersects) COUNT_DEPTH(1u);
+    imageStore(imgTraversalStats, pixelCoord, uvec4(statsNodes, statsItems, statsRays, statsDepth));
+    addTraversalCounter(0u, statsNodes);
+    addTraversalCounter(1u, statsItems);
+    addTraversalCounter(2u, statsRays);
+    addTraversalCounter(3u, 1u);
+    atomicMax(traversalCounters[8], statsNodes);
+    atomicMax(traversalCounters[9], statsItems);
+    if(statsOverflows > 0u) atomicAdd(traversalCounters[10], statsOverflows);
+#endif
 
-    hitInfo = intersectionSphere(ray, sphere);
-    if(hitInfo.hit) color = vec3(1.0) * dot(ray.direction, hitInfo.normal);
+    // Progressive accumulation over the frames already in the output
+    if(accumulatedFrames > 0) color = mix(imageLoad(imgOutput, OUTPUT_COORD(pixelCoord)).rgb, color, 1.0 / float(accumulatedFrames + 1));
 
     // Write pixel
-    imageStore(imgOutput, pixelCoord, vec4(color, 1.0));
-}
\ No newline at end of file
+    imageStore(imgOutput, OUTPUT_COORD(pixelCoord), vec4(color, 1.0));
+}
+#endif
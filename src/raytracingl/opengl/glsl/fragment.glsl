@@ -6,8 +6,30 @@ in vec2 TexCoords;
 
 uniform sampler2D tex;
 
+// Heatmap of TraversalCounters, only in the TRAVERSAL_STATS variant
+#ifdef TRAVERSAL_STATS
+uniform usampler2D traversalStats;
+uniform int heatmap;            // 0 shows tex, 1 nodes, 2 items, 3 rays, 4 path depth
+uniform float heatmapScale;     // count at the red end of the color map
+
+// Blue, cyan, green, yellow and red
+vec3 falseColor(float t) {
+    t = clamp(t, 0.0, 1.0) * 4.0;
+    vec3 colors[5] = vec3[](vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 1.0), vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0));
+    int i = min(int(t), 3);
+    return mix(colors[i], colors[i + 1], t - float(i));
+}
+#endif
+
 void main()
 {             
     vec3 texCol = texture(tex, TexCoords).rgb;      
+#ifdef TRAVERSAL_STATS
+    if(heatmap > 0) {
+        ivec2 size = textureSize(traversalStats, 0);
+        uvec4 stats = texelFetch(traversalStats, min(ivec2(TexCoords * vec2(size)), size - 1), 0);
+        texCol = falseColor(float(stats[heatmap - 1]) / max(heatmapScale, 1.0));
+    }
+#endif
     FragColor = vec4(texCol, 1.0);
 }
\ No newline at end of file
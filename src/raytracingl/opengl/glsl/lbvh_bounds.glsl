@@ -0,0 +1,152 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// LBVH build, step 5: bottom-up bounds. Each leaf walks towards the root and
+// the second child to arrive at a node computes its bounds. The depth of the
+// deepest leaf is kept for the traversal stack size, see LBVH::getDepth()
+//
+// ----------------------------------------------------------------------------
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+struct Vertex {
+    vec3 pos;
+    vec3 color;
+    vec3 normal;
+    vec2 uv;
+    vec3 tan;
+    vec3 bitan;
+};
+
+struct BVHNode {
+    vec3 aabbMin;
+    int left;
+    vec3 aabbMax;
+    int right;
+};
+
+layout(std430, binding = 0) readonly buffer VertexBuffer {
+    Vertex vertices[];
+};
+
+layout(std430, binding = 1) readonly buffer IndexBuffer {
+    uint indices[];
+};
+
+// The same buffer when the scene was uploaded as PackedVertex, see geometry/packedvertex.h
+layout(std430, binding = 0) readonly buffer PackedVertexBuffer {
+    uvec4 packedVertices[];
+};
+
+struct Primitive {
+    vec3 position;
+    int type;       // 0 sphere, 1 box, 2 disc
+    vec3 parameters;
+    int material;
+};
+
+layout(std430, binding = 4) readonly buffer PrimitiveBuffer {
+    Primitive primitives[];
+};
+
+layout(std430, binding = 2) coherent buffer BVH {
+    BVHNode nodes[];
+};
+
+layout(std430, binding = 16) readonly buffer Parents {
+    int parents[];
+};
+
+layout(std430, binding = 19) coherent buffer Flags {
+    uint flags[];
+};
+
+layout(std430, binding = 20) buffer Depth {
+    uint maxDepth;
+};
+
+uniform int numTriangles;
+uniform int numPrimitives;
+uniform int vertexFormat;   // 0 Vertex, 1 PackedVertex
+uniform vec3 vertexOrigin;  // packed positions are vertexOrigin + 16 bit coordinates * vertexScale
+uniform vec3 vertexScale;
+uniform int vertexOffset;   // first vertex and index of the mesh when the buffers are shared
+uniform int indexOffset;    // by several meshes, see BufferArena
+
+uint vertexIndex(uint index) {
+    return uint(vertexOffset) + indices[uint(indexOffset) + index];
+}
+
+vec3 vertexPosition(uint index) {
+    if(vertexFormat == 0) return vertices[index].pos;
+    uvec2 data = packedVertices[index].xy;
+    return vertexOrigin + vec3(data.x & 0xFFFFu, data.x >> 16, data.y & 0xFFFFu) * vertexScale;
+}
+
+// Bounds of an item: triangles first and then the analytic primitives
+void itemBounds(int item, out vec3 aabbMin, out vec3 aabbMax) {
+
+    if(item < numTriangles) {
+        vec3 v1 = vertexPosition(vertexIndex(3 * item));
+        vec3 v2 = vertexPosition(vertexIndex(3 * item + 1));
+        vec3 v3 = vertexPosition(vertexIndex(3 * item + 2));
+        aabbMin = min(v1, min(v2, v3));
+        aabbMax = max(v1, max(v2, v3));
+        return;
+    }
+
+    Primitive primitive = primitives[item - numTriangles];
+
+    if(primitive.type == 0) {
+        aabbMin = primitive.position - vec3(primitive.parameters.x);
+        aabbMax = primitive.position + vec3(primitive.parameters.x);
+    }else if(primitive.type == 1) {
+        aabbMin = primitive.position;
+        aabbMax = primitive.parameters;
+    }else {
+        float radius = length(primitive.parameters);
+        vec3 normal = primitive.parameters / radius;
+        vec3 extent = radius * sqrt(max(vec3(1.0) - normal * normal, vec3(0.0)));
+        aabbMin = primitive.position - extent;
+        aabbMax = primitive.position + extent;
+    }
+}
+
+void main() {
+
+    int i = int(gl_GlobalInvocationID.x);
+    if(i >= numTriangles + numPrimitives) return;
+
+    // Leaf bounds
+    int node = numTriangles + numPrimitives - 1 + i;
+
+    vec3 aabbMin, aabbMax;
+    itemBounds(~nodes[node].left, aabbMin, aabbMax);
+
+    nodes[node].aabbMin = aabbMin;
+    nodes[node].aabbMax = aabbMax;
+    memoryBarrierBuffer();
+
+    uint depth = 0u;
+    for(int parent = parents[node]; parent != -1; parent = parents[parent]) depth ++;
+    atomicMax(maxDepth, depth);
+
+    // Internal nodes
+    node = parents[node];
+    while(node != -1) {
+
+        // The first child to arrive stops, its sibling is not ready yet
+        if(atomicAdd(flags[node], 1u) == 0u) return;
+        memoryBarrierBuffer();
+
+        BVHNode left = nodes[nodes[node].left];
+        BVHNode right = nodes[nodes[node].right];
+
+        nodes[node].aabbMin = min(left.aabbMin, right.aabbMin);
+        nodes[node].aabbMax = max(left.aabbMax, right.aabbMax);
+        memoryBarrierBuffer();
+
+        node = parents[node];
+    }
+}
@@ -0,0 +1,112 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// LBVH build, step 4: hierarchy emission from the sorted Morton codes
+// (Karras 2012, "Maximizing Parallelism in the Construction of BVHs,
+// Octrees, and k-d Trees"). Internal nodes are [0, n - 2], leaves [n - 1, 2n - 2]
+//
+// ----------------------------------------------------------------------------
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+struct BVHNode {
+    vec3 aabbMin;
+    int left;
+    vec3 aabbMax;
+    int right;
+};
+
+layout(std430, binding = 2) writeonly buffer BVH {
+    BVHNode nodes[];
+};
+
+layout(std430, binding = 16) writeonly buffer Parents {
+    int parents[];
+};
+
+layout(std430, binding = 17) readonly buffer Keys {
+    uint keys[];
+};
+
+layout(std430, binding = 18) readonly buffer Values {
+    uint values[];
+};
+
+layout(std430, binding = 19) writeonly buffer Flags {
+    uint flags[];
+};
+
+uniform int numItems;    // triangles and analytic primitives
+
+// ----------------------------------------------------------------------------
+//
+// Functions
+//
+// ----------------------------------------------------------------------------
+
+int clz(uint x) {
+    return 31 - findMSB(x);
+}
+
+// Length of the common prefix of the keys i and j. Equal keys are
+// disambiguated by their index
+int delta(int i, int j) {
+
+    if(j < 0 || j >= numItems) return -1;
+
+    uint ki = keys[i];
+    uint kj = keys[j];
+    if(ki == kj) return 32 + clz(uint(i ^ j));
+
+    return clz(ki ^ kj);
+}
+
+void main() {
+
+    int i = int(gl_GlobalInvocationID.x);
+    if(i >= numItems) return;
+
+    int numInternal = numItems - 1;
+
+    // Leaf
+    nodes[numInternal + i].left = ~int(values[i]);
+    nodes[numInternal + i].right = -1;
+
+    if(i == 0) parents[0] = -1;
+    if(i >= numInternal) return;
+
+    flags[i] = 0u;
+
+    // Direction of the range
+    int d = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1;
+
+    // Upper bound of the range length
+    int deltaMin = delta(i, i - d);
+    int lmax = 2;
+    while(delta(i, i + lmax * d) > deltaMin) lmax *= 2;
+
+    // Other end of the range
+    int l = 0;
+    for(int t = lmax / 2; t >= 1; t /= 2)
+        if(delta(i, i + (l + t) * d) > deltaMin) l += t;
+    int j = i + l * d;
+
+    // Split position
+    int deltaNode = delta(i, j);
+    int s = 0;
+    int t = l;
+    do {
+        t = (t + 1) / 2;
+        if(delta(i, i + (s + t) * d) > deltaNode) s += t;
+    } while(t > 1);
+    int gamma = i + s * d + min(d, 0);
+
+    int left = min(i, j) == gamma ? numInternal + gamma : gamma;
+    int right = max(i, j) == gamma + 1 ? numInternal + gamma + 1 : gamma + 1;
+
+    nodes[i].left = left;
+    nodes[i].right = right;
+    parents[left] = i;
+    parents[right] = i;
+}
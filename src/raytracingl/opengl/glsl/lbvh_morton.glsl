@@ -0,0 +1,153 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// LBVH build, step 2: 30 bit Morton code of each triangle center
+//
+// ----------------------------------------------------------------------------
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+struct Vertex {
+    vec3 pos;
+    vec3 color;
+    vec3 normal;
+    vec2 uv;
+    vec3 tan;
+    vec3 bitan;
+};
+
+layout(std430, binding = 0) readonly buffer VertexBuffer {
+    Vertex vertices[];
+};
+
+layout(std430, binding = 1) readonly buffer IndexBuffer {
+    uint indices[];
+};
+
+// The same buffer when the scene was uploaded as PackedVertex, see geometry/packedvertex.h
+layout(std430, binding = 0) readonly buffer PackedVertexBuffer {
+    uvec4 packedVertices[];
+};
+
+struct Primitive {
+    vec3 position;
+    int type;       // 0 sphere, 1 box, 2 disc
+    vec3 parameters;
+    int material;
+};
+
+layout(std430, binding = 4) readonly buffer PrimitiveBuffer {
+    Primitive primitives[];
+};
+
+layout(std430, binding = 16) readonly buffer SceneBounds {
+    uint sceneBounds[6];
+};
+
+layout(std430, binding = 17) writeonly buffer Keys {
+    uint keys[];
+};
+
+layout(std430, binding = 18) writeonly buffer Values {
+    uint values[];
+};
+
+uniform int numTriangles;
+uniform int numPrimitives;
+uniform int vertexFormat;   // 0 Vertex, 1 PackedVertex
+uniform vec3 vertexOrigin;  // packed positions are vertexOrigin + 16 bit coordinates * vertexScale
+uniform vec3 vertexScale;
+uniform int vertexOffset;   // first vertex and index of the mesh when the buffers are shared
+uniform int indexOffset;    // by several meshes, see BufferArena
+
+// ----------------------------------------------------------------------------
+//
+// Functions
+//
+// ----------------------------------------------------------------------------
+
+float orderedFloat(uint u) {
+    return uintBitsToFloat((u & 0x80000000u) != 0u ? u & 0x7FFFFFFFu : ~u);
+}
+
+// Inserts two zero bits between each of the 10 lower bits
+uint expandBits(uint v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+uint morton3D(vec3 p) {
+    uvec3 q = uvec3(clamp(p * 1024.0, 0.0, 1023.0));
+    return (expandBits(q.x) << 2) | (expandBits(q.y) << 1) | expandBits(q.z);
+}
+
+uint vertexIndex(uint index) {
+    return uint(vertexOffset) + indices[uint(indexOffset) + index];
+}
+
+vec3 vertexPosition(uint index) {
+    if(vertexFormat == 0) return vertices[index].pos;
+    uvec2 data = packedVertices[index].xy;
+    return vertexOrigin + vec3(data.x & 0xFFFFu, data.x >> 16, data.y & 0xFFFFu) * vertexScale;
+}
+
+// Bounds of an item: triangles first and then the analytic primitives
+void itemBounds(int item, out vec3 aabbMin, out vec3 aabbMax) {
+
+    if(item < numTriangles) {
+        vec3 v1 = vertexPosition(vertexIndex(3 * item));
+        vec3 v2 = vertexPosition(vertexIndex(3 * item + 1));
+        vec3 v3 = vertexPosition(vertexIndex(3 * item + 2));
+        aabbMin = min(v1, min(v2, v3));
+        aabbMax = max(v1, max(v2, v3));
+        return;
+    }
+
+    Primitive primitive = primitives[item - numTriangles];
+
+    if(primitive.type == 0) {
+        aabbMin = primitive.position - vec3(primitive.parameters.x);
+        aabbMax = primitive.position + vec3(primitive.parameters.x);
+    }else if(primitive.type == 1) {
+        aabbMin = primitive.position;
+        aabbMax = primitive.parameters;
+    }else {
+        float radius = length(primitive.parameters);
+        vec3 normal = primitive.parameters / radius;
+        vec3 extent = radius * sqrt(max(vec3(1.0) - normal * normal, vec3(0.0)));
+        aabbMin = primitive.position - extent;
+        aabbMax = primitive.position + extent;
+    }
+}
+
+// Triangle centroid or center of the bounds of an analytic primitive
+vec3 itemCenter(int item) {
+
+    if(item < numTriangles) {
+        vec3 v1 = vertexPosition(vertexIndex(3 * item));
+        vec3 v2 = vertexPosition(vertexIndex(3 * item + 1));
+        vec3 v3 = vertexPosition(vertexIndex(3 * item + 2));
+        return (v1 + v2 + v3) / 3.0;
+    }
+
+    vec3 aabbMin, aabbMax;
+    itemBounds(item, aabbMin, aabbMax);
+    return (aabbMin + aabbMax) * 0.5;
+}
+
+void main() {
+
+    int item = int(gl_GlobalInvocationID.x);
+    if(item >= numTriangles + numPrimitives) return;
+
+    vec3 sceneMin = vec3(orderedFloat(sceneBounds[0]), orderedFloat(sceneBounds[1]), orderedFloat(sceneBounds[2]));
+    vec3 sceneMax = vec3(orderedFloat(sceneBounds[3]), orderedFloat(sceneBounds[4]), orderedFloat(sceneBounds[5]));
+    vec3 extent = max(sceneMax - sceneMin, vec3(1e-20));
+
+    keys[item] = morton3D((itemCenter(item) - sceneMin) / extent);
+    values[item] = uint(item);
+}
@@ -0,0 +1,43 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// LBVH build, step 3a: per block histogram of a 4 bit radix digit
+//
+// ----------------------------------------------------------------------------
+
+#define BLOCK_SIZE 256
+#define RADIX 16
+
+layout (local_size_x = BLOCK_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = 16) writeonly buffer Histogram {
+    uint histogram[];   // histogram[digit * numBlocks + block]
+};
+
+layout(std430, binding = 17) readonly buffer KeysIn {
+    uint keysIn[];
+};
+
+uniform int numElements;
+uniform int numBlocks;
+uniform int shift;
+
+shared uint counts[RADIX];
+
+void main() {
+
+    uint local = gl_LocalInvocationID.x;
+    uint block = gl_WorkGroupID.x;
+    uint index = gl_GlobalInvocationID.x;
+
+    if(local < RADIX) counts[local] = 0u;
+    barrier();
+
+    if(index < uint(numElements))
+        atomicAdd(counts[(keysIn[index] >> shift) & (RADIX - 1)], 1u);
+    barrier();
+
+    if(local < RADIX)
+        histogram[local * uint(numBlocks) + block] = counts[local];
+}
@@ -0,0 +1,52 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// LBVH build, step 3b: exclusive prefix sum of the digit-major histogram,
+// which gives the global output offset of each (digit, block) pair.
+// Dispatched as a single work group
+//
+// ----------------------------------------------------------------------------
+
+#define SCAN_SIZE 256
+
+layout (local_size_x = SCAN_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = 16) buffer Histogram {
+    uint histogram[];
+};
+
+uniform int numBlocks;
+
+shared uint partials[SCAN_SIZE];
+
+void main() {
+
+    uint local = gl_LocalInvocationID.x;
+    uint count = uint(numBlocks) * 16u;
+    uint chunk = (count + SCAN_SIZE - 1u) / SCAN_SIZE;
+    uint first = min(local * chunk, count);
+    uint last = min(first + chunk, count);
+
+    // Sum of the chunk of each invocation
+    uint sum = 0u;
+    for(uint i = first; i < last; i ++) sum += histogram[i];
+    partials[local] = sum;
+    barrier();
+
+    // Hillis-Steele inclusive scan of the partial sums
+    for(uint offset = 1u; offset < SCAN_SIZE; offset *= 2u) {
+        uint value = local >= offset ? partials[local - offset] : 0u;
+        barrier();
+        partials[local] += value;
+        barrier();
+    }
+
+    // Exclusive scan of the chunk
+    uint prefix = partials[local] - sum;
+    for(uint i = first; i < last; i ++) {
+        uint value = histogram[i];
+        histogram[i] = prefix;
+        prefix += value;
+    }
+}
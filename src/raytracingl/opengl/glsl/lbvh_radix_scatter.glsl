@@ -0,0 +1,63 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// LBVH build, step 3c: stable scatter of the keys and values by radix digit
+//
+// ----------------------------------------------------------------------------
+
+#define BLOCK_SIZE 256
+#define RADIX 16
+#define INVALID_DIGIT 0xFFu
+
+layout (local_size_x = BLOCK_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = 16) readonly buffer Histogram {
+    uint histogram[];
+};
+
+layout(std430, binding = 17) readonly buffer KeysIn {
+    uint keysIn[];
+};
+
+layout(std430, binding = 18) readonly buffer ValuesIn {
+    uint valuesIn[];
+};
+
+layout(std430, binding = 19) writeonly buffer KeysOut {
+    uint keysOut[];
+};
+
+layout(std430, binding = 20) writeonly buffer ValuesOut {
+    uint valuesOut[];
+};
+
+uniform int numElements;
+uniform int numBlocks;
+uniform int shift;
+
+shared uint digits[BLOCK_SIZE];
+
+void main() {
+
+    uint local = gl_LocalInvocationID.x;
+    uint block = gl_WorkGroupID.x;
+    uint index = gl_GlobalInvocationID.x;
+    bool valid = index < uint(numElements);
+
+    uint key = valid ? keysIn[index] : 0u;
+    uint digit = valid ? (key >> shift) & (RADIX - 1) : INVALID_DIGIT;
+    digits[local] = digit;
+    barrier();
+
+    if(!valid) return;
+
+    // Rank among the previous elements of the block with the same digit
+    uint rank = 0u;
+    for(uint i = 0u; i < local; i ++)
+        if(digits[i] == digit) rank ++;
+
+    uint destination = histogram[digit * uint(numBlocks) + block] + rank;
+    keysOut[destination] = key;
+    valuesOut[destination] = valuesIn[index];
+}
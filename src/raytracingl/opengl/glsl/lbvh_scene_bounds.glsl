@@ -0,0 +1,135 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// LBVH build, step 1: bounds of the item centroids
+//
+// ----------------------------------------------------------------------------
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+struct Vertex {
+    vec3 pos;
+    vec3 color;
+    vec3 normal;
+    vec2 uv;
+    vec3 tan;
+    vec3 bitan;
+};
+
+layout(std430, binding = 0) readonly buffer VertexBuffer {
+    Vertex vertices[];
+};
+
+layout(std430, binding = 1) readonly buffer IndexBuffer {
+    uint indices[];
+};
+
+// The same buffer when the scene was uploaded as PackedVertex, see geometry/packedvertex.h
+layout(std430, binding = 0) readonly buffer PackedVertexBuffer {
+    uvec4 packedVertices[];
+};
+
+struct Primitive {
+    vec3 position;
+    int type;       // 0 sphere, 1 box, 2 disc
+    vec3 parameters;
+    int material;
+};
+
+layout(std430, binding = 4) readonly buffer PrimitiveBuffer {
+    Primitive primitives[];
+};
+
+// min xyz, max xyz as order preserving uints. Must be reset to
+// (0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0, 0, 0) before the dispatch
+layout(std430, binding = 16) buffer SceneBounds {
+    uint sceneBounds[6];
+};
+
+uniform int numTriangles;
+uniform int numPrimitives;
+uniform int vertexFormat;   // 0 Vertex, 1 PackedVertex
+uniform vec3 vertexOrigin;  // packed positions are vertexOrigin + 16 bit coordinates * vertexScale
+uniform vec3 vertexScale;
+uniform int vertexOffset;   // first vertex and index of the mesh when the buffers are shared
+uniform int indexOffset;    // by several meshes, see BufferArena
+
+// ----------------------------------------------------------------------------
+//
+// Functions
+//
+// ----------------------------------------------------------------------------
+
+// Maps a float to an uint keeping the order, so atomicMin and atomicMax work on floats
+uint orderedUint(float f) {
+    uint u = floatBitsToUint(f);
+    return (u & 0x80000000u) != 0u ? ~u : u | 0x80000000u;
+}
+
+uint vertexIndex(uint index) {
+    return uint(vertexOffset) + indices[uint(indexOffset) + index];
+}
+
+vec3 vertexPosition(uint index) {
+    if(vertexFormat == 0) return vertices[index].pos;
+    uvec2 data = packedVertices[index].xy;
+    return vertexOrigin + vec3(data.x & 0xFFFFu, data.x >> 16, data.y & 0xFFFFu) * vertexScale;
+}
+
+// Bounds of an item: triangles first and then the analytic primitives
+void itemBounds(int item, out vec3 aabbMin, out vec3 aabbMax) {
+
+    if(item < numTriangles) {
+        vec3 v1 = vertexPosition(vertexIndex(3 * item));
+        vec3 v2 = vertexPosition(vertexIndex(3 * item + 1));
+        vec3 v3 = vertexPosition(vertexIndex(3 * item + 2));
+        aabbMin = min(v1, min(v2, v3));
+        aabbMax = max(v1, max(v2, v3));
+        return;
+    }
+
+    Primitive primitive = primitives[item - numTriangles];
+
+    if(primitive.type == 0) {
+        aabbMin = primitive.position - vec3(primitive.parameters.x);
+        aabbMax = primitive.position + vec3(primitive.parameters.x);
+    }else if(primitive.type == 1) {
+        aabbMin = primitive.position;
+        aabbMax = primitive.parameters;
+    }else {
+        float radius = length(primitive.parameters);
+        vec3 normal = primitive.parameters / radius;
+        vec3 extent = radius * sqrt(max(vec3(1.0) - normal * normal, vec3(0.0)));
+        aabbMin = primitive.position - extent;
+        aabbMax = primitive.position + extent;
+    }
+}
+
+// Triangle centroid or center of the bounds of an analytic primitive
+vec3 itemCenter(int item) {
+
+    if(item < numTriangles) {
+        vec3 v1 = vertexPosition(vertexIndex(3 * item));
+        vec3 v2 = vertexPosition(vertexIndex(3 * item + 1));
+        vec3 v3 = vertexPosition(vertexIndex(3 * item + 2));
+        return (v1 + v2 + v3) / 3.0;
+    }
+
+    vec3 aabbMin, aabbMax;
+    itemBounds(item, aabbMin, aabbMax);
+    return (aabbMin + aabbMax) * 0.5;
+}
+
+void main() {
+
+    int item = int(gl_GlobalInvocationID.x);
+    if(item >= numTriangles + numPrimitives) return;
+
+    vec3 center = itemCenter(item);
+
+    for(int axis = 0; axis < 3; axis ++) {
+        atomicMin(sceneBounds[axis], orderedUint(center[axis]));
+        atomicMax(sceneBounds[axis + 3], orderedUint(center[axis]));
+    }
+}
@@ -0,0 +1,96 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// Streaming, step 1: each ray traverses the top level BVH over the cluster
+// bounds and queues a (ray, cluster) item for every cluster it enters
+//
+// ----------------------------------------------------------------------------
+
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+#define STACK_SIZE 64
+
+struct BVHNode {
+    vec3 aabbMin;
+    int left;
+    vec3 aabbMax;
+    int right;
+};
+
+layout(std430, binding = 29) readonly buffer TopNodeBuffer {
+    BVHNode topNodes[];
+};
+
+// Origin and maximum distance, direction
+layout(std430, binding = 30) readonly buffer RayBuffer {
+    vec4 rays[];
+};
+
+// Ray, cluster, entry distance bits, state
+layout(std430, binding = 31) writeonly buffer ItemBuffer {
+    uvec4 items[];
+};
+
+// Closest distance bits and triangle of each ray
+layout(std430, binding = 32) writeonly buffer ResultBuffer {
+    uint results[];
+};
+
+layout(std430, binding = 33) buffer CounterBuffer {
+    uint numItems;
+    uint clusterRequests[];
+};
+
+uniform int numRays;
+uniform int maxItems;
+
+float intersectionAABB(vec3 origin, vec3 invDirection, vec3 aabbMin, vec3 aabbMax, float maxDist) {
+
+    vec3 t1 = (aabbMin - origin) * invDirection;
+    vec3 t2 = (aabbMax - origin) * invDirection;
+    vec3 tmin = min(t1, t2);
+    vec3 tmax = max(t1, t2);
+
+    float tnear = max(max(tmin.x, tmin.y), tmin.z);
+    float tfar = min(min(tmax.x, tmax.y), tmax.z);
+
+    return (tfar >= max(tnear, 0.0) && tnear < maxDist) ? max(tnear, 0.0) : -1.0;
+}
+
+void main() {
+
+    uint ray = gl_GlobalInvocationID.x;
+    if(ray >= uint(numRays)) return;
+
+    vec3 origin = rays[2 * ray].xyz;
+    float maxDist = rays[2 * ray].w;
+    vec3 invDirection = 1.0 / rays[2 * ray + 1].xyz;
+
+    results[2 * ray] = floatBitsToUint(maxDist);
+    results[2 * ray + 1] = 0xFFFFFFFFu;
+
+    int stack[STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize ++] = 0;
+
+    while(stackSize > 0) {
+
+        BVHNode node = topNodes[stack[-- stackSize]];
+        float dist = intersectionAABB(origin, invDirection, node.aabbMin, node.aabbMax, maxDist);
+        if(dist < 0.0) continue;
+
+        if(node.left < 0) {
+            uint cluster = uint(~node.left);
+            uint item = atomicAdd(numItems, 1u);
+            if(item < uint(maxItems)) items[item] = uvec4(ray, cluster, floatBitsToUint(dist), 0u);
+            atomicAdd(clusterRequests[cluster], 1u);
+            continue;
+        }
+
+        if(stackSize + 2 <= STACK_SIZE) {
+            stack[stackSize ++] = node.right;
+            stack[stackSize ++] = node.left;
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// Streaming, step 3: the items at the closest distance of their ray write
+// their triangle, the lowest index wins ties between clusters
+//
+// ----------------------------------------------------------------------------
+
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+#define ITEM_HIT 2u
+
+layout(std430, binding = 31) readonly buffer ItemBuffer {
+    uvec4 items[];
+};
+
+layout(std430, binding = 32) buffer ResultBuffer {
+    uint results[];
+};
+
+uniform int numItems;
+
+void main() {
+
+    uint index = gl_GlobalInvocationID.x;
+    if(index >= uint(numItems)) return;
+
+    uvec4 item = items[index];
+    if(item.w == ITEM_HIT && results[2 * item.x] == item.z)
+        atomicMin(results[2 * item.x + 1], item.y);
+}
@@ -0,0 +1,170 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// Streaming, step 2: the items whose cluster is resident traverse its BVH in
+// the cache slot. The rest wait for a later pass
+//
+// ----------------------------------------------------------------------------
+
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+#define STACK_SIZE 64
+
+#define ITEM_PENDING 0u
+#define ITEM_MISS 1u
+#define ITEM_HIT 2u
+
+struct BVHNode {
+    vec3 aabbMin;
+    int left;
+    vec3 aabbMax;
+    int right;
+};
+
+layout(std430, binding = 24) readonly buffer ClusterSlotBuffer {
+    int clusterSlots[];
+};
+
+layout(std430, binding = 25) readonly buffer ClusterPositionBuffer {
+    vec4 clusterPositions[];
+};
+
+layout(std430, binding = 26) readonly buffer ClusterIndexBuffer {
+    uint clusterIndices[];
+};
+
+layout(std430, binding = 27) readonly buffer ClusterTriangleIdBuffer {
+    uint clusterTriangleIds[];
+};
+
+layout(std430, binding = 28) readonly buffer ClusterNodeBuffer {
+    BVHNode clusterNodes[];
+};
+
+layout(std430, binding = 30) readonly buffer RayBuffer {
+    vec4 rays[];
+};
+
+// Once traced: ray, triangle, distance bits, ITEM_HIT or ITEM_MISS
+layout(std430, binding = 31) buffer ItemBuffer {
+    uvec4 items[];
+};
+
+layout(std430, binding = 32) buffer ResultBuffer {
+    uint results[];
+};
+
+uniform int numItems;
+uniform int slotVertices;
+uniform int slotTriangles;
+uniform int slotNodes;
+
+float intersectionAABB(vec3 origin, vec3 invDirection, vec3 aabbMin, vec3 aabbMax, float maxDist) {
+
+    vec3 t1 = (aabbMin - origin) * invDirection;
+    vec3 t2 = (aabbMax - origin) * invDirection;
+    vec3 tmin = min(t1, t2);
+    vec3 tmax = max(t1, t2);
+
+    float tnear = max(max(tmin.x, tmin.y), tmin.z);
+    float tfar = min(min(tmax.x, tmax.y), tmax.z);
+
+    return (tfar >= max(tnear, 0.0) && tnear < maxDist) ? max(tnear, 0.0) : -1.0;
+}
+
+// Same test as distanceTriangle in compute.glsl
+float distanceTriangle(vec3 origin, vec3 direction, vec3 v1, vec3 v2, vec3 v3) {
+
+    const float epsilon = 0.0000001;
+
+    vec3 edge1 = v2 - v1;
+    vec3 edge2 = v3 - v1;
+    vec3 ray_cross_e2 = cross(direction, edge2);
+
+    float det = dot(edge1, ray_cross_e2);
+    if (det > -epsilon && det < epsilon) return -1.0;
+
+    float inv_det = 1.0 / det;
+    vec3 s = origin - v1;
+
+    float u = inv_det * dot(s, ray_cross_e2);
+    if (u < 0 || u > 1) return -1.0;
+
+    vec3 s_cross_e1 = cross(s, edge1);
+    float v = inv_det * dot(direction, s_cross_e1);
+    if (v < 0 || u + v > 1) return -1.0;
+
+    float t = inv_det * dot(edge2, s_cross_e1);
+    return t > epsilon ? t : -1.0;
+}
+
+void main() {
+
+    uint index = gl_GlobalInvocationID.x;
+    if(index >= uint(numItems)) return;
+
+    uvec4 item = items[index];
+    if(item.w != ITEM_PENDING) return;
+
+    int slot = clusterSlots[item.y];
+    if(slot < 0) return;
+
+    // Closest hit so far, it only decreases so an old value prunes less but never wrongly
+    uint ray = item.x;
+    float maxDist = uintBitsToFloat(results[2 * ray]);
+    if(uintBitsToFloat(item.z) >= maxDist) {
+        items[index] = uvec4(ray, 0u, 0u, ITEM_MISS);
+        return;
+    }
+
+    vec3 origin = rays[2 * ray].xyz;
+    vec3 direction = rays[2 * ray + 1].xyz;
+    vec3 invDirection = 1.0 / direction;
+
+    int nodeBase = slot * slotNodes;
+    int indexBase = 3 * slot * slotTriangles;
+    int vertexBase = slot * slotVertices;
+    int triangleBase = slot * slotTriangles;
+
+    float hitDist = maxDist;
+    int hitTriangle = -1;
+
+    int stack[STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize ++] = 0;
+
+    while(stackSize > 0) {
+
+        BVHNode node = clusterNodes[nodeBase + stack[-- stackSize]];
+        if(intersectionAABB(origin, invDirection, node.aabbMin, node.aabbMax, hitDist) < 0.0)
+            continue;
+
+        if(node.left < 0) {
+            int triangle = ~node.left;
+            vec3 v1 = clusterPositions[vertexBase + int(clusterIndices[indexBase + 3 * triangle])].xyz;
+            vec3 v2 = clusterPositions[vertexBase + int(clusterIndices[indexBase + 3 * triangle + 1])].xyz;
+            vec3 v3 = clusterPositions[vertexBase + int(clusterIndices[indexBase + 3 * triangle + 2])].xyz;
+
+            float dist = distanceTriangle(origin, direction, v1, v2, v3);
+            if(dist > 0.0 && dist < hitDist) {
+                hitDist = dist;
+                hitTriangle = triangle;
+            }
+            continue;
+        }
+
+        if(stackSize + 2 <= STACK_SIZE) {
+            stack[stackSize ++] = node.right;
+            stack[stackSize ++] = node.left;
+        }
+    }
+
+    if(hitTriangle < 0) {
+        items[index] = uvec4(ray, 0u, 0u, ITEM_MISS);
+        return;
+    }
+
+    atomicMin(results[2 * ray], floatBitsToUint(hitDist));
+    items[index] = uvec4(ray, clusterTriangleIds[triangleBase + hitTriangle], floatBitsToUint(hitDist), ITEM_HIT);
+}
@@ -0,0 +1,117 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// Temporal reprojection: the frame just traced is blended with the history
+// of the surfaces it sees, found through the motion vectors of imgSurface.
+// History texels of other surfaces (depth or normal too different) are
+// rejected and the rest is clamped to the spread of the new samples. The
+// neighbors of the frame are still read by other invocations, so the result
+// goes to the history first and is copied to the frame by a second dispatch
+//
+// ----------------------------------------------------------------------------
+
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(binding = 0, rgba32f) uniform image2D imgFrame;
+layout(binding = 3, rgba32ui) readonly uniform uimage2D imgSurface;
+layout(binding = 4, rgba32ui) readonly uniform uimage2D imgPreviousSurface;
+layout(binding = 5, rgba32f) readonly uniform image2D imgHistory;          // color and frames
+layout(binding = 6, rgba32f) uniform image2D imgNextHistory;
+
+uniform int stage;          // 0 blends into imgNextHistory, 1 copies it to imgFrame
+uniform int historyValid;
+uniform float maxHistory;
+uniform float depthTolerance;   // relative
+uniform float normalThreshold;  // cosine
+uniform float varianceGamma;
+
+vec3 decodeOctahedral(uint encoded) {
+    vec2 f = unpackSnorm2x16(encoded);
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Both texels see the same surface, or both the sky. The distance of the surface to the
+// previous camera is compared with the one the previous frame stored, both from the same
+// camera, and the normals are in object space so a moving model keeps its history
+bool consistent(uvec4 surface, uvec4 previousSurface) {
+
+    float depth = unpackHalf2x16(surface.z).y;
+    float previousDepth = unpackHalf2x16(previousSurface.z).x;
+    if(depth < 0.0 || previousDepth < 0.0) return depth < 0.0 && previousDepth < 0.0;
+
+    if(abs(depth - previousDepth) > depthTolerance * max(depth, previousDepth)) return false;
+    return dot(decodeOctahedral(surface.w), decodeOctahedral(previousSurface.w)) >= normalThreshold;
+}
+
+void main() {
+
+    ivec2 size = imageSize(imgFrame);
+    ivec2 pixelCoord = ivec2(gl_GlobalInvocationID.xy);
+    if(any(greaterThanEqual(pixelCoord, size))) return;
+
+    if(stage == 1) {
+        imageStore(imgFrame, pixelCoord, vec4(imageLoad(imgNextHistory, pixelCoord).rgb, 1.0));
+        return;
+    }
+
+    vec3 color = imageLoad(imgFrame, pixelCoord).rgb;
+    uvec4 surface = imageLoad(imgSurface, pixelCoord);
+
+    // Mean and standard deviation of the new samples around the pixel
+    vec3 m1 = vec3(0.0), m2 = vec3(0.0);
+    for(int y = -1; y <= 1; y ++) {
+        for(int x = -1; x <= 1; x ++) {
+            vec3 neighbor = imageLoad(imgFrame, clamp(pixelCoord + ivec2(x, y), ivec2(0), size - 1)).rgb;
+            m1 += neighbor;
+            m2 += neighbor * neighbor;
+        }
+    }
+    vec3 mean = m1 / 9.0;
+    vec3 sigma = sqrt(max(m2 / 9.0 - mean * mean, vec3(0.0)));
+
+    // Bilinear fetch of the history, over the texels that pass the disocclusion tests
+    vec3 history = vec3(0.0);
+    float historyLength = 0.0;
+
+    if(historyValid != 0) {
+
+        vec2 previous = vec2(pixelCoord) + vec2(uintBitsToFloat(surface.x), uintBitsToFloat(surface.y));
+        ivec2 base = ivec2(floor(previous));
+        vec2 f = previous - vec2(base);
+        float weights = 0.0;
+
+        for(int i = 0; i < 4; i ++) {
+
+            ivec2 offset = ivec2(i & 1, i >> 1);
+            ivec2 texel = base + offset;
+            if(any(lessThan(texel, ivec2(0))) || any(greaterThanEqual(texel, size))) continue;
+            if(!consistent(surface, imageLoad(imgPreviousSurface, texel))) continue;
+
+            float weight = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+            vec4 texelHistory = imageLoad(imgHistory, texel);
+            history += weight * texelHistory.rgb;
+            historyLength += weight * texelHistory.a;
+            weights += weight;
+        }
+
+        if(weights > 0.01) {
+            history /= weights;
+            historyLength /= weights;
+        }
+        else historyLength = 0.0;
+    }
+
+    // History outside the spread of the new samples belongs to other surfaces or lighting
+    if(historyLength > 0.0)
+        history = clamp(history, mean - varianceGamma * sigma, mean + varianceGamma * sigma);
+
+    historyLength = min(historyLength + 1.0, maxHistory);
+    vec3 result = mix(history, color, 1.0 / historyLength);
+
+    imageStore(imgNextHistory, pixelCoord, vec4(result, historyLength));
+}
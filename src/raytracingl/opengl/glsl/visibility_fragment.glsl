@@ -0,0 +1,22 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// Visibility buffer: triangle + 1 (0 where nothing was drawn), instance,
+// barycentrics of the second and third vertices and distance to the camera
+//
+// ----------------------------------------------------------------------------
+
+in vec3 worldPosition;
+in vec3 barycentrics;
+
+uniform vec3 cameraPosition;
+uniform int instance;
+
+layout (location = 0) out uvec4 visibility;
+
+void main()
+{
+    visibility = uvec4(uint(gl_PrimitiveID) + 1u, uint(instance), packUnorm2x16(barycentrics.yz),
+        floatBitsToUint(distance(worldPosition, cameraPosition)));
+}
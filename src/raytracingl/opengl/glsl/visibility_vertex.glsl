@@ -0,0 +1,77 @@
+#version 430 core
+
+// ----------------------------------------------------------------------------
+//
+// Visibility buffer. There are no vertex attributes, gl_VertexID walks the
+// index buffer and the positions are pulled from the buffers the compute
+// shaders trace, in either vertex format
+//
+// ----------------------------------------------------------------------------
+
+struct Vertex {
+    vec3 pos;
+    vec3 color;
+    vec3 normal;
+    vec2 uv;
+    vec3 tan;
+    vec3 bitan;
+};
+
+layout(std430, binding = 0) readonly buffer VertexBuffer {
+    Vertex vertices[];
+};
+
+layout(std430, binding = 1) readonly buffer IndexBuffer {
+    uint indices[];
+};
+
+layout(std430, binding = 0) readonly buffer PackedVertexBuffer {
+    uvec4 packedVertices[];
+};
+
+uniform int vertexFormat;   // 0 Vertex, 1 PackedVertex
+uniform vec3 vertexOrigin;
+uniform vec3 vertexScale;
+uniform int vertexOffset;
+uniform int indexOffset;
+
+uniform mat4 modelMatrix;
+uniform vec3 cameraPosition;
+uniform vec3 cameraTarget;
+uniform float cameraFov;
+uniform vec2 resolution;
+uniform float nearPlane;
+uniform float farPlane;
+
+out vec3 worldPosition;
+out vec3 barycentrics;
+
+vec3 vertexPosition(uint index) {
+    if(vertexFormat == 0) return vertices[index].pos;
+    uvec2 data = packedVertices[index].xy;
+    return vertexOrigin + vec3(data.x & 0xFFFFu, data.x >> 16, data.y & 0xFFFFu) * vertexScale;
+}
+
+void main() {
+
+    uint index = uint(vertexOffset) + indices[uint(indexOffset) + uint(gl_VertexID)];
+    worldPosition = (modelMatrix * vec4(vertexPosition(index), 1.0)).xyz;
+
+    barycentrics = vec3(0.0);
+    barycentrics[gl_VertexID % 3] = 1.0;
+
+    // Camera of compute.glsl
+    vec3 forward = normalize(cameraTarget - cameraPosition);
+    vec3 right = normalize(cross(forward, vec3(0.0, 1.0, 0.0)));
+    vec3 up = cross(right, forward);
+    float tanHalfFov = tan(radians(cameraFov) / 2.0);
+
+    vec3 view = worldPosition - cameraPosition;
+    float depth = dot(view, forward);
+
+    gl_Position = vec4(dot(view, right) / (tanHalfFov * resolution.x / resolution.y), dot(view, up) / tanHalfFov,
+        (depth * (farPlane + nearPlane) - 2.0 * farPlane * nearPlane) / (farPlane - nearPlane), depth);
+
+    // The rays of compute.glsl go through the corner of the pixels, the raster samples their center
+    gl_Position.xy += gl_Position.w / resolution;
+}
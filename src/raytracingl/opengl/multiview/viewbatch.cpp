@@ -0,0 +1,82 @@
+#include "viewbatch.h"
+
+#include <algorithm>
+
+namespace rgl
+{
+
+ViewBatch::ViewBatch(int _width, int _height, unsigned int _maxViews, unsigned int readbackRing)
+    : width(_width), height(_height), maxViews(_maxViews), memory(MemoryDomain::GPU, MemoryCategory::OutputImages) {
+
+    GLint maxLayers, maxGroups;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 2, &maxGroups);
+    maxViews = std::clamp(maxViews, 1u, (unsigned int)std::min(maxLayers, maxGroups));
+
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA32F, width, height, maxViews);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    ssboCameras = ShaderStorageBuffer<ViewCamera>::New((size_t)maxViews, VIEW_CAMERAS_BINDING_POINT);
+    readback = AsyncReadback::New(width, height, readbackRing);
+
+    memory.resize((size_t)width * height * maxViews * 4 * sizeof(float));
+}
+
+ViewBatch::~ViewBatch() {
+    glDeleteTextures(1, &textureID);
+}
+
+ShaderProgram::Ptr ViewBatch::loadProgram(const std::string& shadersPath, unsigned int stackSize) {
+    std::vector<std::string> defines = {MULTI_VIEW_DEFINE};
+    if(stackSize > BVH_STACK_SIZE) defines.push_back(bvhStackSizeDefine(stackSize));
+    Shader computeShader = Shader::fromFile(shadersPath + "compute.glsl", Shader::ShaderType::Compute, defines);
+    return ShaderProgram::New(computeShader);
+}
+
+size_t ViewBatch::render(ShaderProgram& program, const std::vector<ViewCamera>& cameras,
+    const std::function<void(FrameImage&&)>& onImage, unsigned int samples) {
+
+    size_t delivered = 0;
+    FrameImage image;
+
+    for(size_t first = 0; first < cameras.size(); first += maxViews) {
+
+        unsigned int views = (unsigned int)std::min<size_t>(maxViews, cameras.size() - first);
+        ssboCameras->setData(Span<const ViewCamera>(cameras.data() + first, views));
+        ssboCameras->bindBase();
+
+        // The readbacks of the previous batch were queued before, they still see its layers
+        glBindImageTexture(0, textureID, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+        program.useProgram();
+
+        for(unsigned int sample = 0; sample < std::max(samples, 1u); sample ++) {
+            program.uniformInt("frame", sample);
+            program.uniformInt("accumulatedFrames", sample);
+            glDispatchCompute((width + 9) / 10, (height + 9) / 10, views);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+
+        glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+        for(unsigned int view = 0; view < views; view ++) {
+            readback->requestLayer(textureID, view, first + view);
+            while(readback->collect(image)) {
+                onImage(std::move(image));
+                delivered ++;
+            }
+        }
+    }
+
+    while(readback->getPending() > 0 && readback->collect(image, true)) {
+        onImage(std::move(image));
+        delivered ++;
+    }
+
+    return delivered;
+}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include <GL/glew.h>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/bvh/bvh.h"
+#include "raytracingl/geometry/camera.h"
+#include "raytracingl/io/imagewriter.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/opengl/shader/shader.h"
+#include "raytracingl/opengl/readback/readback.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+#define MULTI_VIEW_DEFINE "MULTI_VIEW"
+
+namespace rgl
+{
+
+// Renders many cameras of the same scene in one dispatch per batch: the MULTI_VIEW variant
+// of compute.glsl reads its camera from VIEW_CAMERAS_BINDING_POINT with gl_GlobalInvocationID.z
+// and writes the layer of the view in a 2D array texture, so the scene and its BVH are read
+// once for all the views. The layers are streamed out through an AsyncReadback while the
+// next batch is traced.
+//
+// The scene uniforms and buffers of the program are set by the caller as for a single view.
+// The visibility buffer, temporal reprojection and traversal stats only support single views.
+class ViewBatch {
+    GENERATE_SHARED_PTR(ViewBatch)
+private:
+    int width, height;
+    unsigned int maxViews;
+    unsigned int textureID;
+    ShaderStorageBuffer<ViewCamera>::Ptr ssboCameras;
+    AsyncReadback::Ptr readback;
+    MemoryRecord memory;
+public:
+    ViewBatch(int _width, int _height, unsigned int _maxViews, unsigned int readbackRing = 4);
+    ~ViewBatch();
+    ViewBatch(const ViewBatch& viewBatch) = delete;
+    ViewBatch& operator=(const ViewBatch& viewBatch) = delete;
+public:
+    // compute.glsl with MULTI_VIEW defined, and a larger traversal stack when the BVH needs more
+    // than BVH_STACK_SIZE entries (WideBVH::getStackSize(), bvhStackSize(2, LBVH::getDepth()))
+    static ShaderProgram::Ptr loadProgram(const std::string& shadersPath = "glsl/", unsigned int stackSize = BVH_STACK_SIZE);
+
+    // Traces the cameras in batches of getMaxViews(), samples frames per view averaged with
+    // accumulatedFrames. onImage receives every view once it is read back, FrameImage::index is
+    // its position in cameras. Returns the number of views delivered
+    size_t render(ShaderProgram& program, const std::vector<ViewCamera>& cameras,
+        const std::function<void(FrameImage&&)>& onImage, unsigned int samples = 1);
+public:
+    unsigned int getTextureID() const { return textureID; }
+    unsigned int getMaxViews() const { return maxViews; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+};
+
+}
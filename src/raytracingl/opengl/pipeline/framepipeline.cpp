@@ -0,0 +1,99 @@
+#include "framepipeline.h"
+
+#include <chrono>
+
+namespace rgl
+{
+
+FramePipeline::FramePipeline(int _width, int _height, unsigned int framesInFlight)
+    : width(_width), height(_height), memory(MemoryDomain::GPU, MemoryCategory::OutputImages),
+    frameCount(0), current(0), waitTime(0.0) {
+
+    frames.resize(framesInFlight > 0 ? framesInFlight : 1);
+
+    for(Frame& frame : frames) {
+
+        glGenTextures(1, &frame.textureID);
+        glBindTexture(GL_TEXTURE_2D, frame.textureID);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+
+        frame.fence = nullptr;
+        frame.index = 0;
+    }
+
+    memory.resize(frames.size() * width * height * 4 * sizeof(float));
+
+    // The last slot, so the first beginFrame starts at 0
+    current = frames.size() - 1;
+}
+
+FramePipeline::~FramePipeline() {
+    for(Frame& frame : frames) {
+        if(frame.fence != nullptr) glDeleteSync(frame.fence);
+        glDeleteTextures(1, &frame.textureID);
+    }
+}
+
+bool FramePipeline::wait(Frame& frame) {
+
+    if(frame.fence == nullptr) return true;
+
+    // The first wait flushes, so the fence is guaranteed to be signaled eventually
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    GLenum status;
+
+    do {
+        status = glClientWaitSync(frame.fence, flags, 1000000000);
+        flags = 0;
+    } while(status == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(frame.fence);
+    frame.fence = nullptr;
+
+    if(status == GL_WAIT_FAILED) {
+        std::cout << "Frame pipeline: wait for frame " << frame.index << " failed" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+unsigned int FramePipeline::beginFrame() {
+
+    current = (current + 1) % frames.size();
+    Frame& frame = frames[current];
+
+    auto start = std::chrono::steady_clock::now();
+    wait(frame);
+    waitTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    frame.index = frameCount ++;
+    glBindImageTexture(FRAME_PIPELINE_IMAGE_UNIT, frame.textureID, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    return current;
+}
+
+void FramePipeline::endFrame() {
+    Frame& frame = frames[current];
+    if(frame.fence != nullptr) glDeleteSync(frame.fence);
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool FramePipeline::isComplete(unsigned int slot) const {
+    const Frame& frame = frames[slot];
+    if(frame.fence == nullptr) return true;
+    GLenum status = glClientWaitSync(frame.fence, 0, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void FramePipeline::finish() {
+    for(Frame& frame : frames) wait(frame);
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+#define FRAME_PIPELINE_IMAGE_UNIT 0
+
+namespace rgl
+{
+
+// Ring of output images so the CPU can prepare a frame while the GPU still traces the
+// previous ones. Each frame writes its own RGBA32F image and is closed with a fence.
+// beginFrame() only blocks when the slot it reuses is still in flight, that is, when the
+// CPU is framesInFlight frames ahead of the GPU.
+class FramePipeline {
+    GENERATE_SHARED_PTR(FramePipeline)
+public:
+    struct Frame {
+        unsigned int textureID;
+        GLsync fence;
+        unsigned long long index;   // frame that last used the slot
+    };
+private:
+    std::vector<Frame> frames;
+    int width, height;
+    MemoryRecord memory;
+
+    unsigned long long frameCount;
+    unsigned int current;
+    double waitTime;                // milliseconds blocked in beginFrame
+private:
+    // Waits for the fence of the slot, false if the wait failed
+    bool wait(Frame& frame);
+public:
+    FramePipeline(int _width, int _height, unsigned int framesInFlight = 2);
+    ~FramePipeline();
+    FramePipeline(const FramePipeline& framePipeline) = delete;
+    FramePipeline& operator=(const FramePipeline& framePipeline) = delete;
+public:
+    // Waits until the next slot is free and binds its image to FRAME_PIPELINE_IMAGE_UNIT.
+    // Returns the slot of the frame
+    unsigned int beginFrame();
+    // Fences the commands issued since beginFrame, the slot can't be reused until they finish
+    void endFrame();
+
+    // Non blocking check of a slot
+    bool isComplete(unsigned int slot) const;
+    // Waits for every frame in flight
+    void finish();
+public:
+    unsigned int getTextureID(unsigned int slot) const { return frames[slot].textureID; }
+    unsigned int getCurrentTextureID() const { return frames[current].textureID; }
+    unsigned int getCurrentSlot() const { return current; }
+    unsigned int getFramesInFlight() const { return frames.size(); }
+    unsigned long long getFrameCount() const { return frameCount; }
+    double getWaitMilliseconds() const { return waitTime; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+};
+
+}
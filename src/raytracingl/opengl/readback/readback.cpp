@@ -0,0 +1,137 @@
+#include "readback.h"
+
+#include <cstring>
+
+namespace rgl
+{
+
+AsyncReadback::AsyncReadback(int _width, int _height, unsigned int ringSize)
+    : width(_width), height(_height), memory(MemoryDomain::GPU, MemoryCategory::Readback), framebufferID(0), first(0), pending(0) {
+
+    slots.resize(ringSize > 0 ? ringSize : 1);
+
+    for(Slot& slot : slots) {
+        glGenBuffers(1, &slot.bufferID);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4 * sizeof(float), nullptr, GL_STREAM_READ);
+        slot.fence = nullptr;
+        slot.index = 0;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    memory.resize(slots.size() * width * height * 4 * sizeof(float));
+}
+
+AsyncReadback::~AsyncReadback() {
+    if(framebufferID != 0) glDeleteFramebuffers(1, &framebufferID);
+    for(Slot& slot : slots) {
+        if(slot.fence != nullptr) glDeleteSync(slot.fence);
+        glDeleteBuffers(1, &slot.bufferID);
+    }
+}
+
+AsyncReadback::Slot& AsyncReadback::nextSlot(unsigned long long index) {
+
+    // Make room, the frame waits in ready until it is collected
+    if(pending == slots.size()) {
+        FrameImage image;
+        if(collectSlot(image, true)) ready.push_back(std::move(image));
+    }
+
+    Slot& slot = slots[(first + pending) % slots.size()];
+    slot.index = index;
+    return slot;
+}
+
+void AsyncReadback::submit(Slot& slot) {
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    pending ++;
+}
+
+void AsyncReadback::request(unsigned int textureID, unsigned long long index) {
+
+    Slot& slot = nextSlot(index);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    submit(slot);
+}
+
+void AsyncReadback::requestLayer(unsigned int textureID, int layer, unsigned long long index) {
+
+    Slot& slot = nextSlot(index);
+
+    // glGetTexImage reads every layer, the layer is attached to a read framebuffer instead
+    if(framebufferID == 0) glGenFramebuffers(1, &framebufferID);
+
+    GLint readFramebuffer;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebufferID);
+    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureID, 0, layer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+
+    submit(slot);
+}
+
+bool AsyncReadback::collect(FrameImage& image, bool wait) {
+
+    if(!ready.empty()) {
+        image = std::move(ready.front());
+        ready.pop_front();
+        return true;
+    }
+
+    return pending > 0 && collectSlot(image, wait);
+}
+
+bool AsyncReadback::collectSlot(FrameImage& image, bool wait) {
+
+    Slot& slot = slots[first];
+
+    GLenum status = glClientWaitSync(slot.fence, 0, 0);
+    while(wait && status == GL_TIMEOUT_EXPIRED)
+        status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+
+    if(status == GL_TIMEOUT_EXPIRED) return false;
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    first = (first + 1) % slots.size();
+    pending --;
+
+    if(status == GL_WAIT_FAILED) {
+        std::cout << "Readback of frame " << slot.index << " failed" << std::endl;
+        return false;
+    }
+
+    size_t size = (size_t)width * height * 4;
+    image.pixels.resize(size);
+    image.width = width;
+    image.height = height;
+    image.index = slot.index;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+    const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size * sizeof(float), GL_MAP_READ_BIT);
+
+    // The fence and the slot are already released, a frame that can't be mapped is dropped
+    bool mapped = data != nullptr;
+    if(mapped) {
+        std::memcpy(image.pixels.data(), data, size * sizeof(float));
+        mapped = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if(!mapped) std::cout << "Readback of frame " << slot.index << " dropped" << std::endl;
+    return mapped;
+}
+
+}
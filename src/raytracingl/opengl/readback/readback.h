@@ -0,0 +1,65 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <deque>
+
+#include <GL/glew.h>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/io/imagewriter.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+namespace rgl
+{
+
+// Asynchronous readback of RGBA32F images through a ring of pixel pack buffers. request()
+// only queues the copy of the image into the next buffer and fences it, collect() maps the
+// buffer once the fence has been signaled, so the render thread never waits for the GPU
+// unless the whole ring is in flight.
+class AsyncReadback {
+    GENERATE_SHARED_PTR(AsyncReadback)
+private:
+    struct Slot {
+        unsigned int bufferID;
+        GLsync fence;
+        unsigned long long index;
+    };
+private:
+    std::vector<Slot> slots;
+    int width, height;
+    MemoryRecord memory;
+    unsigned int framebufferID;     // reads the layers of array textures
+
+    unsigned int first;     // oldest pending slot
+    unsigned int pending;
+    std::deque<FrameImage> ready;   // collected while making room in the ring
+private:
+    // Slot of the next request, waits for the oldest one if the ring is full
+    Slot& nextSlot(unsigned long long index);
+    void submit(Slot& slot);
+    // Maps the oldest pending slot into image, blocking or not
+    bool collectSlot(FrameImage& image, bool wait);
+public:
+    AsyncReadback(int _width, int _height, unsigned int ringSize = 3);
+    ~AsyncReadback();
+    AsyncReadback(const AsyncReadback& asyncReadback) = delete;
+    AsyncReadback& operator=(const AsyncReadback& asyncReadback) = delete;
+public:
+    // Queues the copy of the texture. Writes to it must be made visible before with
+    // glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT). If every buffer is in flight, the oldest
+    // one is waited for and kept until collect()
+    void request(unsigned int textureID, unsigned long long index);
+    // Same for a layer of an RGBA32F 2D array texture of the size of the ring
+    void requestLayer(unsigned int textureID, int layer, unsigned long long index);
+
+    // Oldest finished readback, false if there is none. With wait, blocks on the oldest one
+    bool collect(FrameImage& image, bool wait = false);
+public:
+    unsigned int getPending() const { return pending + ready.size(); }
+    unsigned int getRingSize() const { return slots.size(); }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+};
+
+}
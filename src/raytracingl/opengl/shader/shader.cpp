@@ -47,6 +47,18 @@ std::string Shader::readFile(const std::string& path) {
     return code;
 }
 
+std::string Shader::addDefines(const std::string& code, const std::vector<std::string>& defines) {
+
+    std::string lines = "";
+    for(const std::string& define : defines) lines += "#define " + define + "\n";
+
+    size_t version = code.find("#version");
+    size_t position = version == std::string::npos ? 0 : code.find('\n', version);
+    if(position == std::string::npos) return code + "\n" + lines;
+
+    return version == std::string::npos ? lines + code : code.substr(0, position + 1) + lines + code.substr(position + 1);
+}
+
 void Shader::compileShader() {
 
     std::string debugShader = "";
@@ -160,6 +172,11 @@ void ShaderProgram::uniformFloat(const std::string& uniform, float value) {
     glUniform1f(location, value); 
 }
 
+void ShaderProgram::uniformVec2(const std::string& uniform, const glm::vec2& vec) {
+    int location = glGetUniformLocation(shaderProgramID, uniform.c_str());
+    glUniform2fv(location, 1, &vec[0]);
+}
+
 void ShaderProgram::uniformVec3(const std::string& uniform, const glm::vec3& vec) {
     int location = glGetUniformLocation(shaderProgramID, uniform.c_str());
     glUniform3fv(location, 1, &vec[0]); 
@@ -5,6 +5,7 @@
 
 #include <GL/glew.h>
 
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
@@ -27,6 +28,8 @@ private:
     unsigned int shaderID;
 private:
     static std::string readFile(const std::string& path);
+    // Code with a #define per name after the #version line
+    static std::string addDefines(const std::string& code, const std::vector<std::string>& defines);
     void compileShader();
 public:
     Shader(const std::string& _code, const ShaderType& _shaderType);
@@ -41,6 +44,11 @@ public:
         return Shader(readFile(filePath), shaderType);
     }
 
+    // Variant of the shader compiled with the given macros defined
+    static Shader fromFile(const std::string& filePath, const ShaderType& shaderType, const std::vector<std::string>& defines) {
+        return Shader(addDefines(readFile(filePath), defines), shaderType);
+    }
+
     static Shader fromCode(const std::string& code, const ShaderType& shaderType) {
         return Shader(code, shaderType);
     }
@@ -72,6 +80,7 @@ private:
 public:
     void uniformInt(const std::string& uniform, int value);
     void uniformFloat(const std::string& uniform, float value);
+    void uniformVec2(const std::string& uniform, const glm::vec2& vec);
     void uniformVec3(const std::string& uniform, const glm::vec3& vec);
     void uniformMat4(const std::string& uniform, const glm::mat4& mat);
 public:
@@ -0,0 +1,90 @@
+#include "temporalreprojection.h"
+
+namespace rgl
+{
+
+TemporalReprojection::TemporalReprojection(int _width, int _height, const std::string& shadersPath)
+    : width(_width), height(_height), current(0), historyValid(false),
+    memory(MemoryDomain::GPU, MemoryCategory::OutputImages), previousModelMatrix(1.f), hasPrevious(false) {
+
+    Shader computeShader = Shader::fromFile(shadersPath + "temporal.glsl", Shader::ShaderType::Compute);
+    program = ShaderProgram::New(computeShader);
+
+    for(unsigned int i = 0; i < 2; i ++) {
+        surfaceIDs[i] = createImage(width, height, GL_RGBA32UI);
+        historyIDs[i] = createImage(width, height, GL_RGBA32F);
+    }
+
+    memory.resize(2 * (size_t)width * height * (4 * sizeof(unsigned int) + 4 * sizeof(float)));
+}
+
+TemporalReprojection::~TemporalReprojection() {
+    glDeleteTextures(2, surfaceIDs);
+    glDeleteTextures(2, historyIDs);
+}
+
+unsigned int TemporalReprojection::createImage(int width, int height, GLenum format) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return textureID;
+}
+
+void TemporalReprojection::beginFrame(ShaderProgram& traceProgram, const glm::mat4& modelMatrix, const Camera& camera) {
+
+    if(!hasPrevious) {
+        previousModelMatrix = modelMatrix;
+        previousCamera = camera;
+        hasPrevious = true;
+    }
+
+    traceProgram.useProgram();
+    traceProgram.uniformInt("temporalReprojection", 1);
+    traceProgram.uniformMat4("previousModelMatrix", previousModelMatrix);
+    traceProgram.uniformVec3("previousCameraPosition", previousCamera.position);
+    traceProgram.uniformVec3("previousCameraTarget", previousCamera.target);
+    traceProgram.uniformFloat("previousCameraFov", previousCamera.fov);
+
+    glBindImageTexture(TEMPORAL_SURFACE_IMAGE_UNIT, surfaceIDs[current], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32UI);
+
+    previousModelMatrix = modelMatrix;
+    previousCamera = camera;
+}
+
+void TemporalReprojection::resolve(unsigned int textureID) {
+
+    unsigned int previous = 1 - current;
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    glBindImageTexture(0, textureID, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(TEMPORAL_SURFACE_IMAGE_UNIT, surfaceIDs[current], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32UI);
+    glBindImageTexture(TEMPORAL_PREVIOUS_SURFACE_IMAGE_UNIT, surfaceIDs[previous], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32UI);
+    glBindImageTexture(TEMPORAL_HISTORY_IMAGE_UNIT, historyIDs[previous], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(TEMPORAL_NEXT_HISTORY_IMAGE_UNIT, historyIDs[current], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    program->useProgram();
+    program->uniformInt("historyValid", historyValid ? 1 : 0);
+    program->uniformFloat("maxHistory", settings.maxHistory);
+    program->uniformFloat("depthTolerance", settings.depthTolerance);
+    program->uniformFloat("normalThreshold", settings.normalThreshold);
+    program->uniformFloat("varianceGamma", settings.varianceGamma);
+
+    unsigned int groupsX = (width + 7) / 8, groupsY = (height + 7) / 8;
+
+    program->uniformInt("stage", 0);
+    glDispatchCompute(groupsX, groupsY, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    program->uniformInt("stage", 1);
+    glDispatchCompute(groupsX, groupsY, 1);
+
+    historyValid = true;
+    current = previous;
+}
+
+}
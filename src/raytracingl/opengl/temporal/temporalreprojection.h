@@ -0,0 +1,86 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include <GL/glew.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/opengl/shader/shader.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+// Image units of the surface written by compute.glsl and of the images of temporal.glsl,
+// FRAME_PIPELINE_IMAGE_UNIT is the frame
+#define TEMPORAL_SURFACE_IMAGE_UNIT 3
+#define TEMPORAL_PREVIOUS_SURFACE_IMAGE_UNIT 4
+#define TEMPORAL_HISTORY_IMAGE_UNIT 5
+#define TEMPORAL_NEXT_HISTORY_IMAGE_UNIT 6
+
+namespace rgl
+{
+
+// History reuse while the camera or the model matrix change. The trace kernel writes the
+// motion of every pixel to the previous frame, from the previous transforms, with its
+// distances to the current and previous cameras and its object space normal. resolve() then
+// blends the frame with the history found there: history texels whose distance to the
+// previous camera or normal don't match are disocclusions and are dropped, the
+// rest is clamped to mean +- varianceGamma sigma of the new samples around the pixel and
+// averaged over at most maxHistory frames.
+//
+//     temporal->beginFrame(*computeProgram, modelMatrix, camera);
+//     glDispatchCompute(...);
+//     temporal->resolve(textureID);
+class TemporalReprojection {
+    GENERATE_SHARED_PTR(TemporalReprojection)
+public:
+    struct Settings {
+        float maxHistory = 32.f;        // frames, bounds the lag after a change of the lighting
+        float depthTolerance = 0.05f;   // relative
+        float normalThreshold = 0.9f;   // cosine
+        float varianceGamma = 1.25f;
+    };
+
+    // Uniforms cameraPosition, cameraTarget and cameraFov of compute.glsl
+    struct Camera {
+        glm::vec3 position = glm::vec3(0.f, 0.f, 2.f);
+        glm::vec3 target = glm::vec3(0.f);
+        float fov = 45.f;
+    };
+private:
+    int width, height;
+    unsigned int surfaceIDs[2], historyIDs[2];
+    unsigned int current;       // surface written and history blended this frame
+    bool historyValid;
+    ShaderProgram::Ptr program;
+    Settings settings;
+    MemoryRecord memory;
+
+    glm::mat4 previousModelMatrix;
+    Camera previousCamera;
+    bool hasPrevious;
+private:
+    static unsigned int createImage(int width, int height, GLenum format);
+public:
+    TemporalReprojection(int _width, int _height, const std::string& shadersPath = "glsl/");
+    ~TemporalReprojection();
+    TemporalReprojection(const TemporalReprojection& temporalReprojection) = delete;
+    TemporalReprojection& operator=(const TemporalReprojection& temporalReprojection) = delete;
+public:
+    // Previous transforms and the surface image of the trace kernel, before its dispatch.
+    // The first frame reprojects onto itself
+    void beginFrame(ShaderProgram& traceProgram, const glm::mat4& modelMatrix, const Camera& camera);
+    // Blends the frame traced into the RGBA32F texture with the history, in place
+    void resolve(unsigned int textureID);
+    // Drops the history, e.g. when the scene changes
+    void reset() { historyValid = false; }
+public:
+    const Settings& getSettings() const { return settings; }
+    void setSettings(const Settings& _settings) { settings = _settings; }
+    unsigned int getHistoryTextureID() const { return historyIDs[current]; }
+    unsigned int getSurfaceTextureID() const { return surfaceIDs[current]; }
+};
+
+}
@@ -0,0 +1,36 @@
+#include "timer.h"
+
+namespace rgl
+{
+
+GPUTimer::GPUTimer() : queryIDs{ 0, 0 }, elapsed(0.0), pending(false) {
+    glGenQueries(2, queryIDs);
+}
+
+GPUTimer::~GPUTimer() {
+    glDeleteQueries(2, queryIDs);
+}
+
+void GPUTimer::begin() {
+    glQueryCounter(queryIDs[0], GL_TIMESTAMP);
+}
+
+void GPUTimer::end() {
+    glQueryCounter(queryIDs[1], GL_TIMESTAMP);
+    pending = true;
+}
+
+double GPUTimer::getElapsedMilliseconds() {
+
+    if(pending) {
+        GLuint64 beginTime = 0, endTime = 0;
+        glGetQueryObjectui64v(queryIDs[0], GL_QUERY_RESULT, &beginTime);
+        glGetQueryObjectui64v(queryIDs[1], GL_QUERY_RESULT, &endTime);
+        elapsed = (endTime - beginTime) / 1e6;
+        pending = false;
+    }
+
+    return elapsed;
+}
+
+}
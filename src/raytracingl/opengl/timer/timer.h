@@ -0,0 +1,53 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include "raytracingl/ptr.h"
+
+namespace rgl
+{
+
+// Measures the GPU time spent by the commands issued between begin() and end()
+// with a pair of GL_TIMESTAMP queries. Unlike GL_TIME_ELAPSED, timestamps can be
+// nested and they also cover compute dispatches on Mesa llvmpipe.
+class GPUTimer {
+    GENERATE_SHARED_PTR(GPUTimer)
+private:
+    unsigned int queryIDs[2];
+    double elapsed;
+    bool pending;
+public:
+    GPUTimer();
+    ~GPUTimer();
+    GPUTimer(const GPUTimer& gpuTimer) = delete;
+    GPUTimer& operator=(const GPUTimer& gpuTimer) = delete;
+public:
+    void begin();
+    void end();
+    // Waits for the query result if it is not available yet
+    double getElapsedMilliseconds();
+public:
+    unsigned int getBeginQueryID() const { return queryIDs[0]; }
+    unsigned int getEndQueryID() const { return queryIDs[1]; }
+};
+
+
+class CPUTimer {
+    GENERATE_SHARED_PTR(CPUTimer)
+private:
+    std::chrono::steady_clock::time_point start;
+public:
+    CPUTimer() : start(std::chrono::steady_clock::now()) {}
+    ~CPUTimer() = default;
+public:
+    void reset() { start = std::chrono::steady_clock::now(); }
+
+    double getElapsedMilliseconds() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+}
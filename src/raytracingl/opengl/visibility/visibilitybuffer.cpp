@@ -0,0 +1,121 @@
+#include "visibilitybuffer.h"
+
+namespace rgl
+{
+
+VisibilityBuffer::VisibilityBuffer(int _width, int _height, const std::string& shadersPath)
+    : width(_width), height(_height), memory(MemoryDomain::GPU, MemoryCategory::OutputImages),
+    cameraPosition(0.f, 0.f, 2.f), cameraTarget(0.f), cameraFov(45.f), nearPlane(0.01f), farPlane(1000.f) {
+
+    Shader vertexShader = Shader::fromFile(shadersPath + "visibility_vertex.glsl", Shader::ShaderType::Vertex);
+    Shader fragmentShader = Shader::fromFile(shadersPath + "visibility_fragment.glsl", Shader::ShaderType::Fragment);
+    program = ShaderProgram::New(vertexShader, fragmentShader);
+
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32UI, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &depthID);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebufferID);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureID, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthID);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Visibility buffer: incomplete framebuffer" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Core profiles need a vertex array bound to draw, even without attributes
+    glGenVertexArrays(1, &vertexArrayID);
+
+    memory.resize((size_t)width * height * (4 * sizeof(unsigned int) + sizeof(float)));
+}
+
+VisibilityBuffer::~VisibilityBuffer() {
+    glDeleteVertexArrays(1, &vertexArrayID);
+    glDeleteFramebuffers(1, &framebufferID);
+    glDeleteRenderbuffers(1, &depthID);
+    glDeleteTextures(1, &textureID);
+}
+
+void VisibilityBuffer::setCamera(const glm::vec3& position, const glm::vec3& target, float fov) {
+    cameraPosition = position;
+    cameraTarget = target;
+    cameraFov = fov;
+}
+
+void VisibilityBuffer::setDepthRange(float _nearPlane, float _farPlane) {
+    nearPlane = _nearPlane;
+    farPlane = _farPlane;
+}
+
+void VisibilityBuffer::clear() {
+
+    const GLuint empty[4] = {0u, 0u, 0u, 0u};
+    const GLfloat far = 1.f;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+    glClearBufferuiv(GL_COLOR, 0, empty);
+    glClearBufferfv(GL_DEPTH, 0, &far);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VisibilityBuffer::draw(const Mesh& mesh) {
+
+    if(mesh.numIndices < 3) return;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_CULL_FACE);    // the rays hit both sides
+
+    program->useProgram();
+    program->uniformInt("vertexFormat", (int)mesh.vertexFormat);
+    program->uniformVec3("vertexOrigin", mesh.quantization.origin);
+    program->uniformVec3("vertexScale", mesh.quantization.scale);
+    program->uniformInt("vertexOffset", mesh.vertexOffset);
+    program->uniformInt("indexOffset", mesh.indexOffset);
+    program->uniformMat4("modelMatrix", mesh.modelMatrix);
+    program->uniformInt("instance", mesh.instance);
+    program->uniformVec3("cameraPosition", cameraPosition);
+    program->uniformVec3("cameraTarget", cameraTarget);
+    program->uniformFloat("cameraFov", cameraFov);
+    program->uniformFloat("nearPlane", nearPlane);
+    program->uniformFloat("farPlane", farPlane);
+    program->uniformVec2("resolution", glm::vec2(width, height));
+
+    glBindVertexArray(vertexArrayID);
+    glDrawArrays(GL_TRIANGLES, 0, mesh.numIndices - mesh.numIndices % 3);
+    glBindVertexArray(0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    if(!depthTest) glDisable(GL_DEPTH_TEST);
+    if(cullFace) glEnable(GL_CULL_FACE);
+}
+
+void VisibilityBuffer::bindImage(unsigned int unit) const {
+    glBindImageTexture(unit, textureID, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32UI);
+}
+
+std::vector<glm::uvec4> VisibilityBuffer::download() const {
+    std::vector<glm::uvec4> texels((size_t)width * height);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, texels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texels;
+}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/geometry/packedvertex.h"
+#include "raytracingl/opengl/shader/shader.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+// Image unit of the visibility buffer in compute.glsl, read when primaryVisibility is set
+#define VISIBILITY_IMAGE_UNIT 2
+
+namespace rgl
+{
+
+// Primary visibility rasterized instead of traced. Each texel holds:
+//   x: triangle + 1, 0 where nothing was drawn
+//   y: instance of the mesh
+//   z: barycentrics of the second and third vertices, packUnorm2x16
+//   w: distance to the camera, float bits
+// The meshes are drawn straight from the vertex and index buffers at bindings 0 and 1 with
+// the camera of compute.glsl, so the texels line up with its primary rays. The compute
+// shader only intersects the ray with the triangle of its texel and starts tracing at the
+// secondary rays, the cost of the primary hits doesn't depend on the number of triangles.
+class VisibilityBuffer {
+    GENERATE_SHARED_PTR(VisibilityBuffer)
+public:
+    struct Mesh {
+        unsigned int numIndices = 0;
+        VertexFormat vertexFormat = VertexFormat::Full;
+        VertexQuantization quantization;
+        unsigned int vertexOffset = 0;      // see BufferArena
+        unsigned int indexOffset = 0;
+        glm::mat4 modelMatrix = glm::mat4(1.f);
+        unsigned int instance = 0;
+    };
+private:
+    int width, height;
+    unsigned int framebufferID, textureID, depthID, vertexArrayID;
+    ShaderProgram::Ptr program;
+    MemoryRecord memory;
+
+    glm::vec3 cameraPosition, cameraTarget;
+    float cameraFov, nearPlane, farPlane;
+public:
+    VisibilityBuffer(int _width, int _height, const std::string& shadersPath = "glsl/");
+    ~VisibilityBuffer();
+    VisibilityBuffer(const VisibilityBuffer& visibilityBuffer) = delete;
+    VisibilityBuffer& operator=(const VisibilityBuffer& visibilityBuffer) = delete;
+public:
+    // Same parameters as the cameraPosition, cameraTarget and cameraFov uniforms of compute.glsl
+    void setCamera(const glm::vec3& position, const glm::vec3& target, float fov);
+    // Geometry closer than nearPlane is clipped, the traced rays don't have a near plane
+    void setDepthRange(float _nearPlane, float _farPlane);
+
+    void clear();
+    // Depth tested against the meshes drawn since clear()
+    void draw(const Mesh& mesh);
+    void bindImage(unsigned int unit = VISIBILITY_IMAGE_UNIT) const;
+    std::vector<glm::uvec4> download() const;
+public:
+    unsigned int getTextureID() const { return textureID; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+};
+
+}
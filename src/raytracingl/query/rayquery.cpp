@@ -0,0 +1,219 @@
+#include "rayquery.h"
+
+#include <algorithm>
+
+namespace rgl
+{
+
+// The origin is moved to tmin, the hits are then searched up to tmax - tmin
+static Ray offsetRay(const QueryRay& queryRay) {
+    return Ray(queryRay.origin + queryRay.direction * queryRay.tmin, queryRay.direction);
+}
+
+RayQuery::RayQuery(const CPUTracer::Ptr& _tracer, unsigned int _numThreads)
+    : backend(Backend::CPU), tracer(_tracer), numThreads(_numThreads), job(nullptr), jobCount(0), nextBlock(0),
+    generation(0), busy(0), stopping(false), batchSize(0) {
+
+    if(numThreads == 0) numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    for(unsigned int i = 1; i < numThreads; i ++)
+        workers.emplace_back(&RayQuery::work, this);
+}
+
+RayQuery::RayQuery(const ShaderProgram::Ptr& _program, unsigned int _batchSize)
+    : backend(Backend::Compute), numThreads(0), job(nullptr), jobCount(0), nextBlock(0),
+    generation(0), busy(0), stopping(false), program(_program), batchSize(std::max(_batchSize, 1u)) {
+
+    ssboRays = ShaderStorageBuffer<QueryRay>::New((size_t)batchSize, RAY_QUERY_RAYS_BINDING_POINT, MemoryCategory::Scratch);
+    ssboHits = ShaderStorageBuffer<QueryHit>::New((size_t)batchSize, RAY_QUERY_HITS_BINDING_POINT, MemoryCategory::Scratch);
+    ssboOccluded = ShaderStorageBuffer<unsigned int>::New((size_t)batchSize, RAY_QUERY_OCCLUSION_BINDING_POINT, MemoryCategory::Scratch);
+}
+
+RayQuery::~RayQuery() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& worker : workers) worker.join();
+}
+
+// Workers sleep between batches and trace each batch once
+void RayQuery::work() {
+
+    unsigned long long seen = 0;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if(stopping) return;
+            seen = generation;
+        }
+
+        traceBlocks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy --;
+        }
+        done.notify_one();
+    }
+}
+
+// Blocks of rays are handed out until all are traced
+void RayQuery::traceBlocks() {
+    for(size_t first = nextBlock.fetch_add(RAY_QUERY_CPU_BLOCK); first < jobCount; first = nextBlock.fetch_add(RAY_QUERY_CPU_BLOCK))
+        (*job)(first, std::min<size_t>(first + RAY_QUERY_CPU_BLOCK, jobCount));
+}
+
+void RayQuery::parallelBlocks(size_t count, const std::function<void(size_t, size_t)>& traceBlock) {
+
+    if(count == 0) return;
+    if(count <= RAY_QUERY_CPU_BLOCK || workers.empty()) {
+        traceBlock(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &traceBlock;
+        jobCount = count;
+        nextBlock = 0;
+        busy = (unsigned int)workers.size();
+        generation ++;
+    }
+    wake.notify_all();
+
+    traceBlocks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    job = nullptr;
+}
+
+ShaderProgram::Ptr RayQuery::loadProgram(const std::string& shadersPath, unsigned int stackSize) {
+    std::vector<std::string> defines = {RAY_QUERY_DEFINE};
+    if(stackSize > BVH_STACK_SIZE) defines.push_back(bvhStackSizeDefine(stackSize));
+    Shader computeShader = Shader::fromFile(shadersPath + "compute.glsl", Shader::ShaderType::Compute, defines);
+    return ShaderProgram::New(computeShader);
+}
+
+void RayQuery::dispatch(unsigned int count, bool occlusion) {
+
+    program->useProgram();
+    program->uniformInt("numQueryRays", count);
+    program->uniformInt("queryOcclusion", occlusion ? 1 : 0);
+
+    // One dimensional dispatches of at most 65535 groups
+    const unsigned int maxRays = 65535u * RAY_QUERY_WORKGROUP_SIZE;
+    for(unsigned int first = 0; first < count; first += maxRays) {
+        unsigned int rays = std::min(maxRays, count - first);
+        program->uniformInt("queryOffset", first);
+        glDispatchCompute((rays + RAY_QUERY_WORKGROUP_SIZE - 1) / RAY_QUERY_WORKGROUP_SIZE, 1, 1);
+    }
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void RayQuery::closestHit(Span<const QueryRay> rays, Span<QueryHit> hits) {
+
+    if(hits.size() < rays.size()) {
+        std::cout << "Ray query: " << hits.size() << " hits for " << rays.size() << " rays" << std::endl;
+        return;
+    }
+
+    if(backend == Backend::CPU) {
+        parallelBlocks(rays.size(), [&](size_t first, size_t last) {
+            for(size_t i = first; i < last; i ++) {
+
+                const QueryRay& queryRay = rays[i];
+                QueryHit queryHit;
+
+                float maxDist = queryRay.tmax - queryRay.tmin;
+                HitInfo hitInfo = maxDist > 0.f ? tracer->closestHit(offsetRay(queryRay), maxDist) : HitInfo();
+                if(hitInfo.hit) {
+                    queryHit.normal = hitInfo.normal;
+                    queryHit.dist = hitInfo.dist + queryRay.tmin;
+                    queryHit.triangle = hitInfo.triangle;
+                    queryHit.primitive = hitInfo.primitive;
+                }
+
+                hits[i] = queryHit;
+            }
+        });
+        return;
+    }
+
+    ssboRays->bindBase();
+    ssboHits->bindBase();
+
+    for(size_t first = 0; first < rays.size(); first += batchSize) {
+        unsigned int count = (unsigned int)std::min<size_t>(batchSize, rays.size() - first);
+        ssboRays->setData(rays.subspan(first, count));
+        dispatch(count, false);
+        ssboHits->download(hits.subspan(first, count));
+    }
+}
+
+void RayQuery::occluded(Span<const QueryRay> rays, Span<unsigned int> occluded) {
+
+    if(occluded.size() < rays.size()) {
+        std::cout << "Ray query: " << occluded.size() << " results for " << rays.size() << " rays" << std::endl;
+        return;
+    }
+
+    if(backend == Backend::CPU) {
+        parallelBlocks(rays.size(), [&](size_t first, size_t last) {
+            for(size_t i = first; i < last; i ++) {
+                float maxDist = rays[i].tmax - rays[i].tmin;
+                occluded[i] = maxDist > 0.f && tracer->occluded(offsetRay(rays[i]), maxDist) ? 1u : 0u;
+            }
+        });
+        return;
+    }
+
+    ssboRays->bindBase();
+    ssboOccluded->bindBase();
+
+    for(size_t first = 0; first < rays.size(); first += batchSize) {
+        unsigned int count = (unsigned int)std::min<size_t>(batchSize, rays.size() - first);
+        ssboRays->setData(rays.subspan(first, count));
+        dispatch(count, true);
+        ssboOccluded->download(occluded.subspan(first, count));
+    }
+}
+
+void RayQuery::closestHit(ShaderStorageBuffer<QueryRay>& rays, ShaderStorageBuffer<QueryHit>& hits, unsigned int count) {
+
+    if(backend != Backend::Compute) {
+        std::cout << "Ray query: SSBOs can only be traced by the compute backend" << std::endl;
+        return;
+    }
+
+    if(count > rays.getSize() || count > hits.getSize()) {
+        std::cout << "Ray query: " << count << " rays don't fit in the buffers" << std::endl;
+        return;
+    }
+
+    rays.bindBase(RAY_QUERY_RAYS_BINDING_POINT);
+    hits.bindBase(RAY_QUERY_HITS_BINDING_POINT);
+    dispatch(count, false);
+}
+
+void RayQuery::occluded(ShaderStorageBuffer<QueryRay>& rays, ShaderStorageBuffer<unsigned int>& occluded, unsigned int count) {
+
+    if(backend != Backend::Compute) {
+        std::cout << "Ray query: SSBOs can only be traced by the compute backend" << std::endl;
+        return;
+    }
+
+    if(count > rays.getSize() || count > occluded.getSize()) {
+        std::cout << "Ray query: " << count << " rays don't fit in the buffers" << std::endl;
+        return;
+    }
+
+    rays.bindBase(RAY_QUERY_RAYS_BINDING_POINT);
+    occluded.bindBase(RAY_QUERY_OCCLUSION_BINDING_POINT);
+    dispatch(count, true);
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/span.h"
+#include "raytracingl/geometry/query.h"
+#include "raytracingl/cpu/cputracer.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/opengl/shader/shader.h"
+
+#define RAY_QUERY_DEFINE "RAY_QUERY"
+#define RAY_QUERY_WORKGROUP_SIZE 64
+#define RAY_QUERY_CPU_BLOCK 256
+
+namespace rgl
+{
+
+// Batches of closest hit and occlusion queries for clients that don't render: collisions,
+// line of sight, LiDAR. The rays and the results are arrays of the caller, nothing is
+// allocated per query. Two backends on the BVHs of the renderer:
+//   - CPU: blocks of RAY_QUERY_CPU_BLOCK rays traced by CPUTracer on numThreads - 1 workers
+//     owned by the query and the calling thread. Batches of a single block are traced by the
+//     calling thread alone
+//   - Compute: the RAY_QUERY variant of compute.glsl, one invocation per ray. Host arrays go
+//     through staging SSBOs of batchSize rays, SSBOs of the caller are traced in place
+//
+// As with ViewBatch, the scene buffers and uniforms of the compute program (numIndices,
+// numPrimitives, vertexFormat, bvhWidth...) are set by the caller as for rendering.
+// A query traces one batch at a time, it is not shared by concurrent callers.
+class RayQuery {
+    GENERATE_SHARED_PTR(RayQuery)
+public:
+    enum class Backend { CPU, Compute };
+private:
+    Backend backend;
+
+    CPUTracer::Ptr tracer;
+    unsigned int numThreads;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    const std::function<void(size_t, size_t)>* job;
+    size_t jobCount;
+    std::atomic<size_t> nextBlock;
+    unsigned long long generation;  // batches handed to the workers
+    unsigned int busy;              // workers still tracing the current batch
+    bool stopping;
+
+    ShaderProgram::Ptr program;
+    unsigned int batchSize;
+    ShaderStorageBuffer<QueryRay>::Ptr ssboRays;
+    ShaderStorageBuffer<QueryHit>::Ptr ssboHits;
+    ShaderStorageBuffer<unsigned int>::Ptr ssboOccluded;
+private:
+    void dispatch(unsigned int count, bool occlusion);
+    void work();
+    void traceBlocks();
+    void parallelBlocks(size_t count, const std::function<void(size_t, size_t)>& traceBlock);
+public:
+    // CPU backend, 0 threads uses every hardware thread
+    RayQuery(const CPUTracer::Ptr& _tracer, unsigned int _numThreads = 0);
+    // Compute backend, program is loaded with loadProgram()
+    RayQuery(const ShaderProgram::Ptr& _program, unsigned int _batchSize = 1 << 16);
+    ~RayQuery();
+    RayQuery(const RayQuery& rayQuery) = delete;
+    RayQuery& operator=(const RayQuery& rayQuery) = delete;
+public:
+    // compute.glsl with RAY_QUERY defined, and a larger traversal stack when the BVH needs more
+    // than BVH_STACK_SIZE entries (WideBVH::getStackSize(), bvhStackSize(2, LBVH::getDepth()))
+    static ShaderProgram::Ptr loadProgram(const std::string& shadersPath = "glsl/", unsigned int stackSize = BVH_STACK_SIZE);
+
+    // hits[i] is the closest hit of rays[i] in (tmin, tmax). hits needs rays.size() elements
+    void closestHit(Span<const QueryRay> rays, Span<QueryHit> hits);
+    // occluded[i] is 1 if rays[i] hits anything in (tmin, tmax), 0 otherwise
+    void occluded(Span<const QueryRay> rays, Span<unsigned int> occluded);
+
+    // Compute backend only, the first count rays of SSBOs of the caller. The results stay in
+    // GPU memory, the barriers for shader and buffer reads are issued
+    void closestHit(ShaderStorageBuffer<QueryRay>& rays, ShaderStorageBuffer<QueryHit>& hits, unsigned int count);
+    void occluded(ShaderStorageBuffer<QueryRay>& rays, ShaderStorageBuffer<unsigned int>& occluded, unsigned int count);
+public:
+    Backend getBackend() const { return backend; }
+    const CPUTracer::Ptr& getTracer() const { return tracer; }
+    const ShaderProgram::Ptr& getProgram() const { return program; }
+    unsigned int getNumThreads() const { return numThreads; }
+    unsigned int getBatchSize() const { return batchSize; }
+};
+
+}
@@ -0,0 +1,239 @@
+#include "sampler.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace rgl
+{
+
+// Joe and Kuo direction numbers (new-joe-kuo-6.21201) of the dimensions 1 to 31: degree of the
+// primitive polynomial, its inner coefficients and the initial m values
+struct SobolPolynomial {
+    uint32_t degree;
+    uint32_t coefficients;
+    uint32_t m[7];
+};
+
+static const SobolPolynomial sobolPolynomials[SOBOL_DIMENSIONS - 1] = {
+    {1, 0, {1}},
+    {2, 1, {1, 3}},
+    {3, 1, {1, 3, 1}},
+    {3, 2, {1, 1, 1}},
+    {4, 1, {1, 1, 3, 3}},
+    {4, 4, {1, 3, 5, 13}},
+    {5, 2, {1, 1, 5, 5, 17}},
+    {5, 4, {1, 1, 5, 5, 5}},
+    {5, 7, {1, 1, 7, 11, 19}},
+    {5, 11, {1, 1, 5, 1, 1}},
+    {5, 13, {1, 1, 1, 3, 11}},
+    {5, 14, {1, 3, 5, 5, 31}},
+    {6, 1, {1, 3, 3, 9, 7, 49}},
+    {6, 13, {1, 1, 1, 15, 21, 21}},
+    {6, 16, {1, 3, 1, 13, 27, 49}},
+    {6, 19, {1, 1, 1, 15, 7, 5}},
+    {6, 22, {1, 3, 1, 15, 13, 25}},
+    {6, 25, {1, 1, 5, 5, 19, 61}},
+    {7, 1, {1, 3, 7, 11, 23, 15, 103}},
+    {7, 4, {1, 3, 7, 13, 13, 15, 69}},
+    {7, 7, {1, 1, 3, 13, 7, 35, 63}},
+    {7, 8, {1, 3, 5, 9, 1, 25, 53}},
+    {7, 14, {1, 3, 1, 13, 9, 35, 107}},
+    {7, 19, {1, 3, 1, 5, 27, 61, 31}},
+    {7, 21, {1, 1, 5, 11, 19, 41, 61}},
+    {7, 28, {1, 3, 5, 3, 3, 13, 69}},
+    {7, 31, {1, 1, 7, 13, 1, 19, 1}},
+    {7, 32, {1, 3, 7, 5, 13, 19, 59}},
+    {7, 37, {1, 1, 3, 9, 25, 29, 41}},
+    {7, 41, {1, 3, 5, 13, 23, 1, 55}},
+    {7, 42, {1, 3, 7, 3, 13, 59, 17}}
+};
+
+Sampler::Sampler(SamplerType _type)
+    : type(_type), directions(sobolDirections()), blueNoise(blueNoiseMask()),
+    memory(MemoryDomain::Host, MemoryCategory::Other) {
+    memory.resize((directions.size() + blueNoise.size()) * sizeof(uint32_t));
+}
+
+uint32_t Sampler::sampleBits(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+
+    if(type == SamplerType::Random)
+        return hash(hashCombine(hash(x + hash(y + hash(index))), dimension));
+
+    // The blue noise variant shares one sequence between all the pixels, the mask decorrelates them
+    uint32_t seed = type == SamplerType::BlueNoise ? 0u : hash(x + hash(y));
+
+    // Every group of SOBOL_DIMENSIONS dimensions visits the points in its own order
+    uint32_t shuffled = nestedUniformScramble(index, hashCombine(seed, hash(dimension / SOBOL_DIMENSIONS)));
+    uint32_t value = sobol(shuffled, &directions[(dimension % SOBOL_DIMENSIONS) * 32]);
+    value = nestedUniformScramble(value, hashCombine(seed, dimension));
+
+    if(type == SamplerType::BlueNoise) {
+        uint32_t offset = hash(dimension);
+        uint32_t bx = (x + offset) % BLUE_NOISE_SIZE, by = (y + (offset >> 16)) % BLUE_NOISE_SIZE;
+        value += blueNoise[by * BLUE_NOISE_SIZE + bx] << 20;
+    }
+
+    return value;
+}
+
+void Sampler::upload() {
+    ssboDirections = ShaderStorageBuffer<unsigned int>::New(directions, SOBOL_DIRECTIONS_BINDING_POINT, false, MemoryCategory::Other);
+    ssboBlueNoise = ShaderStorageBuffer<unsigned int>::New(blueNoise, BLUE_NOISE_BINDING_POINT, false, MemoryCategory::Other);
+}
+
+void Sampler::bind() const {
+    if(ssboDirections == nullptr) return;
+    ssboDirections->bindBase();
+    ssboBlueNoise->bindBase();
+}
+
+std::vector<uint32_t> Sampler::sobolDirections() {
+
+    std::vector<uint32_t> v(SOBOL_DIMENSIONS * 32);
+
+    // The first dimension is the van der Corput sequence
+    for(unsigned int i = 0; i < 32; i ++) v[i] = 1u << (31 - i);
+
+    for(unsigned int d = 1; d < SOBOL_DIMENSIONS; d ++) {
+
+        const SobolPolynomial& polynomial = sobolPolynomials[d - 1];
+        uint32_t* dv = &v[d * 32];
+        uint32_t s = polynomial.degree;
+
+        for(unsigned int i = 0; i < 32; i ++) {
+
+            if(i < s) {
+                dv[i] = polynomial.m[i] << (31 - i);
+                continue;
+            }
+
+            dv[i] = dv[i - s] ^ (dv[i - s] >> s);
+            for(unsigned int k = 1; k < s; k ++)
+                if((polynomial.coefficients >> (s - 1 - k)) & 1u) dv[i] ^= dv[i - k];
+        }
+    }
+
+    return v;
+}
+
+std::vector<uint32_t> Sampler::blueNoiseMask(float sigma) {
+
+    const int size = BLUE_NOISE_SIZE;
+    const int n = size * size;
+
+    // Gaussian energy of a point on the torus, by offset
+    std::vector<float> kernel(n);
+    for(int y = 0; y < size; y ++) {
+        for(int x = 0; x < size; x ++) {
+            float dx = (float)std::min(x, size - x), dy = (float)std::min(y, size - y);
+            kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.f * sigma * sigma));
+        }
+    }
+
+    std::vector<unsigned char> points(n, 0);
+    std::vector<float> energy(n, 0.f);
+
+    auto toggle = [&](int p, bool set) {
+        points[p] = set;
+        int px = p % size, py = p / size;
+        float sign = set ? 1.f : -1.f;
+        for(int y = 0; y < size; y ++) {
+            const float* row = &kernel[((y - py + size) % size) * size];
+            for(int x = 0; x < size; x ++) energy[y * size + x] += sign * row[(x - px + size) % size];
+        }
+    };
+
+    auto tightestCluster = [&]() {
+        int best = -1;
+        for(int i = 0; i < n; i ++) if(points[i] && (best < 0 || energy[i] > energy[best])) best = i;
+        return best;
+    };
+
+    auto largestVoid = [&]() {
+        int best = -1;
+        for(int i = 0; i < n; i ++) if(!points[i] && (best < 0 || energy[i] < energy[best])) best = i;
+        return best;
+    };
+
+    // Initial binary pattern: a tenth of the cells at random, relaxed by moving the point of
+    // the tightest cluster to the largest void until it lands where it was
+    uint32_t seed = 1u;
+    int initial = 0;
+    for(int i = 0; i < n / 10; i ++) {
+        seed = hash(seed);
+        int p = seed % n;
+        if(points[p]) continue;
+        toggle(p, true);
+        initial ++;
+    }
+
+    while(true) {
+        int cluster = tightestCluster();
+        toggle(cluster, false);
+        int hole = largestVoid();
+        toggle(hole, true);
+        if(hole == cluster) break;
+    }
+
+    std::vector<unsigned char> prototypePoints = points;
+    std::vector<float> prototypeEnergy = energy;
+    std::vector<uint32_t> ranks(n);
+
+    // Ranks of the initial points, removing the tightest clusters first
+    for(int rank = initial - 1; rank >= 0; rank --) {
+        int cluster = tightestCluster();
+        toggle(cluster, false);
+        ranks[cluster] = rank;
+    }
+
+    // Ranks of the rest, filling the largest voids
+    points = prototypePoints;
+    energy = prototypeEnergy;
+    for(int rank = initial; rank < n; rank ++) {
+        int hole = largestVoid();
+        toggle(hole, true);
+        ranks[hole] = rank;
+    }
+
+    return ranks;
+}
+
+uint32_t Sampler::sobol(uint32_t index, const uint32_t* dimensionDirections) {
+    uint32_t x = 0u;
+    for(unsigned int bit = 0; index != 0u; index >>= 1, bit ++)
+        if(index & 1u) x ^= dimensionDirections[bit];
+    return x;
+}
+
+// Laine-Karras permutation on the reversed bits, every bit is flipped depending on the lower
+// ones, which is an Owen scrambling of the base 2 digits
+uint32_t Sampler::nestedUniformScramble(uint32_t x, uint32_t seed) {
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// PCG hash, the same as pcg() in compute.glsl
+uint32_t Sampler::hash(uint32_t v) {
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint32_t Sampler::hashCombine(uint32_t seed, uint32_t v) {
+    return seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+uint32_t Sampler::reverseBits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4);
+    v = ((v >> 8) & 0x00FF00FFu) | ((v & 0x00FF00FFu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+}
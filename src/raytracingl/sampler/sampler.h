@@ -0,0 +1,86 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+#define SOBOL_DIRECTIONS_BINDING_POINT 9
+#define BLUE_NOISE_BINDING_POINT 10
+
+#define SOBOL_DIMENSIONS 32     // dimensions of the direction table, the next ones are padded
+#define BLUE_NOISE_SIZE 64      // side of the blue noise mask, its ranks are 12 bits
+
+// Dimensions of the direct lighting. Each bounce takes environmentSamples blocks of
+// SAMPLER_LIGHT_DIMENSIONS, one per iteration
+#define SAMPLER_SKY_DIMENSION 0     // 3, alias table entry and position in the texel
+#define SAMPLER_LIGHT_DIMENSION 3   // 3, light BVH descent and point in the triangle
+#define SAMPLER_BSDF_DIMENSION 6    // 2, cosine weighted direction
+#define SAMPLER_LIGHT_DIMENSIONS 8
+
+namespace rgl
+{
+
+enum class SamplerType {
+    Random = 0,     // PCG hash of the pixel, the sample index and the dimension
+    Sobol = 1,      // Owen scrambled Sobol, shuffled per pixel
+    BlueNoise = 2   // Owen scrambled Sobol shared by the pixels, rotated by a blue noise mask
+};
+
+// Sample streams of compute.glsl on the host. sample() and sampleDimension() in the shader give
+// the same bits for the same pixel, index and dimension, so every backend renders the same
+// image. The Sobol points use the Joe and Kuo direction numbers and the hash based Owen
+// scrambling of "Practical Hash-based Owen Scrambling" (Burley). Dimensions past
+// SOBOL_DIMENSIONS reuse the table with an independent shuffle of the index.
+class Sampler {
+    GENERATE_SHARED_PTR(Sampler)
+private:
+    SamplerType type;
+    std::vector<uint32_t> directions;   // 32 per dimension
+    std::vector<uint32_t> blueNoise;    // ranks, BLUE_NOISE_SIZE x BLUE_NOISE_SIZE
+
+    ShaderStorageBuffer<unsigned int>::Ptr ssboDirections, ssboBlueNoise;
+
+    MemoryRecord memory;
+public:
+    Sampler(SamplerType _type = SamplerType::Sobol);
+    ~Sampler() = default;
+    Sampler(const Sampler& sampler) = delete;
+    Sampler& operator=(const Sampler& sampler) = delete;
+public:
+    // 0.32 fixed point sample of a dimension for a pixel and a sample index
+    uint32_t sampleBits(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const;
+    // Same sample in [0, 1) with 24 bits
+    float sample(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const {
+        return (sampleBits(x, y, index, dimension) >> 8) / 16777216.f;
+    }
+
+    // First dimension of a direct lighting iteration
+    static uint32_t lightDimension(uint32_t bounce, uint32_t iteration, uint32_t iterations) {
+        return (bounce * iterations + iteration) * SAMPLER_LIGHT_DIMENSIONS;
+    }
+
+    // Table at SOBOL_DIRECTIONS_BINDING_POINT and mask at BLUE_NOISE_BINDING_POINT
+    void upload();
+    void bind() const;
+public:
+    static std::vector<uint32_t> sobolDirections();
+    // Ranks of a void and cluster mask (Ulichney), deterministic
+    static std::vector<uint32_t> blueNoiseMask(float sigma = 1.5f);
+
+    static uint32_t sobol(uint32_t index, const uint32_t* dimensionDirections);
+    static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed);
+    static uint32_t hash(uint32_t v);
+    static uint32_t hashCombine(uint32_t seed, uint32_t v);
+    static uint32_t reverseBits(uint32_t v);
+public:
+    void setType(SamplerType _type) { type = _type; }
+    SamplerType getType() const { return type; }
+    const std::vector<uint32_t>& getDirections() const { return directions; }
+    const std::vector<uint32_t>& getBlueNoise() const { return blueNoise; }
+};
+
+}
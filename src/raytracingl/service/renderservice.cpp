@@ -0,0 +1,544 @@
+#include "renderservice.h"
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "raytracingl/vendor/json.hpp"
+#include "raytracingl/io/imagewriter.h"
+#include "raytracingl/io/meshloader.h"
+#include "raytracingl/distributed/protocol.h"
+
+using json = nlohmann::json;
+
+namespace rgl
+{
+
+RenderService::RenderService(const std::string& _socketPath, const std::string& shadersPath)
+    : socketPath(_socketPath), listenFD(listenLocal(_socketPath)), running(false),
+    albedoTexture(0), outputTexture(0), outputWidth(0), outputHeight(0),
+    albedoMemory(MemoryDomain::GPU, MemoryCategory::Textures), outputMemory(MemoryDomain::GPU, MemoryCategory::OutputImages),
+    numJobs(0), numUses(0) {
+
+    Shader computeShader = Shader::fromFile(shadersPath + "compute.glsl", Shader::ShaderType::Compute);
+    program = ShaderProgram::New(computeShader);
+    lbvh = LBVH::New(shadersPath);
+    sampler = Sampler::New();
+    sampler->upload();
+
+    const size_t arenaCapacity = 1 << 16;
+    vertexArena = BufferArena<Vertex>::New(arenaCapacity, 0);
+    packedVertexArena = BufferArena<PackedVertex>::New(arenaCapacity, 0);
+    indexArena = BufferArena<unsigned int>::New(3 * arenaCapacity, 1);
+
+    // There are no materials yet, everything is white
+    float white[4] = { 1.f, 1.f, 1.f, 1.f };
+    glGenTextures(1, &albedoTexture);
+    glBindTexture(GL_TEXTURE_2D, albedoTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 1, 1, 0, GL_RGBA, GL_FLOAT, white);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    albedoMemory.resize(sizeof(white));
+}
+
+RenderService::~RenderService() {
+
+    if(albedoTexture != 0) glDeleteTextures(1, &albedoTexture);
+    if(outputTexture != 0) glDeleteTextures(1, &outputTexture);
+
+    if(listenFD >= 0) {
+        close(listenFD);
+        unlink(socketPath.c_str());
+    }
+}
+
+void RenderService::resizeOutput(int width, int height) {
+
+    if(outputTexture != 0 && width == outputWidth && height == outputHeight) return;
+    if(outputTexture == 0) glGenTextures(1, &outputTexture);
+
+    glBindTexture(GL_TEXTURE_2D, outputTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    outputWidth = width;
+    outputHeight = height;
+    outputMemory.resize((size_t)width * height * 4 * sizeof(float));
+}
+
+// Makes room for one more entry
+template<typename T>
+static void evictLeastRecentlyUsed(std::map<std::string, T>& cache, size_t maxSize) {
+    while(!cache.empty() && cache.size() >= maxSize) {
+        auto oldest = std::min_element(cache.begin(), cache.end(),
+            [](const auto& a, const auto& b) { return a.second.lastUse < b.second.lastUse; });
+        cache.erase(oldest);
+    }
+}
+
+std::string RenderService::hash(Span<const Vertex> vertices, Span<const unsigned int> indices) {
+    GeometryHash hash;
+    for(const Vertex& vertex : vertices) hash.add(vertex);
+    for(unsigned int index : indices) hash.add(index);
+    return hash.toString();
+}
+
+bool RenderService::buildScene(Scene& scene) {
+
+    if(!lbvh->isValid()) return false;
+
+    // The builder is shared and reuses its node buffer, every scene keeps a copy of its own
+    if(scene.format == VertexFormat::Packed) lbvh->build(scene.packedVertices, scene.quantization, scene.indices);
+    else lbvh->build(scene.vertices, scene.indices);
+
+    unsigned int stackSize = bvhStackSize(2, lbvh->getDepth());
+    if(stackSize > BVH_STACK_SIZE) {
+        std::cout << "Render service: the BVH needs a traversal stack of " << stackSize << " entries, "
+            << BVH_STACK_SIZE << " available" << std::endl;
+        return false;
+    }
+
+    scene.nodes = ShaderStorageBuffer<BVHNode>::New(lbvh->downloadNodes(), BVH_NODES_BINDING_POINT);
+    scene.lastUse = ++ numUses;
+    evictLeastRecentlyUsed(scenes, RENDER_SERVICE_MAX_SCENES);
+    scenes[scene.hash] = std::move(scene);
+    return true;
+}
+
+std::string RenderService::loadScene(Span<const Vertex> vertices, Span<const unsigned int> indices, bool& resident,
+    VertexFormat format) {
+
+    std::string key = hash(vertices, indices);
+    auto cached = scenes.find(key);
+    resident = cached != scenes.end();
+    if(resident) {
+        cached->second.lastUse = ++ numUses;
+        return key;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    Scene scene;
+    scene.hash = key;
+    scene.numVertices = vertices.size();
+    scene.numIndices = indices.size();
+    scene.format = format;
+
+    if(format == VertexFormat::Packed) {
+        scene.quantization = VertexQuantization::fromVertices(vertices);
+        scene.packedVertices = packedVertexArena->allocate(packVertices(vertices, scene.quantization));
+    }
+    else scene.vertices = vertexArena->allocate(vertices);
+    scene.indices = indexArena->allocate(indices);
+
+    if(!buildScene(scene)) return "";
+    scenes[key].loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    return key;
+}
+
+std::string RenderService::loadScene(const std::string& path, bool& resident, VertexFormat format) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    GLTFMesh::Ptr mesh = GLTFMesh::fromFile(path);
+    if(mesh == nullptr || mesh->getNumIndices() == 0 || mesh->getNumIndices() % 3 != 0) return "";
+
+    // A first pass validates and hashes without writing anything
+    GeometryHash geometryHash;
+    if(!mesh->read(nullptr, nullptr, &geometryHash)) return "";
+
+    std::string key = geometryHash.toString();
+    auto cached = scenes.find(key);
+    resident = cached != scenes.end();
+    if(resident) {
+        cached->second.lastUse = ++ numUses;
+        return key;
+    }
+
+    // Quantization needs the bounds first, the vertices go through the host
+    if(format == VertexFormat::Packed) {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        mesh->read(vertices, indices);
+        return loadScene(vertices, indices, resident, format);
+    }
+
+    Scene scene;
+    scene.hash = key;
+    scene.numVertices = mesh->getNumVertices();
+    scene.numIndices = mesh->getNumIndices();
+    scene.vertices = vertexArena->allocate(mesh->getNumVertices());
+    scene.indices = indexArena->allocate(mesh->getNumIndices());
+
+    // Mapped memory can be lost (e.g. on a mode switch) until it is unmapped
+    bool written = false;
+    for(int attempt = 0; attempt < 3 && !written; attempt ++) {
+        Vertex* vertices = scene.vertices.map();
+        unsigned int* indices = scene.indices.map();
+        if(vertices != nullptr && indices != nullptr) mesh->read(vertices, indices);
+        bool validVertices = vertices != nullptr && scene.vertices.unmap();
+        bool validIndices = indices != nullptr && scene.indices.unmap();
+        written = validVertices && validIndices;
+    }
+    if(!written) return "";
+
+    if(!buildScene(scene)) return "";
+    scenes[key].loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    return key;
+}
+
+bool RenderService::unloadScene(const std::string& hash) {
+    return scenes.erase(hash) > 0;
+}
+
+bool RenderService::render(const Job& job, std::vector<float>& pixels, std::string& error) {
+
+    auto it = scenes.find(job.scene);
+    if(it == scenes.end()) {
+        error = "unknown scene " + job.scene;
+        return false;
+    }
+
+    if(job.width <= 0 || job.height <= 0 || job.width > RENDER_SERVICE_MAX_RESOLUTION || job.height > RENDER_SERVICE_MAX_RESOLUTION) {
+        error = "invalid resolution";
+        return false;
+    }
+
+    Environment::Ptr environment;
+    if(!job.environment.empty()) {
+        auto cached = environments.find(job.environment);
+        if(cached == environments.end()) {
+            environment = Environment::fromFile(job.environment);
+            if(environment == nullptr) {
+                error = "couldn't load the environment " + job.environment;
+                return false;
+            }
+            environment->upload();
+            evictLeastRecentlyUsed(environments, RENDER_SERVICE_MAX_ENVIRONMENTS);
+            environments[job.environment] = { environment, ++ numUses };
+        }
+        else {
+            environment = cached->second.environment;
+            cached->second.lastUse = ++ numUses;
+        }
+    }
+
+    Scene& scene = it->second;
+    scene.lastUse = ++ numUses;
+    if(scene.format == VertexFormat::Packed) packedVertexArena->bindBase();
+    else vertexArena->bindBase();
+    indexArena->bindBase();
+    scene.nodes->bindBase();
+    sampler->bind();
+
+    resizeOutput(job.width, job.height);
+    glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, albedoTexture);
+    if(environment != nullptr) environment->bind(2);
+
+    program->useProgram();
+    program->uniformInt("numVertices", scene.numVertices);
+    program->uniformInt("vertexFormat", (int)scene.format);
+    program->uniformVec3("vertexOrigin", scene.quantization.origin);
+    program->uniformVec3("vertexScale", scene.quantization.scale);
+    program->uniformInt("vertexOffset", scene.format == VertexFormat::Packed ? scene.packedVertices.getOffset() : scene.vertices.getOffset());
+    program->uniformInt("indexOffset", scene.indices.getOffset());
+    program->uniformInt("numIndices", scene.numIndices);
+    program->uniformInt("numPrimitives", 0);
+    program->uniformInt("numLights", 0);
+    program->uniformInt("bvhWidth", 0);
+    program->uniformInt("bvhBits", 8);
+    program->uniformMat4("modelMatrix", glm::mat4(1.f));
+    program->uniformInt("albedo", 1);
+    program->uniformInt("sky", 2);
+    program->uniformInt("environmentWidth", environment != nullptr ? environment->getWidth() : 0);
+    program->uniformInt("environmentHeight", environment != nullptr ? environment->getHeight() : 0);
+    program->uniformInt("environmentSamples", environment != nullptr ? 1 : 0);
+    program->uniformInt("samplerType", (int)job.sampler);
+    program->uniformVec3("cameraPosition", job.cameraPosition);
+    program->uniformVec3("cameraTarget", job.cameraTarget);
+    program->uniformFloat("cameraFov", job.fov);
+
+    unsigned int samples = std::clamp(job.samples, 1u, (unsigned int)RENDER_SERVICE_MAX_SAMPLES);
+    for(unsigned int sample = 0; sample < samples; sample ++) {
+        program->uniformInt("frame", sample);
+        program->uniformInt("accumulatedFrames", sample);
+        glDispatchCompute((job.width + 9) / 10, (job.height + 9) / 10, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    }
+
+    pixels.resize((size_t)job.width * job.height * 4);
+    glBindTexture(GL_TEXTURE_2D, outputTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, pixels.data());
+
+    numJobs ++;
+    return true;
+}
+
+// Optional fields of a request. They are left as they are when missing, false if the field
+// has another type or is out of range
+static bool readString(const json& message, const char* key, std::string& value) {
+    if(!message.contains(key)) return true;
+    if(!message.at(key).is_string()) return false;
+    value = message.at(key).get<std::string>();
+    return true;
+}
+
+static bool readInteger(const json& message, const char* key, long long minimum, long long maximum, long long& value) {
+    if(!message.contains(key)) return true;
+    const json& field = message.at(key);
+    if(!field.is_number_integer()) return false;
+    if(field.is_number_unsigned() && field.get<unsigned long long>() > (unsigned long long)maximum) return false;
+    value = field.get<long long>();
+    return value >= minimum && value <= maximum;
+}
+
+static bool readFloat(const json& message, const char* key, float minimum, float maximum, float& value) {
+    if(!message.contains(key)) return true;
+    if(!message.at(key).is_number()) return false;
+    value = message.at(key).get<float>();
+    return value >= minimum && value <= maximum;
+}
+
+static bool readVec3(const json& message, const char* key, glm::vec3& value) {
+    if(!message.contains(key)) return true;
+    const json& field = message.at(key);
+    if(!field.is_array() || field.size() != 3) return false;
+    for(const json& component : field) if(!component.is_number()) return false;
+    value = glm::vec3(field[0].get<float>(), field[1].get<float>(), field[2].get<float>());
+    return true;
+}
+
+static bool toSamplerType(const std::string& name, SamplerType& type) {
+    if(name == "random") type = SamplerType::Random;
+    else if(name == "sobol") type = SamplerType::Sobol;
+    else if(name == "bluenoise") type = SamplerType::BlueNoise;
+    else return false;
+    return true;
+}
+
+static std::string errorResponse(const std::string& message) {
+    return json({ { "status", "error" }, { "message", message } }).dump();
+}
+
+std::string RenderService::handle(const std::string& request) {
+
+    // The fields are checked before they are read, a malformed request that slips through
+    // fails on its own instead of taking the service down
+    try {
+        return handleRequest(request);
+    }
+    catch(const json::exception& exception) {
+        return errorResponse(std::string("malformed request: ") + exception.what());
+    }
+}
+
+std::string RenderService::handleRequest(const std::string& request) {
+
+    json message = json::parse(request, nullptr, false);
+    if(message.is_discarded() || !message.is_object()) return errorResponse("invalid JSON");
+
+    std::string command;
+    if(!readString(message, "command", command)) return errorResponse("command must be a string");
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    if(command == "load") {
+
+        bool resident;
+        std::string scene, formatName = "full", path;
+        if(!readString(message, "format", formatName)) return errorResponse("format must be a string");
+        if(formatName != "full" && formatName != "packed") return errorResponse("unknown format " + formatName);
+        VertexFormat format = formatName == "packed" ? VertexFormat::Packed : VertexFormat::Full;
+
+        if(message.contains("path")) {
+            if(!readString(message, "path", path)) return errorResponse("path must be a string");
+            scene = loadScene(path, resident, format);
+            if(scene.empty()) return errorResponse("couldn't load " + path);
+        }
+        else if(message.contains("positions") && message.contains("indices")) {
+            const json& positions = message.at("positions");
+            const json& indexList = message.at("indices");
+            if(!positions.is_array() || !indexList.is_array()) return errorResponse("positions and indices must be arrays");
+
+            std::vector<Vertex> vertices;
+            vertices.reserve(positions.size() / 3);
+            for(size_t i = 0; i + 2 < positions.size(); i += 3) {
+                if(!positions[i].is_number() || !positions[i + 1].is_number() || !positions[i + 2].is_number())
+                    return errorResponse("positions must be numbers");
+                vertices.push_back(Vertex(glm::vec3(positions[i].get<float>(), positions[i + 1].get<float>(),
+                    positions[i + 2].get<float>()), glm::vec3(1.f)));
+            }
+
+            std::vector<unsigned int> indices;
+            indices.reserve(indexList.size());
+            for(const json& index : indexList) {
+                if(!index.is_number_unsigned() || index.get<unsigned long long>() >= vertices.size())
+                    return errorResponse("index out of range");
+                indices.push_back(index.get<unsigned int>());
+            }
+            if(indices.empty() || indices.size() % 3 != 0) return errorResponse("no triangles");
+
+            scene = loadScene(vertices, indices, resident, format);
+            if(scene.empty()) return errorResponse("couldn't build the scene");
+        }
+        else return errorResponse("load needs a path or positions and indices");
+
+        return json({ { "status", "ok" }, { "scene", scene }, { "resident", resident }, { "milliseconds", elapsed() } }).dump();
+    }
+
+    if(command == "render") {
+
+        Job job;
+        long long width = job.width, height = job.height, samples = job.samples;
+        std::string samplerName = "sobol";
+
+        if(!readString(message, "scene", job.scene) || !readString(message, "environment", job.environment)
+            || !readString(message, "output", job.output) || !readString(message, "sampler", samplerName))
+            return errorResponse("scene, environment, output and sampler must be strings");
+        if(!readInteger(message, "width", 1, RENDER_SERVICE_MAX_RESOLUTION, width)
+            || !readInteger(message, "height", 1, RENDER_SERVICE_MAX_RESOLUTION, height))
+            return errorResponse("width and height must be integers in [1, " + std::to_string(RENDER_SERVICE_MAX_RESOLUTION) + "]");
+        if(!readInteger(message, "samples", 1, RENDER_SERVICE_MAX_SAMPLES, samples))
+            return errorResponse("samples must be an integer in [1, " + std::to_string(RENDER_SERVICE_MAX_SAMPLES) + "]");
+        if(!toSamplerType(samplerName, job.sampler)) return errorResponse("unknown sampler " + samplerName);
+
+        job.width = (int)width;
+        job.height = (int)height;
+        job.samples = (unsigned int)samples;
+
+        if(message.contains("camera")) {
+            const json& camera = message.at("camera");
+            if(!camera.is_object() || !readVec3(camera, "position", job.cameraPosition) || !readVec3(camera, "target", job.cameraTarget)
+                || !readFloat(camera, "fov", 1e-3f, 179.f, job.fov))
+                return errorResponse("camera needs 3 numbers for position and target and a fov in degrees");
+        }
+
+        FrameImage image;
+        std::string error;
+        if(!render(job, image.pixels, error)) return errorResponse(error);
+        image.width = job.width;
+        image.height = job.height;
+
+        if(!job.output.empty()) {
+            if(!ImageSequenceWriter::writeImage(job.output, ImageSequenceWriter::formatFromPath(job.output), image))
+                return errorResponse("couldn't write " + job.output);
+            return json({ { "status", "ok" }, { "path", job.output }, { "milliseconds", elapsed() } }).dump();
+        }
+
+        // Shared memory object, the client unlinks it
+        std::string name = "/rgl-" + std::to_string(getpid()) + "-" + std::to_string(numJobs);
+        size_t bytes = image.pixels.size() * sizeof(float);
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0) return errorResponse("couldn't create " + name);
+
+        void* memory = ftruncate(fd, bytes) == 0 ? mmap(nullptr, bytes, PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if(memory == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            return errorResponse("couldn't map " + name);
+        }
+
+        std::memcpy(memory, image.pixels.data(), bytes);
+        munmap(memory, bytes);
+
+        return json({ { "status", "ok" }, { "shm", name }, { "bytes", bytes }, { "width", job.width },
+            { "height", job.height }, { "milliseconds", elapsed() } }).dump();
+    }
+
+    if(command == "unload") {
+        std::string scene;
+        if(!readString(message, "scene", scene) || !unloadScene(scene)) return errorResponse("unknown scene");
+        return json({ { "status", "ok" } }).dump();
+    }
+
+    if(command == "list") {
+        json list = json::array();
+        for(const auto& [key, scene] : scenes)
+            list.push_back({ { "scene", key }, { "vertices", scene.numVertices }, { "triangles", scene.numIndices / 3 },
+                { "format", scene.format == VertexFormat::Packed ? "packed" : "full" }, { "bytes", scene.getMemoryBytes() } });
+        return json({ { "status", "ok" }, { "scenes", list }, { "jobs", numJobs },
+            { "memory", json::parse(MemoryRegistry::get().toJSON()) } }).dump();
+    }
+
+    if(command == "shutdown") {
+        running = false;
+        return json({ { "status", "ok" } }).dump();
+    }
+
+    return errorResponse("unknown command " + command);
+}
+
+void RenderService::run() {
+
+    if(listenFD < 0) return;
+
+    std::vector<int> clients;
+    std::map<int, std::string> buffers;     // bytes after the last complete line
+    running = true;
+
+    while(running) {
+
+        std::vector<pollfd> fds = { { listenFD, POLLIN, 0 } };
+        for(int fd : clients) fds.push_back({ fd, POLLIN, 0 });
+
+        if(poll(fds.data(), fds.size(), -1) < 0) continue;
+
+        for(const pollfd& entry : fds) {
+
+            if(entry.revents == 0) continue;
+
+            if(entry.fd == listenFD) {
+                int fd = accept(listenFD, nullptr, nullptr);
+                if(fd >= 0) clients.push_back(fd);
+                continue;
+            }
+
+            char chunk[4096];
+            ssize_t received = recv(entry.fd, chunk, sizeof(chunk), 0);
+
+            if(received <= 0) {
+                close(entry.fd);
+                clients.erase(std::find(clients.begin(), clients.end(), entry.fd));
+                buffers.erase(entry.fd);
+                continue;
+            }
+
+            std::string& buffer = buffers[entry.fd];
+            buffer.append(chunk, received);
+
+            size_t end;
+            bool connected = true;
+            while(running && connected && (end = buffer.find('\n')) != std::string::npos) {
+                std::string response = handle(buffer.substr(0, end)) + "\n";
+                buffer.erase(0, end + 1);
+                connected = sendAll(entry.fd, response.data(), response.size());
+            }
+
+            if(!connected) {
+                close(entry.fd);
+                clients.erase(std::find(clients.begin(), clients.end(), entry.fd));
+                buffers.erase(entry.fd);
+            }
+        }
+    }
+
+    for(int fd : clients) close(fd);
+}
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+
+#include <GL/glew.h>
+
+#include <glm/vec3.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/geometry/vertex.h"
+#include "raytracingl/geometry/packedvertex.h"
+#include "raytracingl/bvh/bvh.h"
+#include "raytracingl/bvh/lbvh.h"
+#include "raytracingl/light/environment.h"
+#include "raytracingl/sampler/sampler.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/opengl/buffer/bufferarena.h"
+#include "raytracingl/opengl/shader/shader.h"
+#include "raytracingl/memory/memoryregistry.h"
+
+// Limits of the render requests, larger values are rejected
+#define RENDER_SERVICE_MAX_RESOLUTION 16384
+#define RENDER_SERVICE_MAX_SAMPLES 65536
+// Resident scenes and environments, the least recently used one is evicted for a new one
+#define RENDER_SERVICE_MAX_SCENES 64
+#define RENDER_SERVICE_MAX_ENVIRONMENTS 8
+
+namespace rgl
+{
+
+// Long running render service. Scenes are uploaded once and stay resident on the GPU, keyed
+// by the hash of their geometry, so jobs only pay for the tracing. Requests arrive over a
+// local Unix socket, one JSON object per line, and each one gets a JSON line back:
+//
+//   {"command": "load", "path": "model.gltf"}      or inline "positions" and "indices",
+//                                                   "format": "packed" for 16 byte vertices
+//       -> {"status": "ok", "scene": "<hash>", "resident": false, "milliseconds": ...}
+//   {"command": "render", "scene": "<hash>", "width": 500, "height": 500, "samples": 1,
+//    "camera": {"position": [0, 0, 2], "target": [0, 0, 0], "fov": 45},
+//    "environment": "sky.hdr", "sampler": "sobol", "output": "frame.png"}
+//   The sampler is "random", "sobol" (default) or "bluenoise", see SamplerType
+//       -> {"status": "ok", "path": "frame.png", "milliseconds": ...}
+//   Without output the RGBA floats (bottom row first) are left in a POSIX shared memory
+//   object that the client reads and unlinks:
+//       -> {"status": "ok", "shm": "/rgl-<pid>-<job>", "bytes": ..., "width": ..., "height": ...}
+//   {"command": "unload", "scene": "<hash>"}, {"command": "list"}, {"command": "shutdown"}
+//   The list also reports the MemoryRegistry under "memory"
+//   The format is "full" (default) or "packed", a scene that was evicted has to be loaded again
+//
+// Errors are answered with {"status": "error", "message": ...}, also for fields of the wrong
+// type and resolutions or samples out of [1, RENDER_SERVICE_MAX_*]. The service needs a current
+// OpenGL 4.3 context and serves the requests one at a time on that thread.
+class RenderService {
+    GENERATE_SHARED_PTR(RenderService)
+public:
+    struct Job {
+        std::string scene;
+        glm::vec3 cameraPosition = glm::vec3(0.f, 0.f, 2.f);
+        glm::vec3 cameraTarget = glm::vec3(0.f);
+        float fov = 45.f;
+        int width = 500, height = 500;
+        unsigned int samples = 1;       // frames averaged, each one with a sky light and BSDF sample
+        std::string environment;        // sky image, resident after the first job that uses it
+        SamplerType sampler = SamplerType::Sobol;
+        std::string output;             // .png, .hdr or raw floats, empty for shared memory
+    };
+
+    struct Scene {
+        std::string hash;
+        unsigned int numVertices = 0, numIndices = 0;
+        VertexFormat format = VertexFormat::Full;
+        VertexQuantization quantization;
+        BufferArena<Vertex>::Allocation vertices;       // one of them, depending on the format
+        BufferArena<PackedVertex>::Allocation packedVertices;
+        BufferArena<unsigned int>::Allocation indices;
+        ShaderStorageBuffer<BVHNode>::Ptr nodes;
+        double loadMilliseconds = 0.0;
+        unsigned long long lastUse = 0;
+
+        size_t getMemoryBytes() const {
+            size_t vertexBytes = format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+            return numVertices * vertexBytes + numIndices * sizeof(unsigned int) + (nodes != nullptr ? nodes->getSize() * sizeof(BVHNode) : 0);
+        }
+    };
+private:
+    std::string socketPath;
+    int listenFD;
+    bool running;
+
+    ShaderProgram::Ptr program;
+    LBVH::Ptr lbvh;
+    Sampler::Ptr sampler;
+
+    // Geometry of every resident scene, so loading and unloading scenes doesn't create or
+    // delete GL buffers
+    BufferArena<Vertex>::Ptr vertexArena;
+    BufferArena<PackedVertex>::Ptr packedVertexArena;
+    BufferArena<unsigned int>::Ptr indexArena;
+    unsigned int albedoTexture, outputTexture;
+    int outputWidth, outputHeight;
+    MemoryRecord albedoMemory, outputMemory;
+
+    struct CachedEnvironment {
+        Environment::Ptr environment;
+        unsigned long long lastUse = 0;
+    };
+
+    std::map<std::string, Scene> scenes;
+    std::map<std::string, CachedEnvironment> environments;
+    unsigned long long numJobs, numUses;
+private:
+    void resizeOutput(int width, int height);
+    // False when the BVH is too deep for the traversal stack of the program or the GPU can't build it
+    bool buildScene(Scene& scene);
+    std::string handleRequest(const std::string& request);
+public:
+    RenderService(const std::string& _socketPath, const std::string& shadersPath = "glsl/");
+    ~RenderService();
+    RenderService(const RenderService& renderService) = delete;
+    RenderService& operator=(const RenderService& renderService) = delete;
+public:
+    // Serves the socket until a shutdown request
+    void run();
+    // One JSON request, returns the JSON response
+    std::string handle(const std::string& request);
+
+    // Hash of the geometry, 16 hexadecimal digits, see GeometryHash
+    static std::string hash(Span<const Vertex> vertices, Span<const unsigned int> indices);
+
+    // Uploads and builds the BVH unless a scene with the same hash is already resident, in which
+    // case it keeps the format it was loaded with. Empty if the BVH is too deep to be traced
+    std::string loadScene(Span<const Vertex> vertices, Span<const unsigned int> indices, bool& resident,
+        VertexFormat format = VertexFormat::Full);
+    // Full vertices are decoded from the glTF file straight into the mapped GPU buffers, empty if
+    // it can't be loaded
+    std::string loadScene(const std::string& path, bool& resident, VertexFormat format = VertexFormat::Full);
+    bool unloadScene(const std::string& hash);
+    // RGBA floats, bottom row first
+    bool render(const Job& job, std::vector<float>& pixels, std::string& error);
+public:
+    bool isListening() const { return listenFD >= 0; }
+    const std::map<std::string, Scene>& getScenes() const { return scenes; }
+    unsigned long long getNumJobs() const { return numJobs; }
+};
+
+}
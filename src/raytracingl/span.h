@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+
+namespace rgl
+{
+
+// Non-owning view over contiguous elements, std::span is C++20
+template <typename T>
+class Span {
+private:
+    T* pointer;
+    size_t count;
+public:
+    Span() : pointer(nullptr), count(0) {}
+    Span(T* _pointer, size_t _count) : pointer(_pointer), count(_count) {}
+
+    template <typename U, typename = std::enable_if_t<std::is_same_v<std::remove_const_t<T>, U>
+        && (std::is_const_v<T> || !std::is_const_v<U>)>>
+    Span(std::vector<U>& vector) : pointer(vector.data()), count(vector.size()) {}
+
+    template <typename U, typename = std::enable_if_t<std::is_same_v<T, const U>>>
+    Span(const std::vector<U>& vector) : pointer(vector.data()), count(vector.size()) {}
+
+    template <typename U, typename = std::enable_if_t<std::is_same_v<T, const U>>>
+    Span(const Span<U>& span) : pointer(span.data()), count(span.size()) {}
+public:
+    T* data() const { return pointer; }
+    size_t size() const { return count; }
+    size_t bytes() const { return count * sizeof(T); }
+    bool empty() const { return count == 0; }
+
+    T* begin() const { return pointer; }
+    T* end() const { return pointer + count; }
+
+    T& operator[](size_t index) const { return pointer[index]; }
+
+    Span subspan(size_t offset, size_t _count) const { return Span(pointer + offset, _count); }
+};
+
+}
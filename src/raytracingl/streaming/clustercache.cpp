@@ -0,0 +1,101 @@
+#include "clustercache.h"
+
+#include <algorithm>
+
+namespace rgl
+{
+
+ClusterCache::ClusterCache(const ClusterFile::Ptr& _file, unsigned int _numSlots)
+    : file(_file), numSlots(std::max(_numSlots, 1u)), valid(false) {
+
+    clusterSlots.assign(file->getNumClusters(), -1);
+    slotClusters.assign(numSlots, -1);
+
+    for(unsigned int slot = 0; slot < numSlots; slot ++) lru.push_back(slot);
+    for(auto it = lru.begin(); it != lru.end(); it ++) lruPositions.push_back(it);
+
+    valid = checkStorageBindings(CLUSTER_NODES_BINDING_POINT, "Cluster cache");
+    if(!valid) return;
+
+    ssboSlots = ShaderStorageBuffer<int>::New(clusterSlots, CLUSTER_SLOTS_BINDING_POINT, false, MemoryCategory::Other);
+    ssboPositions = ShaderStorageBuffer<glm::vec4>::New((size_t)numSlots * getSlotVertices(),
+        CLUSTER_POSITIONS_BINDING_POINT, MemoryCategory::Vertices);
+    ssboIndices = ShaderStorageBuffer<unsigned int>::New((size_t)numSlots * 3 * getSlotTriangles(),
+        CLUSTER_INDICES_BINDING_POINT, MemoryCategory::Indices);
+    ssboTriangleIds = ShaderStorageBuffer<unsigned int>::New((size_t)numSlots * getSlotTriangles(),
+        CLUSTER_TRIANGLE_IDS_BINDING_POINT, MemoryCategory::Indices);
+    ssboNodes = ShaderStorageBuffer<BVHNode>::New((size_t)numSlots * getSlotNodes(),
+        CLUSTER_NODES_BINDING_POINT, MemoryCategory::AccelerationStructures);
+}
+
+size_t ClusterCache::getSlotBytes() const {
+    return getSlotVertices() * sizeof(glm::vec4) + getSlotTriangles() * 4 * sizeof(unsigned int) + getSlotNodes() * sizeof(BVHNode);
+}
+
+void ClusterCache::pageIn(unsigned int cluster, unsigned int slot) {
+
+    const ClusterInfo& info = file->getCluster(cluster);
+
+    // Reading the mapping is what brings the cluster from disk
+    ssboPositions->setData(Span<const glm::vec4>(file->getPositions(cluster), info.numVertices), (size_t)slot * getSlotVertices());
+    ssboIndices->setData(Span<const unsigned int>(file->getIndices(cluster), 3 * info.numTriangles), (size_t)slot * 3 * getSlotTriangles());
+    ssboTriangleIds->setData(Span<const unsigned int>(file->getTriangleIds(cluster), info.numTriangles), (size_t)slot * getSlotTriangles());
+    ssboNodes->setData(Span<const BVHNode>(file->getNodes(cluster), info.numNodes), (size_t)slot * getSlotNodes());
+
+    stats.pageIns ++;
+    stats.bytesUploaded += info.numVertices * sizeof(glm::vec4) + info.numTriangles * 4 * sizeof(unsigned int) + info.numNodes * sizeof(BVHNode);
+}
+
+bool ClusterCache::makeResident(const std::vector<unsigned int>& clusters) {
+
+    if(!valid || clusters.size() > numSlots) return false;
+
+    std::vector<unsigned char> requested(numSlots, 0);
+    std::vector<unsigned int> missing;
+
+    for(unsigned int cluster : clusters) {
+        int slot = clusterSlots[cluster];
+        if(slot < 0) {
+            missing.push_back(cluster);
+            continue;
+        }
+        requested[slot] = 1;
+        lru.splice(lru.begin(), lru, lruPositions[slot]);
+        stats.hits ++;
+    }
+
+    if(missing.empty()) return true;
+
+    for(unsigned int cluster : missing) {
+
+        // Least recently used slot that this request doesn't need
+        auto it = lru.end();
+        do it --; while(requested[*it]);
+        unsigned int slot = *it;
+
+        if(slotClusters[slot] >= 0) {
+            clusterSlots[slotClusters[slot]] = -1;
+            stats.evictions ++;
+        }
+
+        pageIn(cluster, slot);
+        slotClusters[slot] = cluster;
+        clusterSlots[cluster] = slot;
+        requested[slot] = 1;
+        lru.splice(lru.begin(), lru, lruPositions[slot]);
+    }
+
+    ssboSlots->setData(clusterSlots);
+    return true;
+}
+
+void ClusterCache::bind() const {
+    if(!valid) return;
+    ssboSlots->bindBase();
+    ssboPositions->bindBase();
+    ssboIndices->bindBase();
+    ssboTriangleIds->bindBase();
+    ssboNodes->bindBase();
+}
+
+}
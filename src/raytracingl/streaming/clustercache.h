@@ -0,0 +1,78 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <list>
+
+#include <glm/vec4.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/bvh/bvh.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/streaming/clusterfile.h"
+
+// Binding points of the streaming kernels, after the LBVH scratch ones
+#define CLUSTER_SLOTS_BINDING_POINT 24
+#define CLUSTER_POSITIONS_BINDING_POINT 25
+#define CLUSTER_INDICES_BINDING_POINT 26
+#define CLUSTER_TRIANGLE_IDS_BINDING_POINT 27
+#define CLUSTER_NODES_BINDING_POINT 28
+
+namespace rgl
+{
+
+// Fixed number of GPU slots, each one big enough for the largest cluster of the file. The
+// slot of every cluster, or -1 if it isn't resident, is kept at CLUSTER_SLOTS_BINDING_POINT.
+// Clusters are paged in from the mapping of the file and evict the least recently used ones.
+// Nothing is allocated if the GPU lacks the binding points, see isValid().
+class ClusterCache {
+    GENERATE_SHARED_PTR(ClusterCache)
+public:
+    struct Stats {
+        unsigned long long hits = 0;        // clusters requested that were already resident
+        unsigned long long pageIns = 0;
+        unsigned long long evictions = 0;
+        unsigned long long bytesUploaded = 0;
+    };
+private:
+    ClusterFile::Ptr file;
+    unsigned int numSlots;
+    bool valid;
+
+    ShaderStorageBuffer<int>::Ptr ssboSlots;
+    ShaderStorageBuffer<glm::vec4>::Ptr ssboPositions;
+    ShaderStorageBuffer<unsigned int>::Ptr ssboIndices, ssboTriangleIds;
+    ShaderStorageBuffer<BVHNode>::Ptr ssboNodes;
+
+    std::vector<int> clusterSlots;          // host copy of ssboSlots
+    std::vector<int> slotClusters;          // cluster in each slot or -1
+    std::list<unsigned int> lru;            // slots, most recently used first
+    std::vector<std::list<unsigned int>::iterator> lruPositions;
+    Stats stats;
+private:
+    void pageIn(unsigned int cluster, unsigned int slot);
+public:
+    ClusterCache(const ClusterFile::Ptr& _file, unsigned int _numSlots);
+    ~ClusterCache() = default;
+    ClusterCache(const ClusterCache& clusterCache) = delete;
+    ClusterCache& operator=(const ClusterCache& clusterCache) = delete;
+public:
+    // Makes the clusters resident, at most getNumSlots() of them. The ones already resident
+    // are kept and the rest replace the least recently used slots that are not requested.
+    // Returns false if there are more clusters than slots
+    bool makeResident(const std::vector<unsigned int>& clusters);
+    bool isResident(unsigned int cluster) const { return clusterSlots[cluster] >= 0; }
+    void bind() const;
+public:
+    // False if the GPU doesn't have CLUSTER_NODES_BINDING_POINT
+    bool isValid() const { return valid; }
+    unsigned int getNumSlots() const { return numSlots; }
+    unsigned int getSlotVertices() const { return file->getMaxVertices(); }
+    unsigned int getSlotTriangles() const { return file->getMaxTriangles(); }
+    unsigned int getSlotNodes() const { return file->getMaxNodes(); }
+    size_t getSlotBytes() const;
+    const ClusterFile::Ptr& getFile() const { return file; }
+    const Stats& getStats() const { return stats; }
+};
+
+}
@@ -0,0 +1,241 @@
+#include "clusterfile.h"
+
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glm/common.hpp>
+
+#include "raytracingl/bvh/lbvh.h"
+
+namespace rgl
+{
+
+ClusterFile::ClusterFile(const std::string& _path, int _fd, const unsigned char* _mapping, size_t _size)
+    : path(_path), fd(_fd), mapping(_mapping), size(_size) {
+    header = *(const ClusterFileHeader*)mapping;
+    topNodes = (const BVHNode*)(mapping + sizeof(ClusterFileHeader));
+    clusters = (const ClusterInfo*)(mapping + sizeof(ClusterFileHeader) + header.numTopNodes * sizeof(BVHNode));
+}
+
+ClusterFile::~ClusterFile() {
+    if(mapping != nullptr) munmap((void*)mapping, size);
+    if(fd >= 0) close(fd);
+}
+
+// Recursive median split, emits the top level nodes and the triangles of each cluster
+static int splitClusters(std::vector<unsigned int>& triangles, unsigned int begin, unsigned int end,
+    const std::vector<glm::vec3>& centroids, const std::vector<glm::vec3>& aabbMins, const std::vector<glm::vec3>& aabbMaxs,
+    unsigned int trianglesPerCluster, std::vector<BVHNode>& nodes, std::vector<std::pair<unsigned int, unsigned int>>& ranges) {
+
+    int index = nodes.size();
+    nodes.push_back(BVHNode());
+
+    glm::vec3 aabbMin = aabbMins[triangles[begin]], aabbMax = aabbMaxs[triangles[begin]];
+    glm::vec3 centerMin = centroids[triangles[begin]], centerMax = centerMin;
+    for(unsigned int i = begin; i < end; i ++) {
+        aabbMin = glm::min(aabbMin, aabbMins[triangles[i]]);
+        aabbMax = glm::max(aabbMax, aabbMaxs[triangles[i]]);
+        centerMin = glm::min(centerMin, centroids[triangles[i]]);
+        centerMax = glm::max(centerMax, centroids[triangles[i]]);
+    }
+
+    if(end - begin <= trianglesPerCluster) {
+        nodes[index] = BVHNode(aabbMin, aabbMax, BVH_LEAF((int)ranges.size()), -1);
+        ranges.push_back({ begin, end });
+        return index;
+    }
+
+    glm::vec3 extent = centerMax - centerMin;
+    int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+
+    unsigned int middle = (begin + end) / 2;
+    std::nth_element(triangles.begin() + begin, triangles.begin() + middle, triangles.begin() + end,
+        [&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    int left = splitClusters(triangles, begin, middle, centroids, aabbMins, aabbMaxs, trianglesPerCluster, nodes, ranges);
+    int right = splitClusters(triangles, middle, end, centroids, aabbMins, aabbMaxs, trianglesPerCluster, nodes, ranges);
+    nodes[index] = BVHNode(aabbMin, aabbMax, left, right);
+
+    return index;
+}
+
+bool ClusterFile::write(const std::string& path, const std::vector<Vertex>& vertices,
+    const std::vector<unsigned int>& indices, unsigned int trianglesPerCluster) {
+
+    unsigned int numTriangles = indices.size() / 3;
+    if(numTriangles == 0 || trianglesPerCluster == 0) {
+        std::cout << "Cluster file: there are no triangles to write" << std::endl;
+        return false;
+    }
+
+    std::vector<glm::vec3> centroids(numTriangles), aabbMins(numTriangles), aabbMaxs(numTriangles);
+    std::vector<unsigned int> triangles(numTriangles);
+    for(unsigned int i = 0; i < numTriangles; i ++) {
+        const glm::vec3& v1 = vertices[indices[3 * i]].pos;
+        const glm::vec3& v2 = vertices[indices[3 * i + 1]].pos;
+        const glm::vec3& v3 = vertices[indices[3 * i + 2]].pos;
+        aabbMins[i] = glm::min(v1, glm::min(v2, v3));
+        aabbMaxs[i] = glm::max(v1, glm::max(v2, v3));
+        centroids[i] = (v1 + v2 + v3) / 3.f;
+        triangles[i] = i;
+    }
+
+    std::vector<BVHNode> topNodes;
+    std::vector<std::pair<unsigned int, unsigned int>> ranges;
+    splitClusters(triangles, 0, numTriangles, centroids, aabbMins, aabbMaxs, trianglesPerCluster, topNodes, ranges);
+
+    ClusterFileHeader header = {};
+    header.magic = CLUSTER_FILE_MAGIC;
+    header.version = CLUSTER_FILE_VERSION;
+    header.numClusters = ranges.size();
+    header.numTopNodes = topNodes.size();
+    header.numTriangles = numTriangles;
+
+    std::ofstream file(path, std::ios::binary);
+    if(!file) {
+        std::cout << "Couldn't write " << path << std::endl;
+        return false;
+    }
+
+    std::vector<ClusterInfo> clusters(ranges.size());
+    uint64_t offset = ClusterInfo::align(sizeof(ClusterFileHeader) + topNodes.size() * sizeof(BVHNode)
+        + clusters.size() * sizeof(ClusterInfo));
+
+    // The data of the clusters goes after the table, which is written at the end
+    file.seekp(offset);
+
+    for(unsigned int c = 0; c < ranges.size(); c ++) {
+
+        // Local vertices, in order of first use
+        std::unordered_map<unsigned int, unsigned int> localVertices;
+        std::vector<Vertex> clusterVertices;
+        std::vector<unsigned int> clusterIndices, triangleIds;
+
+        for(unsigned int i = ranges[c].first; i < ranges[c].second; i ++) {
+            triangleIds.push_back(triangles[i]);
+            for(int k = 0; k < 3; k ++) {
+                unsigned int vertex = indices[3 * triangles[i] + k];
+                auto it = localVertices.find(vertex);
+                if(it == localVertices.end()) {
+                    it = localVertices.emplace(vertex, clusterVertices.size()).first;
+                    clusterVertices.push_back(Vertex(vertices[vertex].pos));
+                }
+                clusterIndices.push_back(it->second);
+            }
+        }
+
+        std::vector<BVHNode> nodes = LBVH::buildCPU(clusterVertices, clusterIndices);
+        std::vector<glm::vec4> positions;
+        positions.reserve(clusterVertices.size());
+        for(const Vertex& vertex : clusterVertices) positions.push_back(glm::vec4(vertex.pos, 1.f));
+
+        ClusterInfo& cluster = clusters[c];
+        cluster = {};
+        cluster.numVertices = clusterVertices.size();
+        cluster.numTriangles = triangleIds.size();
+        cluster.numNodes = nodes.size();
+        cluster.offset = offset;
+
+        auto section = [&](const void* data, size_t bytes, uint64_t position) {
+            file.seekp(position);
+            file.write((const char*)data, bytes);
+        };
+        section(positions.data(), positions.size() * sizeof(glm::vec4), cluster.positionsOffset());
+        section(clusterIndices.data(), clusterIndices.size() * sizeof(uint32_t), cluster.indicesOffset());
+        section(triangleIds.data(), triangleIds.size() * sizeof(uint32_t), cluster.triangleIdsOffset());
+        section(nodes.data(), nodes.size() * sizeof(BVHNode), cluster.nodesOffset());
+
+        offset = ClusterInfo::align(cluster.offset + cluster.getBytes());
+        header.maxVertices = std::max(header.maxVertices, cluster.numVertices);
+        header.maxTriangles = std::max(header.maxTriangles, cluster.numTriangles);
+    }
+
+    // Bounds of each cluster from its leaf in the top level
+    for(const BVHNode& node : topNodes) {
+        if(!node.isLeaf()) continue;
+        clusters[node.getItem()].aabbMin = node.aabbMin;
+        clusters[node.getItem()].aabbMax = node.aabbMax;
+    }
+
+    // Pads the last section so the mapping covers whole clusters
+    file.seekp(offset - 1);
+    file.put(0);
+
+    file.seekp(0);
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)topNodes.data(), topNodes.size() * sizeof(BVHNode));
+    file.write((const char*)clusters.data(), clusters.size() * sizeof(ClusterInfo));
+
+    if(!file) {
+        std::cout << "Couldn't write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+ClusterFile::Ptr ClusterFile::open(const std::string& path) {
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        std::cout << "Couldn't open " << path << std::endl;
+        return nullptr;
+    }
+
+    struct stat status;
+    if(fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(ClusterFileHeader)) {
+        std::cout << path << " is not a cluster file" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = status.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping == MAP_FAILED) {
+        std::cout << "Couldn't map " << path << std::endl;
+        close(fd);
+        return nullptr;
+    }
+
+    // The clusters are read as they are paged in, in any order
+    madvise(mapping, size, MADV_RANDOM);
+
+    const ClusterFileHeader* header = (const ClusterFileHeader*)mapping;
+    size_t tableEnd = sizeof(ClusterFileHeader) + (size_t)header->numTopNodes * sizeof(BVHNode)
+        + (size_t)header->numClusters * sizeof(ClusterInfo);
+
+    bool valid = header->magic == CLUSTER_FILE_MAGIC && header->version == CLUSTER_FILE_VERSION && tableEnd <= size
+        && header->numTopNodes > 0;
+    if(valid) {
+        const ClusterInfo* clusters = (const ClusterInfo*)((const unsigned char*)mapping + tableEnd - (size_t)header->numClusters * sizeof(ClusterInfo));
+        for(unsigned int i = 0; i < header->numClusters && valid; i ++)
+            valid = clusters[i].offset + clusters[i].getBytes() <= size;
+    }
+    if(valid) {
+        // Leaves name an existing cluster. The nodes are written in preorder, children after
+        // their parent, which also rules out cycles
+        const BVHNode* nodes = (const BVHNode*)((const unsigned char*)mapping + sizeof(ClusterFileHeader));
+        for(unsigned int i = 0; i < header->numTopNodes && valid; i ++) {
+            const BVHNode& node = nodes[i];
+            if(node.isLeaf()) valid = (unsigned int)node.getItem() < header->numClusters;
+            else valid = node.left > (int)i && (unsigned int)node.left < header->numTopNodes
+                && node.right > (int)i && (unsigned int)node.right < header->numTopNodes;
+        }
+    }
+
+    if(!valid) {
+        std::cout << path << " is not a valid cluster file" << std::endl;
+        munmap(mapping, size);
+        close(fd);
+        return nullptr;
+    }
+
+    return ClusterFile::New(path, fd, (const unsigned char*)mapping, size);
+}
+
+}
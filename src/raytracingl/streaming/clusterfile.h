@@ -0,0 +1,105 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/geometry/vertex.h"
+#include "raytracingl/bvh/bvh.h"
+
+#define CLUSTER_FILE_MAGIC 0x434c4752u     // "RGLC"
+#define CLUSTER_FILE_VERSION 1u
+
+namespace rgl
+{
+
+// Bounds of a cluster and the place of its data in the file. The data of a cluster is its
+// positions, its local indices, the original index of each triangle and its BVH, each section
+// aligned to 16 bytes
+struct alignas(16) ClusterInfo {
+
+    // DO NOT MODIFY THE ORDER. OTHERWISE, IT WILL NOT MATCH THE CLUSTER FILES ALREADY WRITTEN
+    glm::vec3 aabbMin;
+    uint32_t numVertices;
+    glm::vec3 aabbMax;
+    uint32_t numTriangles;
+    uint64_t offset;        // bytes from the start of the file
+    uint32_t numNodes;
+    uint32_t padding;
+
+    static uint64_t align(uint64_t bytes) { return (bytes + 15) & ~(uint64_t)15; }
+
+    uint64_t positionsOffset() const { return offset; }
+    uint64_t indicesOffset() const { return positionsOffset() + align(numVertices * sizeof(glm::vec4)); }
+    uint64_t triangleIdsOffset() const { return indicesOffset() + align(3 * numTriangles * sizeof(uint32_t)); }
+    uint64_t nodesOffset() const { return triangleIdsOffset() + align(numTriangles * sizeof(uint32_t)); }
+    uint64_t getBytes() const { return nodesOffset() + numNodes * sizeof(BVHNode) - offset; }
+};
+
+struct ClusterFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numClusters;
+    uint32_t numTopNodes;
+    uint32_t numTriangles;
+    uint32_t maxVertices;       // of a cluster
+    uint32_t maxTriangles;
+    uint32_t padding;
+};
+
+// Scene split in spatially coherent clusters for out-of-core tracing. The triangles are split
+// at the median of the longest axis of their centroids until a part has at most
+// trianglesPerCluster of them; the splits are the top level BVH and the parts are the
+// clusters, each one with its own BVH (LBVH::buildCPU) over its local vertices. The file is
+// memory mapped, so the clusters are only read from disk when they are paged in.
+//
+// Layout: ClusterFileHeader, BVHNode[numTopNodes] with BVH_LEAF(cluster) leaves,
+// ClusterInfo[numClusters] and the data of every cluster.
+class ClusterFile {
+    GENERATE_SHARED_PTR(ClusterFile)
+private:
+    std::string path;
+    int fd;
+    const unsigned char* mapping;
+    size_t size;
+
+    ClusterFileHeader header;
+    const BVHNode* topNodes;
+    const ClusterInfo* clusters;
+public:
+    // Takes a mapping already validated by open()
+    ClusterFile(const std::string& _path, int _fd, const unsigned char* _mapping, size_t _size);
+    ~ClusterFile();
+    ClusterFile(const ClusterFile& clusterFile) = delete;
+    ClusterFile& operator=(const ClusterFile& clusterFile) = delete;
+public:
+    // Splits the mesh and writes the file, false on error
+    static bool write(const std::string& path, const std::vector<Vertex>& vertices,
+        const std::vector<unsigned int>& indices, unsigned int trianglesPerCluster = 4096);
+    // Maps an existing file, nullptr on error
+    static Ptr open(const std::string& path);
+public:
+    const glm::vec4* getPositions(unsigned int cluster) const { return (const glm::vec4*)(mapping + clusters[cluster].positionsOffset()); }
+    const uint32_t* getIndices(unsigned int cluster) const { return (const uint32_t*)(mapping + clusters[cluster].indicesOffset()); }
+    const uint32_t* getTriangleIds(unsigned int cluster) const { return (const uint32_t*)(mapping + clusters[cluster].triangleIdsOffset()); }
+    const BVHNode* getNodes(unsigned int cluster) const { return (const BVHNode*)(mapping + clusters[cluster].nodesOffset()); }
+
+    const ClusterInfo& getCluster(unsigned int cluster) const { return clusters[cluster]; }
+    const BVHNode* getTopNodes() const { return topNodes; }
+    const ClusterFileHeader& getHeader() const { return header; }
+    unsigned int getNumClusters() const { return header.numClusters; }
+    unsigned int getNumTopNodes() const { return header.numTopNodes; }
+    unsigned int getNumTriangles() const { return header.numTriangles; }
+    unsigned int getMaxVertices() const { return header.maxVertices; }
+    unsigned int getMaxTriangles() const { return header.maxTriangles; }
+    unsigned int getMaxNodes() const { return header.maxTriangles > 0 ? 2 * header.maxTriangles - 1 : 0; }
+    const std::string& getPath() const { return path; }
+    size_t getSize() const { return size; }
+};
+
+}
@@ -0,0 +1,150 @@
+#include "streamingtracer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace rgl
+{
+
+static ShaderProgram::Ptr loadProgram(const std::string& filePath) {
+    Shader computeShader = Shader::fromFile(filePath, Shader::ShaderType::Compute);
+    return ShaderProgram::New(computeShader);
+}
+
+StreamingTracer::StreamingTracer(const ClusterFile::Ptr& _file, unsigned int cacheSlots, const std::string& shadersPath,
+    unsigned int _maxRays, unsigned int _maxItems)
+    : file(_file), maxRays(std::max(_maxRays, 1u)), maxItems(std::max(_maxItems, 1u)), valid(false) {
+
+    // One dimensional dispatches
+    maxItems = std::min(maxItems, 65535u * STREAMING_WORKGROUP_SIZE);
+    maxRays = std::min(maxRays, 65535u * STREAMING_WORKGROUP_SIZE);
+
+    cache = ClusterCache::New(file, std::min(cacheSlots, file->getNumClusters()));
+    valid = cache->isValid() && checkStorageBindings(STREAMING_COUNTERS_BINDING_POINT, "Streaming tracer");
+    if(!valid) return;
+
+    enqueueProgram = loadProgram(shadersPath + "streaming_enqueue.glsl");
+    traceProgram = loadProgram(shadersPath + "streaming_trace.glsl");
+    resolveProgram = loadProgram(shadersPath + "streaming_resolve.glsl");
+
+    ssboTopNodes = ShaderStorageBuffer<BVHNode>::New(Span<const BVHNode>(file->getTopNodes(), file->getNumTopNodes()),
+        STREAMING_TOP_NODES_BINDING_POINT);
+    ssboRays = ShaderStorageBuffer<glm::vec4>::New((size_t)2 * maxRays, STREAMING_RAYS_BINDING_POINT, MemoryCategory::Scratch);
+    ssboItems = ShaderStorageBuffer<unsigned int>::New((size_t)4 * maxItems, STREAMING_ITEMS_BINDING_POINT, MemoryCategory::Scratch);
+    ssboResults = ShaderStorageBuffer<unsigned int>::New((size_t)2 * maxRays, STREAMING_RESULTS_BINDING_POINT, MemoryCategory::Scratch);
+    ssboCounters = ShaderStorageBuffer<unsigned int>::New((size_t)file->getNumClusters() + 1,
+        STREAMING_COUNTERS_BINDING_POINT, MemoryCategory::Scratch);
+}
+
+unsigned int StreamingTracer::numGroups(unsigned int count) {
+    return (count + STREAMING_WORKGROUP_SIZE - 1) / STREAMING_WORKGROUP_SIZE;
+}
+
+void StreamingTracer::bind() const {
+    cache->bind();
+    ssboTopNodes->bindBase();
+    ssboRays->bindBase();
+    ssboItems->bindBase();
+    ssboResults->bindBase();
+    ssboCounters->bindBase();
+}
+
+std::vector<StreamingTracer::Hit> StreamingTracer::trace(const std::vector<Ray>& rays, float maxDist) {
+
+    if(!valid) return {};
+
+    std::vector<Hit> hits(rays.size());
+    unsigned int chunk = maxRays;
+
+    // Chunks whose items overflow are split until they fit
+    for(size_t first = 0; first < rays.size(); ) {
+        unsigned int count = (unsigned int)std::min<size_t>(chunk, rays.size() - first);
+        if(traceChunk(rays, first, count, maxDist, hits)) {
+            first += count;
+            continue;
+        }
+        if(count == 1) {
+            std::cout << "Streaming tracer: a ray enters more than " << maxItems << " clusters" << std::endl;
+            return {};
+        }
+        chunk = count / 2;
+    }
+
+    return hits;
+}
+
+bool StreamingTracer::traceChunk(const std::vector<Ray>& rays, size_t first, unsigned int count, float maxDist, std::vector<Hit>& hits) {
+
+    std::vector<glm::vec4> data(2 * count);
+    for(unsigned int i = 0; i < count; i ++) {
+        data[2 * i] = glm::vec4(rays[first + i].origin, maxDist);
+        data[2 * i + 1] = glm::vec4(rays[first + i].direction, 0.f);
+    }
+    ssboRays->setData(data);
+    ssboCounters->setData(std::vector<unsigned int>(file->getNumClusters() + 1, 0u));
+
+    bind();
+
+    enqueueProgram->useProgram();
+    enqueueProgram->uniformInt("numRays", count);
+    enqueueProgram->uniformInt("maxItems", maxItems);
+    glDispatchCompute(numGroups(count), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    std::vector<unsigned int> counters = ssboCounters->download();
+    unsigned int numItems = counters[0];
+    if(numItems > maxItems) return false;
+
+    std::vector<unsigned int> pending;
+    for(unsigned int cluster = 0; cluster < file->getNumClusters(); cluster ++)
+        if(counters[cluster + 1] > 0) pending.push_back(cluster);
+
+    while(!pending.empty()) {
+
+        // Resident clusters first, then the ones with more rays waiting
+        std::sort(pending.begin(), pending.end(), [&](unsigned int a, unsigned int b) {
+            if(cache->isResident(a) != cache->isResident(b)) return cache->isResident(a);
+            return counters[a + 1] != counters[b + 1] ? counters[a + 1] > counters[b + 1] : a < b;
+        });
+
+        size_t batchSize = std::min<size_t>(pending.size(), cache->getNumSlots());
+        std::vector<unsigned int> batch(pending.begin(), pending.begin() + batchSize);
+        pending.erase(pending.begin(), pending.begin() + batchSize);
+
+        for(unsigned int cluster : batch)
+            if(!cache->isResident(cluster)) stats.deferredItems += counters[cluster + 1];
+
+        cache->makeResident(batch);
+        cache->bind();
+
+        traceProgram->useProgram();
+        traceProgram->uniformInt("numItems", numItems);
+        traceProgram->uniformInt("slotVertices", cache->getSlotVertices());
+        traceProgram->uniformInt("slotTriangles", cache->getSlotTriangles());
+        traceProgram->uniformInt("slotNodes", cache->getSlotNodes());
+        glDispatchCompute(numGroups(numItems), 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        stats.passes ++;
+    }
+
+    resolveProgram->useProgram();
+    resolveProgram->uniformInt("numItems", numItems);
+    glDispatchCompute(numGroups(std::max(numItems, 1u)), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    std::vector<unsigned int> results = ssboResults->download();
+    for(unsigned int i = 0; i < count; i ++) {
+        Hit& hit = hits[first + i];
+        hit.triangle = results[2 * i + 1] == 0xFFFFFFFFu ? -1 : (int)results[2 * i + 1];
+        hit.dist = maxDist;
+        if(hit.triangle >= 0) std::memcpy(&hit.dist, &results[2 * i], sizeof(float));
+    }
+
+    stats.rays += count;
+    stats.items += numItems;
+    stats.chunks ++;
+    return true;
+}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <glm/vec4.hpp>
+
+#include "raytracingl/ptr.h"
+#include "raytracingl/geometry/ray.h"
+#include "raytracingl/opengl/buffer/buffer.h"
+#include "raytracingl/opengl/shader/shader.h"
+#include "raytracingl/streaming/clusterfile.h"
+#include "raytracingl/streaming/clustercache.h"
+
+#define STREAMING_WORKGROUP_SIZE 64
+
+#define STREAMING_TOP_NODES_BINDING_POINT 29
+#define STREAMING_RAYS_BINDING_POINT 30
+#define STREAMING_ITEMS_BINDING_POINT 31
+#define STREAMING_RESULTS_BINDING_POINT 32
+#define STREAMING_COUNTERS_BINDING_POINT 33
+
+namespace rgl
+{
+
+// Closest hit queries against a cluster file that doesn't need to fit in GPU memory. Rays are
+// traced in chunks of at most maxRays:
+//   1. streaming_enqueue.glsl traverses the top level BVH and queues a (ray, cluster) item for
+//      each cluster the ray enters, counting the requests of every cluster
+//   2. The requested clusters are made resident in batches of the cache size, the resident
+//      ones first. streaming_trace.glsl traces the items of resident clusters, the rest are
+//      deferred to the next pass, after their clusters are paged in
+//   3. streaming_resolve.glsl picks the triangle of the closest hit of every ray
+// GPU memory is the cache, the items and the rays of a chunk, whatever the size of the scene.
+class StreamingTracer {
+    GENERATE_SHARED_PTR(StreamingTracer)
+public:
+    struct Hit {
+        float dist = 999999.f;
+        int triangle = -1;      // index in the mesh written to the file, -1 if there is no hit
+    };
+
+    struct Stats {
+        unsigned long long rays = 0;
+        unsigned long long items = 0;           // (ray, cluster) pairs
+        unsigned long long deferredItems = 0;   // items whose cluster wasn't resident when queued
+        unsigned long long passes = 0;
+        unsigned long long chunks = 0;
+    };
+private:
+    ClusterFile::Ptr file;
+    ClusterCache::Ptr cache;
+    unsigned int maxRays, maxItems;
+    bool valid;
+
+    ShaderProgram::Ptr enqueueProgram, traceProgram, resolveProgram;
+    ShaderStorageBuffer<BVHNode>::Ptr ssboTopNodes;
+    ShaderStorageBuffer<glm::vec4>::Ptr ssboRays;
+    ShaderStorageBuffer<unsigned int>::Ptr ssboItems, ssboResults, ssboCounters;
+    Stats stats;
+private:
+    static unsigned int numGroups(unsigned int count);
+    void bind() const;
+    // False if the items of the chunk don't fit
+    bool traceChunk(const std::vector<Ray>& rays, size_t first, unsigned int count, float maxDist, std::vector<Hit>& hits);
+public:
+    StreamingTracer(const ClusterFile::Ptr& _file, unsigned int cacheSlots, const std::string& shadersPath = "glsl/",
+        unsigned int _maxRays = 1 << 16, unsigned int _maxItems = 1 << 20);
+    ~StreamingTracer() = default;
+    StreamingTracer(const StreamingTracer& streamingTracer) = delete;
+    StreamingTracer& operator=(const StreamingTracer& streamingTracer) = delete;
+public:
+    // Rays in the space of the mesh, hits closer than maxDist. Empty if the tracer isn't valid
+    // or a ray enters more than maxItems clusters
+    std::vector<Hit> trace(const std::vector<Ray>& rays, float maxDist = 999999.f);
+public:
+    // False if the GPU lacks the binding points of the cache or STREAMING_COUNTERS_BINDING_POINT
+    bool isValid() const { return valid; }
+    const ClusterCache::Ptr& getCache() const { return cache; }
+    const ClusterFile::Ptr& getFile() const { return file; }
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+};
+
+}
@@ -15,9 +15,25 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 #include <raytracingl/opengl/shader/shader.h>
 #include <raytracingl/opengl/buffer/buffer.h>
+#include <raytracingl/opengl/pipeline/framepipeline.h>
+#include <raytracingl/opengl/readback/readback.h>
+#include <raytracingl/opengl/debug/traversalcounters.h>
+#include <raytracingl/opengl/visibility/visibilitybuffer.h>
+#include <raytracingl/opengl/temporal/temporalreprojection.h>
+#include <raytracingl/io/imagewriter.h>
+#include <raytracingl/io/meshloader.h>
+#include <raytracingl/bvh/lbvh.h>
+#include <raytracingl/memory/memoryregistry.h>
+#include <raytracingl/bvh/widebvh.h>
+#include <raytracingl/light/environment.h>
+#include <raytracingl/light/lightbvh.h>
+#include <raytracingl/sampler/sampler.h>
+#include <raytracingl/service/renderservice.h>
 
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
@@ -34,10 +50,41 @@ const unsigned int SCR_HEIGHT = 500;
 // texture size
 const unsigned int TEXTURE_WIDTH = 500, TEXTURE_HEIGHT = 500;
 
+// output images in flight, the CPU prepares the next frames while the GPU traces the previous ones
+const unsigned int FRAMES_IN_FLIGHT = 2;
+
+// frames written to RECORD_PATH as PNG by the encoder threads, 0 disables recording
+const unsigned int RECORD_FRAMES = 0;
+const std::string RECORD_PATH = "frame_";
+
+// wide BVH: 4 or 8 children with 8 or 16 bit bounds, 0 to trace the binary BVH
+const unsigned int BVH_WIDTH = 8, BVH_BITS = 8;
+
+// vertex buffer layout: 96 byte Vertex or 16 byte PackedVertex (quantized positions, octahedral normals, half float UVs)
+const VertexFormat VERTEX_FORMAT = VertexFormat::Full;
+
+// direct lighting samples per pixel, each one is a sky, an emissive triangle and a BSDF sample combined with MIS. 0 disables lighting
+const unsigned int ENVIRONMENT_SAMPLES = 4;
+
+// random numbers of the lighting: PCG hash, Owen scrambled Sobol or Sobol dithered with blue noise
+const SamplerType SAMPLER_TYPE = SamplerType::Sobol;
+
+// traversal debug variant of the shaders: heatmap shown instead of the image (Image disables it), count at
+// its red end and frames between the printed summaries of the counters
+const bool TRAVERSAL_STATS = false;
+const TraversalCounters::Channel TRAVERSAL_HEATMAP = TraversalCounters::Channel::Nodes;
+const float TRAVERSAL_HEATMAP_SCALE = 200.f;
+const unsigned int TRAVERSAL_STATS_INTERVAL = 100;
+
+// primary hits rasterized into a visibility buffer, the compute shader only traces from the secondary rays
+const bool PRIMARY_VISIBILITY = false;
+
+// history of the previous frames reprojected through the motion of the cube instead of starting again at 1 spp
+const bool TEMPORAL_REPROJECTION = false;
+
 // timing 
 float deltaTime = 0.0f, lastFrame = 0.0f;
 
-GLuint createOutputTexture(int width, int height);
 GLuint loadTexture(const char* filename, int& width, int& height, int slot=0);
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -46,11 +93,17 @@ bool loadModel(const std::string& filename, std::vector<Vertex>& vertices, std::
 
 int main(int argc, char* argv[]) {
 
+	// --service <socket> keeps the scenes on the GPU and renders the jobs sent to the socket
+	std::string servicePath;
+	for (int i = 1; i + 1 < argc; i++)
+		if (std::string(argv[i]) == "--service") servicePath = argv[i + 1];
+
 	// GLFW
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (!servicePath.empty()) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Basic", NULL, NULL);
 	if (window == NULL) {
@@ -70,6 +123,12 @@ int main(int argc, char* argv[]) {
 		return 0;
 	}
 
+	if (!servicePath.empty()) {
+		RenderService::New(servicePath, "glsl/")->run();
+		glfwTerminate();
+		return 0;
+	}
+
 	// Query limitations
 	int max_compute_work_group_count[3];
 	int max_compute_work_group_size[3];
@@ -93,18 +152,35 @@ int main(int argc, char* argv[]) {
 	std::cout << "Number of invocations in a single local work group that may be dispatched to a compute shader " << max_compute_work_group_invocations << std::endl;
 
 	// Shaders
+	std::vector<std::string> defines;
+	if(TRAVERSAL_STATS) defines.push_back(TRAVERSAL_STATS_DEFINE);
+
 	Shader vertexShader = Shader::fromFile("glsl/vertex.glsl", Shader::ShaderType::Vertex);
-	Shader fragmentShader = Shader::fromFile("glsl/fragment.glsl", Shader::ShaderType::Fragment);
+	Shader fragmentShader = Shader::fromFile("glsl/fragment.glsl", Shader::ShaderType::Fragment, defines);
 	ShaderProgram::Ptr shaderProgram = ShaderProgram::New(vertexShader, fragmentShader);
 
-	Shader computeShader = Shader::fromFile("glsl/compute.glsl", Shader::ShaderType::Compute);
-	ShaderProgram::Ptr computeShaderProgram = ShaderProgram::New(computeShader);
+	FramePipeline::Ptr framePipeline = FramePipeline::New(TEXTURE_WIDTH, TEXTURE_HEIGHT, FRAMES_IN_FLIGHT);
 
-	unsigned int texture = createOutputTexture(TEXTURE_WIDTH, TEXTURE_HEIGHT);
+	// Recording, frames are read back without stalling and encoded off the render thread
+	AsyncReadback::Ptr readback;
+	ImageSequenceWriter::Ptr writer;
+	if(RECORD_FRAMES > 0) {
+		readback = AsyncReadback::New(TEXTURE_WIDTH, TEXTURE_HEIGHT);
+		writer = ImageSequenceWriter::New(RECORD_PATH, ImageSequenceWriter::Format::PNG);
+	}
 
 	shaderProgram->useProgram();
 	shaderProgram->uniformInt("tex", 0);
 
+	// Nodes, triangles and rays of every pixel
+	TraversalCounters::Ptr traversalCounters;
+	if(TRAVERSAL_STATS) {
+		traversalCounters = TraversalCounters::New(TEXTURE_WIDTH, TEXTURE_HEIGHT);
+		shaderProgram->uniformInt("traversalStats", 1);
+		shaderProgram->uniformInt("heatmap", (int)TRAVERSAL_HEATMAP);
+		shaderProgram->uniformFloat("heatmapScale", TRAVERSAL_HEATMAP_SCALE);
+	}
+
 	// Screen quad
 	std::vector<Vertex> quadVertices = {
 		Vertex(glm::vec3(-1.0f,  1.0f, 0.0f), glm::vec3(1.0), glm::vec3(0.0), glm::vec2(0.0f, 1.0f)),
@@ -202,26 +278,119 @@ int main(int argc, char* argv[]) {
 	std::cout << "Num vertices: " << meshVertices.size() << std::endl;
 	std::cout << "Num indices: " << meshIndices.size() << std::endl;
 
-	ShaderStorageBuffer<Vertex>::Ptr ssboVertices = ShaderStorageBuffer<Vertex>::New(meshVertices, 0);
+	ShaderStorageBuffer<Vertex>::Ptr ssboVertices;
+	ShaderStorageBuffer<PackedVertex>::Ptr ssboPackedVertices;
+	VertexQuantization quantization;
+
+	if(VERTEX_FORMAT == VertexFormat::Packed) {
+		quantization = VertexQuantization::fromVertices(meshVertices);
+		ssboPackedVertices = ShaderStorageBuffer<PackedVertex>::New(packVertices(meshVertices, quantization), 0);
+	}
+	else ssboVertices = ShaderStorageBuffer<Vertex>::New(meshVertices, 0);
+
 	ShaderStorageBuffer<unsigned int>::Ptr ssboIndices = ShaderStorageBuffer<unsigned int>::New(meshIndices, 1);
 
+	// Analytic primitives live in the object space of the mesh
+	glm::vec3 sphereCenter = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(0.f, 0.f, -2.f, 1.f));
+	std::vector<rgl::Primitive> primitives = { rgl::Primitive::sphere(sphereCenter, 0.25f / 0.35f) };
+	ShaderStorageBuffer<rgl::Primitive>::Ptr ssboPrimitives = ShaderStorageBuffer<rgl::Primitive>::New(primitives, PRIMITIVES_BINDING_POINT);
+
+	// Acceleration structure
+	LBVH::Ptr lbvh = LBVH::New("glsl/");
+	if(VERTEX_FORMAT == VertexFormat::Packed) lbvh->build(ssboPackedVertices, quantization, ssboIndices, ssboPrimitives);
+	else lbvh->build(ssboVertices, ssboIndices, ssboPrimitives);
+
+	LBVH::Timings timings = lbvh->getTimings();
+	std::cout << "LBVH build time: " << timings.total << " ms (morton " << timings.mortonCodes
+		<< " ms, sort " << timings.sort << " ms, hierarchy " << timings.hierarchy << " ms, bounds " << timings.bounds << " ms)" << std::endl;
+
+	WideBVH::Ptr wideBVH;
+	if(BVH_WIDTH > 0) {
+		wideBVH = WideBVH::New(lbvh->downloadNodes(), BVH_WIDTH, BVH_BITS);
+		wideBVH->upload();
+		std::cout << "Wide BVH: " << wideBVH->getMemoryBytes() << " bytes, binary BVH: "
+			<< lbvh->getNumNodes() * sizeof(BVHNode) << " bytes" << std::endl;
+	}
+
+	// The trace kernel is compiled once the stack the BVH needs is known
+	unsigned int stackSize = wideBVH != nullptr ? wideBVH->getStackSize() : bvhStackSize(2, lbvh->getDepth());
+	if(stackSize > BVH_STACK_SIZE) {
+		std::cout << "BVH traversal stack: " << stackSize << " entries" << std::endl;
+		defines.push_back(bvhStackSizeDefine(stackSize));
+	}
+
+	Shader computeShader = Shader::fromFile("glsl/compute.glsl", Shader::ShaderType::Compute, defines);
+	ShaderProgram::Ptr computeShaderProgram = ShaderProgram::New(computeShader);
+
 	computeShaderProgram->useProgram();
 	computeShaderProgram->uniformInt("numVertices", meshVertices.size());
 	computeShaderProgram->uniformInt("numIndices", meshIndices.size());
+	computeShaderProgram->uniformInt("numPrimitives", primitives.size());
+	computeShaderProgram->uniformInt("vertexFormat", (int)VERTEX_FORMAT);
+	computeShaderProgram->uniformVec3("vertexOrigin", quantization.origin);
+	computeShaderProgram->uniformVec3("vertexScale", quantization.scale);
 	computeShaderProgram->uniformMat4("modelMatrix", modelMatrix);
+	computeShaderProgram->uniformInt("bvhWidth", BVH_WIDTH);
+	computeShaderProgram->uniformInt("bvhBits", BVH_BITS);
 
 	// Texture
-	int albedoWidth, albedoHeight;
+	int albedoWidth = 0, albedoHeight = 0;
 	unsigned int albedoTexture = loadTexture("/home/morcillosanz/Desktop/cat.png", albedoWidth, albedoHeight, 1);
+	MemoryRecord albedoMemory(MemoryDomain::GPU, MemoryCategory::Textures, (size_t)albedoWidth * albedoHeight * 4);
+
+	// Sky, importance sampled through its alias table
+	Environment::Ptr environment = Environment::fromFile("/home/morcillosanz/Desktop/sky.png");
+	if(environment != nullptr) {
+		environment->upload();
+		computeShaderProgram->uniformInt("environmentWidth", environment->getWidth());
+		computeShaderProgram->uniformInt("environmentHeight", environment->getHeight());
+	}
+	computeShaderProgram->uniformInt("environmentSamples", ENVIRONMENT_SAMPLES);
+
+	// Emissive triangles: the flat top of the mesh, the horizontal triangles at its highest point
+	std::vector<glm::vec3> meshEmission(meshIndices.size() / 3, glm::vec3(0.f));
+	float meshTop = meshVertices.empty() ? 0.f : meshVertices[0].pos.y;
+	for(const Vertex& vertex : meshVertices) meshTop = std::max(meshTop, vertex.pos.y);
+
+	for(size_t i = 0; i < meshEmission.size(); i ++) {
+		const glm::vec3& v1 = meshVertices[meshIndices[3 * i]].pos;
+		const glm::vec3& v2 = meshVertices[meshIndices[3 * i + 1]].pos;
+		const glm::vec3& v3 = meshVertices[meshIndices[3 * i + 2]].pos;
+
+		glm::vec3 normal = glm::cross(v2 - v1, v3 - v1);
+		float length = glm::length(normal);
+		bool top = std::min(v1.y, std::min(v2.y, v3.y)) >= meshTop - 1e-4f;
+		if(top && length > 0.f && std::abs(normal.y) / length > 0.99f) meshEmission[i] = glm::vec3(4.f);
+	}
+
+	LightBVH::Ptr lightBVH = LightBVH::New(meshVertices, meshIndices, meshEmission);
+	lightBVH->upload();
+	computeShaderProgram->uniformInt("numLights", lightBVH->getNumLights());
+
+	rgl::Sampler::Ptr sampler = rgl::Sampler::New(SAMPLER_TYPE);
+	sampler->upload();
+	computeShaderProgram->uniformInt("samplerType", (int)SAMPLER_TYPE);
+
+	// Default camera of the compute shader
+	VisibilityBuffer::Ptr visibilityBuffer;
+	VisibilityBuffer::Mesh visibilityMesh;
+	if(PRIMARY_VISIBILITY) {
+		visibilityBuffer = VisibilityBuffer::New(TEXTURE_WIDTH, TEXTURE_HEIGHT);
+		visibilityMesh.numIndices = meshIndices.size();
+		visibilityMesh.vertexFormat = VERTEX_FORMAT;
+		visibilityMesh.quantization = quantization;
+	}
+	computeShaderProgram->uniformInt("primaryVisibility", PRIMARY_VISIBILITY ? 1 : 0);
 
-	int skyWidth, skyHeight;
-	unsigned int sky = loadTexture("/home/morcillosanz/Desktop/sky.png", skyWidth, skyHeight, 2);
+	TemporalReprojection::Ptr temporal;
+	if(TEMPORAL_REPROJECTION) temporal = TemporalReprojection::New(TEXTURE_WIDTH, TEXTURE_HEIGHT);
 
 	// Main loop
 	while (!glfwWindowShouldClose(window)) {
 
 		// Set frame time.
 		static int fCounter = 0;
+		static int frame = 0;
 		float currentFrame = glfwGetTime();
 
 		deltaTime = currentFrame - lastFrame;
@@ -233,68 +402,92 @@ int main(int argc, char* argv[]) {
 		} else 
 			fCounter++;
 
+		// Blocks only if the GPU is FRAMES_IN_FLIGHT frames behind
+		framePipeline->beginFrame();
+
 		// Update model matrix rotation
 		modelMatrix = glm::rotate(modelMatrix, glm::radians(0.5f), glm::vec3(1.f, 1.f, 0.f));
 
+		// Primary hits
+		if(visibilityBuffer != nullptr) {
+			visibilityMesh.modelMatrix = modelMatrix;
+			visibilityBuffer->clear();
+			visibilityBuffer->draw(visibilityMesh);
+			visibilityBuffer->bindImage();
+		}
+
 		// Compute Shader
 		computeShaderProgram->useProgram();
 
-		computeShaderProgram->uniformFloat("t", currentFrame);
+		computeShaderProgram->uniformInt("frame", frame ++);
 		computeShaderProgram->uniformMat4("modelMatrix", modelMatrix);
 
 		glActiveTexture(GL_TEXTURE1);
 		glBindTexture(GL_TEXTURE_2D, albedoTexture);
 		computeShaderProgram->uniformInt("albedo", 1);
 
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, sky);
+		if(environment != nullptr) environment->bind(2);
 		computeShaderProgram->uniformInt("sky", 2);
 
+		lightBVH->bind();
+		sampler->bind();
+
+		if(traversalCounters != nullptr) {
+			traversalCounters->reset();
+			traversalCounters->bind();
+		}
+
+		if(temporal != nullptr) temporal->beginFrame(*computeShaderProgram, modelMatrix, TemporalReprojection::Camera());
+
 		glDispatchCompute((unsigned int)TEXTURE_WIDTH / 10, (unsigned int)TEXTURE_HEIGHT / 10, 1);
-		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		if(temporal != nullptr) temporal->resolve(framePipeline->getCurrentTextureID());
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+
+		if(traversalCounters != nullptr && frame % TRAVERSAL_STATS_INTERVAL == 1)
+			TraversalCounters::print(traversalCounters->summarize());
+
+		if(readback != nullptr && frame <= (int)RECORD_FRAMES) readback->request(framePipeline->getCurrentTextureID(), frame - 1);
 
 		// render image to quad
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		shaderProgram->useProgram();
 
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture);
+		glBindTexture(GL_TEXTURE_2D, framePipeline->getCurrentTextureID());
 		shaderProgram->uniformInt("tex", 0);
 
+		if(traversalCounters != nullptr) {
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, traversalCounters->getTextureID());
+			glActiveTexture(GL_TEXTURE0);
+		}
+
 		vertexArray->bind();
 		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 		vertexArray->unbind();
 
+		framePipeline->endFrame();
+
+		FrameImage image;
+		while(writer != nullptr && readback->collect(image)) writer->push(std::move(image));
+
 		// Swap buffers and poll events
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
-	glDeleteTextures(1, &texture);
+	framePipeline->finish();
+
+	if(writer != nullptr) {
+		FrameImage image;
+		while(readback->collect(image, true)) writer->push(std::move(image));
+		writer->finish();
+	}
 	glfwTerminate();
 
 	return EXIT_SUCCESS;
 }
 
-GLuint createOutputTexture(int width, int height) {
-
-	GLuint texture;
-	glGenTextures(1, &texture);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
-	glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-
-	return texture;
-}
-
 GLuint loadTexture(const char* filename, int& width, int& height, int slot) {
 
     GLuint textureID;
@@ -326,6 +519,7 @@ GLuint loadTexture(const char* filename, int& width, int& height, int slot) {
     {
         // Manejar error si la carga de la imagen falla
         std::cerr << "Error al cargar la textura: " << filename << std::endl;
+        width = height = 0;
     }
 
     return textureID;
@@ -337,79 +531,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 
 bool loadModel(const std::string& filename, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
 
-    tinygltf::Model model;
-    tinygltf::TinyGLTF loader;
-    std::string err, warn;
-
-    // Cargar el modelo GLTF
-    bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
-
-    if (!ret) {
-        std::cerr << "Error al cargar el archivo GLTF: " << err << std::endl;
-        return false;
-    }
-
-    // Iterar sobre todas las mallas del modelo
-    for (size_t m = 0; m < model.meshes.size(); ++m) {
-        const tinygltf::Mesh& mesh = model.meshes[m];
-
-        // Iterar sobre las primitivas de cada malla
-        for (size_t p = 0; p < mesh.primitives.size(); ++p) {
-            const tinygltf::Primitive& primitive = mesh.primitives[p];
-
-            // Obtener los accesores de los atributos
-            const tinygltf::Accessor& posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-            const tinygltf::Accessor& normalAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-            const tinygltf::Accessor& colorAccessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
-            const tinygltf::Accessor& uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-
-            // Obtener los datos de los buffers para cada atributo
-            const tinygltf::BufferView& posBufferView = model.bufferViews[posAccessor.bufferView];
-            const tinygltf::BufferView& normalBufferView = model.bufferViews[normalAccessor.bufferView];
-            const tinygltf::BufferView& colorBufferView = model.bufferViews[colorAccessor.bufferView];
-            const tinygltf::BufferView& uvBufferView = model.bufferViews[uvAccessor.bufferView];
-
-            const tinygltf::Buffer& posBuffer = model.buffers[posBufferView.buffer];
-            const tinygltf::Buffer& normalBuffer = model.buffers[normalBufferView.buffer];
-            const tinygltf::Buffer& colorBuffer = model.buffers[colorBufferView.buffer];
-            const tinygltf::Buffer& uvBuffer = model.buffers[uvBufferView.buffer];
-
-            // Calcular los offsets dentro de los buffer views
-            size_t posOffset = posAccessor.byteOffset + posBufferView.byteOffset;
-            size_t normalOffset = normalAccessor.byteOffset + normalBufferView.byteOffset;
-            size_t colorOffset = colorAccessor.byteOffset + colorBufferView.byteOffset;
-            size_t uvOffset = uvAccessor.byteOffset + uvBufferView.byteOffset;
-
-            // Leer los datos de los buffers
-            const float* posData = reinterpret_cast<const float*>(&posBuffer.data[posOffset]);
-            const float* normalData = reinterpret_cast<const float*>(&normalBuffer.data[normalOffset]);
-            const float* colorData = reinterpret_cast<const float*>(&colorBuffer.data[colorOffset]);
-            const float* uvData = reinterpret_cast<const float*>(&uvBuffer.data[uvOffset]);
-
-            // Leer los índices
-            const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
-            const tinygltf::BufferView& indexBufferView = model.bufferViews[indexAccessor.bufferView];
-            const tinygltf::Buffer& indexBuffer = model.buffers[indexBufferView.buffer];
-            size_t indexOffset = indexAccessor.byteOffset + indexBufferView.byteOffset;
-
-            const uint32_t* indexData = reinterpret_cast<const uint32_t*>(&indexBuffer.data[indexOffset]);
-            size_t indexCount = indexAccessor.count;
-
-            // Procesar los datos de vértices e índices
-            for (size_t v = 0; v < posAccessor.count; ++v) {
-                Vertex vertex;
-                vertex.pos = glm::vec3(posData[v * 3], posData[v * 3 + 1], posData[v * 3 + 2]);
-                vertex.normal = glm::vec3(normalData[v * 3], normalData[v * 3 + 1], normalData[v * 3 + 2]);
-                vertex.color = glm::vec3(colorData[v * 3], colorData[v * 3 + 1], colorData[v * 3 + 2]);
-                vertex.uv = glm::vec2(uvData[v * 2], uvData[v * 2 + 1]);
-                vertices.push_back(vertex);
-            }
-
-            for (size_t i = 0; i < indexCount; ++i) {
-                indices.push_back(indexData[i]);
-            }
-        }
-    }
-
-    return true;
+    // The vertices are decoded straight into the vectors, GLTFMesh::read can also write into a mapped SSBO
+    GLTFMesh::Ptr mesh = GLTFMesh::fromFile(filename);
+    return mesh != nullptr && mesh->read(vertices, indices);
 }
\ No newline at end of file
@@ -0,0 +1,517 @@
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <raytracingl/geometry/vertex.h>
+#include <raytracingl/geometry/ray.h>
+#include <raytracingl/bvh/bvh.h>
+#include <raytracingl/bvh/widebvh.h>
+#include <raytracingl/cpu/cputracer.h>
+#include <raytracingl/opengl/timer/timer.h>
+#include <raytracingl/memory/memoryregistry.h>
+#include <raytracingl/sampler/sampler.h>
+#include <raytracingl/distributed/coordinator.h>
+#include <raytracingl/distributed/worker.h>
+#include <raytracingl/vendor/json.hpp>
+
+using namespace rgl;
+using json = nlohmann::json;
+
+// Headless benchmark of the acceleration structures on the CPU backend. With --convergence [path]
+// it measures the error against reference images over time instead and writes the curves as JSON
+
+struct Scene {
+    std::string name;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+struct Config {
+    std::string name;
+    unsigned int width, bits;   // width 0 is the binary BVH
+};
+
+// Everything that changes the noise of an image for the same scene
+struct ConvergenceConfig {
+    std::string name;
+    std::string backend;
+    SamplerType sampler;
+};
+
+const unsigned int IMAGE_WIDTH = 256, IMAGE_HEIGHT = 256;
+const glm::vec3 LIGHT_POSITION(1.5f, 2.f, 1.f);
+
+// tile distributed render of the terrain: local worker processes, samples per pixel, tile size, samples per task
+const unsigned int DISTRIBUTED_WORKERS = 4, DISTRIBUTED_SAMPLES = 16, DISTRIBUTED_TILE = 32, DISTRIBUTED_TASK_SAMPLES = 4;
+const std::string DISTRIBUTED_SOCKET = "/tmp/raytracingl_benchmark.sock";
+
+// time to quality: reference samples per pixel, cached in the working directory, and first sample
+// of the reference so it doesn't share points with the measured configurations. Errors are measured
+// at every power of two samples up to CONVERGENCE_SAMPLES, the thresholds are relative MSE
+const unsigned int REFERENCE_SAMPLES = 1024, REFERENCE_FIRST_SAMPLE = 1u << 20, CONVERGENCE_SAMPLES = 64;
+const std::vector<double> CONVERGENCE_THRESHOLDS = { 1e-2, 3e-3, 1e-3 };
+const std::string CONVERGENCE_PATH = "convergence.json";
+
+Scene createSphere(int resolution);
+Scene createTriangleSoup(int numTriangles);
+Scene createTerrain(int resolution);
+
+Ray primaryRay(float x, float y);
+
+void renderTile(const CPUTracer& tracer, const Sampler& sampler, const TileTask& task, std::vector<float>& pixels);
+bool renderDistributed(const CPUTracer& tracer, const Sampler& sampler, bool truncateFirstResult, std::vector<float>& image,
+    TileCoordinator::Stats& stats);
+bool benchmarkDistributed(const Scene& scene);
+json benchmarkConvergence(const Scene& scene, const std::vector<ConvergenceConfig>& configs);
+
+int main(int argc, char* argv[]) {
+
+    std::vector<Scene> scenes = { createSphere(256), createTriangleSoup(100000), createTerrain(300) };
+
+    if(argc > 1 && std::string(argv[1]) == "--convergence") {
+
+        std::cout << std::fixed << std::setprecision(2);
+
+        std::vector<ConvergenceConfig> configs = {
+            { "random", "cpu", SamplerType::Random }, { "sobol", "cpu", SamplerType::Sobol }, { "bluenoise", "cpu", SamplerType::BlueNoise }
+        };
+
+        json result = { { "width", IMAGE_WIDTH }, { "height", IMAGE_HEIGHT }, { "referenceSamples", REFERENCE_SAMPLES }, { "scenes", json::array() } };
+        for(auto& scene : scenes) result["scenes"].push_back(benchmarkConvergence(scene, configs));
+
+        std::string path = argc > 2 ? argv[2] : CONVERGENCE_PATH;
+        std::ofstream file(path);
+        if(!file) {
+            std::cout << "Couldn't write " << path << std::endl;
+            return EXIT_FAILURE;
+        }
+        file << result.dump(2) << std::endl;
+        std::cout << "Convergence written to " << path << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<Config> configs = {
+        { "binary", 0, 0 }, { "wide4x8", 4, 8 }, { "wide4x16", 4, 16 }, { "wide8x8", 8, 8 }, { "wide8x16", 8, 16 }
+    };
+
+    std::cout << std::fixed << std::setprecision(2);
+
+    for(auto& scene : scenes) {
+
+        MemoryRegistry::get().resetPeaks();
+
+        CPUTimer buildTimer;
+        CPUTracer tracer(scene.vertices, scene.indices);
+        double buildTime = buildTimer.getElapsedMilliseconds();
+
+        size_t binaryBytes = tracer.getNodes().size() * sizeof(BVHNode);
+
+        std::cout << "Scene " << scene.name << ": " << tracer.getNumTriangles() << " triangles, build "
+            << buildTime << " ms" << std::endl;
+
+        std::vector<int> reference;
+
+        for(auto& config : configs) {
+
+            if(config.width == 0) tracer.useBinaryBVH();
+            else tracer.useWideBVH(config.width, config.bits);
+
+            size_t bytes = config.width == 0 ? binaryBytes : tracer.getWideBVH()->getMemoryBytes();
+
+            CPUTracer::TraversalStats stats;
+            std::vector<int> hits;
+            hits.reserve(IMAGE_WIDTH * IMAGE_HEIGHT);
+
+            std::vector<Ray> shadowRays;
+            std::vector<float> shadowDists;
+
+            CPUTimer traceTimer;
+            for(int y = 0; y < (int)IMAGE_HEIGHT; y ++) {
+                for(int x = 0; x < (int)IMAGE_WIDTH; x ++) {
+                    HitInfo hitInfo = tracer.closestHit(primaryRay(x, y), &stats);
+                    hits.push_back(hitInfo.triangle);
+                    if(!hitInfo.hit) continue;
+
+                    // Shadow ray towards the light, offset to avoid self intersection
+                    glm::vec3 toLight = LIGHT_POSITION - hitInfo.intersection;
+                    float dist = glm::length(toLight);
+                    shadowRays.push_back(Ray(hitInfo.intersection + toLight * (1e-4f / dist), toLight / dist));
+                    shadowDists.push_back(dist);
+                }
+            }
+            double traceTime = traceTimer.getElapsedMilliseconds();
+
+            // Shadow rays with the closest hit traversal and with the any hit one
+            CPUTracer::TraversalStats closestStats, anyStats;
+            std::vector<unsigned char> visibleClosest(shadowRays.size()), visibleAny;
+
+            CPUTimer closestTimer;
+            for(size_t i = 0; i < shadowRays.size(); i ++) {
+                HitInfo hitInfo = tracer.closestHit(shadowRays[i], &closestStats);
+                visibleClosest[i] = !(hitInfo.hit && hitInfo.dist < shadowDists[i]);
+            }
+            double closestTime = closestTimer.getElapsedMilliseconds();
+
+            CPUTimer anyTimer;
+            tracer.visibility(shadowRays, shadowDists, visibleAny, &anyStats);
+            double anyTime = anyTimer.getElapsedMilliseconds();
+
+            unsigned int shadowMismatches = 0;
+            for(size_t i = 0; i < shadowRays.size(); i ++)
+                if(visibleClosest[i] != visibleAny[i]) shadowMismatches ++;
+
+            // Every configuration must find the same triangles as the binary BVH
+            unsigned int mismatches = 0;
+            if(reference.empty()) reference = hits;
+            for(size_t i = 0; i < hits.size(); i ++)
+                if(hits[i] != reference[i]) mismatches ++;
+
+            std::cout << "  " << std::left << std::setw(10) << config.name << std::right
+                << " nodes " << std::setw(10) << bytes << " B (" << (double)binaryBytes / bytes << "x)"
+                << "  steps/ray " << std::setw(7) << (double)stats.nodes / stats.rays
+                << "  boxes/ray " << std::setw(7) << (double)stats.boxTests / stats.rays
+                << "  triangles/ray " << std::setw(6) << (double)stats.triangleTests / stats.rays
+                << "  " << std::setw(6) << stats.rays / (traceTime * 1000.0) << " Mrays/s"
+                << "  mismatches " << mismatches << std::endl;
+
+            if(shadowRays.empty()) continue;
+
+            std::cout << "  " << std::setw(10) << "" << " shadow rays " << shadowRays.size()
+                << "  steps/ray closest " << (double)closestStats.nodes / closestStats.rays
+                << " any " << (double)anyStats.nodes / anyStats.rays
+                << "  Mrays/s closest " << closestStats.rays / (closestTime * 1000.0)
+                << " any " << anyStats.rays / (anyTime * 1000.0)
+                << "  mismatches " << shadowMismatches << std::endl;
+        }
+
+        std::cout << "  memory" << std::endl;
+        MemoryRegistry::get().print();
+    }
+
+    bool distributed = benchmarkDistributed(scenes.back());
+
+    std::cout << "Memory " << MemoryRegistry::get().toJSON() << std::endl;
+
+    return distributed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Frame split across local worker processes. With truncateFirstResult the first worker sends
+// half of the pixels of its first task, the coordinator has to drop it and requeue the tile
+bool renderDistributed(const CPUTracer& tracer, const Sampler& sampler, bool truncateFirstResult, std::vector<float>& image,
+    TileCoordinator::Stats& stats) {
+
+    TileCoordinator coordinator(DISTRIBUTED_SOCKET);
+    if(!coordinator.isListening()) return false;
+
+    // The workers inherit the scene
+    std::vector<pid_t> workers;
+    for(unsigned int i = 0; i < DISTRIBUTED_WORKERS; i ++) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            bool truncate = truncateFirstResult && i == 0;
+            long long tasks = TileWorker::run(DISTRIBUTED_SOCKET, [&](const TileTask& task, std::vector<float>& pixels) {
+                renderTile(tracer, sampler, task, pixels);
+                if(truncate) pixels.resize(pixels.size() / 2);
+                truncate = false;
+            });
+            _exit(tasks >= 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        if(pid > 0) workers.push_back(pid);
+    }
+
+    TileCoordinator::Settings settings;
+    settings.width = IMAGE_WIDTH;
+    settings.height = IMAGE_HEIGHT;
+    settings.samples = DISTRIBUTED_SAMPLES;
+    settings.tileSize = DISTRIBUTED_TILE;
+    settings.samplesPerTask = DISTRIBUTED_TASK_SAMPLES;
+    settings.numWorkers = workers.size();
+
+    bool success = coordinator.render(settings);
+    for(pid_t pid : workers) waitpid(pid, nullptr, 0);
+
+    image = coordinator.getImage();
+    stats = coordinator.getStats();
+    return success;
+}
+
+// Renders the frame in one process and then split across local worker processes, both must
+// give the same image, also when a worker sends a malformed result
+bool benchmarkDistributed(const Scene& scene) {
+
+    CPUTracer tracer(scene.vertices, scene.indices);
+    tracer.useWideBVH(4, 8);
+    Sampler sampler(SamplerType::Sobol);
+
+    TileTask frame = { 0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, 0, DISTRIBUTED_SAMPLES, IMAGE_WIDTH, IMAGE_HEIGHT, 0 };
+    std::vector<float> reference((size_t)IMAGE_WIDTH * IMAGE_HEIGHT * 4);
+
+    CPUTimer singleTimer;
+    renderTile(tracer, sampler, frame, reference);
+    double singleTime = singleTimer.getElapsedMilliseconds();
+
+    auto maxDifference = [&](const std::vector<float>& image) {
+        float difference = image.size() == reference.size() ? 0.f : INFINITY;
+        for(size_t i = 0; i < image.size() && i < reference.size(); i ++) difference = std::max(difference, std::abs(image[i] - reference[i]));
+        return difference;
+    };
+
+    std::vector<float> image;
+    TileCoordinator::Stats stats;
+    bool success = renderDistributed(tracer, sampler, false, image, stats);
+    float difference = maxDifference(image);
+
+    std::cout << "Distributed " << scene.name << ": " << DISTRIBUTED_SAMPLES << " spp, 1 process " << singleTime << " ms, "
+        << DISTRIBUTED_WORKERS << " workers " << stats.milliseconds << " ms (" << singleTime / stats.milliseconds << "x), "
+        << stats.tasks << " tasks, max difference " << difference << (success ? "" : ", FAILED") << std::endl;
+
+    std::vector<float> faultyImage;
+    TileCoordinator::Stats faultyStats;
+    bool faultySuccess = renderDistributed(tracer, sampler, true, faultyImage, faultyStats);
+    float faultyDifference = maxDifference(faultyImage);
+    faultySuccess = faultySuccess && faultyStats.requeued > 0 && faultyDifference <= std::max(difference, 1e-4f);
+
+    std::cout << "Distributed with a malformed result: " << faultyStats.tasks << " tasks, " << faultyStats.requeued
+        << " requeued, max difference " << faultyDifference << (faultySuccess ? "" : ", FAILED") << std::endl;
+
+    return success && faultySuccess;
+}
+
+// Error of every configuration against a reference of the scene as a function of the samples per
+// pixel and of the render time, without the time spent measuring the error
+json benchmarkConvergence(const Scene& scene, const std::vector<ConvergenceConfig>& configs) {
+
+    CPUTracer tracer(scene.vertices, scene.indices);
+    tracer.useWideBVH(4, 8);
+
+    const size_t numPixels = (size_t)IMAGE_WIDTH * IMAGE_HEIGHT;
+    TileTask frame = { 0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, 0, 1, IMAGE_WIDTH, IMAGE_HEIGHT, 0 };
+    std::vector<float> reference(numPixels * 4);
+
+    // The reference is rendered once and kept next to the results
+    std::string referencePath = "reference_" + scene.name + "_" + std::to_string(IMAGE_WIDTH) + "x"
+        + std::to_string(IMAGE_HEIGHT) + "_" + std::to_string(REFERENCE_SAMPLES) + ".raw";
+    std::ifstream cached(referencePath, std::ios::binary);
+    bool loaded = cached && cached.read((char*)reference.data(), reference.size() * sizeof(float)).gcount() == (std::streamsize)(reference.size() * sizeof(float));
+
+    double referenceTime = 0.0;
+    if(!loaded) {
+        Sampler sampler(SamplerType::Sobol);
+        TileTask referenceFrame = frame;
+        referenceFrame.firstSample = REFERENCE_FIRST_SAMPLE;
+        referenceFrame.numSamples = REFERENCE_SAMPLES;
+
+        CPUTimer referenceTimer;
+        renderTile(tracer, sampler, referenceFrame, reference);
+        referenceTime = referenceTimer.getElapsedMilliseconds();
+
+        std::ofstream file(referencePath, std::ios::binary);
+        file.write((const char*)reference.data(), reference.size() * sizeof(float));
+    }
+
+    std::cout << "Convergence " << scene.name << ": reference " << REFERENCE_SAMPLES << " spp"
+        << (loaded ? " cached" : ", " + std::to_string(referenceTime) + " ms") << std::endl;
+
+    json result = { { "scene", scene.name }, { "triangles", tracer.getNumTriangles() },
+        { "referenceMilliseconds", loaded ? json() : json(referenceTime) }, { "configurations", json::array() } };
+
+    for(auto& config : configs) {
+
+        Sampler sampler(config.sampler);
+        std::vector<double> sum(numPixels, 0.0);
+        std::vector<float> pass(numPixels * 4);
+        json curve = json::array();
+        double milliseconds = 0.0;
+
+        for(unsigned int s = 0; s < CONVERGENCE_SAMPLES; s ++) {
+
+            frame.firstSample = s;
+            CPUTimer passTimer;
+            renderTile(tracer, sampler, frame, pass);
+            for(size_t i = 0; i < numPixels; i ++) sum[i] += pass[4 * i];
+            milliseconds += passTimer.getElapsedMilliseconds();
+
+            unsigned int samples = s + 1;
+            if((samples & (samples - 1)) != 0) continue;
+
+            // Relative MSE divides by the squared reference, plus a bit so the dark pixels don't dominate
+            double squaredError = 0.0, relativeError = 0.0;
+            for(size_t i = 0; i < numPixels; i ++) {
+                double value = sum[i] / samples, expected = reference[4 * i];
+                double error = (value - expected) * (value - expected);
+                squaredError += error;
+                relativeError += error / (expected * expected + 1e-2);
+            }
+
+            curve.push_back({ { "samples", samples }, { "milliseconds", milliseconds },
+                { "rmse", std::sqrt(squaredError / numPixels) }, { "relMSE", relativeError / numPixels } });
+        }
+
+        // First crossing of each threshold, interpolated in log-log between the measured points
+        json timeToError = json::array();
+        for(double threshold : CONVERGENCE_THRESHOLDS) {
+
+            json crossing = { { "relMSE", threshold }, { "milliseconds", json() }, { "samples", json() } };
+            for(size_t i = 0; i < curve.size(); i ++) {
+
+                double error = curve[i]["relMSE"];
+                if(error > threshold) continue;
+
+                double time = curve[i]["milliseconds"], samples = curve[i]["samples"];
+                if(i > 0) {
+                    double previousError = curve[i - 1]["relMSE"], previousTime = curve[i - 1]["milliseconds"];
+                    double previousSamples = curve[i - 1]["samples"];
+                    double t = std::log(previousError / threshold) / std::log(previousError / error);
+                    time = previousTime * std::pow(time / previousTime, t);
+                    samples = previousSamples * std::pow(samples / previousSamples, t);
+                }
+
+                crossing["milliseconds"] = time;
+                crossing["samples"] = samples;
+                break;
+            }
+            timeToError.push_back(crossing);
+        }
+
+        const json& last = curve.back();
+        std::cout << "  " << std::left << std::setw(10) << config.name << std::right << " " << config.backend
+            << "  " << CONVERGENCE_SAMPLES << " spp " << (double)last["milliseconds"] << " ms"
+            << "  rmse " << std::scientific << (double)last["rmse"] << "  relMSE " << (double)last["relMSE"] << std::fixed;
+        for(const json& crossing : timeToError) {
+            std::cout << "  " << std::scientific << std::setprecision(0) << (double)crossing["relMSE"] << std::fixed << std::setprecision(2) << " in ";
+            if(crossing["milliseconds"].is_null()) std::cout << "-";
+            else std::cout << (double)crossing["milliseconds"] << " ms";
+        }
+        std::cout << std::endl;
+
+        result["configurations"].push_back({ { "name", config.name }, { "backend", config.backend },
+            { "samplesPerPass", 1 }, { "curve", curve }, { "timeToError", timeToError } });
+    }
+
+    return result;
+}
+
+// Visibility of a spherical light with jittered primary rays. Each sample only depends on
+// its pixel and index, so any split of the samples gives the same mean. Dimensions 0 and 1
+// jitter the pixel, 2 to 4 are the point of the light
+void renderTile(const CPUTracer& tracer, const Sampler& sampler, const TileTask& task, std::vector<float>& pixels) {
+
+    for(unsigned int j = 0; j < task.height; j ++) {
+        for(unsigned int i = 0; i < task.width; i ++) {
+
+            int x = task.x + i, y = task.y + j;
+            float value = 0.f;
+
+            for(unsigned int s = task.firstSample; s < task.firstSample + task.numSamples; s ++) {
+
+                HitInfo hitInfo = tracer.closestHit(primaryRay(x + sampler.sample(x, y, s, 0), y + sampler.sample(x, y, s, 1)));
+                if(!hitInfo.hit) continue;
+
+                glm::vec3 u(sampler.sample(x, y, s, 2), sampler.sample(x, y, s, 3), sampler.sample(x, y, s, 4));
+                glm::vec3 light = LIGHT_POSITION + (u - 0.5f) * 0.5f;
+                glm::vec3 toLight = light - hitInfo.intersection;
+                float dist = glm::length(toLight);
+                if(!tracer.occluded(Ray(hitInfo.intersection + toLight * (1e-4f / dist), toLight / dist), dist)) value += 1.f;
+            }
+
+            float* pixel = &pixels[4 * (j * task.width + i)];
+            pixel[0] = pixel[1] = pixel[2] = value / task.numSamples;
+            pixel[3] = 1.f;
+        }
+    }
+}
+
+// Same camera as compute.glsl
+Ray primaryRay(float x, float y) {
+
+    glm::vec3 cameraPos(0.f, 0.f, 2.f), cameraTarget(0.f), cameraUp(0.f, 1.f, 0.f);
+
+    glm::vec3 forward = glm::normalize(cameraTarget - cameraPos);
+    glm::vec3 right = glm::normalize(glm::cross(forward, cameraUp));
+    glm::vec3 up = glm::cross(right, forward);
+
+    glm::vec2 ndc = glm::vec2(x / (float)IMAGE_WIDTH, y / (float)IMAGE_HEIGHT) * 2.f - 1.f;
+    float fov = glm::radians(45.f);
+    float aspectRatio = IMAGE_WIDTH / (float)IMAGE_HEIGHT;
+
+    float imagePlaneX = ndc.x * aspectRatio * std::tan(fov / 2.f);
+    float imagePlaneY = ndc.y * std::tan(fov / 2.f);
+
+    return Ray(cameraPos, glm::normalize(imagePlaneX * right + imagePlaneY * up + forward));
+}
+
+Scene createSphere(int resolution) {
+
+    Scene scene;
+    scene.name = "sphere";
+
+    for(int i = 0; i <= resolution; i ++) {
+        for(int j = 0; j <= resolution; j ++) {
+            float theta = glm::pi<float>() * i / resolution, phi = 2.f * glm::pi<float>() * j / resolution;
+            glm::vec3 pos(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            scene.vertices.push_back(Vertex(pos * 0.5f, glm::vec3(1.f), pos));
+        }
+    }
+
+    for(int i = 0; i < resolution; i ++) {
+        for(int j = 0; j < resolution; j ++) {
+            unsigned int a = i * (resolution + 1) + j, b = a + 1, c = a + resolution + 1, d = c + 1;
+            scene.indices.insert(scene.indices.end(), { a, c, b, b, c, d });
+        }
+    }
+
+    return scene;
+}
+
+Scene createTriangleSoup(int numTriangles) {
+
+    Scene scene;
+    scene.name = "soup";
+
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+
+    for(int i = 0; i < numTriangles; i ++) {
+        glm::vec3 center(distribution(generator), distribution(generator), distribution(generator));
+        for(int k = 0; k < 3; k ++) {
+            glm::vec3 offset(distribution(generator), distribution(generator), distribution(generator));
+            scene.vertices.push_back(Vertex(center + offset * 0.03f));
+            scene.indices.push_back(3 * i + k);
+        }
+    }
+
+    return scene;
+}
+
+Scene createTerrain(int resolution) {
+
+    Scene scene;
+    scene.name = "terrain";
+
+    for(int i = 0; i <= resolution; i ++) {
+        for(int j = 0; j <= resolution; j ++) {
+            float x = (float)j / resolution - 0.5f, z = (float)i / resolution - 0.5f;
+            float height = 0.1f * std::sin(x * 20.f) * std::cos(z * 15.f);
+            scene.vertices.push_back(Vertex(glm::vec3(x * 2.f, height - 0.3f, z * 2.f)));
+        }
+    }
+
+    for(int i = 0; i < resolution; i ++) {
+        for(int j = 0; j < resolution; j ++) {
+            unsigned int a = i * (resolution + 1) + j, b = a + 1, c = a + resolution + 1, d = c + 1;
+            scene.indices.insert(scene.indices.end(), { a, c, b, b, c, d });
+        }
+    }
+
+    return scene;
+}